@@ -33,6 +33,13 @@ J2534::J2534(void)
 	hDLL = NULL;
 	debugMode = false;
 	isLibraryInitialized = false;
+	inProcess = false;
+	msgHook = NULL;
+	msgHookCtx = NULL;
+	callHook = NULL;
+	callHookCtx = NULL;
+	logHook = NULL;
+	logHookCtx = NULL;
 	// default to the Openport 2.0 J2534 DLL
 #if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
 	strcpy(dllName,"op20pt32.dll");
@@ -48,6 +55,37 @@ void J2534::setDllName(const char* name)
 	strcpy(dllName,name);
 }
 
+bool J2534::init(const PASSTHRU_API* api)
+{
+	if (!api)
+		return false;
+
+	pfPassThruOpen = api->PassThruOpen;
+	pfPassThruClose = api->PassThruClose;
+	pfPassThruConnect = api->PassThruConnect;
+	pfPassThruDisconnect = api->PassThruDisconnect;
+	pfPassThruReadMsgs = api->PassThruReadMsgs;
+	pfPassThruWriteMsgs = api->PassThruWriteMsgs;
+	pfPassThruStartPeriodicMsg = api->PassThruStartPeriodicMsg;
+	pfPassThruStopPeriodicMsg = api->PassThruStopPeriodicMsg;
+	pfPassThruStartMsgFilter = api->PassThruStartMsgFilter;
+	pfPassThruStopMsgFilter = api->PassThruStopMsgFilter;
+	pfPassThruSetProgrammingVoltage = api->PassThruSetProgrammingVoltage;
+	pfPassThruReadVersion = api->PassThruReadVersion;
+	pfPassThruGetLastError = api->PassThruGetLastError;
+	pfPassThruIoctl = api->PassThruIoctl;
+
+	// nothing to unload, but checkDLL() needs to see a handle
+	inProcess = true;
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+	hDLL = (HINSTANCE)1;
+#else
+	hDLL = (void*)1;
+#endif
+	DBGPRINT(("using in-process passthru implementation\n"));
+	return true;
+}
+
 char* J2534::getLastError()
 {
 	return lastError;
@@ -66,10 +104,10 @@ J2534::~J2534(void)
 #else
 
 #if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
-	if (hDLL)
+	if (hDLL && !inProcess)
 		FreeLibrary(hDLL);
 #else 
-	if (hDLL)
+	if (hDLL && !inProcess)
 		dlclose(hDLL);
 #endif
 #endif
@@ -89,7 +127,8 @@ J2534::~J2534(void)
 #endif
 #endif
 
-#define DBGPRINT_BUFSIZE 10240
+// 'R '/'W ' or indent, 16 bytes as hex and a newline
+#define DBGDUMP_LINESIZE (3 + 16 * 3 + 2)
 
 bool J2534::getPTfns()
 {
@@ -117,31 +156,20 @@ bool J2534::getPTfns()
 void J2534::dbgprint(const char* Format, ...)
 {
 	va_list arglist;
-	int cb;
-	char buffer[DBGPRINT_BUFSIZE];
-	char *pbuf = buffer;
 
 	va_start(arglist, Format);
-
-	cb = vsprintf(pbuf, Format, arglist);
-
-	if (cb == -1)
-	{
-		buffer[sizeof(buffer) - 2] = '\n';
-		buffer[sizeof(buffer) - 1] = '\0';
-	}
-
-    printf("%s",buffer);
+	if (logHook)
+		logHook(logHookCtx, Format, arglist);
+	else
+		vprintf(Format, arglist);
 	va_end(arglist);
 }
 
-#define MSG_READ 1
-#define MSG_WRITE 2
-
 void J2534::dbgdump(const unsigned char *data,unsigned int datalen,int kind)
 {
+	static const char hex[] = "0123456789ABCDEF";
 	unsigned int i;
-	char buf[DBGPRINT_BUFSIZE];
+	char buf[DBGDUMP_LINESIZE];
 	char *pbuf = buf;
 
 	if (kind == MSG_READ)
@@ -155,14 +183,24 @@ void J2534::dbgdump(const unsigned char *data,unsigned int datalen,int kind)
 		*pbuf++ = ' ';
 	}
 
+	// one line per 16 bytes, so every dbgprint is a complete line
 	for (i = 0; i < datalen; i++)
 	{
 		if (i > 15 && (i & 0xF) == 0)
-			pbuf += sprintf(pbuf,"\n   ");
-		pbuf += sprintf(pbuf,"%02X ",data[i]);
+		{
+			*pbuf = '\0';
+			dbgprint("%s\n", buf);
+			pbuf = buf;
+			*pbuf++ = ' ';
+			*pbuf++ = ' ';
+			*pbuf++ = ' ';
+		}
+		*pbuf++ = hex[data[i] >> 4];
+		*pbuf++ = hex[data[i] & 0xF];
+		*pbuf++ = ' ';
 	}
-	pbuf += sprintf(pbuf,"\n");
-	dbgprint(buf);
+	*pbuf = '\0';
+	dbgprint("%s\n", buf);
 }
 
 
@@ -298,6 +336,8 @@ long J2534::PassThruOpen(const void *pName, unsigned long *pDeviceID)
 	DBGPRINT(("PassThruOpen(name=%s,pDeviceID=@%08X)\n",(char*)pName,pDeviceID));
 
 	result = (*pfPassThruOpen)(pName,pDeviceID);
+	if (callHook)
+		callHook(callHookCtx,CALL_OPEN,result,NULL,0,result ? 0 : *pDeviceID,NULL,0);
 	DBGPRINT(("PassThruOpen returned result %d and DeviceID %u\n",result,*pDeviceID));
 
 	return result;
@@ -310,6 +350,8 @@ long J2534::PassThruClose(unsigned long DeviceID)
 		return ERR_DEVICE_NOT_CONNECTED;
 	DBGPRINT(("PassThruClose(%u)\n",DeviceID));
 	result = (*pfPassThruClose)(DeviceID);
+	if (callHook)
+		callHook(callHookCtx,CALL_CLOSE,result,&DeviceID,1,0,NULL,0);
 	DBGPRINT(("PassThruClose returned result %d\n",result));
 
 	return result;
@@ -322,6 +364,10 @@ long J2534::PassThruConnect(unsigned long DeviceID, unsigned long ProtocolID, un
 		return ERR_DEVICE_NOT_CONNECTED;
 	DBGPRINT(("PassThruConnect(DeviceID=%u,ProtocolID=%u,Flags=%08X,Baudrate=%u,pChannelID=@%08X)\n",DeviceID,ProtocolID,Flags,Baudrate,pChannelID));
 	result = (*pfPassThruConnect)(DeviceID,ProtocolID,Flags,Baudrate,pChannelID);
+	if (callHook) {
+		unsigned long args[4] = { DeviceID, ProtocolID, Flags, Baudrate };
+		callHook(callHookCtx,CALL_CONNECT,result,args,4,result ? 0 : *pChannelID,NULL,0);
+	}
 	DBGPRINT(("PassThruConnect returned result %d and ChannelID %u\n",result,*pChannelID));
 	return result;
 }
@@ -333,6 +379,8 @@ long J2534::PassThruDisconnect(unsigned long ChannelID)
 		return ERR_DEVICE_NOT_CONNECTED;
 	DBGPRINT(("PassThruDisconnect(ChannelID=%u)\n",ChannelID));
 	result = (*pfPassThruDisconnect)(ChannelID);
+	if (callHook)
+		callHook(callHookCtx,CALL_DISCONNECT,result,&ChannelID,1,0,NULL,0);
 	DBGPRINT(("PassThruDisconnect returned result %d\n",result));
 	return result;
 }
@@ -344,6 +392,8 @@ long J2534::PassThruReadMsgs(unsigned long ChannelID, PASSTHRU_MSG *pMsg, unsign
 		return ERR_DEVICE_NOT_CONNECTED;
 	DBGPRINT(("PassThruReadMsgs(ChannelID=%u,pMsg=@%08X,pNumMsgs=%u,Timeout=%u)\n",ChannelID,pMsg,*pNumMsgs,Timeout));
 	result = (*pfPassThruReadMsgs)(ChannelID,pMsg,pNumMsgs,Timeout);
+	if (msgHook)
+		msgHook(msgHookCtx,MSG_READ,result,pMsg,*pNumMsgs);
 	DBGPRINT(("PassThruReadMsgs returned result %d\n",result));
 	return result;
 }
@@ -356,6 +406,8 @@ long J2534::PassThruWriteMsgs(unsigned long ChannelID, const PASSTHRU_MSG *pMsg,
 		return ERR_DEVICE_NOT_CONNECTED;
 	DBGPRINT(("PassThruWriteMsgs(ChannelID=%u,pMsg=@%08X,NumMsgs=%u,Timeout=%u)\n",ChannelID,pMsg,*pNumMsgs,Timeout));
 	result = (*pfPassThruWriteMsgs)(ChannelID,pMsg,pNumMsgs,Timeout);
+	if (msgHook)
+		msgHook(msgHookCtx,MSG_WRITE,result,pMsg,*pNumMsgs);
 	for (i = 0; i < *pNumMsgs; i++)
 		DBGPRINTPT((&(pMsg[i]),MSG_WRITE));
 	DBGPRINT(("PassThruWriteMsgs returned result %d\n",result));
@@ -369,6 +421,10 @@ long J2534::PassThruStartPeriodicMsg(unsigned long ChannelID, const PASSTHRU_MSG
 		return ERR_DEVICE_NOT_CONNECTED;
 	DBGPRINT(("PassThruStartPeriodicMsg(ChannelID=%u,pMsg=@%08X,pMsgID=@%08X,TimeInterval=%u)\n",ChannelID,pMsg,pMsgID,TimeInterval));
 	result = (*pfPassThruStartPeriodicMsg)(ChannelID,pMsg,pMsgID,TimeInterval);
+	if (callHook) {
+		unsigned long args[2] = { ChannelID, TimeInterval };
+		callHook(callHookCtx,CALL_START_PERIODIC,result,args,2,result ? 0 : *pMsgID,&pMsg,1);
+	}
 	DBGPRINTPT((pMsg,0));
 	DBGPRINT(("PassThruStartPeriodicMsg returned result %d and MsgID %u\n",result,*pMsgID));
 	return result;
@@ -381,6 +437,10 @@ long J2534::PassThruStopPeriodicMsg(unsigned long ChannelID, unsigned long MsgID
 		return ERR_DEVICE_NOT_CONNECTED;
 	DBGPRINT(("PassThruStopPeriodicMsg(ChannelID=%u,MsgID=@%08X,TimeInterval=%u)\n",ChannelID,MsgID));
 	result = (*pfPassThruStopPeriodicMsg)(ChannelID,MsgID);
+	if (callHook) {
+		unsigned long args[2] = { ChannelID, MsgID };
+		callHook(callHookCtx,CALL_STOP_PERIODIC,result,args,2,0,NULL,0);
+	}
 	DBGPRINT(("PassThruStopPeriodicMsg returned result %d\n",result));
 	return result;
 }
@@ -401,6 +461,11 @@ long J2534::PassThruStartMsgFilter(unsigned long ChannelID,
 	DBGPRINT(("FlowControlMsg\n",result));
 	DBGPRINTPT((pFlowControlMsg,0));
 	result = (*pfPassThruStartMsgFilter)(ChannelID,FilterType,pMaskMsg,pPatternMsg,pFlowControlMsg,pMsgID);
+	if (callHook) {
+		unsigned long args[2] = { ChannelID, FilterType };
+		const PASSTHRU_MSG* msgs[3] = { pMaskMsg, pPatternMsg, pFlowControlMsg };
+		callHook(callHookCtx,CALL_START_FILTER,result,args,2,result ? 0 : *pMsgID,msgs,3);
+	}
 	DBGPRINT(("PassThruStartMsgFilter returned result %d and MsgID %u\n",result,*pMsgID));
 	return result;
 }
@@ -412,6 +477,10 @@ long J2534::PassThruStopMsgFilter(unsigned long ChannelID, unsigned long MsgID)
 		return ERR_DEVICE_NOT_CONNECTED;
 	DBGPRINT(("PassThruStopMsgFilter(ChannelID=%u,MsgID=@%08X,TimeInterval=%u)\n",ChannelID,MsgID));
 	result = (*pfPassThruStopMsgFilter)(ChannelID,MsgID);
+	if (callHook) {
+		unsigned long args[2] = { ChannelID, MsgID };
+		callHook(callHookCtx,CALL_STOP_FILTER,result,args,2,0,NULL,0);
+	}
 	DBGPRINT(("PassThruStopMsgFilter returned result %d\n",result));
 	return result;
 }
@@ -720,6 +789,10 @@ long J2534::PassThruIoctl(unsigned long ChannelID, unsigned long IoctlID, const
 	}
 
 	result = (*pfPassThruIoctl)(ChannelID,IoctlID,pInput,pOutput);
+	if (callHook) {
+		unsigned long args[2] = { ChannelID, IoctlID };
+		callHook(callHookCtx,CALL_IOCTL,result,args,2,0,NULL,0);
+	}
 
 	if (output_as_sa)
 	{
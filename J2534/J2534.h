@@ -13,6 +13,8 @@
 #include <windows.h>
 #endif
 
+#include <stdarg.h>
+
 #include "j2534_tactrix.h"
 
 #define PTfn(name) PF_##name* pf##name
@@ -20,29 +22,81 @@
 
 #define DBGPRINT(args_in_parens)                                \
     {                                               \
-			dbgprint args_in_parens; \
+			if (debugMode) dbgprint args_in_parens; \
     }
 
 #define DBGDUMP(args_in_parens)                                \
     {                                               \
-			dbgdump args_in_parens; \
+			if (debugMode) dbgdump args_in_parens; \
     }
 
 #define DBGPRINTPT(args_in_parens)                                \
     {                                               \
-			dbgprintptmsg args_in_parens; \
+			if (debugMode) dbgprintptmsg args_in_parens; \
     }
 
+#define MSG_READ 1
+#define MSG_WRITE 2
+
+// called for every message passed through PassThruReadMsgs/PassThruWriteMsgs.
+// kind is MSG_READ or MSG_WRITE, numMsgs may be 0 for a read that returned nothing.
+typedef void (*J2534_MSG_HOOK)(void* ctx, int kind, long result, const PASSTHRU_MSG* pMsg, unsigned long numMsgs);
+
+// the setup calls reported to the call hook
+#define CALL_OPEN             1
+#define CALL_CLOSE            2
+#define CALL_CONNECT          3
+#define CALL_DISCONNECT       4
+#define CALL_START_PERIODIC   5
+#define CALL_STOP_PERIODIC    6
+#define CALL_START_FILTER     7
+#define CALL_STOP_FILTER      8
+#define CALL_IOCTL            9
+#define CALL_MAX_ARGS         4
+#define CALL_MAX_MSGS         3
+
+// called for every passthru call that sets up or tears down the device and channels, and for Ioctl.
+// args are the integer arguments of the call, out the ID it returned (device, channel, message or
+// filter), msgs its messages: the periodic message, or a filter's mask, pattern and flow control (NULL if none).
+typedef void (*J2534_CALL_HOOK)(void* ctx, int call, long result, const unsigned long* args, unsigned long numArgs,
+	unsigned long out, const PASSTHRU_MSG* const* msgs, unsigned long numMsgs);
+
+// receives the debug output enabled with debug(true), one line per call. Without a hook it goes to stdout.
+typedef void (*J2534_LOG_HOOK)(void* ctx, const char* format, va_list args);
+
+// an in-process implementation of the passthru API, used in place of a DLL
+typedef struct
+{
+	PF_PassThruOpen* PassThruOpen;
+	PF_PassThruClose* PassThruClose;
+	PF_PassThruConnect* PassThruConnect;
+	PF_PassThruDisconnect* PassThruDisconnect;
+	PF_PassThruReadMsgs* PassThruReadMsgs;
+	PF_PassThruWriteMsgs* PassThruWriteMsgs;
+	PF_PassThruStartPeriodicMsg* PassThruStartPeriodicMsg;
+	PF_PassThruStopPeriodicMsg* PassThruStopPeriodicMsg;
+	PF_PassThruStartMsgFilter* PassThruStartMsgFilter;
+	PF_PassThruStopMsgFilter* PassThruStopMsgFilter;
+	PF_PassThruSetProgrammingVoltage* PassThruSetProgrammingVoltage;
+	PF_PassThruReadVersion* PassThruReadVersion;
+	PF_PassThruGetLastError* PassThruGetLastError;
+	PF_PassThruIoctl* PassThruIoctl;
+} PASSTHRU_API;
+
 class J2534
 {
 public:
 	J2534(void);
 	~J2534(void);
 	bool init() { return checkDLL(); };
+	bool init(const PASSTHRU_API* api);
 	void setDllName(const char* name);
 	bool getDLLName(char* dllName);
 	bool valid();
 	void debug(bool enable) { debugMode = enable; };
+	void setMessageHook(J2534_MSG_HOOK hook, void* ctx) { msgHook = hook; msgHookCtx = ctx; };
+	void setCallHook(J2534_CALL_HOOK hook, void* ctx) { callHook = hook; callHookCtx = ctx; };
+	void setLogHook(J2534_LOG_HOOK hook, void* ctx) { logHook = hook; logHookCtx = ctx; };
 	char* getLastError();
 
     long PassThruOpen(const void *pName, unsigned long *pDeviceID);
@@ -78,6 +132,14 @@ private:
 	char dllName[256];
 	bool debugMode;
 	bool isLibraryInitialized;
+	bool inProcess;
+
+	J2534_MSG_HOOK msgHook;
+	void* msgHookCtx;
+	J2534_CALL_HOOK callHook;
+	void* callHookCtx;
+	J2534_LOG_HOOK logHook;
+	void* logHookCtx;
 
 
 #if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
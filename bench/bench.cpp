@@ -0,0 +1,164 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "util.h"
+
+bench_config_t bench_config = { NULL, NULL, NULL, SIMECU_LATENCY_NONE };
+
+static bench_result_t benchResults[BENCH_MAX_RESULTS];
+static size_t benchNumResults;
+
+static const void* volatile benchSink;
+
+void bench_consume(const void* value)
+{
+  benchSink = value;
+}
+
+bench_result_t bench_run_bytes(const char* name, bench_fn fn, void* ctx, uint64_t bytesPerOp)
+{
+  bench_result_t result = { name, 1, 0, bytesPerOp };
+  uint64_t elapsed = 0;
+
+  if (bench_config.filter && !strstr(name, bench_config.filter)) {
+    result.iterations = 0;
+    return result;
+  }
+
+  // warm up caches and the branch predictor
+  fn(ctx, 1);
+
+  for (;;) {
+    uint64_t start = monotonic_us();
+    fn(ctx, result.iterations);
+    elapsed = monotonic_us() - start;
+    if (elapsed >= BENCH_MIN_TIME_US) break;
+    result.iterations *= 2;
+  }
+
+  result.nsPerOp = (double)elapsed * 1000.0 / (double)result.iterations;
+  if (bytesPerOp)
+    printf("%-40s %12llu %14.1f ns/op %9.1f KB/s\n", name, (unsigned long long)result.iterations, result.nsPerOp,
+      (double)bytesPerOp * 1e9 / result.nsPerOp / 1024.0);
+  else
+    printf("%-40s %12llu %14.1f ns/op\n", name, (unsigned long long)result.iterations, result.nsPerOp);
+  fflush(stdout);
+
+  if (benchNumResults < BENCH_MAX_RESULTS)
+    benchResults[benchNumResults++] = result;
+  return result;
+}
+
+bench_result_t bench_run(const char* name, bench_fn fn, void* ctx)
+{
+  return bench_run_bytes(name, fn, ctx, 0);
+}
+
+// benchmark names are plain ASCII, only quotes and backslashes need escaping
+static void bench_json_string(FILE* file, const char* value)
+{
+  fputc('"', file);
+  for (; *value; value++) {
+    if (*value == '"' || *value == '\\') fputc('\\', file);
+    fputc(*value, file);
+  }
+  fputc('"', file);
+}
+
+static size_t bench_export_json(const char* path)
+{
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    fprintf(stderr, "failed to open %s\n", path);
+    return 1;
+  }
+
+  fprintf(file, "{\n  \"label\": ");
+  bench_json_string(file, bench_config.label ? bench_config.label : "");
+  fprintf(file, ",\n  \"latency\": {\"response_us\": %u, \"frame_us\": %u, \"program_us\": %u},\n  \"results\": [\n",
+    bench_config.latency.responseUs, bench_config.latency.frameUs, bench_config.latency.programUs);
+  for (size_t i = 0; i < benchNumResults; i++) {
+    fprintf(file, "    {\"name\": ");
+    bench_json_string(file, benchResults[i].name);
+    fprintf(file, ", \"iterations\": %llu, \"ns_per_op\": %.1f",
+      (unsigned long long)benchResults[i].iterations, benchResults[i].nsPerOp);
+    if (benchResults[i].bytesPerOp)
+      fprintf(file, ", \"bytes_per_op\": %llu, \"bytes_per_sec\": %.0f",
+        (unsigned long long)benchResults[i].bytesPerOp, (double)benchResults[i].bytesPerOp * 1e9 / benchResults[i].nsPerOp);
+    fprintf(file, "}%s\n", i + 1 < benchNumResults ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+  fclose(file);
+  return 0;
+}
+
+// "none", "car" or "response,frame,program" in microseconds
+static size_t bench_parse_latency(const char* value, simecu_latency_t* latency)
+{
+  unsigned int response, frame, program;
+  if (strcmp(value, "none") == 0) *latency = SIMECU_LATENCY_NONE;
+  else if (strcmp(value, "car") == 0) *latency = SIMECU_LATENCY_DEFAULT;
+  else if (sscanf(value, "%u,%u,%u", &response, &frame, &program) == 3) {
+    latency->responseUs = response;
+    latency->frameUs    = frame;
+    latency->programUs  = program;
+  }
+  else return 1;
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--filter=", 9) == 0) bench_config.filter = argv[i] + 9;
+    else if (strncmp(argv[i], "--json=", 7) == 0) bench_config.jsonFileName = argv[i] + 7;
+    else if (strncmp(argv[i], "--label=", 8) == 0) bench_config.label = argv[i] + 8;
+    else if (strncmp(argv[i], "--latency=", 10) == 0 && !bench_parse_latency(argv[i] + 10, &bench_config.latency)) continue;
+    else {
+      fprintf(stderr, "Usage: %s [--filter=text] [--json=results.json] [--label=text] [--latency=none|car|R,F,P]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  printf("%-40s %12s %17s\n", "benchmark", "iterations", "time");
+  bench_uds();
+  bench_key();
+  bench_metrics();
+  bench_log();
+  bench_progress();
+  bench_hexdump();
+  bench_transfer();
+  bench_celltrace();
+  bench_loganalyze();
+  bench_romedit();
+  bench_ramvideo();
+  bench_dumpfile();
+  bench_calindex();
+  bench_defindex();
+  bench_defconvert();
+  bench_defresolve();
+  bench_tableeval();
+  bench_sh2xref();
+
+  if (bench_config.jsonFileName && bench_export_json(bench_config.jsonFileName))
+    return 1;
+  return 0;
+}
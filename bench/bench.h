@@ -0,0 +1,81 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "simecu.h"
+
+/* Benchmark harness.
+ *
+ * A benchmark is a function that runs its operation `iterations` times. The harness
+ * doubles the iteration count until one run takes at least BENCH_MIN_TIME_US and
+ * reports the time per operation of that run. Macro benchmarks (a whole dump or flash
+ * against the simulated ECU) use the same harness, one operation is one transfer.
+ *
+ * ecudump-bench [--filter=text] [--json=results.json] [--label=text] [--latency=none|car|R,F,P]
+ * Results can be saved as JSON to compare them across commits.
+ */
+
+static const uint64_t BENCH_MIN_TIME_US = 200000;
+static const size_t   BENCH_MAX_RESULTS = 128;
+
+typedef void (*bench_fn)(void* ctx, uint64_t iterations);
+
+typedef struct Bench_Result {
+  const char* name;
+  uint64_t    iterations;
+  double      nsPerOp;
+  uint64_t    bytesPerOp;  // 0 unless the benchmark moves data
+} bench_result_t;
+
+typedef struct Bench_Config {
+  const char*      filter;    // only run benchmarks whose name contains this
+  const char*      jsonFileName;
+  const char*      label;     // stored with the JSON results, e.g. a commit
+  simecu_latency_t latency;   // for the macro benchmarks
+} bench_config_t;
+
+extern bench_config_t bench_config;
+
+bench_result_t bench_run(const char* name, bench_fn fn, void* ctx);
+
+/** Same as bench_run, also reports throughput */
+bench_result_t bench_run_bytes(const char* name, bench_fn fn, void* ctx, uint64_t bytesPerOp);
+
+/** keep the compiler from optimizing away a result */
+void bench_consume(const void* value);
+
+void bench_uds();
+void bench_key();
+void bench_metrics();
+void bench_log();
+void bench_progress();
+void bench_hexdump();
+void bench_transfer();
+void bench_celltrace();
+void bench_loganalyze();
+void bench_romedit();
+void bench_ramvideo();
+void bench_dumpfile();
+void bench_calindex();
+void bench_defindex();
+void bench_defconvert();
+void bench_defresolve();
+void bench_tableeval();
+void bench_sh2xref();
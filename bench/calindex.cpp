@@ -0,0 +1,302 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+#include "bench.h"
+#include "calindex.h"
+#include "zipfile.h"
+
+static const char*    BENCH_CALINDEX_DIRECTORY = "ecudump-bench-library";
+static const char*    BENCH_CALINDEX_PATH      = "ecudump-bench-library/" CALINDEX_FILE_NAME;
+static const uint32_t BENCH_CALINDEX_LENGTH    = 0x80000;
+static const size_t   BENCH_CALINDEX_PACKAGES  = 32;
+// about every calibration of every Mazda the scraper can reach
+static const size_t   BENCH_CALINDEX_ENTRIES   = 10000;
+
+typedef struct Bench_Calindex {
+  uint8_t* rom;
+  uint8_t* phf;          // header, then `rom`
+  size_t   phfLength;
+  uint8_t* deflated;     // `rom` as a DEFLATE stream
+  size_t   deflatedLength;
+  uint8_t* out;
+  calindex_entry_t* entries;
+  uint32_t* byPart;
+  calindex_t index;      // over `entries`, not mapped
+  char ids[64][32];
+} bench_calindex_t;
+
+typedef struct Bench_Calindex_Writer {
+  uint8_t* out;
+  size_t   length;
+  uint64_t buffer;
+  unsigned count;
+} bench_calindex_writer_t;
+
+static void bench_calindex_bits(bench_calindex_writer_t* writer, uint32_t value, unsigned n)
+{
+  writer->buffer |= (uint64_t)value << writer->count;
+  writer->count += n;
+  while (writer->count >= 8) {
+    writer->out[writer->length++] = (uint8_t)writer->buffer;
+    writer->buffer >>= 8;
+    writer->count -= 8;
+  }
+}
+
+// Huffman codes go highest bit first
+static void bench_calindex_code(bench_calindex_writer_t* writer, uint32_t code, unsigned n)
+{
+  uint32_t reversed = 0;
+  for (unsigned b = 0; b < n; b++)
+    reversed |= ((code >> b) & 1) << (n - 1 - b);
+  bench_calindex_bits(writer, reversed, n);
+}
+
+static void bench_calindex_symbol(bench_calindex_writer_t* writer, unsigned symbol)
+{
+  if (symbol < 144)      bench_calindex_code(writer, 0x30 + symbol, 8);
+  else if (symbol < 256) bench_calindex_code(writer, 0x190 + symbol - 144, 9);
+  else if (symbol < 280) bench_calindex_code(writer, symbol - 256, 7);
+  else                   bench_calindex_code(writer, 0xc0 + symbol - 280, 8);
+}
+
+/*
+ * One block with the fixed codes: literals, and runs of a repeated byte as matches 1
+ * back. No zip tool writes that little, but it has the literals and copies an inflate
+ * spends its time on, without a compressor in the tree.
+ */
+static size_t bench_calindex_deflate(const uint8_t* in, size_t length, uint8_t* out)
+{
+  bench_calindex_writer_t writer = { out, 0, 0, 0 };
+  bench_calindex_bits(&writer, 1, 1);
+  bench_calindex_bits(&writer, 1, 2);
+  bench_calindex_symbol(&writer, in[0]);
+  size_t i = 1;
+  while (i < length) {
+    size_t run = 0;
+    while (i + run < length && run < 258 && in[i + run] == in[i - 1]) run++;
+    if (run < 3) {
+      bench_calindex_symbol(&writer, in[i++]);
+      continue;
+    }
+    // length 258 has a code of its own, anything else a base and extra bits
+    if (run == 258) {
+      bench_calindex_symbol(&writer, 285);
+    } else {
+      static const uint16_t base[28] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                         35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227 };
+      unsigned code = 27;
+      while (base[code] > run) code--;
+      bench_calindex_symbol(&writer, 257 + code);
+      unsigned extra = code < 8 ? 0 : (code - 4) / 4;
+      bench_calindex_bits(&writer, (uint32_t)(run - base[code]), extra);
+    }
+    bench_calindex_code(&writer, 0, 5);
+    i += run;
+  }
+  bench_calindex_symbol(&writer, 256);
+  bench_calindex_bits(&writer, 0, 7);
+  return writer.length;
+}
+
+static void bench_calindex_rom(uint8_t* rom)
+{
+  uint16_t instructions[256];
+  for (int i = 0; i < 256; i++) instructions[i] = (uint16_t)rand();
+  for (uint32_t i = 0; i < 0x40000; i += 2) {
+    uint16_t instruction = instructions[rand() % 256 & rand() % 256];
+    memcpy(rom + i, &instruction, 2);
+  }
+  for (uint32_t i = 0x40000; i < 0x60000; i += 2) {
+    uint16_t cell = (uint16_t)(((i >> 5) & 0x7ff) * 16 + (i & 31) * 8 + rand() % 4);
+    memcpy(rom + i, &cell, 2);
+  }
+  memset(rom + 0x60000, 0xff, BENCH_CALINDEX_LENGTH - 0x60000);
+}
+
+static size_t bench_calindex_header(char* out, const char* part)
+{
+  const char* fields[4][2] = { { "FILE_NAME", "" }, { "PART_NUMBER", part }, { "MODULE", "PCM" }, { "FORMAT", "PHF" } };
+  size_t length = 0;
+  for (int f = 0; f < 4; f++)
+    length += (size_t)sprintf(out + length, " %-29s>%s%s", fields[f][0], f ? "" : "SW-", f ? fields[f][1] : part) + 1;
+  out[length++] = '$';
+  return length;
+}
+
+static bool bench_calindex_library(bench_calindex_t* bench)
+{
+  char path[128], part[32];
+  mkdir(BENCH_CALINDEX_DIRECTORY, 0755);
+  for (size_t p = 0; p < BENCH_CALINDEX_PACKAGES; p++) {
+    snprintf(part, sizeof(part), "N3Z2EU%03zu", p);
+    snprintf(path, sizeof(path), "%s/SW-%s.PHF", BENCH_CALINDEX_DIRECTORY, part);
+    size_t header = bench_calindex_header((char*)bench->phf, part);
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+    bool written = fwrite(bench->phf, 1, header, file) == header &&
+                   fwrite(bench->rom, 1, BENCH_CALINDEX_LENGTH, file) == BENCH_CALINDEX_LENGTH;
+    if (fclose(file) || !written) return false;
+  }
+  return true;
+}
+
+static void bench_calindex_remove(void)
+{
+  char path[128];
+  for (size_t p = 0; p < BENCH_CALINDEX_PACKAGES; p++) {
+    snprintf(path, sizeof(path), "%s/SW-N3Z2EU%03zu.PHF", BENCH_CALINDEX_DIRECTORY, p);
+    remove(path);
+  }
+  remove(BENCH_CALINDEX_PATH);
+  rmdir(BENCH_CALINDEX_DIRECTORY);
+}
+
+static bool bench_calindex_setup(bench_calindex_t* bench)
+{
+  bench->rom      = (uint8_t*)malloc(BENCH_CALINDEX_LENGTH);
+  bench->phf      = (uint8_t*)malloc(BENCH_CALINDEX_LENGTH + 512);
+  bench->deflated = (uint8_t*)malloc(BENCH_CALINDEX_LENGTH * 2);
+  bench->out      = (uint8_t*)malloc(BENCH_CALINDEX_LENGTH);
+  bench->entries  = (calindex_entry_t*)calloc(BENCH_CALINDEX_ENTRIES, sizeof(calindex_entry_t));
+  bench->byPart   = (uint32_t*)calloc(BENCH_CALINDEX_ENTRIES, sizeof(uint32_t));
+  if (!bench->rom || !bench->phf || !bench->deflated || !bench->out || !bench->entries || !bench->byPart) return false;
+
+  srand(1);
+  bench_calindex_rom(bench->rom);
+  bench->deflatedLength = bench_calindex_deflate(bench->rom, BENCH_CALINDEX_LENGTH, bench->deflated);
+  size_t header = bench_calindex_header((char*)bench->phf, "N3Z2EU000");
+  memcpy(bench->phf + header, bench->rom, BENCH_CALINDEX_LENGTH);
+  bench->phfLength = header + BENCH_CALINDEX_LENGTH;
+
+  // part numbers like the real ones, a CALID per part number
+  for (size_t e = 0; e < BENCH_CALINDEX_ENTRIES; e++) {
+    calindex_entry_t* entry = &bench->entries[e];
+    snprintf(entry->partNumber, sizeof(entry->partNumber), "%c%c%c%c%c%c%03zu", 'A' + rand() % 26, '0' + rand() % 10,
+             'A' + rand() % 26, '0' + rand() % 10, 'A' + rand() % 26, 'A' + rand() % 26, e % 1000);
+    strcpy(entry->calid, entry->partNumber);
+    snprintf(entry->archive, sizeof(entry->archive), "SW-%s.zip", entry->partNumber);
+  }
+  std::sort(bench->entries, bench->entries + BENCH_CALINDEX_ENTRIES, [](const calindex_entry_t& a, const calindex_entry_t& b) {
+    return strcmp(a.calid, b.calid) < 0;
+  });
+  for (size_t e = 0; e < BENCH_CALINDEX_ENTRIES; e++)
+    bench->byPart[e] = (uint32_t)e;
+  for (size_t i = 0; i < 64; i++)
+    strcpy(bench->ids[i], bench->entries[(size_t)rand() % BENCH_CALINDEX_ENTRIES].partNumber);
+  bench->index.entries    = bench->entries;
+  bench->index.byPart     = bench->byPart;
+  bench->index.numEntries = BENCH_CALINDEX_ENTRIES;
+
+  return zipfile_inflate(bench->deflated, bench->deflatedLength, bench->out, BENCH_CALINDEX_LENGTH) == (long)BENCH_CALINDEX_LENGTH &&
+         !memcmp(bench->out, bench->rom, BENCH_CALINDEX_LENGTH) && bench_calindex_library(bench);
+}
+
+static void bench_calindex_inflate(void* ctx, uint64_t iterations)
+{
+  bench_calindex_t* bench = (bench_calindex_t*)ctx;
+  long length = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    length += zipfile_inflate(bench->deflated, bench->deflatedLength, bench->out, BENCH_CALINDEX_LENGTH);
+  bench_consume(&length);
+}
+
+static void bench_calindex_crc32(void* ctx, uint64_t iterations)
+{
+  bench_calindex_t* bench = (bench_calindex_t*)ctx;
+  uint32_t crc = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    crc ^= zipfile_crc32(0, bench->rom, BENCH_CALINDEX_LENGTH);
+  bench_consume(&crc);
+}
+
+static void bench_calindex_phf(void* ctx, uint64_t iterations)
+{
+  bench_calindex_t* bench = (bench_calindex_t*)ctx;
+  calindex_entry_t entry;
+  for (uint64_t i = 0; i < iterations; i++) {
+    memset(&entry, 0, sizeof(entry));
+    calindex_read_phf(bench->phf, bench->phfLength, &entry);
+  }
+  bench_consume(&entry);
+}
+
+static void bench_calindex_scan(void* ctx, uint64_t iterations)
+{
+  calindex_stats_t stats;
+  (void)ctx;
+  for (uint64_t i = 0; i < iterations; i++) {
+    remove(BENCH_CALINDEX_PATH);
+    calindex_update(BENCH_CALINDEX_DIRECTORY, BENCH_CALINDEX_PATH, 0, &stats);
+  }
+  bench_consume(&stats);
+}
+
+// what an update costs once everything is indexed
+static void bench_calindex_unchanged(void* ctx, uint64_t iterations)
+{
+  calindex_stats_t stats;
+  (void)ctx;
+  for (uint64_t i = 0; i < iterations; i++)
+    calindex_update(BENCH_CALINDEX_DIRECTORY, BENCH_CALINDEX_PATH, 0, &stats);
+  bench_consume(&stats);
+}
+
+static void bench_calindex_find(void* ctx, uint64_t iterations)
+{
+  bench_calindex_t* bench = (bench_calindex_t*)ctx;
+  const calindex_entry_t* matches[4];
+  size_t found = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    found += calindex_find(&bench->index, bench->ids[i % 64], matches, 4);
+  bench_consume(&found);
+}
+
+void bench_calindex()
+{
+  bench_calindex_t* bench = (bench_calindex_t*)calloc(1, sizeof(bench_calindex_t));
+  if (!bench) return;
+  if (bench_calindex_setup(bench)) {
+    bench_run_bytes("zipfile inflate 512KB of ROM", bench_calindex_inflate, bench, BENCH_CALINDEX_LENGTH);
+    bench_run_bytes("zipfile crc32 512KB", bench_calindex_crc32, bench, BENCH_CALINDEX_LENGTH);
+    bench_run_bytes("calindex read PHF 512KB", bench_calindex_phf, bench, bench->phfLength);
+    bench_run("calindex update 32 PHFs, all new", bench_calindex_scan, bench);
+    bench_run("calindex update 32 PHFs, unchanged", bench_calindex_unchanged, bench);
+    bench_run("calindex find, 10000 entries", bench_calindex_find, bench);
+  }
+  bench_calindex_remove();
+  free(bench->rom);
+  free(bench->phf);
+  free(bench->deflated);
+  free(bench->out);
+  free(bench->entries);
+  free(bench->byPart);
+  free(bench);
+}
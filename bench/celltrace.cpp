@@ -0,0 +1,139 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "bench.h"
+#include "celltrace.h"
+
+// about what a full definition binds: dozens of 3D maps and a few 2D tables on 4 channels
+static const size_t BENCH_CELLTRACE_3D      = 48;
+static const size_t BENCH_CELLTRACE_2D      = 16;
+static const size_t BENCH_CELLTRACE_SAMPLES = 4096;
+
+typedef struct Bench_Celltrace {
+  celltrace_t trace;
+  float samples[4][BENCH_CELLTRACE_SAMPLES];
+  uint32_t hits[BENCH_CELLTRACE_3D][16 * 16];
+} bench_celltrace_t;
+
+// 16 breakpoints from `low` to `high`, a little denser at the low end like real maps
+static void bench_celltrace_axis(float* axis, float low, float high)
+{
+  for (int i = 0; i < 16; i++) {
+    float t = (float)i / 15;
+    axis[i] = low + (high - low) * t * (0.5f + 0.5f * t);
+  }
+}
+
+static void bench_celltrace_setup(bench_celltrace_t* bench)
+{
+  static const char* names[4] = { "rpm", "load", "ect", "afr" };
+  static const float ranges[4][2] = { { 0, 8000 }, { 0, 2 }, { -40, 120 }, { 10, 18 } };
+  static const int afr = 3;
+  float x[16], y[16];
+  char name[32];
+
+  celltrace_init(&bench->trace);
+  for (int c = 0; c < 4; c++) {
+    celltrace_channel_t channel;
+    memset(&channel, 0, sizeof(channel));
+    strcpy(channel.name, names[c]);
+    channel.address = 0xffff8000u + c * 2;
+    channel.storage = DEFINITION_STORAGE_UINT16;
+    channel.scale   = 1;
+    channel.min     = ranges[c][0];
+    channel.max     = ranges[c][1];
+    celltrace_add_channel(&bench->trace, &channel);
+  }
+  // a few axis variants per channel, like the different RPM breakpoints of different maps
+  for (size_t t = 0; t < BENCH_CELLTRACE_3D; t++) {
+    bench_celltrace_axis(x, 500.0f + (float)(t % 6) * 100, 7500);
+    bench_celltrace_axis(y, 0.1f + (float)(t % 5) * 0.05f, 2);
+    snprintf(name, sizeof(name), "3D %zu", t);
+    celltrace_add_table(&bench->trace, name, x, 16, 0, y, 16, 1, &afr, t % 2);
+  }
+  for (size_t t = 0; t < BENCH_CELLTRACE_2D; t++) {
+    bench_celltrace_axis(y, -40.0f + (float)(t % 4) * 10, 110);
+    snprintf(name, sizeof(name), "2D %zu", t);
+    celltrace_add_table(&bench->trace, name, NULL, 1, -1, y, 16, 2, NULL, 0);
+  }
+
+  srand(1);
+  for (size_t i = 0; i < BENCH_CELLTRACE_SAMPLES; i++) {
+    for (int c = 0; c < 4; c++)
+      bench->samples[c][i] = ranges[c][0] + (ranges[c][1] - ranges[c][0]) * (float)rand() / (float)RAND_MAX;
+  }
+}
+
+// one sample at a time, the way live logging feeds it
+static void bench_celltrace_sample(void* ctx, uint64_t iterations)
+{
+  bench_celltrace_t* bench = (bench_celltrace_t*)ctx;
+  float values[4];
+  for (uint64_t i = 0; i < iterations; i++) {
+    size_t s = i % BENCH_CELLTRACE_SAMPLES;
+    for (int c = 0; c < 4; c++) values[c] = bench->samples[c][s];
+    celltrace_sample(&bench->trace, values);
+  }
+}
+
+static void bench_celltrace_batch(void* ctx, uint64_t iterations)
+{
+  bench_celltrace_t* bench = (bench_celltrace_t*)ctx;
+  const float* columns[4] = { bench->samples[0], bench->samples[1], bench->samples[2], bench->samples[3] };
+  for (uint64_t i = 0; i < iterations; i++)
+    celltrace_add(&bench->trace, columns, BENCH_CELLTRACE_SAMPLES);
+}
+
+// nearest cell of every 3D table by binary search over each table's own axes, for comparison
+static void bench_celltrace_bsearch(void* ctx, uint64_t iterations)
+{
+  bench_celltrace_t* bench = (bench_celltrace_t*)ctx;
+  const celltrace_t* trace = &bench->trace;
+  for (uint64_t i = 0; i < iterations; i++) {
+    for (size_t s = 0; s < BENCH_CELLTRACE_SAMPLES; s++) {
+      for (size_t t = 0; t < BENCH_CELLTRACE_3D; t++) {
+        const celltrace_axis_t* x = &trace->axes[trace->tables[t].x];
+        const celltrace_axis_t* y = &trace->axes[trace->tables[t].y];
+        size_t ix = std::upper_bound(x->values, x->values + x->length, bench->samples[0][s]) - x->values;
+        size_t iy = std::upper_bound(y->values, y->values + y->length, bench->samples[1][s]) - y->values;
+        ix = ix ? ix - 1 : 0;
+        iy = iy ? iy - 1 : 0;
+        bench->hits[t][iy * 16 + ix]++;
+      }
+    }
+  }
+  bench_consume(bench->hits);
+}
+
+void bench_celltrace()
+{
+  bench_celltrace_t* bench = (bench_celltrace_t*)calloc(1, sizeof(bench_celltrace_t));
+  if (!bench) return;
+  bench_celltrace_setup(bench);
+
+  bench_run("celltrace 1 sample, 64 tables", bench_celltrace_sample, bench);
+  bench_run("celltrace 4096 samples, 64 tables", bench_celltrace_batch, bench);
+  bench_run("celltrace 4096 samples, bsearch 48 3D", bench_celltrace_bsearch, bench);
+
+  celltrace_free(&bench->trace);
+  free(bench);
+}
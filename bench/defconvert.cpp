@@ -0,0 +1,183 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+#include <string>
+
+#include "bench.h"
+#include "defconvert.h"
+
+static const char* BENCH_DEFCONVERT_INPUT    = "ecudump-bench-defconvert";
+static const char* BENCH_DEFCONVERT_OUTPUT   = "ecudump-bench-defconvert-out";
+static const char* BENCH_DEFCONVERT_MANIFEST = "ecudump-bench-defconvert-out/" DEFCONVERT_MANIFEST;
+// single definitions are written over and over into this one
+static const char* BENCH_DEFCONVERT_FILE     = "ecudump-bench-defconvert.xml";
+// about what ScoobyRom finds in an RX8 ROM, see definitions/RomRaider/EcuEditor
+static const size_t BENCH_DEFCONVERT_2D    = 370;
+static const size_t BENCH_DEFCONVERT_3D    = 110;
+static const size_t BENCH_DEFCONVERT_FILES = 16;
+
+typedef struct Bench_Defconvert {
+  std::string text;
+  definition_t definition;
+  FILE* out;
+} bench_defconvert_t;
+
+static const char* bench_defconvert_scaling(size_t i, char* out, size_t size)
+{
+  static const char* factors[8] = { "1", "2", "0.5", "0.01", "0.0078125", "0.00390625", "25", "0.005" };
+  static const char* types[3] = { "uint8", "uint16", "float" };
+  snprintf(out, size, "storagetype=\"%s\" endian=\"big\">\n      <scaling units=\"\" expression=\"x*%s\" to_byte=\"x/%s\" format=\"0.000\" />",
+           types[i % 3], factors[i % 8], factors[i % 8]);
+  return out;
+}
+
+static bool bench_defconvert_setup(bench_defconvert_t* bench)
+{
+  char table[1024], scaling[256];
+  uint32_t address = 0x6c7a4;
+  bench->text = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<roms>\n  <rom>\n    <romid>\n      <xmlid>N3K1EU000</xmlid>\n"
+                "      <internalidaddress>6c646</internalidaddress>\n      <internalidstring>N3K1EU000</internalidstring>\n"
+                "      <filesize>512KB</filesize>\n    </romid>\n";
+  for (size_t t = 0; t < BENCH_DEFCONVERT_2D + BENCH_DEFCONVERT_3D; t++) {
+    bool is3D = t >= BENCH_DEFCONVERT_2D;
+    size_t length = snprintf(table, sizeof(table), "    <table type=\"%s\" name=\"Record 0x%X\" category=\"Unknown\" sizex=\"16\" sizey=\"16\" "
+                             "storageaddress=\"0x%X\" %s\n", is3D ? "3D" : "2D", address, address,
+                             bench_defconvert_scaling(t, scaling, sizeof(scaling)));
+    for (size_t a = is3D ? 0 : 1; a < 2; a++)
+      length += snprintf(table + length, sizeof(table) - length, "      <table type=\"%s\" name=\"\" storageaddress=\"0x%X\" %s\n      </table>\n",
+                         a ? "Y Axis" : "X Axis", address + 0x400 + (uint32_t)a * 0x40, bench_defconvert_scaling(2, scaling, sizeof(scaling)));
+    snprintf(table + length, sizeof(table) - length, "    </table>\n");
+    bench->text += table;
+    address += 0x480;
+  }
+  bench->text += "  </rom>\n</roms>\n";
+  if (definition_parse_rom(&bench->definition, "bench", bench->text.data(), bench->text.size(), 0)) return false;
+
+  mkdir(BENCH_DEFCONVERT_INPUT, 0755);
+  for (size_t f = 0; f < BENCH_DEFCONVERT_FILES; f++) {
+    char path[256], id[16];
+    std::string text = bench->text;
+    snprintf(id, sizeof(id), "N3K1EU%03zu", f);
+    text.replace(text.find("N3K1EU000"), 9, id);
+    snprintf(path, sizeof(path), "%s/%s.xml", BENCH_DEFCONVERT_INPUT, id);
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    if (fclose(file) || !written) return false;
+  }
+  bench->out = fopen(BENCH_DEFCONVERT_FILE, "wb");
+  return bench->out != NULL;
+}
+
+static void bench_defconvert_remove(void)
+{
+  char path[256];
+  for (size_t f = 0; f < BENCH_DEFCONVERT_FILES; f++) {
+    snprintf(path, sizeof(path), "%s/N3K1EU%03zu.xml", BENCH_DEFCONVERT_INPUT, f);
+    remove(path);
+    snprintf(path, sizeof(path), "%s/N3K1EU%03zu.xml", BENCH_DEFCONVERT_OUTPUT, f);
+    remove(path);
+  }
+  remove(BENCH_DEFCONVERT_MANIFEST);
+  remove(BENCH_DEFCONVERT_FILE);
+  rmdir(BENCH_DEFCONVERT_INPUT);
+  rmdir(BENCH_DEFCONVERT_OUTPUT);
+}
+
+static void bench_defconvert_parse(void* ctx, uint64_t iterations)
+{
+  bench_defconvert_t* bench = (bench_defconvert_t*)ctx;
+  size_t tables = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    definition_t definition;
+    if (!definition_parse_rom(&definition, "bench", bench->text.data(), bench->text.size(), 0))
+      tables += definition.numTables;
+    definition_free(&definition);
+  }
+  bench_consume(&tables);
+}
+
+static void bench_defconvert_ecuflash(void* ctx, uint64_t iterations)
+{
+  bench_defconvert_t* bench = (bench_defconvert_t*)ctx;
+  size_t scalings = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    rewind(bench->out);
+    defconvert_write_ecuflash(&bench->definition, bench->out, &scalings);
+  }
+  bench_consume(&scalings);
+}
+
+static void bench_defconvert_romraider(void* ctx, uint64_t iterations)
+{
+  bench_defconvert_t* bench = (bench_defconvert_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++) {
+    rewind(bench->out);
+    defconvert_write_romraider(&bench->definition, bench->out);
+  }
+}
+
+static void bench_defconvert_directory(void* ctx, uint64_t iterations)
+{
+  defconvert_stats_t stats;
+  (void)ctx;
+  for (uint64_t i = 0; i < iterations; i++) {
+    remove(BENCH_DEFCONVERT_MANIFEST);
+    defconvert_run(BENCH_DEFCONVERT_INPUT, BENCH_DEFCONVERT_OUTPUT, DEFCONVERT_ECUFLASH, 0, &stats);
+  }
+  bench_consume(&stats);
+}
+
+// nothing changed since the last run: every input is hashed, none is parsed
+static void bench_defconvert_unchanged(void* ctx, uint64_t iterations)
+{
+  defconvert_stats_t stats;
+  (void)ctx;
+  for (uint64_t i = 0; i < iterations; i++)
+    defconvert_run(BENCH_DEFCONVERT_INPUT, BENCH_DEFCONVERT_OUTPUT, DEFCONVERT_ECUFLASH, 0, &stats);
+  bench_consume(&stats);
+}
+
+void bench_defconvert()
+{
+  bench_defconvert_t* bench = new bench_defconvert_t();
+  uint64_t bytes = 0;
+  if (bench_defconvert_setup(bench)) {
+    bytes = bench->text.size();
+    bench_run_bytes("definition parse, 480 tables", bench_defconvert_parse, bench, bytes);
+    bench_run("defconvert write EcuFlash, 480 tables", bench_defconvert_ecuflash, bench);
+    bench_run("defconvert write RomRaider, 480 tables", bench_defconvert_romraider, bench);
+    bench_run_bytes("defconvert 16 files", bench_defconvert_directory, bench, bytes * BENCH_DEFCONVERT_FILES);
+    bench_run_bytes("defconvert 16 files, unchanged", bench_defconvert_unchanged, bench, bytes * BENCH_DEFCONVERT_FILES);
+  }
+  if (bench->out) fclose(bench->out);
+  definition_free(&bench->definition);
+  bench_defconvert_remove();
+  delete bench;
+}
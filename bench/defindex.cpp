@@ -0,0 +1,132 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+#include <string>
+
+#include "bench.h"
+#include "defindex.h"
+
+static const char*    BENCH_DEFINDEX_DIRECTORY = "ecudump-bench-definitions";
+static const char*    BENCH_DEFINDEX_PATH      = "ecudump-bench-definitions/definitions.xml";
+static const uint32_t BENCH_DEFINDEX_LENGTH    = 0x80000;
+// hundreds of ROMs in one RomRaider file, their IDs at a few different addresses
+static const size_t   BENCH_DEFINDEX_ROMS      = 1000;
+static const uint32_t BENCH_DEFINDEX_ADDRESSES[4] = { 0x6c646, 0x6c640, 0x7ff00, 0x2000 };
+
+typedef struct Bench_Defindex {
+  std::string text;
+  defindex_t index;
+  uint8_t* rom;        // holds the ID of the last definition
+} bench_defindex_t;
+
+static void bench_defindex_id(char* out, size_t i)
+{
+  sprintf(out, "N3%c%zuEU%03zu", "KZM"[i % 3], i % 7, i % 1000);
+}
+
+static bool bench_defindex_setup(bench_defindex_t* bench)
+{
+  char id[32], rom[512];
+  bench->text = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<roms>\n <rom>\n  <romid><xmlid>RX8BASE</xmlid></romid>\n"
+                "  <table type=\"1D\" name=\"Base\" storagetype=\"uint8\" storageaddress=\"0x1000\"/>\n </rom>\n";
+  for (size_t i = 0; i < BENCH_DEFINDEX_ROMS; i++) {
+    bench_defindex_id(id, i);
+    snprintf(rom, sizeof(rom), " <rom base=\"RX8BASE\">\n  <romid>\n   <xmlid>%s</xmlid>\n   <internalidaddress>0x%X</internalidaddress>\n"
+             "   <internalidstring>%s</internalidstring>\n  </romid>\n"
+             "  <table type=\"1D\" name=\"Table %zu\" storagetype=\"uint16\" storageaddress=\"0x%zX\"/>\n </rom>\n",
+             id, BENCH_DEFINDEX_ADDRESSES[i % 4], id, i, 0x10000 + i * 2);
+    bench->text += rom;
+  }
+  bench->text += "</roms>\n";
+
+  mkdir(BENCH_DEFINDEX_DIRECTORY, 0755);
+  FILE* file = fopen(BENCH_DEFINDEX_PATH, "wb");
+  if (!file) return false;
+  bool written = fwrite(bench->text.data(), 1, bench->text.size(), file) == bench->text.size();
+  if (fclose(file) || !written) return false;
+  if (defindex_build(&bench->index, BENCH_DEFINDEX_DIRECTORY)) return false;
+
+  bench->rom = (uint8_t*)malloc(BENCH_DEFINDEX_LENGTH);
+  if (!bench->rom) return false;
+  memset(bench->rom, 0xff, BENCH_DEFINDEX_LENGTH);
+  size_t last = BENCH_DEFINDEX_ROMS - 1;
+  bench_defindex_id(id, last);
+  memcpy(bench->rom + BENCH_DEFINDEX_ADDRESSES[last % 4], id, strlen(id));
+  return true;
+}
+
+static void bench_defindex_scan(void* ctx, uint64_t iterations)
+{
+  bench_defindex_t* bench = (bench_defindex_t*)ctx;
+  size_t roms = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    roms += definition_scan(bench->text.data(), bench->text.size(), NULL, NULL);
+  bench_consume(&roms);
+}
+
+static void bench_defindex_identify(void* ctx, uint64_t iterations)
+{
+  bench_defindex_t* bench = (bench_defindex_t*)ctx;
+  uint32_t matches[4];
+  size_t found = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    found += defindex_identify(&bench->index, bench->rom, BENCH_DEFINDEX_LENGTH, matches, 4);
+  bench_consume(&found);
+}
+
+// every definition's ID compared against the ROM in turn, what the index replaces
+static void bench_defindex_linear(void* ctx, uint64_t iterations)
+{
+  bench_defindex_t* bench = (bench_defindex_t*)ctx;
+  size_t found = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    for (size_t e = 0; e < bench->index.numEntries; e++) {
+      const definition_romid_t* romid = &bench->index.entries[e].rom.romid;
+      size_t length = strlen(romid->internalIDString);
+      if (length && romid->internalIDAddress + length <= BENCH_DEFINDEX_LENGTH &&
+          !memcmp(bench->rom + romid->internalIDAddress, romid->internalIDString, length))
+        found++;
+    }
+  }
+  bench_consume(&found);
+}
+
+void bench_defindex()
+{
+  bench_defindex_t* bench = new bench_defindex_t();
+  if (bench_defindex_setup(bench)) {
+    bench_run_bytes("definition scan romids, 1000 ROMs", bench_defindex_scan, bench, bench->text.size());
+    bench_run("defindex identify, 1000 definitions", bench_defindex_identify, bench);
+    bench_run("defindex identify, linear compare", bench_defindex_linear, bench);
+  }
+  defindex_free(&bench->index);
+  free(bench->rom);
+  remove(BENCH_DEFINDEX_PATH);
+  rmdir(BENCH_DEFINDEX_DIRECTORY);
+  delete bench;
+}
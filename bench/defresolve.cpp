@@ -0,0 +1,186 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+#include <string>
+
+#include "bench.h"
+#include "defresolve.h"
+
+static const char*  BENCH_DEFRESOLVE_DIRECTORY = "ecudump-bench-defresolve";
+// a full EcuFlash base, a model year on top of it and one small file per ROM on top of that
+static const size_t BENCH_DEFRESOLVE_TABLES    = 480;
+static const size_t BENCH_DEFRESOLVE_SCALINGS  = 48;
+static const size_t BENCH_DEFRESOLVE_LEAVES    = 64;
+static const size_t BENCH_DEFRESOLVE_OVERRIDES = 120;
+
+typedef struct Bench_Defresolve {
+  defindex_t index;
+  uint32_t leaves[BENCH_DEFRESOLVE_LEAVES];
+} bench_defresolve_t;
+
+static bool bench_defresolve_write(const char* name, const std::string& text)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s", BENCH_DEFRESOLVE_DIRECTORY, name);
+  FILE* file = fopen(path, "wb");
+  if (!file) return false;
+  bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+  return !fclose(file) && written;
+}
+
+static std::string bench_defresolve_romid(const char* xmlID, const char* include)
+{
+  char text[256];
+  snprintf(text, sizeof(text), "<rom>\n\t<romid>\n\t\t<xmlid>%s</xmlid>\n\t\t<internalidaddress>6c646</internalidaddress>\n"
+           "\t\t<internalidstring>%s</internalidstring>\n\t</romid>\n", xmlID, xmlID);
+  std::string rom = text;
+  if (include) {
+    snprintf(text, sizeof(text), "\t<include>%s</include>\n", include);
+    rom += text;
+  }
+  return rom;
+}
+
+static bool bench_defresolve_setup(bench_defresolve_t* bench)
+{
+  char line[512];
+  std::string base = bench_defresolve_romid("N3BASE", NULL);
+  for (size_t s = 0; s < BENCH_DEFRESOLVE_SCALINGS; s++) {
+    snprintf(line, sizeof(line), "\t<scaling name=\"Scaling %zu\" units=\"u%zu\" toexpr=\"x*%zu/64\" frexpr=\"x*64/%zu\" format=\"%%0.2f\""
+             " storagetype=\"%s\" endian=\"big\"/>\n", s, s, s + 1, s + 1, s % 2 ? "uint16" : "uint8");
+    base += line;
+  }
+  for (size_t t = 0; t < BENCH_DEFRESOLVE_TABLES; t++) {
+    snprintf(line, sizeof(line), "\t<table name=\"Table %zu\" category=\"Category %zu\" type=\"3D\" scaling=\"Scaling %zu\">\n"
+             "\t\t<table name=\"Load %zu\" type=\"X Axis\" elements=\"16\" scaling=\"Scaling %zu\"/>\n"
+             "\t\t<table name=\"RPM %zu\" type=\"Y Axis\" elements=\"16\" scaling=\"Scaling %zu\"/>\n\t</table>\n",
+             t, t % 12, t % BENCH_DEFRESOLVE_SCALINGS, t, (t + 1) % BENCH_DEFRESOLVE_SCALINGS, t, (t + 2) % BENCH_DEFRESOLVE_SCALINGS);
+    base += line;
+  }
+  base += "</rom>\n";
+
+  // the model year redefines a few scalings, every table using them changes
+  std::string year = bench_defresolve_romid("N3YEAR", "N3BASE");
+  for (size_t s = 0; s < BENCH_DEFRESOLVE_SCALINGS; s += 8) {
+    snprintf(line, sizeof(line), "\t<scaling name=\"Scaling %zu\" units=\"u%zu\" toexpr=\"x/2\" frexpr=\"x*2\" format=\"%%0.1f\""
+             " storagetype=\"uint16\" endian=\"big\"/>\n", s, s);
+    year += line;
+  }
+  year += "</rom>\n";
+
+  mkdir(BENCH_DEFRESOLVE_DIRECTORY, 0755);
+  if (!bench_defresolve_write("base.xml", base) || !bench_defresolve_write("year.xml", year)) return false;
+  // ROMs give the addresses of some tables and their axes
+  for (size_t l = 0; l < BENCH_DEFRESOLVE_LEAVES; l++) {
+    char xmlID[32], name[sizeof(xmlID) + 4];  // room for ".xml"
+    snprintf(xmlID, sizeof(xmlID), "N3K1EU%03zu", l);
+    std::string leaf = bench_defresolve_romid(xmlID, "N3YEAR");
+    for (size_t o = 0; o < BENCH_DEFRESOLVE_OVERRIDES; o++) {
+      size_t t = (l * 7 + o * 3) % BENCH_DEFRESOLVE_TABLES;
+      uint32_t address = (uint32_t)(0x60000 + l * 0x100 + o * 0x400);
+      snprintf(line, sizeof(line), "\t<table name=\"Table %zu\" address=\"%x\">\n\t\t<table name=\"Load %zu\" address=\"%x\" />\n"
+               "\t\t<table name=\"RPM %zu\" address=\"%x\" />\n\t</table>\n", t, address, t, address + 0x200, t, address + 0x220);
+      leaf += line;
+    }
+    leaf += "</rom>\n";
+    snprintf(name, sizeof(name), "%s.xml", xmlID);
+    if (!bench_defresolve_write(name, leaf)) return false;
+  }
+
+  if (defindex_build(&bench->index, BENCH_DEFRESOLVE_DIRECTORY)) return false;
+  for (size_t l = 0; l < BENCH_DEFRESOLVE_LEAVES; l++) {
+    char xmlID[32];
+    snprintf(xmlID, sizeof(xmlID), "N3K1EU%03zu", l);
+    long entry = defindex_find(&bench->index, xmlID);
+    if (entry < 0) return false;
+    bench->leaves[l] = (uint32_t)entry;
+  }
+  return true;
+}
+
+// every ROM of the library through one resolver, the merged bases are reused
+static void bench_defresolve_shared(void* ctx, uint64_t iterations)
+{
+  bench_defresolve_t* bench = (bench_defresolve_t*)ctx;
+  size_t tables = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    defresolve_t resolver;
+    if (defresolve_init(&resolver, &bench->index)) return;
+    for (size_t l = 0; l < BENCH_DEFRESOLVE_LEAVES; l++) {
+      definition_t definition;
+      if (defresolve_load(&resolver, bench->leaves[l], &definition)) continue;
+      tables += definition.numTables;
+      definition_free(&definition);
+    }
+    defresolve_free(&resolver);
+  }
+  bench_consume(&tables);
+}
+
+// a resolver per ROM, the whole chain is parsed and merged every time
+static void bench_defresolve_fresh(void* ctx, uint64_t iterations)
+{
+  bench_defresolve_t* bench = (bench_defresolve_t*)ctx;
+  size_t tables = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    for (size_t l = 0; l < BENCH_DEFRESOLVE_LEAVES; l++) {
+      defresolve_t resolver;
+      definition_t definition;
+      if (defresolve_init(&resolver, &bench->index)) return;
+      if (!defresolve_load(&resolver, bench->leaves[l], &definition)) {
+        tables += definition.numTables;
+        definition_free(&definition);
+      }
+      defresolve_free(&resolver);
+    }
+  }
+  bench_consume(&tables);
+}
+
+void bench_defresolve()
+{
+  bench_defresolve_t* bench = new bench_defresolve_t();
+  if (bench_defresolve_setup(bench)) {
+    bench_run("defresolve 64 ROMs, shared bases", bench_defresolve_shared, bench);
+    bench_run("defresolve 64 ROMs, resolver per ROM", bench_defresolve_fresh, bench);
+  }
+  defindex_free(&bench->index);
+
+  char path[256];
+  static const char* bases[2] = { "base.xml", "year.xml" };
+  for (int b = 0; b < 2; b++) {
+    snprintf(path, sizeof(path), "%s/%s", BENCH_DEFRESOLVE_DIRECTORY, bases[b]);
+    remove(path);
+  }
+  for (size_t l = 0; l < BENCH_DEFRESOLVE_LEAVES; l++) {
+    snprintf(path, sizeof(path), "%s/N3K1EU%03zu.xml", BENCH_DEFRESOLVE_DIRECTORY, l);
+    remove(path);
+  }
+  rmdir(BENCH_DEFRESOLVE_DIRECTORY);
+  delete bench;
+}
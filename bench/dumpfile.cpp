@@ -0,0 +1,209 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "crc32c.h"
+#include "dumpfile.h"
+#include "lzblock.h"
+
+static const char*    BENCH_DUMPFILE_PATH_A = "ecudump-bench-a.rxd";
+static const char*    BENCH_DUMPFILE_PATH_B = "ecudump-bench-b.rxd";
+static const char*    BENCH_DUMPFILE_PATH_Z = "ecudump-bench-z.rxd";
+static const uint32_t BENCH_DUMPFILE_LENGTH = 0x80000;
+static const uint32_t BENCH_DUMPFILE_CHUNK  = 0x100;
+
+typedef struct Bench_Dumpfile {
+  uint8_t* a;
+  uint8_t* b;           // a with two bytes changed
+  dumpfile_reader_t readerA;
+  dumpfile_reader_t readerB;
+  dumpfile_reader_t readerZ;  // `rom`, compressed
+  uint8_t* rom;
+  uint8_t  compressed[0x1100];
+  size_t   compressedLength;
+  uint8_t  block[DUMPFILE_BLOCK];
+  uint32_t blocks[16];
+} bench_dumpfile_t;
+
+static bool bench_dumpfile_save(const char* path, const uint8_t* data, bool compress)
+{
+  dumpfile_t dump;
+  dumpfile_init(&dump, "JM1FE17N0Z0000001", "N3M5EF00013H6020", BENCH_DUMPFILE_CHUNK, compress);
+  size_t ret = dumpfile_add_region(&dump, "rom", 0, BENCH_DUMPFILE_LENGTH);
+  if (!ret) ret = dumpfile_save(&dump, path, data);
+  dumpfile_free(&dump);
+  return !ret;
+}
+
+// something like a ROM: code from a small set of instructions, smooth 16 bit tables and 0xFF padding
+static void bench_dumpfile_rom(uint8_t* rom)
+{
+  uint16_t instructions[256];
+  for (int i = 0; i < 256; i++) instructions[i] = (uint16_t)rand();
+  for (uint32_t i = 0; i < 0x40000; i += 2) {
+    uint16_t instruction = instructions[rand() % 256 & rand() % 256];
+    memcpy(rom + i, &instruction, 2);
+  }
+  for (uint32_t i = 0x40000; i < 0x60000; i += 2) {
+    uint16_t cell = (uint16_t)(((i >> 5) & 0x7ff) * 16 + (i & 31) * 8 + rand() % 4);
+    memcpy(rom + i, &cell, 2);
+  }
+  memset(rom + 0x60000, 0xff, BENCH_DUMPFILE_LENGTH - 0x60000);
+}
+
+static bool bench_dumpfile_setup(bench_dumpfile_t* bench)
+{
+  bench->a = (uint8_t*)malloc(BENCH_DUMPFILE_LENGTH);
+  bench->b = (uint8_t*)malloc(BENCH_DUMPFILE_LENGTH);
+  bench->rom = (uint8_t*)malloc(BENCH_DUMPFILE_LENGTH);
+  if (!bench->a || !bench->b || !bench->rom) return false;
+  srand(1);
+  for (uint32_t i = 0; i < BENCH_DUMPFILE_LENGTH; i++) bench->a[i] = (uint8_t)rand();
+  memcpy(bench->b, bench->a, BENCH_DUMPFILE_LENGTH);
+  bench->b[0x20000]++;
+  bench->b[0x68aec]++;
+  bench_dumpfile_rom(bench->rom);
+  bench->compressedLength = lzblock_compress(bench->rom, DUMPFILE_BLOCK, bench->compressed, sizeof(bench->compressed));
+  if (!bench_dumpfile_save(BENCH_DUMPFILE_PATH_A, bench->a, false) || !bench_dumpfile_save(BENCH_DUMPFILE_PATH_B, bench->b, false) ||
+      !bench_dumpfile_save(BENCH_DUMPFILE_PATH_Z, bench->rom, true))
+    return false;
+  if (dumpfile_open(&bench->readerA, BENCH_DUMPFILE_PATH_A)) return false;
+  if (dumpfile_open(&bench->readerB, BENCH_DUMPFILE_PATH_B)) {
+    dumpfile_close(&bench->readerA);
+    return false;
+  }
+  if (dumpfile_open(&bench->readerZ, BENCH_DUMPFILE_PATH_Z)) {
+    dumpfile_close(&bench->readerA);
+    dumpfile_close(&bench->readerB);
+    return false;
+  }
+  return true;
+}
+
+static void bench_dumpfile_crc32c(void* ctx, uint64_t iterations)
+{
+  bench_dumpfile_t* bench = (bench_dumpfile_t*)ctx;
+  uint32_t crc = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    crc ^= crc32c(0, bench->a + (i % 128) * DUMPFILE_BLOCK, DUMPFILE_BLOCK);
+  bench_consume(&crc);
+}
+
+// what the read loop adds per dump, fed a request at a time
+static void bench_dumpfile_update(void* ctx, uint64_t iterations)
+{
+  bench_dumpfile_t* bench = (bench_dumpfile_t*)ctx;
+  dumpfile_t dump;
+  dumpfile_init(&dump, "", "", BENCH_DUMPFILE_CHUNK, false);
+  dumpfile_add_region(&dump, "rom", 0, BENCH_DUMPFILE_LENGTH);
+  for (uint64_t i = 0; i < iterations; i++) {
+    dump.received = 0;
+    for (uint32_t offset = 0; offset < BENCH_DUMPFILE_LENGTH; offset += BENCH_DUMPFILE_CHUNK)
+      dumpfile_update(&dump, bench->a + offset, BENCH_DUMPFILE_CHUNK, 0);
+    dumpfile_build_tree(dump.tree, dump.header.numBlocks);
+  }
+  bench_consume(dump.tree);
+  dumpfile_free(&dump);
+}
+
+static void bench_dumpfile_verify(void* ctx, uint64_t iterations)
+{
+  bench_dumpfile_t* bench = (bench_dumpfile_t*)ctx;
+  size_t bad = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    bad += dumpfile_verify(&bench->readerA, bench->blocks, 16);
+  bench_consume(&bad);
+}
+
+static void bench_dumpfile_diff(void* ctx, uint64_t iterations)
+{
+  bench_dumpfile_t* bench = (bench_dumpfile_t*)ctx;
+  long differ = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    differ += dumpfile_diff(&bench->readerA, &bench->readerB, bench->blocks, 16);
+  bench_consume(&differ);
+}
+
+static void bench_dumpfile_compress(void* ctx, uint64_t iterations)
+{
+  bench_dumpfile_t* bench = (bench_dumpfile_t*)ctx;
+  uint8_t out[0x1100];
+  size_t length = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    length += lzblock_compress(bench->rom + (i % 128) * DUMPFILE_BLOCK, DUMPFILE_BLOCK, out, sizeof(out));
+  bench_consume(&length);
+}
+
+static void bench_dumpfile_decompress(void* ctx, uint64_t iterations)
+{
+  bench_dumpfile_t* bench = (bench_dumpfile_t*)ctx;
+  long length = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    length += lzblock_decompress(bench->compressed, bench->compressedLength, bench->block, DUMPFILE_BLOCK);
+  bench_consume(&length);
+}
+
+// a table somewhere in a compressed dump, one block decompressed
+static void bench_dumpfile_read(void* ctx, uint64_t iterations)
+{
+  bench_dumpfile_t* bench = (bench_dumpfile_t*)ctx;
+  uint8_t table[256];
+  for (uint64_t i = 0; i < iterations; i++)
+    dumpfile_read(&bench->readerZ, (uint32_t)((i * 0x1e00) % (BENCH_DUMPFILE_LENGTH - 0x1000)), table, sizeof(table));
+  bench_consume(table);
+}
+
+// the full byte scan the tree walk replaces
+static void bench_dumpfile_scan(void* ctx, uint64_t iterations)
+{
+  bench_dumpfile_t* bench = (bench_dumpfile_t*)ctx;
+  size_t differ = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    for (uint32_t b = 0; b < BENCH_DUMPFILE_LENGTH / DUMPFILE_BLOCK; b++)
+      differ += memcmp(bench->readerA.data + b * DUMPFILE_BLOCK, bench->readerB.data + b * DUMPFILE_BLOCK, DUMPFILE_BLOCK) != 0;
+  }
+  bench_consume(&differ);
+}
+
+void bench_dumpfile()
+{
+  bench_dumpfile_t* bench = (bench_dumpfile_t*)calloc(1, sizeof(bench_dumpfile_t));
+  if (!bench) return;
+  if (bench_dumpfile_setup(bench)) {
+    bench_run_bytes(crc32c_hardware() ? "crc32c 4KB, sse4.2" : "crc32c 4KB, tables", bench_dumpfile_crc32c, bench, DUMPFILE_BLOCK);
+    bench_run_bytes("dumpfile hash 512KB in 256B chunks", bench_dumpfile_update, bench, BENCH_DUMPFILE_LENGTH);
+    bench_run_bytes("dumpfile verify 512KB", bench_dumpfile_verify, bench, BENCH_DUMPFILE_LENGTH);
+    bench_run("dumpfile diff 512KB, tree walk", bench_dumpfile_diff, bench);
+    bench_run("dumpfile diff 512KB, memcmp", bench_dumpfile_scan, bench);
+    bench_run_bytes("lzblock compress 4KB of ROM", bench_dumpfile_compress, bench, DUMPFILE_BLOCK);
+    bench_run_bytes("lzblock decompress 4KB of ROM", bench_dumpfile_decompress, bench, DUMPFILE_BLOCK);
+    bench_run("dumpfile read 256B, compressed", bench_dumpfile_read, bench);
+    dumpfile_close(&bench->readerA);
+    dumpfile_close(&bench->readerB);
+    dumpfile_close(&bench->readerZ);
+  }
+  remove(BENCH_DUMPFILE_PATH_A);
+  remove(BENCH_DUMPFILE_PATH_B);
+  remove(BENCH_DUMPFILE_PATH_Z);
+  free(bench->rom);
+  free(bench->a);
+  free(bench->b);
+  free(bench);
+}
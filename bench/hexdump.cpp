@@ -0,0 +1,113 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "bench.h"
+#include "hexdump.h"
+
+// one ROM page per operation, the rows are what matters, not the image size
+static const size_t BENCH_HEXDUMP_LENGTH = 4096;
+
+typedef struct Bench_Hexdump {
+  FILE*    out;
+  uint8_t  data[BENCH_HEXDUMP_LENGTH];
+  uint8_t  compare[BENCH_HEXDUMP_LENGTH];
+} bench_hexdump_t;
+
+// hexdump() as it was before hexdump_write, kept for comparison
+static void bench_hexdump_legacy_dump(FILE* out, void* ptr, size_t buflen)
+{
+  unsigned char* buf = (unsigned char*)ptr;
+  size_t i, j;
+  for (i = 0; i < buflen; i += 16) {
+    fprintf(out, "%06lx: ", i);
+    for (j = 0; j < 16; j++)
+      if (i + j < buflen)
+        fprintf(out, "%02x ", buf[i + j]);
+      else
+        fprintf(out, "   ");
+    fprintf(out, " ");
+    for (j = 0; j < 16; j++)
+      if (i + j < buflen)
+        fprintf(out, "%c", isprint(buf[i + j]) ? buf[i + j] : '.');
+    fprintf(out, "\n");
+  }
+}
+
+static void bench_hexdump_legacy(void* ctx, uint64_t iterations)
+{
+  bench_hexdump_t* bench = (bench_hexdump_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++)
+    bench_hexdump_legacy_dump(bench->out, bench->data, sizeof(bench->data));
+}
+
+static void bench_hexdump_write(void* ctx, uint64_t iterations)
+{
+  bench_hexdump_t* bench = (bench_hexdump_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++)
+    hexdump_write(bench->out, bench->data, sizeof(bench->data), NULL);
+}
+
+static void bench_hexdump_wide(void* ctx, uint64_t iterations)
+{
+  bench_hexdump_t* bench = (bench_hexdump_t*)ctx;
+  hexdump_options_t options = { 0, 32, 0, NULL, false, false, false };
+  for (uint64_t i = 0; i < iterations; i++)
+    hexdump_write(bench->out, bench->data, sizeof(bench->data), &options);
+}
+
+static void bench_hexdump_diff(void* ctx, uint64_t iterations)
+{
+  bench_hexdump_t* bench = (bench_hexdump_t*)ctx;
+  hexdump_options_t options = { 0, 0, 0, bench->compare, true, false, false };
+  for (uint64_t i = 0; i < iterations; i++)
+    hexdump_write(bench->out, bench->data, sizeof(bench->data), &options);
+}
+
+static void bench_hexdump_frame(void* ctx, uint64_t iterations)
+{
+  bench_hexdump_t* bench = (bench_hexdump_t*)ctx;
+  char line[64 * 3];
+  for (uint64_t i = 0; i < iterations; i++) {
+    hexdump_hex(line, bench->data + (i & 0xff), 64, true);
+    bench_consume(line);
+  }
+}
+
+void bench_hexdump()
+{
+  bench_hexdump_t* bench = (bench_hexdump_t*)malloc(sizeof(bench_hexdump_t));
+  bench->out = fopen("/dev/null", "wb");
+  for (size_t i = 0; i < BENCH_HEXDUMP_LENGTH; i++)
+    bench->data[i] = (uint8_t)(i * 7 + (i >> 8));
+  memcpy(bench->compare, bench->data, BENCH_HEXDUMP_LENGTH);
+  // a calibration change every few hundred bytes
+  for (size_t i = 0; i < BENCH_HEXDUMP_LENGTH; i += 300)
+    bench->compare[i] ^= 0x5a;
+
+  bench_run_bytes("hexdump 4K (legacy printf)", bench_hexdump_legacy, bench, BENCH_HEXDUMP_LENGTH);
+  bench_run_bytes("hexdump 4K", bench_hexdump_write, bench, BENCH_HEXDUMP_LENGTH);
+  bench_run_bytes("hexdump 4K (32 wide)", bench_hexdump_wide, bench, BENCH_HEXDUMP_LENGTH);
+  bench_run_bytes("hexdump 4K (diff only)", bench_hexdump_diff, bench, BENCH_HEXDUMP_LENGTH);
+  bench_run("hexdump_hex 64 bytes", bench_hexdump_frame, bench);
+
+  fclose(bench->out);
+  free(bench);
+}
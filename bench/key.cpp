@@ -0,0 +1,50 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+
+#include "bench.h"
+#include "librx8.h"
+
+static void bench_key_legacy(void* ctx, uint64_t iterations)
+{
+  (void)ctx;
+  uint8_t seed[SEED_LENGTH] = { 0x12, 0x34, 0x56 };
+  uint8_t* key = NULL;
+  for (uint64_t i = 0; i < iterations; i++) {
+    seed[2] = (uint8_t)i;
+    RX8::calculateKey(seed, &key);
+    bench_consume(key);
+    free(key);
+  }
+}
+
+static void bench_key_span(void* ctx, uint64_t iterations)
+{
+  (void)ctx;
+  rx8_seed_t seed = { { 0x12, 0x34, 0x56 } };
+  for (uint64_t i = 0; i < iterations; i++) {
+    seed[2] = (uint8_t)i;
+    rx8_key_t key = RX8::calculateKey(seed);
+    bench_consume(&key);
+  }
+}
+
+void bench_key()
+{
+  bench_run("calculateKey (malloc)", bench_key_legacy, NULL);
+  bench_run("calculateKey", bench_key_span, NULL);
+}
@@ -0,0 +1,69 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "log.h"
+
+static const char* TAG = "Bench";
+
+// LOGI as it was before the log queue, kept for comparison
+#define BENCH_LEGACY_LOGI(TAG, ...) do { fprintf(stderr, "[" "\x1b[36m"); fprintf(stderr, TAG); fprintf(stderr, "\x1b[0m" "] "); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\r\n"); fflush(stderr); } while(0)
+
+static void bench_log_legacy(void* ctx, uint64_t iterations)
+{
+  (void)ctx;
+  for (uint64_t i = 0; i < iterations; i++)
+    BENCH_LEGACY_LOGI(TAG, "read 0x%08X %u bytes", (uint32_t)i * 0x100, 0x100);
+}
+
+static void bench_log(void* ctx, uint64_t iterations)
+{
+  (void)ctx;
+  for (uint64_t i = 0; i < iterations; i++)
+    LOGI(TAG, "read 0x%08X %u bytes", (uint32_t)i * 0x100, 0x100);
+}
+
+static void bench_log_filtered(void* ctx, uint64_t iterations)
+{
+  (void)ctx;
+  for (uint64_t i = 0; i < iterations; i++)
+    LOGD(TAG, "read 0x%08X %u bytes", (uint32_t)i * 0x100, 0x100);
+}
+
+void bench_log()
+{
+  // the lines themselves are not interesting, only what they cost the caller
+  int saved = dup(STDERR_FILENO);
+  int devnull = open("/dev/null", O_WRONLY);
+  fflush(stderr);
+  dup2(devnull, STDERR_FILENO);
+
+  bench_run("LOGI (legacy fprintf)", bench_log_legacy, NULL);
+  bench_run("LOGI (synchronous)", bench_log, NULL);
+  log_start();
+  bench_run("LOGI (queued)", bench_log, NULL);
+  bench_run("LOGD (filtered out)", bench_log_filtered, NULL);
+  log_stop();
+
+  fflush(stderr);
+  dup2(saved, STDERR_FILENO);
+  close(devnull);
+  close(saved);
+}
@@ -0,0 +1,158 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <thread>
+
+#include "bench.h"
+#include "loganalyze.h"
+
+// about a minute of logging at 50Hz, repeated so it's big enough to split
+static const size_t BENCH_LOGANALYZE_ROWS   = 131072;
+static const size_t BENCH_LOGANALYZE_TABLES = 64;
+static const char*  BENCH_LOGANALYZE_PATH   = "ecudump-bench-log.csv";
+
+typedef struct Bench_Loganalyze {
+  celltrace_t trace;   // 64 tables over rpm/load with knock and AFR error averaged
+  celltrace_t parse;   // one 2D table, mostly parsing
+  char* path;
+  uint64_t bytes;
+  unsigned threads;
+} bench_loganalyze_t;
+
+static void bench_loganalyze_channel(celltrace_t* trace, const char* name, const char* column, float min, float max)
+{
+  celltrace_channel_t channel;
+  memset(&channel, 0, sizeof(channel));
+  snprintf(channel.name, sizeof(channel.name), "%s", name);
+  snprintf(channel.column, sizeof(channel.column), "%s", column);
+  channel.source = CELLTRACE_SOURCE_COLUMN;
+  channel.scale  = 1;
+  channel.min    = min;
+  channel.max    = max;
+  celltrace_add_channel(trace, &channel);
+}
+
+static void bench_loganalyze_setup(bench_loganalyze_t* bench)
+{
+  float x[16], y[16];
+  char name[32];
+
+  celltrace_init(&bench->trace);
+  bench_loganalyze_channel(&bench->trace, "rpm", "Engine Speed (rpm)", 0, 8000);
+  bench_loganalyze_channel(&bench->trace, "load", "Engine Load (g/rev)", 0, 2);
+  bench_loganalyze_channel(&bench->trace, "afr", "AFR", 10, 18);
+  bench_loganalyze_channel(&bench->trace, "target", "Target AFR", 10, 18);
+  bench_loganalyze_channel(&bench->trace, "knock", "Knock Retard", 0, 10);
+  celltrace_channel_t error;
+  memset(&error, 0, sizeof(error));
+  strcpy(error.name, "afrerror");
+  error.source     = CELLTRACE_SOURCE_DIFFERENCE;
+  error.minuend    = 2;
+  error.subtrahend = 3;
+  celltrace_add_channel(&bench->trace, &error);
+
+  static const int averages[2] = { 4, 5 };
+  for (size_t t = 0; t < BENCH_LOGANALYZE_TABLES; t++) {
+    for (int i = 0; i < 16; i++) {
+      x[i] = 500.0f + (float)(t % 6) * 100 + (float)i * 450;
+      y[i] = 0.1f + (float)(t % 5) * 0.05f + (float)i * 0.12f;
+    }
+    snprintf(name, sizeof(name), "3D %zu", t);
+    celltrace_add_table(&bench->trace, name, x, 16, 0, y, 16, 1, averages, 2);
+  }
+
+  celltrace_init(&bench->parse);
+  bench_loganalyze_channel(&bench->parse, "rpm", "Engine Speed (rpm)", 0, 8000);
+  for (int i = 0; i < 16; i++) y[i] = (float)i * 500;
+  celltrace_add_table(&bench->parse, "2D", NULL, 1, -1, y, 16, 0, NULL, 0);
+
+  FILE* file = fopen(BENCH_LOGANALYZE_PATH, "w");
+  if (!file) return;
+  fprintf(file, "Time (sec),Engine Speed (rpm),Engine Load (g/rev),Coolant Temp (C),AFR,Target AFR,Knock Retard,Throttle (%%)\n");
+  srand(1);
+  for (size_t i = 0; i < BENCH_LOGANALYZE_ROWS; i++) {
+    double rpm = 4000 + 3200 * sin((double)i / 700), load = 1 + 0.8 * cos((double)i / 450);
+    fprintf(file, "%.3f,%.0f,%.3f,%d,%.2f,%.2f,%.1f,%.1f\n", (double)i * 0.02, rpm, load, 85 + rand() % 10,
+      11.5 + (double)(rand() % 400) / 100, 12.5, rand() % 16 ? 0.0 : 1.4, (double)(rand() % 1000) / 10);
+  }
+  bench->bytes = (uint64_t)ftell(file);
+  fclose(file);
+  bench->path = (char*)BENCH_LOGANALYZE_PATH;
+  bench->threads = std::thread::hardware_concurrency();
+}
+
+static void bench_loganalyze_one(bench_loganalyze_t* bench, celltrace_t* trace, unsigned threads, uint64_t iterations)
+{
+  loganalyze_stats_t stats;
+  for (uint64_t i = 0; i < iterations; i++)
+    loganalyze_run(trace, &bench->path, 1, threads, &stats);
+  bench_consume(trace->tables[0].hits);
+}
+
+static void bench_loganalyze_parse(void* ctx, uint64_t iterations)
+{
+  bench_loganalyze_t* bench = (bench_loganalyze_t*)ctx;
+  bench_loganalyze_one(bench, &bench->parse, 1, iterations);
+}
+
+static void bench_loganalyze_tables(void* ctx, uint64_t iterations)
+{
+  bench_loganalyze_t* bench = (bench_loganalyze_t*)ctx;
+  bench_loganalyze_one(bench, &bench->trace, 1, iterations);
+}
+
+static void bench_loganalyze_threads(void* ctx, uint64_t iterations)
+{
+  bench_loganalyze_t* bench = (bench_loganalyze_t*)ctx;
+  bench_loganalyze_one(bench, &bench->trace, bench->threads, iterations);
+}
+
+static void bench_loganalyze_float(void* ctx, uint64_t iterations)
+{
+  (void)ctx;
+  static const char* fields[4] = { "6543", "1.234", "-0.75", "14.70" };
+  float sum = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    const char* field = fields[i & 3];
+    sum += loganalyze_parse_float(field, field + strlen(field));
+  }
+  bench_consume(&sum);
+}
+
+void bench_loganalyze()
+{
+  bench_loganalyze_t* bench = (bench_loganalyze_t*)calloc(1, sizeof(bench_loganalyze_t));
+  if (!bench) return;
+  bench_loganalyze_setup(bench);
+
+  bench_run("loganalyze parse float", bench_loganalyze_float, bench);
+  if (bench->path) {
+    // one log of 128k rows per op
+    bench_run_bytes("loganalyze 1 2D table", bench_loganalyze_parse, bench, bench->bytes);
+    bench_run_bytes("loganalyze 64 tables", bench_loganalyze_tables, bench, bench->bytes);
+    bench_run_bytes("loganalyze 64 tables, all cores", bench_loganalyze_threads, bench, bench->bytes);
+    remove(BENCH_LOGANALYZE_PATH);
+  }
+
+  celltrace_free(&bench->trace);
+  celltrace_free(&bench->parse);
+  free(bench);
+}
@@ -0,0 +1,64 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "metrics.h"
+#include "UDS.h"
+#include "util.h"
+
+// everything uds_request_send records for a single frame readMem, clock reads included
+static void bench_metrics_transaction(void* ctx, uint64_t iterations)
+{
+  metrics_t* metrics = (metrics_t*)ctx;
+  uint64_t last = monotonic_us();
+  for (uint64_t i = 0; i < iterations; i++) {
+    uint64_t start = monotonic_us();
+    uint64_t sent = monotonic_us();
+    uint64_t read = monotonic_us();
+    metrics_poll();
+    metrics_phase(metrics, METRICS_PHASE_HOST, start - last);
+    metrics_count(metrics, METRICS_REQUESTS, 1);
+    metrics_count(metrics, METRICS_BYTES_TX, 7);
+    metrics_phase(metrics, METRICS_PHASE_WRITE, sent - start);
+    metrics_phase(metrics, METRICS_PHASE_READ, read - sent);
+    metrics_phase(metrics, METRICS_PHASE_FIRST_FRAME, read - sent);
+    metrics_service(metrics, UDS_SID_READ_MEMORY_BY_ADDRESS, read - sent);
+    metrics_count(metrics, METRICS_RESPONSES, 1);
+    metrics_count(metrics, METRICS_BYTES_RX, 257);
+    last = read;
+  }
+}
+
+static void bench_metrics_record(void* ctx, uint64_t iterations)
+{
+  metrics_t* metrics = (metrics_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++)
+    metrics_phase(metrics, METRICS_PHASE_READ, (i * 2654435761u) & 0xfffff);
+}
+
+void bench_metrics()
+{
+  metrics_t* metrics = new metrics_t;
+  metrics_init(metrics);
+
+  bench_run("metrics_histogram_record", bench_metrics_record, metrics);
+  bench_run("metrics per transaction", bench_metrics_transaction, metrics);
+
+  metrics_deinit(metrics);
+  delete metrics;
+}
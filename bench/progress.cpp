@@ -0,0 +1,89 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "progressbar.h"
+
+typedef struct Bench_Progress {
+  FILE* out;
+  progress_t* progress;
+  size_t charsCurrent;
+} bench_progress_t;
+
+// printProgress as it was before the reporter thread, writing to `out` instead of stdout
+static void bench_progress_legacy_print(bench_progress_t* bench, const size_t amount, const size_t total)
+{
+  size_t charsNeeded;
+  size_t charsTotal = (isatty(fileno(bench->out)) ? 34 : 40);
+
+  if (bench->charsCurrent != charsTotal) {
+    float pct = (total ? (((float) amount) / total) : 1.0);
+    charsNeeded = (charsTotal * pct) + 0.5;
+    while (charsNeeded > bench->charsCurrent) {
+      if (isatty (fileno(bench->out))) {
+        size_t i;
+        for (i = 0; i < bench->charsCurrent; i++)
+          fputc('#', bench->out);
+        for (; i < charsTotal; i++)
+          fputc(' ', bench->out);
+        fprintf(bench->out, "(%3d%%)", (int)((100 * pct) + 0.5));
+        for (i = 0; i < (charsTotal + 6); i++)
+          fputc('\b', bench->out);
+      } else {
+        fprintf(bench->out, "#");
+      }
+      bench->charsCurrent++;
+    }
+    fflush(bench->out);
+  }
+}
+
+static void bench_progress_legacy(void* ctx, uint64_t iterations)
+{
+  bench_progress_t* bench = (bench_progress_t*)ctx;
+  bench->charsCurrent = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    bench_progress_legacy_print(bench, (size_t)i * 0x100, (size_t)iterations * 0x100);
+}
+
+static void bench_progress(void* ctx, uint64_t iterations)
+{
+  bench_progress_t* bench = (bench_progress_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++)
+    progress_chunk(bench->progress, 0x100, 11000 + (i & 0x3ff));
+}
+
+void bench_progress()
+{
+  bench_progress_t bench;
+  bench.out = fopen("/dev/null", "w");
+  bench.progress = new progress_t;
+  if (!bench.out) return;
+
+  bench_run("printProgress per chunk (legacy)", bench_progress_legacy, &bench);
+
+  // the reporter thread is running and rendering while the chunks are counted
+  progress_init(bench.progress, bench.out, PROGRESS_MAX_RATE_HZ);
+  progress_start(bench.progress, "bench", UINT64_MAX);
+  bench_run("progress_chunk", bench_progress, &bench);
+  progress_finish(bench.progress);
+
+  delete bench.progress;
+  fclose(bench.out);
+}
@@ -0,0 +1,115 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "ramvideo.h"
+
+static const char*    BENCH_RAMVIDEO_PATH   = "ecudump-bench-ram.rv";
+static const uint32_t BENCH_RAMVIDEO_LENGTH = 0x7D00;
+static const size_t   BENCH_RAMVIDEO_FRAMES = 256;
+
+typedef struct Bench_Ramvideo {
+  uint8_t* frames[BENCH_RAMVIDEO_FRAMES];
+  uint8_t* encoded;
+  size_t   encodedLength[BENCH_RAMVIDEO_FRAMES];
+  uint8_t* frame;
+  ramvideo_t video;
+} bench_ramvideo_t;
+
+// RAM that mostly sits still: a few hundred scattered variables and a busy stack at the top change every frame
+static bool bench_ramvideo_setup(bench_ramvideo_t* bench)
+{
+  srand(1);
+  for (size_t f = 0; f < BENCH_RAMVIDEO_FRAMES; f++) {
+    if (!(bench->frames[f] = (uint8_t*)malloc(BENCH_RAMVIDEO_LENGTH))) return false;
+    if (!f) {
+      for (uint32_t i = 0; i < BENCH_RAMVIDEO_LENGTH; i++) bench->frames[0][i] = (uint8_t)(rand() & rand());
+      continue;
+    }
+    memcpy(bench->frames[f], bench->frames[f - 1], BENCH_RAMVIDEO_LENGTH);
+    for (int v = 0; v < 300; v++) bench->frames[f][rand() % BENCH_RAMVIDEO_LENGTH]++;
+    for (uint32_t i = BENCH_RAMVIDEO_LENGTH - 0x200; i < BENCH_RAMVIDEO_LENGTH; i++)
+      if (rand() % 4 == 0) bench->frames[f][i] = (uint8_t)rand();
+  }
+  bench->encoded = (uint8_t*)malloc(ramvideo_encoded_bound(BENCH_RAMVIDEO_LENGTH));
+  bench->frame   = (uint8_t*)malloc(BENCH_RAMVIDEO_LENGTH);
+  if (!bench->encoded || !bench->frame) return false;
+  bench->encodedLength[1] = ramvideo_encode(bench->frames[0], bench->frames[1], BENCH_RAMVIDEO_LENGTH, bench->encoded);
+
+  if (ramvideo_create(&bench->video, BENCH_RAMVIDEO_PATH, 0xffff6000, BENCH_RAMVIDEO_LENGTH)) return false;
+  for (size_t f = 0; f < BENCH_RAMVIDEO_FRAMES; f++)
+    if (ramvideo_append(&bench->video, bench->frames[f], f * 20000)) return false;
+  return !ramvideo_close(&bench->video) && !ramvideo_open(&bench->video, BENCH_RAMVIDEO_PATH);
+}
+
+static void bench_ramvideo_encode(void* ctx, uint64_t iterations)
+{
+  bench_ramvideo_t* bench = (bench_ramvideo_t*)ctx;
+  size_t length = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    length += ramvideo_encode(bench->frames[0], bench->frames[1], BENCH_RAMVIDEO_LENGTH, bench->encoded);
+  bench_consume(&length);
+}
+
+static void bench_ramvideo_encode_still(void* ctx, uint64_t iterations)
+{
+  bench_ramvideo_t* bench = (bench_ramvideo_t*)ctx;
+  size_t length = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    length += ramvideo_encode(bench->frames[0], bench->frames[0], BENCH_RAMVIDEO_LENGTH, bench->encoded);
+  bench_consume(&length);
+}
+
+static void bench_ramvideo_decode(void* ctx, uint64_t iterations)
+{
+  bench_ramvideo_t* bench = (bench_ramvideo_t*)ctx;
+  memcpy(bench->frame, bench->frames[0], BENCH_RAMVIDEO_LENGTH);
+  // the XOR undoes itself every second iteration
+  for (uint64_t i = 0; i < iterations; i++)
+    ramvideo_decode(bench->frame, BENCH_RAMVIDEO_LENGTH, bench->encoded, bench->encodedLength[1]);
+  bench_consume(bench->frame);
+}
+
+// the worst case decodes a keyframe and 63 deltas
+static void bench_ramvideo_seek(void* ctx, uint64_t iterations)
+{
+  bench_ramvideo_t* bench = (bench_ramvideo_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++)
+    ramvideo_seek(&bench->video, (i * 97) % BENCH_RAMVIDEO_FRAMES);
+  bench_consume(bench->video.frame);
+}
+
+void bench_ramvideo()
+{
+  bench_ramvideo_t* bench = (bench_ramvideo_t*)calloc(1, sizeof(bench_ramvideo_t));
+  if (!bench) return;
+  if (bench_ramvideo_setup(bench)) {
+    bench_run_bytes("ramvideo encode 0x7D00", bench_ramvideo_encode, bench, BENCH_RAMVIDEO_LENGTH);
+    bench_run_bytes("ramvideo encode 0x7D00 unchanged", bench_ramvideo_encode_still, bench, BENCH_RAMVIDEO_LENGTH);
+    bench_run_bytes("ramvideo decode 0x7D00", bench_ramvideo_decode, bench, BENCH_RAMVIDEO_LENGTH);
+    bench_run("ramvideo seek random frame", bench_ramvideo_seek, bench);
+  }
+  ramvideo_close(&bench->video);
+  remove(BENCH_RAMVIDEO_PATH);
+  for (size_t f = 0; f < BENCH_RAMVIDEO_FRAMES; f++) free(bench->frames[f]);
+  free(bench->encoded);
+  free(bench->frame);
+  free(bench);
+}
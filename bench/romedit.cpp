@@ -0,0 +1,125 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "romedit.h"
+
+static const char*  BENCH_ROMEDIT_PATH   = "ecudump-bench-rom.bin";
+static const size_t BENCH_ROMEDIT_LENGTH = 0x80000;
+
+typedef struct Bench_Romedit {
+  romedit_t edit;
+  definition_table_t table;   // a 16x16 uint16 map
+  float values[16 * 16];
+} bench_romedit_t;
+
+static void bench_romedit_put_be32(uint8_t* p, uint32_t value)
+{
+  p[0] = (uint8_t)(value >> 24);
+  p[1] = (uint8_t)(value >> 16);
+  p[2] = (uint8_t)(value >> 8);
+  p[3] = (uint8_t)value;
+}
+
+// random image with a subarudbw checksum table over three ranges
+static bool bench_romedit_setup(bench_romedit_t* bench)
+{
+  static const uint32_t ranges[3][2] = { { 0, 0x8000 }, { 0x8000, 0x60000 }, { 0x60000, 0x7fb80 } };
+  uint8_t* rom = (uint8_t*)malloc(BENCH_ROMEDIT_LENGTH);
+  if (!rom) return false;
+  srand(1);
+  for (size_t i = 0; i < BENCH_ROMEDIT_LENGTH; i++) rom[i] = (uint8_t)rand();
+
+  uint8_t* table = rom + BENCH_ROMEDIT_LENGTH - ROMEDIT_CHECKSUM_TABLE;
+  memset(table, 0, ROMEDIT_CHECKSUM_TABLE);
+  for (size_t c = 0; c < 3; c++) {
+    uint32_t sum = 0;
+    for (uint32_t a = ranges[c][0]; a < ranges[c][1]; a += 4)
+      sum += (uint32_t)rom[a] << 24 | (uint32_t)rom[a + 1] << 16 | (uint32_t)rom[a + 2] << 8 | rom[a + 3];
+    bench_romedit_put_be32(table + c * 12, ranges[c][0]);
+    bench_romedit_put_be32(table + c * 12 + 4, ranges[c][1]);
+    bench_romedit_put_be32(table + c * 12 + 8, ROMEDIT_CHECKSUM_MAGIC - sum);
+  }
+  bench_romedit_put_be32(table + 3 * 12 + 8, ROMEDIT_CHECKSUM_MAGIC);
+
+  FILE* file = fopen(BENCH_ROMEDIT_PATH, "wb");
+  bool written = file && fwrite(rom, 1, BENCH_ROMEDIT_LENGTH, file) == BENCH_ROMEDIT_LENGTH;
+  if (file) fclose(file);
+  free(rom);
+  if (!written || romedit_open(&bench->edit, BENCH_ROMEDIT_PATH)) return false;
+
+  definition_table_t* t = &bench->table;
+  strcpy(t->name, "bench");
+  t->dimensions = 3;
+  t->storage    = DEFINITION_STORAGE_UINT16;
+  t->bigEndian  = true;
+  t->address    = 0x6c000;
+  t->sizeX      = 16;
+  t->sizeY      = 16;
+  t->scaling    = definition_scaling_t{ "", "x*0.01", "x/0.01", "", 0.01f, 0, true, "" };
+  for (size_t i = 0; i < 16 * 16; i++) bench->values[i] = (float)(i % 200) + 0.5f;
+  return true;
+}
+
+// a whole 16x16 map, checksums fixed as it goes, then put back
+static void bench_romedit_table(void* ctx, uint64_t iterations)
+{
+  bench_romedit_t* bench = (bench_romedit_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++) {
+    for (uint16_t row = 0; row < 16; row++)
+      romedit_set_cells(&bench->edit, &bench->table, row, 0, bench->values + row * 16, 16);
+    romedit_discard(&bench->edit);
+  }
+}
+
+// one cell, the smallest revision
+static void bench_romedit_cell(void* ctx, uint64_t iterations)
+{
+  bench_romedit_t* bench = (bench_romedit_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++) {
+    float value = (float)(i & 127);
+    romedit_set_cells(&bench->edit, &bench->table, 3, 5, &value, 1);
+    romedit_discard(&bench->edit);
+  }
+}
+
+// what fixing checksums costs without the incremental sums
+static void bench_romedit_verify(void* ctx, uint64_t iterations)
+{
+  bench_romedit_t* bench = (bench_romedit_t*)ctx;
+  bool valid = true;
+  for (uint64_t i = 0; i < iterations; i++)
+    valid &= romedit_verify_checksums(&bench->edit);
+  bench_consume(&valid);
+}
+
+void bench_romedit()
+{
+  bench_romedit_t* bench = (bench_romedit_t*)calloc(1, sizeof(bench_romedit_t));
+  if (!bench) return;
+  if (bench_romedit_setup(bench)) {
+    bench_run("romedit 1 cell", bench_romedit_cell, bench);
+    bench_run("romedit 16x16 table", bench_romedit_table, bench);
+    bench_run_bytes("romedit full checksum pass", bench_romedit_verify, bench, BENCH_ROMEDIT_LENGTH);
+    romedit_close(&bench->edit);
+  }
+  remove(BENCH_ROMEDIT_PATH);
+  free(bench);
+}
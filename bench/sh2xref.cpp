@@ -0,0 +1,149 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "sh2xref.h"
+
+// about the code of an RX8 ROM, a function every 64 bytes with its own literal pool
+static const size_t BENCH_SH2XREF_ROM      = 1024 * 1024;
+static const size_t BENCH_SH2XREF_FUNCTION = 64;
+static const char*  BENCH_SH2XREF_FILE     = "ecudump-bench-sh2xref.xref";
+
+typedef struct Bench_Sh2xref {
+  uint8_t* rom;
+  sh2xref_t index;
+} bench_sh2xref_t;
+
+static void bench_sh2xref_be16(uint8_t* p, uint32_t value)
+{
+  p[0] = (uint8_t)(value >> 8);
+  p[1] = (uint8_t)value;
+}
+
+static void bench_sh2xref_be32(uint8_t* p, uint32_t value)
+{
+  bench_sh2xref_be16(p, value >> 16);
+  bench_sh2xref_be16(p + 2, value);
+}
+
+/*
+ * Each function loads a RAM address, a table and another function from its pool, calls
+ * that one, calls its neighbour with bsr and returns:
+ *   mov.l @(pool),r1  mov.l @(pool+4),r4  mov.w @(pool+8),r2  jsr @r2  nop
+ *   mova @(pool+12),r0  bsr next  nop  rts  nop
+ *   ... nops ...
+ *   pool: RAM address, table address, function (word), padding, mova target
+ */
+static void bench_sh2xref_setup(bench_sh2xref_t* bench)
+{
+  uint8_t* rom = bench->rom;
+  srand(1);
+  memset(rom, 0xff, SH2XREF_VECTORS);
+  bench_sh2xref_be32(rom, (uint32_t)SH2XREF_VECTORS);
+  for (size_t f = SH2XREF_VECTORS; f + BENCH_SH2XREF_FUNCTION <= BENCH_SH2XREF_ROM; f += BENCH_SH2XREF_FUNCTION) {
+    uint8_t* p = rom + f;
+    size_t pool = f + BENCH_SH2XREF_FUNCTION - 16;
+    uint32_t callee = (uint32_t)(SH2XREF_VECTORS + (rand() % 0x7000) * BENCH_SH2XREF_FUNCTION);
+    for (size_t i = 0; i < BENCH_SH2XREF_FUNCTION - 16; i += 2)
+      bench_sh2xref_be16(p + i, 0x0009);
+    bench_sh2xref_be16(p + 0,  0xD100 | (uint32_t)((pool - (f + 4)) / 4));
+    bench_sh2xref_be16(p + 2,  0xD400 | (uint32_t)((pool + 4 - (f + 4)) / 4));
+    bench_sh2xref_be16(p + 4,  0x9200 | (uint32_t)((pool + 8 - (f + 8)) / 2));
+    bench_sh2xref_be16(p + 6,  0x420B);
+    bench_sh2xref_be16(p + 10, 0xC700 | (uint32_t)((pool + 12 - (f + 12)) / 4));
+    bench_sh2xref_be16(p + 12, 0xB000 | (uint32_t)((BENCH_SH2XREF_FUNCTION - 16) / 2));
+    bench_sh2xref_be16(p + 16, 0x000B);
+    bench_sh2xref_be32(rom + pool,      0xffff8000u + (uint32_t)(rand() % 0x4000) * 2);
+    bench_sh2xref_be32(rom + pool + 4,  0x60000u + (uint32_t)(rand() % 0x400) * 0x40);
+    bench_sh2xref_be16(rom + pool + 8,  callee < 0x8000 ? callee : 0x0400);
+    bench_sh2xref_be16(rom + pool + 10, 0x0009);
+    bench_sh2xref_be32(rom + pool + 12, 0x0009000B);
+  }
+}
+
+static void bench_sh2xref_build(void* ctx, uint64_t iterations, unsigned threads)
+{
+  bench_sh2xref_t* bench = (bench_sh2xref_t*)ctx;
+  sh2xref_stats_t stats;
+  for (uint64_t i = 0; i < iterations; i++) {
+    sh2xref_t index;
+    if (sh2xref_build(&index, bench->rom, BENCH_SH2XREF_ROM, threads, &stats)) return;
+    bench_consume(&index.numRefs);
+    sh2xref_free(&index);
+  }
+}
+
+static void bench_sh2xref_single(void* ctx, uint64_t iterations)
+{
+  bench_sh2xref_build(ctx, iterations, 1);
+}
+
+static void bench_sh2xref_threads(void* ctx, uint64_t iterations)
+{
+  bench_sh2xref_build(ctx, iterations, 0);
+}
+
+static void bench_sh2xref_cached(void* ctx, uint64_t iterations)
+{
+  (void)ctx;
+  for (uint64_t i = 0; i < iterations; i++) {
+    sh2xref_t index;
+    if (sh2xref_open(&index, BENCH_SH2XREF_FILE)) return;
+    bench_consume(&index.numRefs);
+    sh2xref_free(&index);
+  }
+}
+
+// who refers to each of the 1024 tables
+static void bench_sh2xref_find(void* ctx, uint64_t iterations)
+{
+  bench_sh2xref_t* bench = (bench_sh2xref_t*)ctx;
+  size_t found = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    for (uint32_t t = 0; t < 0x400; t++) {
+      const sh2xref_ref_t* refs;
+      size_t count = sh2xref_find(&bench->index, 0x60000u + t * 0x40, 0x60000u + t * 0x40 + 1, &refs);
+      for (size_t r = 0; r < count; r++)
+        found += refs[r].function != SH2XREF_NO_FUNCTION;
+    }
+  }
+  bench_consume(&found);
+}
+
+void bench_sh2xref()
+{
+  bench_sh2xref_t bench;
+  sh2xref_stats_t stats;
+  memset(&bench, 0, sizeof(bench));
+  bench.rom = (uint8_t*)malloc(BENCH_SH2XREF_ROM);
+  if (!bench.rom) return;
+  bench_sh2xref_setup(&bench);
+
+  bench_run_bytes("sh2xref 1 MB ROM, 1 thread", bench_sh2xref_single, &bench, BENCH_SH2XREF_ROM);
+  bench_run_bytes("sh2xref 1 MB ROM, all cores", bench_sh2xref_threads, &bench, BENCH_SH2XREF_ROM);
+  if (!sh2xref_build(&bench.index, bench.rom, BENCH_SH2XREF_ROM, 0, &stats)) {
+    if (!sh2xref_save(&bench.index, BENCH_SH2XREF_FILE))
+      bench_run("sh2xref 1 MB ROM, from the cache", bench_sh2xref_cached, &bench);
+    bench_run("sh2xref 1024 table lookups", bench_sh2xref_find, &bench);
+    sh2xref_free(&bench.index);
+  }
+  remove(BENCH_SH2XREF_FILE);
+  free(bench.rom);
+}
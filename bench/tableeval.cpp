@@ -0,0 +1,163 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "bench.h"
+#include "tableeval.h"
+
+// about what a full definition has: dozens of 3D maps and a few 2D tables on 4 channels
+static const size_t   BENCH_TABLEEVAL_3D      = 48;
+static const size_t   BENCH_TABLEEVAL_2D      = 16;
+static const size_t   BENCH_TABLEEVAL_TABLES  = BENCH_TABLEEVAL_3D + BENCH_TABLEEVAL_2D;
+static const size_t   BENCH_TABLEEVAL_SAMPLES = 4096;
+static const uint32_t BENCH_TABLEEVAL_ROM     = 0x40000;
+
+typedef struct Bench_Tableeval {
+  uint8_t rom[BENCH_TABLEEVAL_ROM];
+  definition_table_t tables[BENCH_TABLEEVAL_TABLES];
+  tableeval_t eval;
+  tableeval_scratch_t scratch;
+  float samples[4][BENCH_TABLEEVAL_SAMPLES];
+  float outputs[BENCH_TABLEEVAL_TABLES][BENCH_TABLEEVAL_SAMPLES];
+  float axes[BENCH_TABLEEVAL_TABLES][2][16];   // decoded, for the generic lookup
+} bench_tableeval_t;
+
+static void bench_tableeval_be16(uint8_t* p, uint16_t value)
+{
+  p[0] = (uint8_t)(value >> 8);
+  p[1] = (uint8_t)value;
+}
+
+// 16 uint16 breakpoints from `low` to `high` at `address`, a little denser at the low end like real maps
+static void bench_tableeval_axis(bench_tableeval_t* bench, definition_axis_t* axis, uint32_t address, float low, float high,
+                                 float scale)
+{
+  memset(axis, 0, sizeof(*axis));
+  axis->storage   = DEFINITION_STORAGE_UINT16;
+  axis->bigEndian = true;
+  axis->address   = address;
+  axis->length    = 16;
+  axis->set       = DEFINITION_SET_TYPE;
+  axis->scaling   = definition_scaling_t{ "", "x", "x", "", scale, 0.0f, true, "" };
+  for (int i = 0; i < 16; i++) {
+    float t = (float)i / 15;
+    bench_tableeval_be16(bench->rom + address + i * 2, (uint16_t)((low + (high - low) * t * (0.5f + 0.5f * t)) / scale));
+  }
+}
+
+static bool bench_tableeval_setup(bench_tableeval_t* bench)
+{
+  uint32_t address = 0x1000;
+  srand(1);
+  for (uint32_t i = 0; i < BENCH_TABLEEVAL_ROM; i++) bench->rom[i] = (uint8_t)rand();
+
+  tableeval_init(&bench->eval);
+  bench->eval.numChannels = 4;
+  for (size_t t = 0; t < BENCH_TABLEEVAL_TABLES; t++) {
+    definition_table_t* table = &bench->tables[t];
+    bool is3D = t < BENCH_TABLEEVAL_3D;
+    memset(table, 0, sizeof(*table));
+    snprintf(table->name, sizeof(table->name), "Table %zu", t);
+    table->dimensions = is3D ? 3 : 2;
+    // half of them uint8, a few swapped
+    table->storage    = t % 2 ? DEFINITION_STORAGE_UINT16 : DEFINITION_STORAGE_UINT8;
+    table->bigEndian  = true;
+    table->swapXY     = t % 5 == 0;
+    table->sizeX      = is3D ? 16 : 1;
+    table->sizeY      = 16;
+    table->scaling    = definition_scaling_t{ "", "x*0.5", "x/0.5", "", 0.5f, 0.0f, true, "" };
+    table->address    = address;
+    address += 16 * 16 * 2;
+    if (is3D) bench_tableeval_axis(bench, &table->x, address, 500.0f + (float)(t % 6) * 100, 7500, 1);
+    bench_tableeval_axis(bench, &table->y, address + 32, is3D ? 0.1f + (float)(t % 5) * 0.05f : (float)(t % 4) * 10,
+                         is3D ? 2 : 150, is3D ? 0.001f : 0.01f);
+    address += 64;
+    if (is3D && definition_decode_axis(&table->x, bench->rom, BENCH_TABLEEVAL_ROM, bench->axes[t][0])) return false;
+    if (definition_decode_axis(&table->y, bench->rom, BENCH_TABLEEVAL_ROM, bench->axes[t][1])) return false;
+    if (tableeval_add_table(&bench->eval, table, bench->rom, BENCH_TABLEEVAL_ROM, is3D ? 0 : -1, is3D ? 1 : 2)) return false;
+  }
+  if (tableeval_scratch_init(&bench->scratch, &bench->eval)) return false;
+
+  static const float ranges[4][2] = { { 0, 8000 }, { 0, 2 }, { 0, 160 }, { 10, 18 } };
+  for (size_t i = 0; i < BENCH_TABLEEVAL_SAMPLES; i++)
+    for (int c = 0; c < 4; c++)
+      bench->samples[c][i] = ranges[c][0] + (ranges[c][1] - ranges[c][0]) * (float)rand() / (float)RAND_MAX;
+  return true;
+}
+
+static void bench_tableeval_run(void* ctx, uint64_t iterations)
+{
+  bench_tableeval_t* bench = (bench_tableeval_t*)ctx;
+  const float* columns[4] = { bench->samples[0], bench->samples[1], bench->samples[2], bench->samples[3] };
+  float* outputs[BENCH_TABLEEVAL_TABLES];
+  for (size_t t = 0; t < BENCH_TABLEEVAL_TABLES; t++) outputs[t] = bench->outputs[t];
+  for (uint64_t i = 0; i < iterations; i++)
+    tableeval_run(&bench->eval, &bench->scratch, columns, BENCH_TABLEEVAL_SAMPLES, outputs);
+  bench_consume(bench->outputs);
+}
+
+// interval and position of `value` by binary search, clamped
+static void bench_tableeval_find(const float* axis, size_t length, float value, size_t* index, float* fraction)
+{
+  size_t n = (size_t)(std::upper_bound(axis + 1, axis + length - 1, value) - (axis + 1));
+  float f = (value - axis[n]) / (axis[n + 1] - axis[n]);
+  *index = n;
+  *fraction = f < 0 ? 0 : (f > 1 ? 1 : f);
+}
+
+// a sample at a time, every table's own axes searched and its cells decoded from the ROM, for comparison
+static void bench_tableeval_generic(void* ctx, uint64_t iterations)
+{
+  bench_tableeval_t* bench = (bench_tableeval_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++) {
+    for (size_t s = 0; s < BENCH_TABLEEVAL_SAMPLES; s++) {
+      for (size_t t = 0; t < BENCH_TABLEEVAL_TABLES; t++) {
+        const definition_table_t* table = &bench->tables[t];
+        size_t ix = 0, iy;
+        float fx = 0, fy, cells[4];
+        if (table->dimensions == 3)
+          bench_tableeval_find(bench->axes[t][0], 16, bench->samples[0][s], &ix, &fx);
+        bench_tableeval_find(bench->axes[t][1], 16, bench->samples[table->dimensions == 3 ? 1 : 2][s], &iy, &fy);
+        size_t dx = table->dimensions == 3 ? 1 : 0;
+        for (int c = 0; c < 4; c++) {
+          uint32_t address = definition_cell_address(table, (uint16_t)(iy + c / 2), (uint16_t)(ix + (c % 2) * dx));
+          definition_decode(bench->rom, BENCH_TABLEEVAL_ROM, address, 1, table->storage, table->bigEndian, &table->scaling, &cells[c]);
+        }
+        float top = cells[0] + (cells[1] - cells[0]) * fx, bottom = cells[2] + (cells[3] - cells[2]) * fx;
+        bench->outputs[t][s] = top + (bottom - top) * fy;
+      }
+    }
+  }
+  bench_consume(bench->outputs);
+}
+
+void bench_tableeval()
+{
+  bench_tableeval_t* bench = (bench_tableeval_t*)calloc(1, sizeof(bench_tableeval_t));
+  if (!bench) return;
+  if (bench_tableeval_setup(bench)) {
+    bench_run("tableeval 4096 samples, 64 tables", bench_tableeval_run, bench);
+    bench_run("tableeval 4096 samples, generic lookup", bench_tableeval_generic, bench);
+  }
+  tableeval_scratch_free(&bench->scratch);
+  tableeval_free(&bench->eval);
+  free(bench);
+}
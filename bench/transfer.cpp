@@ -0,0 +1,98 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "J2534.h"
+#include "librx8.h"
+#include "simecu.h"
+#include "util.h"
+
+// what ecudump uses by default for --download and --upload
+static const uint32_t BENCH_DUMP_LENGTH = 0x80000;
+static const uint16_t BENCH_DUMP_CHUNK  = 0x100;
+static const uint16_t BENCH_FLASH_CHUNK = 0x400;
+static const uint32_t BENCH_FLASH_LENGTH = MAZDA_SBL_LENGTH + MAZDA_ROM_LENGTH - MAZDA_ROM_START_OFFSET;
+
+typedef struct Bench_Transfer {
+  RX8*     ecu;
+  uint8_t* buffer;
+  size_t   failures;
+} bench_transfer_t;
+
+static void bench_transfer_dump(void* ctx, uint64_t iterations)
+{
+  bench_transfer_t* bench = (bench_transfer_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++) {
+    bench->ecu->beginTransfer();
+    for (uint32_t address = 0; address < BENCH_DUMP_LENGTH; address += BENCH_DUMP_CHUNK) {
+      rx8_span_t out = { bench->buffer + address, BENCH_DUMP_CHUNK };
+      if (!bench->ecu->readMemory(address, out).ok()) bench->failures++;
+    }
+    bench->ecu->endTransfer();
+  }
+}
+
+static void bench_transfer_flash(void* ctx, uint64_t iterations)
+{
+  bench_transfer_t* bench = (bench_transfer_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++) {
+    if (!bench->ecu->enterBootloader().ok() || !bench->ecu->startDownload(0, BENCH_FLASH_LENGTH).ok()) {
+      bench->failures++;
+      continue;
+    }
+    for (uint32_t offset = 0; offset < BENCH_FLASH_LENGTH; offset += BENCH_FLASH_CHUNK) {
+      rx8_const_span_t data = { bench->buffer + offset, BENCH_FLASH_CHUNK };
+      if (!bench->ecu->transferData(data).ok()) bench->failures++;
+    }
+    if (!bench->ecu->exitTransfer().ok()) bench->failures++;
+  }
+}
+
+void bench_transfer()
+{
+  bench_transfer_t bench = { NULL, NULL, 0 };
+  J2534 j2534;
+  unsigned long devID, chanID;
+  rx8_seed_t seed;
+
+  bench.buffer = (uint8_t*)calloc(1, BENCH_DUMP_LENGTH > BENCH_FLASH_LENGTH ? BENCH_DUMP_LENGTH : BENCH_FLASH_LENGTH);
+  simecu_set_latency(&bench_config.latency);
+  if (!bench.buffer || !j2534.init(simecu_api()) || j2534Connect(&j2534, NULL, &devID, &chanID)) {
+    fprintf(stderr, "failed to open the simulated ECU\n");
+    free(bench.buffer);
+    return;
+  }
+
+  RX8 ecu(&j2534, devID, chanID);
+  if (!ecu.startSession(MAZDA_SBF_SESSION_85).ok() ||
+      !ecu.requestSeed(seed).ok() ||
+      !ecu.sendKey(RX8::calculateKey(seed)).ok()) {
+    fprintf(stderr, "failed to unlock the simulated ECU\n");
+    free(bench.buffer);
+    return;
+  }
+  bench.ecu = &ecu;
+
+  bench_run_bytes("dump 512K (simulated ECU)", bench_transfer_dump, &bench, BENCH_DUMP_LENGTH);
+  bench_run_bytes("flash 510K (simulated ECU)", bench_transfer_flash, &bench, BENCH_FLASH_LENGTH);
+  if (bench.failures)
+    fprintf(stderr, "%zu simulated transfer requests failed\n", bench.failures);
+
+  free(bench.buffer);
+}
@@ -0,0 +1,164 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "J2534.h"
+#include "UDS.h"
+#include "librx8.h"
+#include "simecu.h"
+#include "util.h"
+#include "metrics.h"
+
+// a typical dump request, 256 bytes per ReadMemoryByAddress
+static const uint16_t BENCH_UDS_CHUNK = 0x100;
+
+typedef struct Bench_UDS {
+  uds_request_t* request;
+  uint32_t address;
+} bench_uds_t;
+
+// uds_request_prepare as it was before dirty length tracking, kept for comparison
+static void bench_uds_legacy_prepare(uds_request_t* request)
+{
+  request->sid = 0;
+  request->payload = NULL;
+
+  memset(request->txBuffer, 0, 5);
+  memset(request->rxBuffer, 0, 5);
+
+  for (size_t i = 0; i < request->numTx; i++) {
+    memset(request->txBuffer[i].Data, 0, PM_DATA_LEN);
+    memset(request->rxBuffer[i].Data, 0, PM_DATA_LEN);
+
+    request->txBuffer[i].ProtocolID = ISO15765;
+    request->txBuffer[i].TxFlags = ISO15765_FRAME_PAD;
+
+    request->txBuffer[i].Data[0] = 0x0;
+    request->txBuffer[i].Data[1] = 0x0;
+    request->txBuffer[i].Data[2] = UDS_REQUEST_CANID_MSB;
+    request->txBuffer[i].Data[3] = UDS_REQUEST_CANID_LSB;
+    request->rxBuffer[i].ProtocolID = ISO15765;
+    request->rxBuffer[i].TxFlags = ISO15765_FRAME_PAD;
+  }
+
+  request->payload = &request->txBuffer[0].Data[5];
+}
+
+// what a ReadMemoryByAddress of BENCH_UDS_CHUNK bytes leaves behind
+static void bench_uds_dirty(uds_request_t* request)
+{
+  request->txDirty = 4 + 1 + 6;
+  request->rxDirty = 4 + 1 + BENCH_UDS_CHUNK;
+}
+
+static void bench_uds_fill(uds_request_t* request, uint32_t address)
+{
+  request->sid        = UDS_SID_READ_MEMORY_BY_ADDRESS;
+  request->payload[0] = 0;
+  request->payload[1] = address >> 16;
+  request->payload[2] = address >> 8;
+  request->payload[3] = address;
+  request->payload[4] = BENCH_UDS_CHUNK >> 8;
+  request->payload[5] = BENCH_UDS_CHUNK & 0xff;
+  request->length     = 6;
+  request->expectedLength = 1 + BENCH_UDS_CHUNK;
+}
+
+static void bench_uds_prepare_legacy(void* ctx, uint64_t iterations)
+{
+  bench_uds_t* bench = (bench_uds_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++) {
+    bench_uds_legacy_prepare(bench->request);
+    bench_uds_fill(bench->request, (uint32_t)i);
+    bench_consume(bench->request->payload);
+  }
+}
+
+static void bench_uds_prepare(void* ctx, uint64_t iterations)
+{
+  bench_uds_t* bench = (bench_uds_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++) {
+    bench_uds_dirty(bench->request);
+    uds_request_prepare(bench->request);
+    bench_uds_fill(bench->request, (uint32_t)i);
+    bench_consume(bench->request->payload);
+  }
+}
+
+static void bench_uds_transaction_legacy(void* ctx, uint64_t iterations)
+{
+  bench_uds_t* bench = (bench_uds_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++) {
+    bench_uds_legacy_prepare(bench->request);
+    bench_uds_fill(bench->request, bench->address);
+    uds_request_send(bench->request);
+    bench->address = (bench->address + BENCH_UDS_CHUNK) % (MAZDA_ROM_LENGTH - BENCH_UDS_CHUNK);
+  }
+}
+
+static void bench_uds_transaction(void* ctx, uint64_t iterations)
+{
+  bench_uds_t* bench = (bench_uds_t*)ctx;
+  for (uint64_t i = 0; i < iterations; i++) {
+    uds_request_prepare(bench->request);
+    bench_uds_fill(bench->request, bench->address);
+    uds_request_send(bench->request);
+    bench->address = (bench->address + BENCH_UDS_CHUNK) % (MAZDA_ROM_LENGTH - BENCH_UDS_CHUNK);
+  }
+}
+
+void bench_uds()
+{
+  alignas(UDS_REQUEST_ARENA_ALIGN) static uint8_t arena[UDS_REQUEST_ARENA_SIZE];
+  bench_uds_t bench = { NULL, 0 };
+  J2534 j2534;
+  unsigned long devID, chanID;
+  rx8_seed_t seed;
+
+  // an ECU with no latency, so only host side overhead is measured
+  simecu_set_latency(&SIMECU_LATENCY_NONE);
+  if (!j2534.init(simecu_api()) || j2534Connect(&j2534, NULL, &devID, &chanID)) {
+    fprintf(stderr, "failed to open the simulated ECU\n");
+    return;
+  }
+
+  RX8 ecu(&j2534, devID, chanID);
+  if (!ecu.startSession(MAZDA_SBF_SESSION_85).ok() ||
+      !ecu.requestSeed(seed).ok() ||
+      !ecu.sendKey(RX8::calculateKey(seed)).ok()) {
+    fprintf(stderr, "failed to unlock the simulated ECU\n");
+    return;
+  }
+
+  uds_request_init_arena(&bench.request, arena, sizeof(arena), &j2534, devID, chanID);
+
+  bench_run("uds_request_prepare (legacy)", bench_uds_prepare_legacy, &bench);
+  bench_run("uds_request_prepare", bench_uds_prepare, &bench);
+  bench_run("readMem transaction (legacy prepare)", bench_uds_transaction_legacy, &bench);
+  bench_run("readMem transaction", bench_uds_transaction, &bench);
+
+  uds_request_deinit(bench.request);
+
+  // a request only gets its histograms if metrics are on when it is made
+  metrics_enable(true);
+  uds_request_init_arena(&bench.request, arena, sizeof(arena), &j2534, devID, chanID);
+  bench_run("readMem transaction (metrics)", bench_uds_transaction, &bench);
+  uds_request_deinit(bench.request);
+  metrics_enable(false);
+}
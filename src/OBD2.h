@@ -24,3 +24,11 @@ static const uint8_t OBD2_SID_REQUEST_VEHICLE_INFORMATION     = 0x09;
 static const uint8_t OBD2_SID_REQUEST_VEHICLE_INFORMATION_ACK = OBD2_SID_REQUEST_VEHICLE_INFORMATION + OBD2_ACK_OFFSET;
 static const uint8_t OBD2_PID_REQUEST_VIN                     = 0x02;
 static const uint8_t OBD2_PID_REQUEST_CALID                   = 0x04;
+
+static const uint8_t OBD2_SID_REQUEST_CURRENT_DATA            = 0x01;
+static const uint8_t OBD2_SID_REQUEST_CURRENT_DATA_ACK        = OBD2_SID_REQUEST_CURRENT_DATA + OBD2_ACK_OFFSET;
+static const uint8_t OBD2_PID_SUPPORTED_PIDS_01_20            = 0x00;
+
+// functionally addressed requests go to every emissions related module at once (ISO 15765-4)
+static const uint8_t OBD2_FUNCTIONAL_CANID_MSB                = 0x07;
+static const uint8_t OBD2_FUNCTIONAL_CANID_LSB                = 0xDF;
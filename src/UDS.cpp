@@ -6,163 +6,267 @@
 
 #include "UDS.h"
 #include "OBD2.h"
+#include "util.h"
 
 static const char* TAG = "UDS";
 
 size_t uds_request_send(uds_request_t* request)
 {
   size_t ret = UDS_ERROR_OK;
+  uds_deadline_t deadline;
+  uint8_t sid = (uint8_t)request->sid;
+  uint32_t expectedLength = request->expectedLength;
+  metrics_t* metrics = metrics_enabled() ? request->metrics : NULL;
+  uint64_t now, sent, firstFrame = 0, pendingSince = 0;
+  bool responding = false;
+
+  metrics_poll();
 
   request->txBuffer[0].DataSize = 
     request->length + // payload length
     1 +               // sid
     4;                // CANID
   request->txBuffer[0].Data[4] = (uint8_t)request->sid;
+  request->txDirty = request->txBuffer[0].DataSize;
 
   // nulify these fields
   request->payload = NULL;
   request->length = 0;
   request->sid = 0;
+  request->expectedLength = 0;
+
+  now = monotonic_us();
+  if (metrics) {
+    if (request->lastEndUs) metrics_phase(metrics, METRICS_PHASE_HOST, now - request->lastEndUs);
+    metrics_count(metrics, METRICS_REQUESTS, 1);
+    metrics_count(metrics, METRICS_BYTES_TX, request->txBuffer[0].DataSize - 4);
+  }
 
+  request->numTx = 1;
   ret = request->j2534->PassThruWriteMsgs(
     request->chanID, 
     &request->txBuffer[0], 
     &request->numTx, 
     TX_TIMEOUT
   );
-  if (ret) return ret;
+  sent = monotonic_us();
+  if (metrics) metrics_phase(metrics, METRICS_PHASE_WRITE, sent - now);
+  now = sent;
+  if (ret) {
+    if (metrics) metrics_count(metrics, METRICS_DRIVER_ERRORS, 1);
+    request->lastEndUs = now;
+    return ret;
+  }
+
+  // P2 starts once the request is on the bus
+  uds_deadline_start(&deadline, sid, expectedLength, now);
 
   for(;;) {
+    unsigned long timeout = uds_deadline_remaining_ms(&deadline, now);
+    if (timeout == 0) {
+      if (deadline.receiving)    ret = UDS_ERROR_TRANSFER_TIMEOUT;
+      else if (deadline.pending) ret = UDS_ERROR_PENDING_TIMEOUT;
+      else                       ret = UDS_ERROR_TIMEOUT;
+      if (metrics) metrics_count(metrics, METRICS_TIMEOUTS, 1);
+      break;
+    }
+
+    request->numRx = 1;
     ret = request->j2534->PassThruReadMsgs(
       request->chanID, 
       &request->rxBuffer[0], 
       &request->numRx, 
-      RX_TIMEOUT
+      timeout
     );
-    if (ret) break;
+    uint64_t read = monotonic_us();
+    if (metrics) metrics_phase(metrics, METRICS_PHASE_READ, read - now);
+    now = read;
+
+    // nothing arrived in time, the deadline check above turns this into a typed error
+    if (ret == ERR_BUFFER_EMPTY || ret == ERR_TIMEOUT) {
+      if (metrics) metrics_count(metrics, METRICS_EMPTY_READS, 1);
+      continue;
+    }
+    if (ret) {
+      if (metrics) metrics_count(metrics, METRICS_DRIVER_ERRORS, 1);
+      break;
+    }
+    if (request->numRx && request->rxBuffer[0].DataSize > request->rxDirty)
+      request->rxDirty = request->rxBuffer[0].DataSize < PM_DATA_LEN ? request->rxBuffer[0].DataSize : PM_DATA_LEN;
 
     if(request->numRx) {
-      if (request->rxBuffer[0].RxStatus & START_OF_MESSAGE)      continue;
+      if (request->rxBuffer[0].RxStatus & START_OF_MESSAGE) {
+        if (request->rxBuffer[0].Data[3] == UDS_RESPONSE_CANID_LSB) {
+          uds_deadline_first_frame(&deadline, now);
+          firstFrame = now;
+          if (metrics && !responding) metrics_phase(metrics, METRICS_PHASE_FIRST_FRAME, now - sent);
+          if (metrics && pendingSince) metrics_phase(metrics, METRICS_PHASE_PENDING, now - pendingSince);
+          responding = true;
+          pendingSince = 0;
+        }
+        continue;
+      }
 			if (request->rxBuffer[0].Data[3] == UDS_REQUEST_CANID_LSB) continue;
       if (request->rxBuffer[0].Data[3] == UDS_RESPONSE_CANID_LSB) {
         if(request->rxBuffer[0].Data[4] == UDS_NEGATIVE_RESPONSE) {
-          if(request->rxBuffer[0].Data[6] == UDS_NEGATIVE_RESPONSE_REQUEST_RECEIVED_RESPONSE_PENDING) 
+          // the keepalive is sent by the passthru device, its rejections are not for us
+          if(request->rxBuffer[0].Data[5] == UDS_SID_TESTER_PRESENT)
+            continue;
+          if(request->rxBuffer[0].Data[6] == UDS_NEGATIVE_RESPONSE_REQUEST_RECEIVED_RESPONSE_PENDING) {
+            uds_deadline_pending(&deadline, now);
+            if (metrics) {
+              metrics_count(metrics, METRICS_PENDING, 1);
+              if (!responding) metrics_phase(metrics, METRICS_PHASE_FIRST_FRAME, now - sent);
+            }
+            responding = true;
+            if (!pendingSince) pendingSince = now;
             continue;
+          }
 
           assert(request->rxBuffer[0].DataSize >= 5);
           request->sid     =  UDS_NEGATIVE_RESPONSE;
           request->payload = &request->rxBuffer[0].Data[5];
           request->length  =  request->rxBuffer[0].DataSize - 5;
           ret              = UDS_ERROR_NEGATIVE_RESPONSE;
-          break;
+          if (metrics) metrics_nrc(metrics, request->rxBuffer[0].Data[6]);
+        } else if(request->rxBuffer[0].Data[4] == UDS_SID_TESTER_PRESENT_ACK) {
+          // ECU answered a periodic TesterPresent despite the suppress bit
+          continue;
         } else {
           assert(request->rxBuffer[0].DataSize >= 5);
           request->sid     =  request->rxBuffer[0].Data[4];
           request->payload = &request->rxBuffer[0].Data[5];
           request->length  =  request->rxBuffer[0].DataSize - 5;
           ret              = UDS_ERROR_OK;
-          break;
         }
-      }
 
-      // fall thru, will turn into a RX Timeout next loop
-      ret = UDS_ERROR_UNKNOWN;
+        if (metrics) {
+          if (!responding) metrics_phase(metrics, METRICS_PHASE_FIRST_FRAME, now - sent);
+          if (pendingSince) metrics_phase(metrics, METRICS_PHASE_PENDING, now - pendingSince);
+          if (firstFrame) metrics_phase(metrics, METRICS_PHASE_TRANSFER, now - firstFrame);
+          metrics_service(metrics, sid, now - sent);
+          metrics_count(metrics, METRICS_RESPONSES, 1);
+          metrics_count(metrics, METRICS_BYTES_RX, request->rxBuffer[0].DataSize - 4);
+        }
+        break;
+      }
     } 
   }
 
+  request->lastEndUs = now;
   return ret;
 }
 
 
-// helper function to clear the tx and rx buffers, and setup a 0x7E0 CANID ISO15765 frame
-size_t uds_request_prepare(uds_request_t* request)
-{
-  request->sid = 0;
-  request->payload = NULL;
+// CAN ID every physically addressed request starts with
+static const uint8_t uds_request_header[4] = { 0x00, 0x00, UDS_REQUEST_CANID_MSB, UDS_REQUEST_CANID_LSB };
 
-	assert(request->numTx <= TX_BUFFER_LEN);
-	assert(request->numRx <= RX_BUFFER_LEN);
+// the parts of a PASSTHRU_MSG in front of Data, Data itself is cleared by dirty length
+static const size_t UDS_MSG_HEADER_LEN = sizeof(PASSTHRU_MSG) - PM_DATA_LEN;
 
-	// zero out both buffers to prevent accidental tx/rx of irrelevant data
-	memset(request->txBuffer, 0, TX_BUFFER_LEN);
-	memset(request->rxBuffer, 0, RX_BUFFER_LEN);
+static void uds_request_format(uds_request_t* request)
+{
+  memset(request->txBuffer, 0, UDS_MSG_HEADER_LEN);
+  memset(request->rxBuffer, 0, UDS_MSG_HEADER_LEN);
+  request->txBuffer[0].ProtocolID = ISO15765;
+  request->txBuffer[0].TxFlags    = ISO15765_FRAME_PAD;
+  request->rxBuffer[0].ProtocolID = ISO15765;
+  request->rxBuffer[0].TxFlags    = ISO15765_FRAME_PAD;
+  memcpy(request->txBuffer[0].Data, uds_request_header, sizeof(uds_request_header));
+  memset(request->txBuffer[0].Data + sizeof(uds_request_header), 0, PM_DATA_LEN - sizeof(uds_request_header));
+  memset(request->rxBuffer[0].Data, 0, PM_DATA_LEN);
+  request->txDirty = 0;
+  request->rxDirty = 0;
+}
 
-	for (size_t i = 0; i < request->numTx; i++) {
-		memset(request->txBuffer[i].Data, 0, PM_DATA_LEN);
-		memset(request->rxBuffer[i].Data, 0, PM_DATA_LEN);
+// helper function to reset the request for the next transaction.
+// the 0x7E0 ISO15765 header is formatted once by init, only the bytes the last transaction touched are cleared
+size_t uds_request_prepare(uds_request_t* request)
+{
+  request->sid = 0;
+  request->length = 0;
+  request->expectedLength = 0;
 
-		request->txBuffer[i].ProtocolID = ISO15765;
-		request->txBuffer[i].TxFlags = ISO15765_FRAME_PAD;
-		
-		request->txBuffer[i].Data[0] = 0x0;
-		request->txBuffer[i].Data[1] = 0x0;
-		request->txBuffer[i].Data[2] = UDS_REQUEST_CANID_MSB;
-		request->txBuffer[i].Data[3] = UDS_REQUEST_CANID_LSB;
-		request->rxBuffer[i].ProtocolID = ISO15765;
-		request->rxBuffer[i].TxFlags = ISO15765_FRAME_PAD;
-	}
+  // zero out what was used to prevent accidental tx/rx of irrelevant data
+  if (request->txDirty > sizeof(uds_request_header))
+    memset(request->txBuffer[0].Data + sizeof(uds_request_header), 0, request->txDirty - sizeof(uds_request_header));
+  if (request->rxDirty)
+    memset(request->rxBuffer[0].Data, 0, request->rxDirty);
+  request->txDirty = 0;
+  request->rxDirty = 0;
 
   request->payload = &request->txBuffer[0].Data[5];
-	return UDS_ERROR_OK;
+  return UDS_ERROR_OK;
 }
 
-size_t uds_request_init(uds_request_t** request_out, 
-                        J2534* j2534, 
-                        unsigned long devID, 
-                        unsigned long chanID)
+size_t uds_request_init_arena(uds_request_t** request_out,
+                              void* arena,
+                              size_t arenaLength,
+                              J2534* j2534,
+                              unsigned long devID,
+                              unsigned long chanID)
 {
-  uds_request_t* request = (uds_request_t*)malloc(sizeof(uds_request_t));
-  if(!request) {
-    request_out = NULL;
-    return ENOMEM;
+  size_t offset = (sizeof(uds_request_t) + UDS_REQUEST_ARENA_ALIGN - 1) & ~(UDS_REQUEST_ARENA_ALIGN - 1);
+  if(!arena || arenaLength < UDS_REQUEST_ARENA_SIZE) {
+    *request_out = NULL;
+    return EINVAL;
   }
-  
+
+  uds_request_t* request = (uds_request_t*)arena;
   request->j2534 = j2534;
   request->devID = devID;
   request->chanID = chanID;
   request->numTx = 1;
   request->numRx = 1;
   request->sid = 0;
+  request->length = 0;
   request->payload = NULL;
-
-  request->txBuffer = (PASSTHRU_MSG*)malloc(
-    sizeof(PASSTHRU_MSG) * request->numTx
-  );
-
-  if(!request->txBuffer) {
-    free(request);
-    request_out = NULL;
-    return ENOMEM;
+  request->expectedLength = 0;
+  request->lastEndUs = 0;
+  request->metrics = NULL;
+  if(metrics_enabled()) {
+    request->metrics = (metrics_t*)malloc(sizeof(metrics_t));
+    if(!request->metrics) {
+      *request_out = NULL;
+      return ENOMEM;
+    }
+    metrics_init(request->metrics);
   }
 
-  request->rxBuffer = (PASSTHRU_MSG*)malloc(
-    sizeof(PASSTHRU_MSG) * request->numRx
-  );
-
-  if(!request->rxBuffer) {
-    free(request->txBuffer);
-    request->txBuffer = NULL;
-    free(request);
-    request_out = NULL;
-    return ENOMEM;
-  }
+  request->txBuffer = (PASSTHRU_MSG*)((uint8_t*)arena + offset);
+  request->rxBuffer = request->txBuffer + 1;
+  uds_request_format(request);
 
   *request_out = request;
   return 0;
 }
 
-size_t uds_request_deinit(uds_request_t* request)
+size_t uds_request_init(uds_request_t** request_out, 
+                        J2534* j2534, 
+                        unsigned long devID, 
+                        unsigned long chanID)
 {
-  if(request->txBuffer)
-    free(request->txBuffer);
+  void* arena = malloc(UDS_REQUEST_ARENA_SIZE);
+  if(!arena) {
+    *request_out = NULL;
+    return ENOMEM;
+  }
+  size_t ret = uds_request_init_arena(request_out, arena, UDS_REQUEST_ARENA_SIZE, j2534, devID, chanID);
+  if(ret)
+    free(arena);
+  return ret;
+}
 
+// the buffers belong to the arena, releasing the request releases them
+size_t uds_request_deinit(uds_request_t* request)
+{
+  if(request->metrics) {
+    metrics_deinit(request->metrics);
+    free(request->metrics);
+    request->metrics = NULL;
+  }
   request->txBuffer = NULL;
-
-  if(request->rxBuffer)
-    free(request->rxBuffer);
-
   request->rxBuffer = NULL;
-  
   return 0;
 }
 
@@ -170,14 +274,18 @@ static const char* uds_error_string[] = {
   "not an error",
   "unknown",
   "negative response (0x7f)",
+  "no response within P2",
+  "no response within P2* after response pending",
+  "multi frame response did not complete",
   NULL
 };
-char UDSlastErrorString[255] = {0};
+// fleet mode runs a session per thread, each gets its own copy
+static thread_local char UDSlastErrorString[255] = {0};
 
 const char* uds_request_error_string(uds_request_t* request, size_t err)
 {
   if(err > UDS_ERROR_START) {
-    uds_error_string[err - UDS_ERROR_START];
+    return uds_error_string[err - UDS_ERROR_START];
   } else if(err > 0) {
     request->j2534->PassThruGetLastError(UDSlastErrorString);
     return UDSlastErrorString;
@@ -210,9 +318,14 @@ static const char* uds_negative_response_error_string[] = {
 };
 
 const char* uds_request_negative_response_error_string(uds_request_t* request) 
+{
+  return uds_negative_response_string(request->rxBuffer[0].Data[6]);
+}
+
+const char* uds_negative_response_string(uint8_t nrc)
 {
   // sorry
-  switch(request->rxBuffer[0].Data[6]){
+  switch(nrc){
   case UDS_NEGATIVE_RESPONSE_GENERAL_REJECT:                              return uds_negative_response_error_string[0];
   case UDS_NEGATIVE_RESPONSE_SERVICE_NOT_SUPPORTED:                       return uds_negative_response_error_string[1];
   case UDS_NEGATIVE_RESPONSE_SUBFUNCTION_NOT_SUPPORTED:                   return uds_negative_response_error_string[2];
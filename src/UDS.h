@@ -22,6 +22,9 @@ limitations under the License.
 #include "J2534.h"
 #define PM_DATA_LEN	4128
 
+#include "timing.h"
+#include "metrics.h"
+
 static const uint8_t UDS_REQUEST_CANID_MSB  = 0x07;
 static const uint8_t UDS_REQUEST_CANID_LSB  = 0xE0;
 static const uint8_t UDS_RESPONSE_CANID_MSB = UDS_REQUEST_CANID_MSB;
@@ -33,7 +36,6 @@ static const size_t TX_TIMEOUT = 1000;
 
 // number of rx PASSTHRU_MSG structs to keep around
 static const size_t RX_BUFFER_LEN = 5;
-static const size_t RX_TIMEOUT = 1000;
 
 static const uint8_t UDS_SID_SESSION                  = 0x10;
 static const uint8_t UDS_SID_SESSION_ACK              = UDS_SID_SESSION + OBD2_ACK_OFFSET;
@@ -51,6 +53,7 @@ static const uint8_t UDS_SID_TRANSFER_DATA_ACK        = UDS_SID_TRANSFER_DATA +
 static const uint8_t UDS_SID_REQUEST_TRANSFER_EXIT    = 0x37;
 static const uint8_t UDS_SID_REQUEST_TRANSFER_EXIT_ACK = UDS_SID_REQUEST_TRANSFER_EXIT + OBD2_ACK_OFFSET;
 static const uint8_t UDS_SID_TESTER_PRESENT           = 0x3E;
+static const uint8_t UDS_SID_TESTER_PRESENT_ACK       = UDS_SID_TESTER_PRESENT + OBD2_ACK_OFFSET;
 static const uint8_t UDS_SID_ACCESS_TIMING_PARAMETER  = 0x83;
 static const uint8_t UDS_SID_SECURE_DATA_TRANSMISSION = 0x84;
 static const uint8_t UDS_SID_CONTROL_DTC_SETTING      = 0x85;
@@ -84,6 +87,12 @@ enum uds_error {
 	UDS_ERROR_OK                = 0,
 	UDS_ERROR_UNKNOWN           = UDS_ERROR_START+1,
 	UDS_ERROR_NEGATIVE_RESPONSE = UDS_ERROR_START+2,
+	/* no response within P2 */
+	UDS_ERROR_TIMEOUT           = UDS_ERROR_START+3,
+	/* ECU said 0x78 response pending, then went quiet for longer than P2* */
+	UDS_ERROR_PENDING_TIMEOUT   = UDS_ERROR_START+4,
+	/* first frame arrived but the rest of the message did not */
+	UDS_ERROR_TRANSFER_TIMEOUT  = UDS_ERROR_START+5,
 };
 
 typedef struct UDS_Request {
@@ -101,14 +110,44 @@ typedef struct UDS_Request {
 	/* Payload Length */
 	uint32_t      length;
 	uint8_t*      payload;
+
+	/* Length of the response the caller expects, 0 if unknown. Used for the transfer deadline */
+	uint32_t      expectedLength;
+
+	/* latency histograms and counters of every request sent with this object, see metrics.h.
+	 * Allocated outside the arena, and only if metrics were enabled when the request was made */
+	metrics_t*    metrics;
+
+	/* monotonic_us() when the last transaction finished, start of the host phase */
+	uint64_t      lastEndUs;
+
+	/* bytes of txBuffer[0].Data/rxBuffer[0].Data used since the last prepare, only these get cleared */
+	uint32_t      txDirty;
+	uint32_t      rxDirty;
 } uds_request_t;
 
+/* A request and its message buffers live in one block, the arena. uds_request_init() allocates
+ * it and a single free(request) releases everything. uds_request_init_arena() uses caller owned
+ * storage instead, which must be suitably aligned and at least UDS_REQUEST_ARENA_SIZE bytes. */
+static const size_t UDS_REQUEST_ARENA_ALIGN = 16;
+static const size_t UDS_REQUEST_ARENA_SIZE  =
+  ((sizeof(uds_request_t) + UDS_REQUEST_ARENA_ALIGN - 1) & ~(UDS_REQUEST_ARENA_ALIGN - 1)) +
+  2 * sizeof(PASSTHRU_MSG);
+
 size_t uds_request_init(uds_request_t** request_out, 
                         J2534* j2534, 
                         unsigned long devID, 
                         unsigned long chanID);
+size_t uds_request_init_arena(uds_request_t** request_out,
+                              void* arena,
+                              size_t arenaLength,
+                              J2534* j2534,
+                              unsigned long devID,
+                              unsigned long chanID);
 size_t uds_request_prepare(uds_request_t* request);
 size_t uds_request_send(uds_request_t* request);
+size_t uds_request_deinit(uds_request_t* request);
 
 const char* uds_request_error_string(uds_request_t* request, size_t ret);
-const char* uds_request_negative_response_error_string(uds_request_t* request);
\ No newline at end of file
+const char* uds_request_negative_response_error_string(uds_request_t* request);
+const char* uds_negative_response_string(uint8_t nrc);
\ No newline at end of file
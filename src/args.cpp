@@ -10,6 +10,8 @@
 #endif
 
 #include "args.h"
+#include "hexdump.h"
+#include "log.h"
 
 void decomposeArgs(ecudump_args_t* args)
 {
@@ -29,12 +31,34 @@ void decomposeArgs(ecudump_args_t* args)
     "\tULOCK=%d\n"
     "\tDL   =%d\n"
     "\tUL   =%d\n"
+    "\tDISC =%d\n"
+    "\tCELLS=%d\n"
+    "\tVIDEO=%d\n"
     "\rPARAMS=\n"
     "\ttransfer.startAddress = 0x%08X\n"
     "\ttransfer.transferSize = 0x%08X\n"
     "\ttransfer.chunkSize    = 0x%04X\n"
     "\rWRITEMEM=\n"
     "\twritemem.SBLfileName = %s\n"
+    "\twritemem.verify      = %d\n"
+    "\rTRACE=\n"
+    "\ttrace  = %s\n"
+    "\treplay = %s\n"
+    "\rFLEET=\n"
+    "\tfleet    = %s\n"
+    "\tsimulate = %d %s\n"
+    "\rMETRICS=\n"
+    "\tmetrics = %s\n"
+    "\rCELLS=\n"
+    "\tcells      = %s\n"
+    "\tdefinition = %s\n"
+    "\trom        = %s\n"
+    "\tsamples    = %u\n"
+    "\tlogs       = %s\n"
+    "\tthreads    = %u\n"
+    "\tpredict    = %s\n"
+    "\rVIDEO=\n"
+    "\tramvideo = %s\n"
     ,
     args->command,
     args->fileName[0] ? args->fileName : "NULL",
@@ -45,10 +69,28 @@ void decomposeArgs(ecudump_args_t* args)
     _UNLOCK(args->command),
     _READ_MEM(args->command),
     _WRITE_MEM(args->command),
+    _DISCOVER(args->command),
+    _TRACE_CELLS(args->command),
+    _RAM_VIDEO(args->command),
     args->params.transfer.startAddress,
     args->params.transfer.transferSize,
     args->params.transfer.chunkSize,
-    args->params.write.SBLfileName
+    args->params.write.SBLfileName,
+    args->params.write.verify,
+    args->traceFileName[0] ? args->traceFileName : "NULL",
+    args->replayFileName[0] ? args->replayFileName : "NULL",
+    args->fleet[0] ? args->fleet : "NULL",
+    args->simulate,
+    args->simulateRomFileName,
+    args->metricsFileName[0] ? args->metricsFileName : "NULL",
+    args->cellsFileName[0] ? args->cellsFileName : "NULL",
+    args->definitionFileName[0] ? args->definitionFileName : "NULL",
+    args->romFileName[0] ? args->romFileName : "NULL",
+    args->samples,
+    args->logs[0] ? args->logs : "NULL",
+    args->threads,
+    args->predictFileName[0] ? args->predictFileName : "NULL",
+    args->ramVideoFileName[0] ? args->ramVideoFileName : "NULL"
   );
 }
 
@@ -85,6 +127,7 @@ size_t getCommandArgs(int argc, char** argv, ecudump_args_t* args)
 {
   assert(args != NULL);
   memset(args, 0, sizeof(args));
+  args->progressRate = -1;
   ecudump_cmd_t command = 0;
   int c;
   for(;;) {
@@ -98,21 +141,73 @@ size_t getCommandArgs(int argc, char** argv, ecudump_args_t* args)
       {"seed",     no_argument,       NULL,  's'},
       {"unlock",   no_argument,       NULL,  'n'},
       {"key",      no_argument,       NULL,  'k'},
+      {"discover", no_argument,       NULL,   0 },
+      {"cells",    required_argument, NULL,   0 },
+      {"ram-video", required_argument, NULL,  0 },
 
       // transfer options
       {"start-address", required_argument, NULL, 0},
       {"transfer-size", required_argument, NULL, 0},
       {"chunk-size",    required_argument, NULL, 0},
       {"overwrite",     no_argument,       NULL, 'f'},
+      {"container",     no_argument,       NULL, 0},
+      {"compress",      no_argument,       NULL, 0},
 
       // write mem options
       {"sbl", required_argument, NULL, 0},
+      {"verify", required_argument, NULL, 0},
 
       // meta
       {"help",     no_argument,       NULL,  'h'},
       {"verbose",  no_argument,       NULL,  'v'},
       {"version",  no_argument,       NULL,   0 },
       {"dry-run",  no_argument,       NULL,   0 },
+      {"debug",    no_argument,       NULL,   0 },
+      {"log-level", required_argument, NULL,  0 },
+      {"progress-rate", required_argument, NULL, 0 },
+      {"trace",    required_argument, NULL,   0 },
+      {"replay",   required_argument, NULL,   0 },
+      {"fleet",    required_argument, NULL,   0 },
+      {"simulate", optional_argument, NULL,   0 },
+      {"metrics",  required_argument, NULL,   0 },
+
+      // offline viewers
+      {"hexdump",     required_argument, NULL, 0 },
+      {"compare",     required_argument, NULL, 0 },
+      {"width",       required_argument, NULL, 0 },
+      {"stride",      required_argument, NULL, 0 },
+      {"diff-only",   no_argument,       NULL, 0 },
+      {"print-trace", required_argument, NULL, 0 },
+      {"dump-info",   required_argument, NULL, 0 },
+      {"extract",     required_argument, NULL, 0 },
+      {"pack",        required_argument, NULL, 0 },
+      {"play",        required_argument, NULL, 0 },
+      {"library",     required_argument, NULL, 0 },
+      {"find-calibration", required_argument, NULL, 0 },
+      {"identify",    required_argument, NULL, 0 },
+      {"convert",     required_argument, NULL, 0 },
+      {"output",      required_argument, NULL, 0 },
+      {"frame",       required_argument, NULL, 0 },
+      {"at",          required_argument, NULL, 0 },
+      {"xref",        required_argument, NULL, 0 },
+      {"xref-cache",  required_argument, NULL, 0 },
+      {"xref-csv",    required_argument, NULL, 0 },
+
+      // map cell tracing
+      {"definition", required_argument, NULL, 0 },
+      {"rom",        required_argument, NULL, 0 },
+      {"cells-csv",  required_argument, NULL, 0 },
+      {"samples",    required_argument, NULL, 0 },
+      {"logs",       required_argument, NULL, 0 },
+      {"threads",    required_argument, NULL, 0 },
+      {"predict",    required_argument, NULL, 0 },
+      {"predict-csv", required_argument, NULL, 0 },
+
+      // ROM editing
+      {"edit",       required_argument, NULL, 0 },
+      {"patch",      required_argument, NULL, 0 },
+      {"undo",       no_argument,       NULL, 0 },
+      {"redo",       no_argument,       NULL, 0 },
       {NULL,       0,                 NULL,   0 }
     };
 
@@ -161,16 +256,277 @@ size_t getCommandArgs(int argc, char** argv, ecudump_args_t* args)
             break;
         }
 
+        if (strcmp(long_options[option_index].name, "verify") == 0) {
+            if      (strcmp(optarg, "all")     == 0) args->params.write.verify = ECUDUMP_VERIFY_ALL;
+            else if (strcmp(optarg, "changed") == 0) args->params.write.verify = ECUDUMP_VERIFY_CHANGED;
+            else if (strcmp(optarg, "none")    == 0) args->params.write.verify = ECUDUMP_VERIFY_NONE;
+            else {
+                fprintf(stderr, "--verify must be one of all, changed, none\n");
+                return 1;
+            }
+            break;
+        }
+
         if (strcmp(long_options[option_index].name, "overwrite") == 0) {
           args->overwrite = true;
           break;
         }
 
+        if (strcmp(long_options[option_index].name, "container") == 0) {
+          args->container = true;
+          break;
+        }
+
+        if (strcmp(long_options[option_index].name, "compress") == 0) {
+          args->container = true;
+          args->compress = true;
+          break;
+        }
+
         if (strcmp(long_options[option_index].name, "dry-run") == 0) {
             args->dryRun = true;
             break;
         }
 
+        if (strcmp(long_options[option_index].name, "debug") == 0) {
+            args->debug = true;
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "log-level") == 0) {
+            if      (strcmp(optarg, "error") == 0) args->logLevel = LOG_LEVEL_ERROR;
+            else if (strcmp(optarg, "warn")  == 0) args->logLevel = LOG_LEVEL_WARN;
+            else if (strcmp(optarg, "info")  == 0) args->logLevel = LOG_LEVEL_INFO;
+            else if (strcmp(optarg, "debug") == 0) args->logLevel = LOG_LEVEL_DEBUG;
+            else {
+                fprintf(stderr, "--log-level must be one of error, warn, info, debug\n");
+                command = 0;
+                args->logLevel = -1;
+            }
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "progress-rate") == 0) {
+            args->progressRate = strtol(optarg, NULL, 10);
+            if (args->progressRate < 0) {
+                fprintf(stderr, "--progress-rate must be 0 or more updates per second\n");
+                command = 0;
+            }
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "trace") == 0) {
+            strcpy(args->traceFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "replay") == 0) {
+            strcpy(args->replayFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "hexdump") == 0) {
+            strcpy(args->hexdumpFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "compare") == 0) {
+            strcpy(args->compareFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "width") == 0 ||
+            strcmp(long_options[option_index].name, "stride") == 0) {
+          signed long long ret = decodeHex(optarg, 0xffff);
+          if(ret <= 0) {
+            fprintf(stderr, "could not decode %s=%s (%lld)\n", long_options[option_index].name, optarg, ret);
+            return 1;
+          }
+          if (long_options[option_index].name[0] == 'w') args->hexdumpWidth = ret;
+          else args->hexdumpStride = ret;
+          break;
+        }
+
+        if (strcmp(long_options[option_index].name, "diff-only") == 0) {
+            args->diffOnly = true;
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "edit") == 0) {
+            strcpy(args->editFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "patch") == 0) {
+            strcpy(args->patchFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "undo") == 0) {
+            args->undo = true;
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "redo") == 0) {
+            args->redo = true;
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "print-trace") == 0) {
+            strcpy(args->printTraceFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "dump-info") == 0) {
+            strcpy(args->dumpInfoFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "extract") == 0) {
+            strcpy(args->extractFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "pack") == 0) {
+            strcpy(args->packFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "library") == 0) {
+            snprintf(args->libraryDirectory, sizeof(args->libraryDirectory), "%s", optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "find-calibration") == 0) {
+            snprintf(args->findCalibration, sizeof(args->findCalibration), "%s", optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "identify") == 0) {
+            snprintf(args->identifyFileName, sizeof(args->identifyFileName), "%s", optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "convert") == 0) {
+            snprintf(args->convertFormat, sizeof(args->convertFormat), "%s", optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "output") == 0) {
+            snprintf(args->outputDirectory, sizeof(args->outputDirectory), "%s", optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "xref") == 0) {
+            snprintf(args->xrefFileName, sizeof(args->xrefFileName), "%s", optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "xref-cache") == 0) {
+            snprintf(args->xrefCacheDirectory, sizeof(args->xrefCacheDirectory), "%s", optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "xref-csv") == 0) {
+            snprintf(args->xrefCsvFileName, sizeof(args->xrefCsvFileName), "%s", optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "play") == 0) {
+            strcpy(args->playFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "frame") == 0) {
+          signed long long ret = decodeHex(optarg, 0xffffffff);
+          if(ret < 0) {
+            fprintf(stderr, "could not decode %s=%s (%lld)\n", long_options[option_index].name, optarg, ret);
+            return 1;
+          }
+          args->showFrame = true;
+          args->frame = ret;
+          break;
+        }
+
+        if (strcmp(long_options[option_index].name, "at") == 0) {
+          char* end = NULL;
+          args->frameTime = strtod(optarg, &end);
+          if (end == optarg || *end || args->frameTime < 0) {
+            fprintf(stderr, "could not decode %s=%s\n", long_options[option_index].name, optarg);
+            return 1;
+          }
+          args->showFrame = true;
+          args->frameByTime = true;
+          break;
+        }
+
+        if (strcmp(long_options[option_index].name, "definition") == 0) {
+            strcpy(args->definitionFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "rom") == 0) {
+            strcpy(args->romFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "cells-csv") == 0) {
+            strcpy(args->cellsCsvFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "samples") == 0) {
+          signed long long ret = decodeHex(optarg, 0xffffffff);
+          if(ret < 0) {
+            fprintf(stderr, "could not decode %s=%s (%lld)\n", long_options[option_index].name, optarg, ret);
+            return 1;
+          }
+          args->samples = ret;
+          break;
+        }
+
+        if (strcmp(long_options[option_index].name, "logs") == 0) {
+            snprintf(args->logs, sizeof(args->logs), "%s", optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "predict") == 0) {
+            snprintf(args->predictFileName, sizeof(args->predictFileName), "%s", optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "predict-csv") == 0) {
+            snprintf(args->predictCsvFileName, sizeof(args->predictCsvFileName), "%s", optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "threads") == 0) {
+          signed long long ret = decodeHex(optarg, 256);
+          if(ret < 0) {
+            fprintf(stderr, "could not decode %s=%s (%lld)\n", long_options[option_index].name, optarg, ret);
+            return 1;
+          }
+          args->threads = ret;
+          break;
+        }
+
+        if (strcmp(long_options[option_index].name, "fleet") == 0) {
+            strcpy(args->fleet, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "simulate") == 0) {
+            args->simulate = true;
+            if (optarg)
+                strcpy(args->simulateRomFileName, optarg);
+            break;
+        }
+
+        if (strcmp(long_options[option_index].name, "metrics") == 0) {
+            strcpy(args->metricsFileName, optarg);
+            break;
+        }
+
         if(command) {fprintf(stderr, "only one command may be provided\n"); command=0; break;}
         if(strcmp(long_options[option_index].name, "vin") == 0) {
           command = ECUDUMP_GET_VIN;
@@ -192,6 +548,20 @@ size_t getCommandArgs(int argc, char** argv, ecudump_args_t* args)
           command = ECUDUMP_UNLOCK;
           break;
         }
+        if(strcmp(long_options[option_index].name, "discover") == 0) {
+          command = ECUDUMP_DISCOVER;
+          break;
+        }
+        if(strcmp(long_options[option_index].name, "cells") == 0) {
+          command = ECUDUMP_TRACE_CELLS;
+          strcpy(args->cellsFileName, optarg);
+          break;
+        }
+        if(strcmp(long_options[option_index].name, "ram-video") == 0) {
+          command = ECUDUMP_RAM_VIDEO;
+          strcpy(args->ramVideoFileName, optarg);
+          break;
+        }
         if(strcmp(long_options[option_index].name, "download") == 0) {
           command = ECUDUMP_READ_MEM;
           if (optarg)
@@ -299,6 +669,104 @@ size_t getCommandArgs(int argc, char** argv, ecudump_args_t* args)
           fprintf(stderr, "[writemem] SBL file is required to upload rom\n");
           return 1;
       }
+      if (args->params.write.verify == ECUDUMP_VERIFY_CHANGED && !args->compareFileName[0]) {
+          fprintf(stderr, "[writemem] --verify=changed needs --compare, the ROM the ECU had before\n");
+          return 1;
+      }
+  }
+
+  else if (_TRACE_CELLS(command)) {
+      if (!args->definitionFileName[0]) {
+          fprintf(stderr, "[cells] --definition is required\n");
+          return 1;
+      }
+      if (!args->romFileName[0] && !args->simulateRomFileName[0]) {
+          fprintf(stderr, "[cells] --rom is required for the axis breakpoints\n");
+          return 1;
+      }
+      if (!args->cellsCsvFileName[0])
+          strcpy(args->cellsCsvFileName, "cells.csv");
+  }
+
+  else if (_RAM_VIDEO(command)) {
+      // the README's RAM dump, 0 chunk size reads as much as fits in one request
+      if (args->params.transfer.startAddress == 0) {
+          if (args->verbose) fprintf(stderr, "[ramvideo] using default start address 0x%08x\n", 0xffff6000);
+          args->params.transfer.startAddress = 0xffff6000;
+      }
+      if (args->params.transfer.transferSize == 0) {
+          if (args->verbose) fprintf(stderr, "[ramvideo] using default transfer size 0x%08x\n", 0x7D00);
+          args->params.transfer.transferSize = 0x7D00;
+      }
+  }
+
+  if (args->logs[0] && !_TRACE_CELLS(command)) {
+      fprintf(stderr, "[cells] --logs needs --cells\n");
+      return 1;
+  }
+  if (args->predictFileName[0] && (!args->logs[0] || !args->romFileName[0])) {
+      fprintf(stderr, "[cells] --predict needs --logs and --rom, the ROM it is compared with\n");
+      return 1;
+  }
+  if (args->predictFileName[0] && !args->predictCsvFileName[0])
+      strcpy(args->predictCsvFileName, "predict.csv");
+  if (args->packFileName[0])
+      return 0;
+  if (args->findCalibration[0] && !args->libraryDirectory[0]) {
+      fprintf(stderr, "[library] --find-calibration needs --library\n");
+      return 1;
+  }
+  if (args->libraryDirectory[0])
+      return 0;
+  if (args->identifyFileName[0]) {
+      if (!args->definitionFileName[0]) {
+          fprintf(stderr, "[definition] --identify needs --definition, a directory of definitions\n");
+          return 1;
+      }
+      return 0;
+  }
+  if (args->convertFormat[0]) {
+      if (strcmp(args->convertFormat, "ecuflash") && strcmp(args->convertFormat, "romraider")) {
+          fprintf(stderr, "[definition] --convert is ecuflash or romraider\n");
+          return 1;
+      }
+      if (!args->definitionFileName[0] || !args->outputDirectory[0]) {
+          fprintf(stderr, "[definition] --convert needs --definition, a file or directory, and --output\n");
+          return 1;
+      }
+      return 0;
+  }
+  if (args->xrefCsvFileName[0] && (!args->xrefFileName[0] || !args->definitionFileName[0])) {
+      fprintf(stderr, "[xref] --xref-csv needs --xref and --definition\n");
+      return 1;
+  }
+  if (args->xrefFileName[0]) {
+      if (!args->xrefCacheDirectory[0])
+          strcpy(args->xrefCacheDirectory, "xref-cache");
+      if (args->definitionFileName[0] && !args->xrefCsvFileName[0])
+          strcpy(args->xrefCsvFileName, "xref.csv");
+      return 0;
+  }
+  if (args->extractFileName[0] && !args->dumpInfoFileName[0]) {
+      fprintf(stderr, "[container] --extract needs --dump-info\n");
+      return 1;
+  }
+  if (args->container && !args->dumpInfoFileName[0] && (!_READ_MEM(command) || args->fleet[0])) {
+      fprintf(stderr, "[readmem] --container only works with --download\n");
+      return 1;
+  }
+  if (args->fleet[0] && !_READ_MEM(command)) {
+      fprintf(stderr, "[fleet] only --download is supported with --fleet\n");
+      return 1;
+  }
+  if (args->fleet[0] && (args->traceFileName[0] || args->replayFileName[0])) {
+      fprintf(stderr, "[fleet] --trace and --replay only record or replay a single device\n");
+      return 1;
+  }
+  if (args->logLevel < 0) return 1;
+  if (args->simulate && args->replayFileName[0]) {
+      fprintf(stderr, "--simulate and --replay are exclusive\n");
+      return 1;
   }
 
   if (args->params.transfer.chunkSize > args->params.transfer.transferSize) {
@@ -306,5 +774,36 @@ size_t getCommandArgs(int argc, char** argv, ecudump_args_t* args)
       return 1;
   }
 
+  if (args->editFileName[0]) {
+      if ((args->patchFileName[0] ? 1 : 0) + args->undo + args->redo != 1) {
+          fprintf(stderr, "[edit] one of --patch, --undo or --redo is required\n");
+          return 1;
+      }
+      if (args->patchFileName[0] && !args->definitionFileName[0]) {
+          fprintf(stderr, "[edit] --definition is required to find the tables of a patch\n");
+          return 1;
+      }
+      return 0;
+  }
+
+  if (args->dumpInfoFileName[0])
+      return 0;
+
+  if (args->showFrame && !args->playFileName[0]) {
+      fprintf(stderr, "[ramvideo] --frame and --at need --play\n");
+      return 1;
+  }
+  if (args->hexdumpFileName[0] || args->printTraceFileName[0] || args->playFileName[0]) {
+      if (args->hexdumpWidth > HEXDUMP_MAX_WIDTH) {
+          fprintf(stderr, "[hexdump] --width can be at most %u\n", (unsigned)HEXDUMP_MAX_WIDTH);
+          return 1;
+      }
+      if (args->hexdumpStride && args->hexdumpStride < (args->hexdumpWidth ? args->hexdumpWidth : HEXDUMP_DEFAULT_WIDTH)) {
+          fprintf(stderr, "[hexdump] --stride cannot be smaller than --width\n");
+          return 1;
+      }
+      return 0;
+  }
+
   return command == 0;
 }
\ No newline at end of file
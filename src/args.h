@@ -33,6 +33,9 @@ static const uint16_t ECUDUMP_CALCULATE_KEY = 0b0011000000000000;
 static const uint16_t ECUDUMP_UNLOCK        = 0b0011100000000000;
 static const uint16_t ECUDUMP_READ_MEM      = 0b1111110000000000;
 static const uint16_t ECUDUMP_WRITE_MEM     = 0b1111101000000000;
+static const uint16_t ECUDUMP_DISCOVER      = 0b0000000100000000;
+static const uint16_t ECUDUMP_TRACE_CELLS   = 0b0011100010000000;
+static const uint16_t ECUDUMP_RAM_VIDEO     = 0b0011100001000000;
 
 #define _GET_VIN(COMMAND)       ((COMMAND >> 15) & 1)
 #define _GET_CALID(COMMAND)     ((COMMAND >> 14) & 1)
@@ -42,9 +45,17 @@ static const uint16_t ECUDUMP_WRITE_MEM     = 0b1111101000000000;
 #define _UNLOCK(COMMAND)        ((COMMAND >> 11) & 1)
 #define _READ_MEM(COMMAND)      ((COMMAND >> 10) & 1)
 #define _WRITE_MEM(COMMAND)     ((COMMAND >>  9) & 1)
+#define _DISCOVER(COMMAND)      ((COMMAND >>  8) & 1)
+#define _TRACE_CELLS(COMMAND)   ((COMMAND >>  7) & 1)
+#define _RAM_VIDEO(COMMAND)     ((COMMAND >>  6) & 1)
 
 typedef uint16_t ecudump_cmd_t;
 
+// what --upload reads back once the ECU is running the new ROM
+static const int ECUDUMP_VERIFY_ALL     = 0;
+static const int ECUDUMP_VERIFY_CHANGED = 1;   // blocks that differ from --compare, the image the ECU held before
+static const int ECUDUMP_VERIFY_NONE    = 2;
+
 /**
  * @brief params for a transfer. 
  * Optional, but helpful for tuning
@@ -60,6 +71,8 @@ typedef struct transfer_params {
 
 typedef struct writemem_params {
 	char SBLfileName[255];
+	// ECUDUMP_VERIFY_*
+	int verify;
 } writemem_params_t;
 
 typedef struct ecudump_params {
@@ -73,6 +86,81 @@ typedef struct ecudump_args {
 	bool verbose;
 	bool overwrite;
 	bool dryRun;
+	bool debug;
+	// LOG_LEVEL_*, 0 keeps the default
+	int logLevel;
+	// progress updates per second, 0 disables them and -1 keeps the default
+	long progressRate;
+	// record every passthru message to a binary trace
+	char traceFileName[255];
+	// use a recorded trace instead of the passthru device
+	char replayFileName[255];
+	// dump several devices in parallel, a count or comma separated device names
+	char fleet[255];
+	// talk to a simulated ECU instead of the passthru device, optionally seeded with a ROM
+	bool simulate;
+	char simulateRomFileName[255];
+	// export UDS latency metrics at exit, Prometheus text for .prom/.txt, JSON otherwise
+	char metricsFileName[255];
+	// offline viewers, no ECU needed. The hexdump honours --start-address and --transfer-size
+	char hexdumpFileName[255];
+	char compareFileName[255];
+	uint32_t hexdumpWidth;
+	uint32_t hexdumpStride;
+	bool diffOnly;
+	char printTraceFileName[255];
+	// log RAM and count which cells of the definition's tables get used, see celltrace.h
+	char cellsFileName[255];
+	// or a directory of them, the one matching the ROM's internal ID is picked, see defindex.h
+	char definitionFileName[255];
+	// axis breakpoints come from here, or the --simulate ROM
+	char romFileName[255];
+	char cellsCsvFileName[255];
+	// stop after this many samples, 0 runs until interrupted
+	uint32_t samples;
+	// analyze recorded logs instead, comma separated files and directories of *.csv
+	char logs[1024];
+	// worker threads for the logs, 0 for one per core
+	uint32_t threads;
+	// replay the logs through the tables of --rom and of this changed ROM, see tableeval.h
+	char predictFileName[255];
+	char predictCsvFileName[255];
+	// edit a ROM image in place with a patch, or step through its edit journal, see romedit.h
+	char editFileName[255];
+	char patchFileName[255];
+	bool undo;
+	bool redo;
+	// record the RAM window at --start-address/--transfer-size over and over, see ramvideo.h
+	char ramVideoFileName[255];
+	// offline: list the frames of a recording, or dump one against the frame before it
+	char playFileName[255];
+	bool showFrame;
+	uint32_t frame;
+	// pick the frame by time instead, seconds since the first frame
+	bool frameByTime;
+	double frameTime;
+	// --download into a container with VIN, CALID, read timings and block CRCs, see dumpfile.h
+	bool container;
+	// LZ4 compress the container block by block, implies --container
+	bool compress;
+	// offline: what a container holds, verified, or its blocks that differ from --compare
+	char dumpInfoFileName[255];
+	// offline: the raw dump out of a container, or a raw dump into one
+	char extractFileName[255];
+	char packFileName[255];
+	// offline: index the calibration packages in a directory, or look one up, see calindex.h
+	char libraryDirectory[255];
+	char findCalibration[64];
+	// offline: which definitions of the --definition directory match a ROM
+	char identifyFileName[255];
+	// offline: --definition converted to ecuflash or romraider into --output, see defconvert.h
+	char convertFormat[16];
+	char outputDirectory[255];
+	// offline: which code refers to which address of a ROM, see sh2xref.h. Lists the references
+	// to --start-address (up to --transfer-size), or to every table of --definition into --xref-csv
+	char xrefFileName[255];
+	char xrefCacheDirectory[255];
+	char xrefCsvFileName[255];
 	ecudump_params_t params;
 } ecudump_args_t;
 
@@ -0,0 +1,552 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#include <io.h>
+#define F_OK 0
+#define access _access
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "calindex.h"
+#include "crc32c.h"
+#include "zipfile.h"
+#include "util.h"
+
+static const char* TAG = "Calindex";
+
+typedef struct Calindex_File {
+  char*    path;
+  const char* name;   // relative to the directory
+  uint64_t size;
+  int64_t  time;
+} calindex_file_t;
+
+typedef struct Calindex_Job {
+  calindex_file_t* files;
+  size_t numFiles;
+  std::atomic<size_t> next;
+} calindex_job_t;
+
+typedef struct Calindex_Worker {
+  std::vector<calindex_entry_t> entries;
+  uint8_t* buffer;      // extracted PHF
+  size_t   capacity;
+  uint64_t bytes;
+} calindex_worker_t;
+
+static bool calindex_has_suffix(const char* name, const char* suffix)
+{
+  size_t n = strlen(name), m = strlen(suffix);
+  if (m > n) return false;
+  for (size_t i = 0; i < m; i++)
+    if (tolower((unsigned char)name[n - m + i]) != tolower((unsigned char)suffix[i]))
+      return false;
+  return true;
+}
+
+// upper case, without surrounding spaces and an "SW-" prefix
+static void calindex_normalize(char* out, size_t size, const char* in, size_t length)
+{
+  while (length && isspace((unsigned char)*in)) {
+    in++;
+    length--;
+  }
+  while (length && isspace((unsigned char)in[length - 1]))
+    length--;
+  if (length > 3 && toupper((unsigned char)in[0]) == 'S' && toupper((unsigned char)in[1]) == 'W' && in[2] == '-') {
+    in += 3;
+    length -= 3;
+  }
+  size_t n = length < size ? length : size - 1;
+  for (size_t i = 0; i < n; i++)
+    out[i] = (char)toupper((unsigned char)in[i]);
+  out[n] = 0;
+}
+
+size_t calindex_parse_phf(const uint8_t* data, size_t length, calindex_field_fn field, void* ctx)
+{
+  const uint8_t* end = (const uint8_t*)memchr(data, '$', length);
+  if (!end) return 0;
+
+  const uint8_t* p = data;
+  while (p < end) {
+    const uint8_t* next = (const uint8_t*)memchr(p, 0, (size_t)(end - p));
+    if (!next) next = end;
+    const uint8_t* separator = (const uint8_t*)memchr(p, '>', (size_t)(next - p));
+    if (separator) {
+      const char* key = (const char*)p;
+      size_t keyLength = (size_t)(separator - p);
+      while (keyLength && (isspace((unsigned char)*key) || !*key)) {
+        key++;
+        keyLength--;
+      }
+      while (keyLength && isspace((unsigned char)key[keyLength - 1]))
+        keyLength--;
+      const char* value = (const char*)separator + 1;
+      size_t valueLength = (size_t)(next - separator - 1);
+      while (valueLength && isspace((unsigned char)value[valueLength - 1]))
+        valueLength--;
+      if (keyLength) field(ctx, key, keyLength, value, valueLength);
+    }
+    p = next + 1;
+  }
+  return (size_t)(end - data) + 1;
+}
+
+// header keys compared without case, spaces and underscores
+static bool calindex_key_is(const char* key, size_t length, const char* name)
+{
+  for (size_t i = 0; i < length; i++) {
+    if (key[i] == '_' || key[i] == ' ' || key[i] == '-') continue;
+    if (!*name || toupper((unsigned char)key[i]) != *name) return false;
+    name++;
+  }
+  return !*name;
+}
+
+static void calindex_field(void* ctx, const char* key, size_t keyLength, const char* value, size_t valueLength)
+{
+  calindex_entry_t* entry = (calindex_entry_t*)ctx;
+  entry->headerFields++;
+  if (calindex_key_is(key, keyLength, "PARTNUMBER") || calindex_key_is(key, keyLength, "PARTNO") ||
+      calindex_key_is(key, keyLength, "SOFTWAREPARTNUMBER")) {
+    if (!entry->partNumber[0]) calindex_normalize(entry->partNumber, sizeof(entry->partNumber), value, valueLength);
+  } else if (calindex_key_is(key, keyLength, "CALID") || calindex_key_is(key, keyLength, "CALIBRATIONID") ||
+             calindex_key_is(key, keyLength, "CALIBRATION")) {
+    if (!entry->calid[0]) calindex_normalize(entry->calid, sizeof(entry->calid), value, valueLength);
+  }
+}
+
+size_t calindex_read_phf(const uint8_t* data, size_t length, calindex_entry_t* entry)
+{
+  entry->headerFields = 0;
+  size_t payload = calindex_parse_phf(data, length, calindex_field, entry);
+  if (!payload || !entry->headerFields) return EINVAL;
+  entry->payloadLength = (uint32_t)(length - payload);
+  entry->payloadCrc    = crc32c(0, data + payload, length - payload);
+  return 0;
+}
+
+static void calindex_add(calindex_worker_t* worker, const calindex_file_t* file, const char* member,
+                         const uint8_t* data, size_t length)
+{
+  calindex_entry_t entry;
+  memset(&entry, 0, sizeof(entry));
+  snprintf(entry.archive, sizeof(entry.archive), "%s", file->name);
+  snprintf(entry.member, sizeof(entry.member), "%s", member);
+  entry.archiveSize = file->size;
+  entry.archiveTime = file->time;
+
+  if (!data || calindex_read_phf(data, length, &entry))
+    entry.flags |= CALINDEX_DAMAGED;
+  if (data) worker->bytes += length;
+  // the file name stands in for a header without a part number, SW-N3K1EU000.PHF
+  if (!entry.partNumber[0]) {
+    const char* base = member[0] ? member : file->name;
+    const char* slash = strrchr(base, '/');
+    if (slash) base = slash + 1;
+    const char* dot = strrchr(base, '.');
+    calindex_normalize(entry.partNumber, sizeof(entry.partNumber), base, dot ? (size_t)(dot - base) : strlen(base));
+  }
+  if (!entry.calid[0]) strcpy(entry.calid, entry.partNumber);
+  if (entry.flags & CALINDEX_DAMAGED)
+    LOGE(TAG, "%s%s%s is damaged", file->name, member[0] ? ":" : "", member);
+  worker->entries.push_back(entry);
+}
+
+static void calindex_scan(calindex_worker_t* worker, const calindex_file_t* file)
+{
+  if (calindex_has_suffix(file->name, ".phf")) {
+    mapfile_t map;
+    if (mapfile_open(&map, file->path)) {
+      calindex_add(worker, file, "", NULL, 0);
+      return;
+    }
+    calindex_add(worker, file, "", map.data, map.length);
+    mapfile_close(&map);
+    return;
+  }
+
+  zipfile_t zip;
+  if (zipfile_open(&zip, file->path)) {
+    calindex_add(worker, file, "", NULL, 0);
+    return;
+  }
+  size_t phfs = 0;
+  for (size_t e = 0; e < zip.numEntries; e++) {
+    const zipfile_entry_t* member = &zip.entries[e];
+    if (!calindex_has_suffix(member->name, ".phf")) continue;
+    phfs++;
+    if (member->length > worker->capacity) {
+      uint8_t* grown = (uint8_t*)realloc(worker->buffer, member->length);
+      if (!grown) {
+        calindex_add(worker, file, member->name, NULL, 0);
+        continue;
+      }
+      worker->buffer = grown;
+      worker->capacity = member->length;
+    }
+    if (zipfile_extract(&zip, member, worker->buffer)) calindex_add(worker, file, member->name, NULL, 0);
+    else calindex_add(worker, file, member->name, worker->buffer, member->length);
+  }
+  if (!phfs) {
+    calindex_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    snprintf(entry.archive, sizeof(entry.archive), "%s", file->name);
+    entry.archiveSize = file->size;
+    entry.archiveTime = file->time;
+    entry.flags = CALINDEX_NO_PHF;
+    LOGI(TAG, "%s holds no PHF files", file->name);
+    worker->entries.push_back(entry);
+  }
+  zipfile_close(&zip);
+}
+
+static void calindex_worker(calindex_job_t* job, calindex_worker_t* worker)
+{
+  for (;;) {
+    size_t f = job->next++;
+    if (f >= job->numFiles) break;
+    calindex_scan(worker, &job->files[f]);
+  }
+}
+
+static bool calindex_by_calid(const calindex_entry_t& a, const calindex_entry_t& b)
+{
+  int c = strcmp(a.calid, b.calid);
+  if (!c) c = strcmp(a.partNumber, b.partNumber);
+  if (!c) c = strcmp(a.archive, b.archive);
+  if (!c) c = strcmp(a.member, b.member);
+  return c < 0;
+}
+
+static size_t calindex_stat(calindex_file_t* file)
+{
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  struct _stat64 st;
+  if (_stat64(file->path, &st)) return errno;
+#else
+  struct stat st;
+  if (stat(file->path, &st)) return errno;
+#endif
+  file->size = (uint64_t)st.st_size;
+  file->time = (int64_t)st.st_mtime;
+  return 0;
+}
+
+static size_t calindex_save(const char* path, const std::vector<calindex_entry_t>& entries)
+{
+  calindex_header_t header;
+  std::vector<uint32_t> byPart(entries.size());
+  char temporary[512];
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CALINDEX_MAGIC, sizeof(CALINDEX_MAGIC));
+  header.version    = CALINDEX_VERSION;
+  header.entrySize  = sizeof(calindex_entry_t);
+  header.numEntries = entries.size();
+  header.updated    = (int64_t)time(NULL);
+  for (size_t e = 0; e < entries.size(); e++)
+    byPart[e] = (uint32_t)e;
+  std::stable_sort(byPart.begin(), byPart.end(), [&entries](uint32_t a, uint32_t b) {
+    return strcmp(entries[a].partNumber, entries[b].partNumber) < 0;
+  });
+
+  // written next to it and renamed over it, a reader never sees half an index
+  if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= (int)sizeof(temporary))
+    return ENAMETOOLONG;
+  FILE* file = fopen(temporary, "wb");
+  if (!file) {
+    size_t ret = errno;
+    LOGE(TAG, "Failed to create %s %s", temporary, strerror(errno));
+    return ret;
+  }
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(entries.data(), sizeof(calindex_entry_t), entries.size(), file) == entries.size() &&
+                 fwrite(byPart.data(), sizeof(uint32_t), byPart.size(), file) == byPart.size();
+  if (fclose(file) || !written) {
+    LOGE(TAG, "Failed to write %s", temporary);
+    remove(temporary);
+    return EIO;
+  }
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  if (!MoveFileExA(temporary, path, MOVEFILE_REPLACE_EXISTING)) {
+    LOGE(TAG, "Failed to replace %s (%lu)", path, GetLastError());
+    remove(temporary);
+    return EIO;
+  }
+#else
+  if (rename(temporary, path)) {
+    size_t ret = errno;
+    LOGE(TAG, "Failed to replace %s %s", path, strerror(errno));
+    remove(temporary);
+    return ret;
+  }
+#endif
+  return 0;
+}
+
+static size_t calindex_list(const char* directory, std::vector<calindex_file_t>& files)
+{
+  static const char* suffixes[2] = { ".zip", ".phf" };
+  size_t prefix = strlen(directory) + 1;
+  for (size_t s = 0; s < 2; s++) {
+    size_t count = 0;
+    char** paths = list_files(directory, suffixes[s], &count);
+    if (!paths) return errno ? errno : ENOENT;
+    for (size_t p = 0; p < count; p++) {
+      calindex_file_t file;
+      memset(&file, 0, sizeof(file));
+      file.path = paths[p];
+      file.name = paths[p] + prefix;
+      if (strlen(file.name) >= sizeof(((calindex_entry_t*)0)->archive)) {
+        LOGE(TAG, "Skipping %s, the name is too long", file.name);
+        free(paths[p]);
+        continue;
+      }
+      if (calindex_stat(&file)) {
+        LOGE(TAG, "Skipping %s %s", file.name, strerror(errno));
+        free(paths[p]);
+        continue;
+      }
+      files.push_back(file);
+    }
+    free(paths);
+  }
+  return 0;
+}
+
+size_t calindex_update(const char* directory, const char* path, unsigned threads, calindex_stats_t* stats)
+{
+  uint64_t start = monotonic_us();
+  std::vector<calindex_file_t> files;
+  std::vector<calindex_file_t> changed;
+  std::vector<calindex_entry_t> entries;
+  calindex_worker_t* workers = NULL;
+  calindex_t index;
+  bool indexed = false;
+  size_t ret;
+
+  memset(stats, 0, sizeof(calindex_stats_t));
+  if ((ret = calindex_list(directory, files))) {
+    LOGE(TAG, "Failed to list %s %s", directory, strerror((int)ret));
+    return ret;
+  }
+  stats->files = files.size();
+
+  // what is still there and unchanged keeps its entries
+  if (access(path, F_OK) == 0 && !calindex_open(&index, path)) {
+    indexed = true;
+    std::vector<uint32_t> byArchive(index.numEntries);
+    for (size_t e = 0; e < index.numEntries; e++)
+      byArchive[e] = (uint32_t)e;
+    std::sort(byArchive.begin(), byArchive.end(), [&index](uint32_t a, uint32_t b) {
+      return strcmp(index.entries[a].archive, index.entries[b].archive) < 0;
+    });
+    std::vector<bool> seen(index.numEntries);
+    for (size_t f = 0; f < files.size(); f++) {
+      auto first = std::lower_bound(byArchive.begin(), byArchive.end(), files[f].name, [&index](uint32_t e, const char* name) {
+        return strcmp(index.entries[e].archive, name) < 0;
+      });
+      auto last = first;
+      while (last != byArchive.end() && !strcmp(index.entries[*last].archive, files[f].name)) {
+        seen[*last] = true;
+        last++;
+      }
+      if (first != last && index.entries[*first].archiveSize == files[f].size &&
+          index.entries[*first].archiveTime == files[f].time) {
+        for (auto e = first; e != last; e++)
+          entries.push_back(index.entries[*e]);
+        stats->unchanged += (size_t)(last - first);
+      } else {
+        changed.push_back(files[f]);
+      }
+    }
+    // counted once per package, not per PHF
+    for (size_t e = 0; e < byArchive.size(); e++) {
+      const calindex_entry_t* entry = &index.entries[byArchive[e]];
+      if (!seen[byArchive[e]] && (!e || strcmp(entry->archive, index.entries[byArchive[e - 1]].archive)))
+        stats->removed++;
+    }
+    calindex_close(&index);
+  } else {
+    changed = files;
+  }
+  stats->scanned = changed.size();
+
+  if (!changed.empty()) {
+    calindex_job_t job;
+    if (!threads) threads = std::thread::hardware_concurrency();
+    if (!threads) threads = 1;
+    if (threads > changed.size()) threads = (unsigned)changed.size();
+    stats->threads = threads;
+
+    workers = new calindex_worker_t[threads]();
+    job.files    = changed.data();
+    job.numFiles = changed.size();
+    job.next     = 0;
+    {
+      std::vector<std::thread> pool;
+      for (unsigned t = 1; t < threads; t++)
+        pool.push_back(std::thread(calindex_worker, &job, &workers[t]));
+      calindex_worker(&job, &workers[0]);
+      for (size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+    }
+    for (unsigned t = 0; t < threads; t++) {
+      entries.insert(entries.end(), workers[t].entries.begin(), workers[t].entries.end());
+      stats->bytes += workers[t].bytes;
+      free(workers[t].buffer);
+    }
+    delete[] workers;
+  }
+
+  for (size_t e = 0; e < entries.size(); e++) {
+    if (!(entries[e].flags & CALINDEX_NO_PHF)) stats->phfs++;
+    if (entries[e].flags & CALINDEX_DAMAGED) stats->damaged++;
+  }
+  // nothing new, nothing gone: the index is current as it is
+  if (!indexed || stats->scanned || stats->removed) {
+    std::sort(entries.begin(), entries.end(), calindex_by_calid);
+    ret = calindex_save(path, entries);
+  }
+
+  for (size_t f = 0; f < files.size(); f++)
+    free(files[f].path);
+  stats->elapsedUs = monotonic_us() - start;
+  return ret;
+}
+
+size_t calindex_open(calindex_t* index, const char* path)
+{
+  memset(index, 0, sizeof(calindex_t));
+  size_t ret = mapfile_open(&index->map, path);
+  if (ret) return ret;
+
+  const calindex_header_t* header = (const calindex_header_t*)index->map.data;
+  if (index->map.length < sizeof(calindex_header_t) || memcmp(header->magic, CALINDEX_MAGIC, sizeof(CALINDEX_MAGIC)) ||
+      header->version != CALINDEX_VERSION || header->entrySize != sizeof(calindex_entry_t) ||
+      header->numEntries > (index->map.length - sizeof(calindex_header_t)) / (sizeof(calindex_entry_t) + sizeof(uint32_t))) {
+    LOGE(TAG, "%s is no calibration index of this version", path);
+    mapfile_close(&index->map);
+    return EINVAL;
+  }
+  index->header     = header;
+  index->numEntries = (size_t)header->numEntries;
+  index->entries    = (const calindex_entry_t*)(index->map.data + sizeof(calindex_header_t));
+  index->byPart     = (const uint32_t*)(index->entries + index->numEntries);
+  for (size_t e = 0; e < index->numEntries; e++) {
+    if (index->byPart[e] >= index->numEntries) {
+      LOGE(TAG, "%s is damaged", path);
+      calindex_close(index);
+      return EINVAL;
+    }
+  }
+  return 0;
+}
+
+void calindex_close(calindex_t* index)
+{
+  if (index->header) mapfile_close(&index->map);
+  memset(index, 0, sizeof(calindex_t));
+}
+
+size_t calindex_find(const calindex_t* index, const char* id, const calindex_entry_t** matches, size_t max)
+{
+  char key[32];
+  size_t found = 0;
+  calindex_normalize(key, sizeof(key), id, strlen(id));
+
+  const calindex_entry_t* entries = index->entries;
+  const calindex_entry_t* first = std::lower_bound(entries, entries + index->numEntries, key,
+    [](const calindex_entry_t& entry, const char* k) { return strcmp(entry.calid, k) < 0; });
+  for (const calindex_entry_t* e = first; e < entries + index->numEntries && !strcmp(e->calid, key); e++) {
+    if (found < max) matches[found] = e;
+    found++;
+  }
+
+  const uint32_t* part = std::lower_bound(index->byPart, index->byPart + index->numEntries, key,
+    [entries](uint32_t entry, const char* k) { return strcmp(entries[entry].partNumber, k) < 0; });
+  for (; part < index->byPart + index->numEntries && !strcmp(entries[*part].partNumber, key); part++) {
+    // listed already if its CALID is the part number
+    if (!strcmp(entries[*part].calid, key)) continue;
+    if (found < max) matches[found] = &entries[*part];
+    found++;
+  }
+  return found;
+}
+
+size_t calindex_library(const char* directory, const char* id, unsigned threads)
+{
+  char path[512];
+  calindex_stats_t stats;
+  calindex_t index;
+  size_t ret;
+
+  if (snprintf(path, sizeof(path), "%s/%s", directory, CALINDEX_FILE_NAME) >= (int)sizeof(path)) {
+    LOGE(TAG, "%s is too long", directory);
+    return ENAMETOOLONG;
+  }
+  // a lookup uses the index as it is, updating it is a walk over every package
+  if (!id[0] || access(path, F_OK) != 0) {
+    if ((ret = calindex_update(directory, path, threads, &stats)))
+      return ret;
+    LOGI(TAG, "%zu packages, %zu opened with %u threads (%.1f MB extracted) in %.1f ms, %zu entries unchanged, %zu packages gone",
+         stats.files, stats.scanned, stats.threads, (double)stats.bytes / (1024.0 * 1024.0),
+         (double)stats.elapsedUs / 1000.0, stats.unchanged, stats.removed);
+    LOGI(TAG, "%zu PHF files indexed in %s", stats.phfs, path);
+    if (stats.damaged)
+      LOGE(TAG, "%zu packages or PHF files couldn't be read", stats.damaged);
+    if (!id[0])
+      return 0;
+  }
+
+  const calindex_entry_t* matches[32];
+  size_t max = sizeof(matches) / sizeof(matches[0]);
+  if ((ret = calindex_open(&index, path)))
+    return ret;
+  uint64_t start = monotonic_us();
+  size_t found = calindex_find(&index, id, matches, max);
+  uint64_t elapsed = monotonic_us() - start;
+  if (!found) {
+    LOGE(TAG, "No calibration %s among %zu entries (%llu us)", id, index.numEntries, (unsigned long long)elapsed);
+    calindex_close(&index);
+    return ENOENT;
+  }
+  LOGI(TAG, "%zu matches for %s (%llu us)", found, id, (unsigned long long)elapsed);
+  for (size_t m = 0; m < found && m < max; m++) {
+    const calindex_entry_t* entry = matches[m];
+    LOGI(TAG, "  part %-12s CALID %-12s %s%s%s, %u byte payload, CRC32C 0x%08x%s", entry->partNumber, entry->calid,
+         entry->archive, entry->member[0] ? ":" : "", entry->member, entry->payloadLength, entry->payloadCrc,
+         (entry->flags & CALINDEX_DAMAGED) ? " (damaged)" : "");
+  }
+  calindex_close(&index);
+  return 0;
+}
@@ -0,0 +1,129 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "mapfile.h"
+
+/* Calibration package library.
+ *
+ * An index over a directory of the SW-*.zip packages fms-calibration-scraper.sh
+ * downloads (and any loose .phf files), so the stock calibration for a car is a lookup
+ * instead of a search. A package holds one or more PHF files: a text header of
+ * `key >value` fields, each ended by a NUL, up to a '$', then the payload that gets
+ * flashed. For every PHF the index keeps the part number, the CALID, where it is, and
+ * the length and CRC32C of its payload, so the same calibration in two packages shows
+ * up as the same CRC.
+ *
+ * Updates are incremental: a package whose size and modification time match the index
+ * keeps its entries, only new or changed ones are opened. Those are extracted and
+ * parsed by worker threads, one package at a time. Packages that can't be read stay in
+ * the index flagged, so they aren't opened again until they change.
+ *
+ * File layout:
+ *   calindex_header_t
+ *   calindex_entry_t entries[numEntries]  sorted by CALID
+ *   uint32_t byPart[numEntries]           entry numbers sorted by part number
+ * Part numbers and CALIDs are upper case, a lookup is a binary search over either.
+ */
+
+#define CALINDEX_MAGIC     "RX8CIDX"
+#define CALINDEX_FILE_NAME "calibrations.idx"
+static const uint32_t CALINDEX_VERSION = 1;
+
+// entry flags
+static const uint32_t CALINDEX_DAMAGED   = 1;   // no zip we can read, or a PHF without a header
+static const uint32_t CALINDEX_NO_PHF    = 2;   // a zip without PHF files
+static const uint32_t CALINDEX_UNUSABLE  = CALINDEX_DAMAGED | CALINDEX_NO_PHF;
+
+typedef struct Calindex_Header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t entrySize;
+  uint64_t numEntries;
+  int64_t  updated;       // time(), last update
+} calindex_header_t;
+
+typedef struct Calindex_Entry {
+  char     partNumber[32];
+  char     calid[32];
+  char     archive[160];  // relative to the library directory
+  char     member[64];    // PHF inside the archive, empty for a loose one
+  uint64_t archiveSize;
+  int64_t  archiveTime;   // modification time, seconds
+  uint32_t payloadLength;
+  uint32_t payloadCrc;    // CRC32C
+  uint32_t flags;         // CALINDEX_*
+  uint32_t headerFields;
+} calindex_entry_t;
+
+typedef struct Calindex {
+  mapfile_t map;
+  const calindex_header_t* header;
+  const calindex_entry_t* entries;
+  const uint32_t* byPart;
+  size_t numEntries;
+} calindex_t;
+
+typedef struct Calindex_Stats {
+  size_t   files;       // packages in the directory
+  size_t   scanned;     // new or changed, opened
+  size_t   unchanged;   // entries kept from the index
+  size_t   removed;     // packages in the index that are gone
+  size_t   phfs;        // PHF files in the index
+  size_t   damaged;
+  uint64_t bytes;       // PHF bytes extracted
+  unsigned threads;
+  uint64_t elapsedUs;
+} calindex_stats_t;
+
+/** Bring the index of `directory` at `path` up to date with `threads` workers, 0 for one per core. Returns 0 or errno */
+size_t calindex_update(const char* directory, const char* path, unsigned threads, calindex_stats_t* stats);
+
+/** Map an index. Returns 0, errno, or EINVAL if it isn't one */
+size_t calindex_open(calindex_t* index, const char* path);
+void calindex_close(calindex_t* index);
+
+/**
+ * Entries whose CALID or part number is `id` (any case, an "SW-" prefix is ignored),
+ * CALID matches first. Up to `max` go into `matches`, returns how many there are
+ */
+size_t calindex_find(const calindex_t* index, const char* id, const calindex_entry_t** matches, size_t max);
+
+/**
+ * --library: bring the index of `directory` up to date, or look up `id` in it if `id` isn't
+ * empty, updating it first only if there is none yet. Returns 0, ENOENT if nothing matches,
+ * or errno
+ */
+size_t calindex_library(const char* directory, const char* id, unsigned threads);
+
+/**
+ * Parse a PHF header, calling `field` for each `key >value`. Returns the offset of the
+ * payload, after the '$', or 0 if there is no header
+ */
+typedef void (*calindex_field_fn)(void* ctx, const char* key, size_t keyLength, const char* value, size_t valueLength);
+size_t calindex_parse_phf(const uint8_t* data, size_t length, calindex_field_fn field, void* ctx);
+
+/**
+ * Part number, CALID, payload length and CRC of a PHF into `entry`, the fields it has.
+ * Returns 0 or EINVAL. Mazda CALIDs are the part number of the calibration (N3K1EU000),
+ * the index falls back to that, and to the file name for the part number
+ */
+size_t calindex_read_phf(const uint8_t* data, size_t length, calindex_entry_t* entry);
@@ -0,0 +1,833 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CELLTRACE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "celltrace.h"
+#include "defresolve.h"
+#include "librx8.h"
+#include "util.h"
+
+static const char* TAG = "Celltrace";
+
+// sample outside of what the axis can place, e.g. its channel wasn't logged
+static const uint16_t CELLTRACE_NO_INDEX = 0xffff;
+
+void celltrace_init(celltrace_t* trace)
+{
+  memset(trace, 0, sizeof(*trace));
+}
+
+void celltrace_free(celltrace_t* trace)
+{
+  for (size_t i = 0; i < trace->numAxes; i++) {
+    free(trace->axes[i].values);
+    free(trace->axes[i].index);
+    free(trace->axes[i].fraction);
+  }
+  for (size_t i = 0; i < trace->numTables; i++) {
+    free(trace->tables[i].hits);
+    free(trace->tables[i].weights);
+    for (size_t a = 0; a < trace->tables[i].numAverages; a++) {
+      free(trace->tables[i].averageWeights[a]);
+      free(trace->tables[i].sums[a]);
+    }
+  }
+  for (size_t c = 0; c < trace->numChannels; c++)
+    free(trace->differences[c]);
+  free(trace->axes);
+  free(trace->tables);
+  celltrace_init(trace);
+}
+
+size_t celltrace_clone(celltrace_t* clone, const celltrace_t* trace)
+{
+  celltrace_init(clone);
+  for (size_t c = 0; c < trace->numChannels; c++) {
+    if (celltrace_add_channel(clone, &trace->channels[c]) < 0) {
+      celltrace_free(clone);
+      return ENOMEM;
+    }
+  }
+  // adding the tables in the same order shares the axes the same way, so indices match
+  for (size_t t = 0; t < trace->numTables; t++) {
+    const celltrace_table_t* table = &trace->tables[t];
+    const celltrace_axis_t* x = table->x >= 0 ? &trace->axes[table->x] : NULL;
+    const celltrace_axis_t* y = &trace->axes[table->y];
+    size_t ret = celltrace_add_table(clone, table->name, x ? x->values : NULL, table->columns, x ? x->channel : -1,
+                                     y->values, table->rows, y->channel, table->averages, table->numAverages);
+    if (ret) {
+      celltrace_free(clone);
+      return ret;
+    }
+  }
+  return 0;
+}
+
+void celltrace_merge(celltrace_t* trace, const celltrace_t* from)
+{
+  for (size_t t = 0; t < trace->numTables && t < from->numTables; t++) {
+    celltrace_table_t* table = &trace->tables[t];
+    const celltrace_table_t* partial = &from->tables[t];
+    size_t cells = (size_t)table->rows * table->columns;
+    for (size_t i = 0; i < cells; i++) {
+      table->hits[i]    += partial->hits[i];
+      table->weights[i] += partial->weights[i];
+    }
+    for (size_t a = 0; a < table->numAverages; a++) {
+      for (size_t i = 0; i < cells; i++) {
+        table->averageWeights[a][i] += partial->averageWeights[a][i];
+        table->sums[a][i]           += partial->sums[a][i];
+      }
+    }
+    table->samples += partial->samples;
+  }
+  trace->samples += from->samples;
+}
+
+int celltrace_add_channel(celltrace_t* trace, const celltrace_channel_t* channel)
+{
+  if (trace->numChannels == CELLTRACE_MAX_CHANNELS) return -1;
+  switch (channel->source) {
+  case CELLTRACE_SOURCE_RAM:
+    if (!definition_storage_size(channel->storage)) return -1;
+    break;
+  case CELLTRACE_SOURCE_COLUMN:
+    break;
+  case CELLTRACE_SOURCE_DIFFERENCE:
+    // only earlier channels, so one pass in channel order computes every difference
+    if (channel->minuend < 0 || (size_t)channel->minuend >= trace->numChannels ||
+        channel->subtrahend < 0 || (size_t)channel->subtrahend >= trace->numChannels)
+      return -1;
+    trace->differences[trace->numChannels] = (float*)malloc(CELLTRACE_BATCH * sizeof(float));
+    if (!trace->differences[trace->numChannels]) return -1;
+    break;
+  default:
+    return -1;
+  }
+  trace->channels[trace->numChannels] = *channel;
+  trace->numSpans = 0;
+  return (int)trace->numChannels++;
+}
+
+int celltrace_channel(const celltrace_t* trace, const char* name)
+{
+  for (size_t i = 0; i < trace->numChannels; i++)
+    if (strcmp(trace->channels[i].name, name) == 0)
+      return (int)i;
+  return -1;
+}
+
+static bool celltrace_ascending(const float* values, uint16_t length)
+{
+  for (uint16_t i = 0; i < length; i++) {
+    if (!isfinite(values[i])) return false;
+    if (i && values[i] < values[i - 1]) return false;
+  }
+  return length == 1 || values[length - 1] > values[0];
+}
+
+// index of an axis with these breakpoints, added if there is none yet. -1 if out of memory
+static int celltrace_axis(celltrace_t* trace, const float* values, uint16_t length, int channel)
+{
+  for (size_t i = 0; i < trace->numAxes; i++) {
+    const celltrace_axis_t* axis = &trace->axes[i];
+    if (axis->channel == channel && axis->length == length && memcmp(axis->values, values, length * sizeof(float)) == 0)
+      return (int)i;
+  }
+
+  celltrace_axis_t* axes = (celltrace_axis_t*)realloc(trace->axes, (trace->numAxes + 1) * sizeof(celltrace_axis_t));
+  if (!axes) return -1;
+  trace->axes = axes;
+  celltrace_axis_t* axis = &axes[trace->numAxes];
+  memset(axis, 0, sizeof(*axis));
+  axis->values   = (float*)malloc(length * sizeof(float));
+  axis->index    = (uint16_t*)malloc(CELLTRACE_BATCH * sizeof(uint16_t));
+  axis->fraction = (float*)malloc(CELLTRACE_BATCH * sizeof(float));
+  if (!axis->values || !axis->index || !axis->fraction) {
+    free(axis->values);
+    free(axis->index);
+    free(axis->fraction);
+    return -1;
+  }
+  memcpy(axis->values, values, length * sizeof(float));
+  axis->length  = length;
+  axis->channel = channel;
+  axis->origin  = values[0];
+
+  float range = values[length - 1] - values[0];
+  axis->inverseStep = range > 0 ? (float)CELLTRACE_BUCKETS / range : 0;
+  uint16_t last = length > 1 ? (uint16_t)(length - 2) : 0;
+  uint16_t index = 0;
+  for (size_t b = 0; b < CELLTRACE_BUCKETS; b++) {
+    float start = range > 0 ? axis->origin + (float)b / axis->inverseStep : axis->origin;
+    while (index < last && values[index + 1] <= start) index++;
+    axis->buckets[b] = index;
+  }
+  return (int)trace->numAxes++;
+}
+
+size_t celltrace_add_table(celltrace_t* trace, const char* name,
+                           const float* x, uint16_t columns, int xChannel,
+                           const float* y, uint16_t rows, int yChannel,
+                           const int* averages, size_t numAverages)
+{
+  if (!x) columns = 1;
+  if (!y || !rows || !columns || numAverages > CELLTRACE_MAX_AVERAGES) return EINVAL;
+  if ((x && !celltrace_ascending(x, columns)) || !celltrace_ascending(y, rows)) {
+    LOGE(TAG, "%s: axis breakpoints are not ascending", name);
+    return EINVAL;
+  }
+  if ((x && (xChannel < 0 || (size_t)xChannel >= trace->numChannels)) ||
+      yChannel < 0 || (size_t)yChannel >= trace->numChannels)
+    return EINVAL;
+  for (size_t a = 0; a < numAverages; a++)
+    if (averages[a] < 0 || (size_t)averages[a] >= trace->numChannels) return EINVAL;
+
+  celltrace_table_t* tables = (celltrace_table_t*)realloc(trace->tables, (trace->numTables + 1) * sizeof(celltrace_table_t));
+  if (!tables) return ENOMEM;
+  trace->tables = tables;
+  celltrace_table_t* table = &tables[trace->numTables];
+  memset(table, 0, sizeof(*table));
+  snprintf(table->name, sizeof(table->name), "%s", name);
+  table->columns = columns;
+  table->rows    = rows;
+  table->x = x ? celltrace_axis(trace, x, columns, xChannel) : -1;
+  table->y = celltrace_axis(trace, y, rows, yChannel);
+
+  size_t cells = (size_t)rows * columns;
+  // one more row and column past the end, so the four cells around a sample can always be written
+  size_t padded = cells + columns + 1;
+  table->hits    = (uint32_t*)calloc(cells, sizeof(uint32_t));
+  table->weights = (double*)calloc(padded, sizeof(double));
+  bool allocated = table->hits && table->weights;
+  for (size_t a = 0; a < numAverages; a++) {
+    table->averages[a]       = averages[a];
+    table->averageWeights[a] = (double*)calloc(padded, sizeof(double));
+    table->sums[a]           = (double*)calloc(padded, sizeof(double));
+    allocated = allocated && table->averageWeights[a] && table->sums[a];
+  }
+  table->numAverages = numAverages;
+  if ((x && table->x < 0) || table->y < 0 || !allocated) {
+    free(table->hits);
+    free(table->weights);
+    for (size_t a = 0; a < numAverages; a++) {
+      free(table->averageWeights[a]);
+      free(table->sums[a]);
+    }
+    return ENOMEM;
+  }
+  trace->numTables++;
+  return 0;
+}
+
+// interval and fraction of one value, the bucket has already been looked up
+static inline void celltrace_refine(const celltrace_axis_t* axis, float value, uint16_t index, uint16_t* outIndex, float* outFraction)
+{
+  const float* values = axis->values;
+  uint16_t last = axis->length > 1 ? (uint16_t)(axis->length - 2) : 0;
+
+  if (value != value) {
+    *outIndex = CELLTRACE_NO_INDEX;
+    *outFraction = 0;
+    return;
+  }
+  if (axis->length == 1 || value <= values[0]) {
+    *outIndex = 0;
+    *outFraction = 0;
+    return;
+  }
+  if (value >= values[axis->length - 1]) {
+    *outIndex = last;
+    *outFraction = 1;
+    return;
+  }
+  while (index < last && values[index + 1] <= value) index++;
+  float span = values[index + 1] - values[index];
+  *outIndex = index;
+  *outFraction = span > 0 ? (value - values[index]) / span : 0;
+}
+
+/** place `count` values on the axis, into axis->index and axis->fraction */
+static void celltrace_locate(celltrace_axis_t* axis, const float* in, size_t count)
+{
+  size_t i = 0;
+  if (!in) {
+    for (; i < count; i++) {
+      axis->index[i] = CELLTRACE_NO_INDEX;
+      axis->fraction[i] = 0;
+    }
+    return;
+  }
+#if defined(CELLTRACE_SSE2)
+  const __m128 origin  = _mm_set1_ps(axis->origin);
+  const __m128 inverse = _mm_set1_ps(axis->inverseStep);
+  const __m128 zero    = _mm_setzero_ps();
+  const __m128 top     = _mm_set1_ps((float)(CELLTRACE_BUCKETS - 1));
+  alignas(16) int32_t buckets[4];
+  for (; i + 4 <= count; i += 4) {
+    __m128 v = _mm_loadu_ps(in + i);
+    // NaN turns into bucket 0 here, celltrace_refine() catches it
+    __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(v, origin), inverse), zero), top);
+    _mm_store_si128((__m128i*)buckets, _mm_cvttps_epi32(b));
+    for (size_t lane = 0; lane < 4; lane++)
+      celltrace_refine(axis, in[i + lane], axis->buckets[buckets[lane]], &axis->index[i + lane], &axis->fraction[i + lane]);
+  }
+#endif
+  for (; i < count; i++) {
+    float b = (in[i] - axis->origin) * axis->inverseStep;
+    size_t bucket = b > 0 ? (b < (float)(CELLTRACE_BUCKETS - 1) ? (size_t)b : CELLTRACE_BUCKETS - 1) : 0;
+    celltrace_refine(axis, in[i], axis->buckets[bucket], &axis->index[i], &axis->fraction[i]);
+  }
+}
+
+// `columns` already start at the batch
+static void celltrace_accumulate(celltrace_t* trace, celltrace_table_t* table, const float* const* columns, size_t count)
+{
+  static const uint16_t zeroIndex[CELLTRACE_BATCH] = { 0 };
+  static const float zeroFraction[CELLTRACE_BATCH] = { 0 };
+  const celltrace_axis_t* y = &trace->axes[table->y];
+  const uint16_t* xIndex    = table->x >= 0 ? trace->axes[table->x].index : zeroIndex;
+  const float*    xFraction = table->x >= 0 ? trace->axes[table->x].fraction : zeroFraction;
+  size_t stride = table->columns;
+
+  for (size_t i = 0; i < count; i++) {
+    uint16_t ix = xIndex[i], iy = y->index[i];
+    if (ix == CELLTRACE_NO_INDEX || iy == CELLTRACE_NO_INDEX) continue;
+    float fx = xFraction[i], fy = y->fraction[i];
+    size_t cell = (size_t)iy * stride + ix;
+
+    table->hits[cell + (fy >= 0.5f ? stride : 0) + (fx >= 0.5f ? 1 : 0)]++;
+    table->samples++;
+
+    // the four cells around the sample. The ones with no weight may be past the edge, into
+    // the padding or the next row, adding 0 there is cheaper than branching around them
+    double w00 = (1 - fx) * (1 - fy), w01 = fx * (1 - fy), w10 = (1 - fx) * fy, w11 = fx * fy;
+    double* weights = table->weights + cell;
+    weights[0]          += w00;
+    weights[1]          += w01;
+    weights[stride]     += w10;
+    weights[stride + 1] += w11;
+
+    for (size_t a = 0; a < table->numAverages; a++) {
+      const float* average = columns[table->averages[a]];
+      float value = average ? average[i] : NAN;
+      if (!isfinite(value)) continue;
+      double* averageWeights = table->averageWeights[a] + cell;
+      double* sums           = table->sums[a] + cell;
+      averageWeights[0]          += w00;
+      averageWeights[1]          += w01;
+      averageWeights[stride]     += w10;
+      averageWeights[stride + 1] += w11;
+      sums[0]          += w00 * value;
+      sums[1]          += w01 * value;
+      sums[stride]     += w10 * value;
+      sums[stride + 1] += w11 * value;
+    }
+  }
+}
+
+void celltrace_add(celltrace_t* trace, const float* const* columns, size_t count)
+{
+  const float* batch[CELLTRACE_MAX_CHANNELS];
+  for (size_t offset = 0; offset < count; offset += CELLTRACE_BATCH) {
+    size_t n = count - offset < CELLTRACE_BATCH ? count - offset : CELLTRACE_BATCH;
+    for (size_t c = 0; c < trace->numChannels; c++) {
+      const celltrace_channel_t* channel = &trace->channels[c];
+      if (channel->source != CELLTRACE_SOURCE_DIFFERENCE) {
+        batch[c] = columns[c] ? columns[c] + offset : NULL;
+        continue;
+      }
+      const float* a = batch[channel->minuend];
+      const float* b = batch[channel->subtrahend];
+      float* out = trace->differences[c];
+      if (!a || !b) {
+        batch[c] = NULL;
+        continue;
+      }
+      for (size_t i = 0; i < n; i++) out[i] = a[i] - b[i];
+      batch[c] = out;
+    }
+    for (size_t a = 0; a < trace->numAxes; a++)
+      celltrace_locate(&trace->axes[a], batch[trace->axes[a].channel], n);
+    for (size_t t = 0; t < trace->numTables; t++)
+      celltrace_accumulate(trace, &trace->tables[t], batch, n);
+  }
+  trace->samples += count;
+}
+
+void celltrace_sample(celltrace_t* trace, const float* values)
+{
+  const float* columns[CELLTRACE_MAX_CHANNELS];
+  for (size_t c = 0; c < trace->numChannels; c++)
+    columns[c] = values ? &values[c] : NULL;
+  celltrace_add(trace, columns, 1);
+}
+
+// group channels that are close together into one read each
+static void celltrace_plan(celltrace_t* trace)
+{
+  bool planned[CELLTRACE_MAX_CHANNELS] = { false };
+  trace->numSpans = 0;
+  for (size_t c = 0; c < trace->numChannels; c++)
+    planned[c] = trace->channels[c].source != CELLTRACE_SOURCE_RAM;
+  for (;;) {
+    // lowest channel not covered yet starts a span
+    int first = -1;
+    for (size_t c = 0; c < trace->numChannels; c++)
+      if (!planned[c] && (first < 0 || trace->channels[c].address < trace->channels[first].address))
+        first = (int)c;
+    if (first < 0) return;
+
+    celltrace_span_t* span = &trace->spans[trace->numSpans++];
+    span->address = trace->channels[first].address;
+    span->length  = 0;
+    for (size_t c = 0; c < trace->numChannels; c++) {
+      const celltrace_channel_t* channel = &trace->channels[c];
+      uint32_t end = channel->address + (uint32_t)definition_storage_size(channel->storage);
+      if (planned[c] || channel->address < span->address || end - span->address > CELLTRACE_MAX_SPAN) continue;
+      planned[c] = true;
+      if (end - span->address > span->length) span->length = (uint16_t)(end - span->address);
+    }
+  }
+}
+
+size_t celltrace_poll(celltrace_t* trace, celltrace_read_fn read, void* ctx)
+{
+  uint8_t ram[CELLTRACE_MAX_CHANNELS][CELLTRACE_MAX_SPAN];
+  float values[CELLTRACE_MAX_CHANNELS];
+  size_t ret;
+
+  if (!trace->numSpans) celltrace_plan(trace);
+  for (size_t s = 0; s < trace->numSpans; s++)
+    if ((ret = read(ctx, trace->spans[s].address, ram[s], trace->spans[s].length)))
+      return ret;
+
+  for (size_t c = 0; c < trace->numChannels; c++) {
+    const celltrace_channel_t* channel = &trace->channels[c];
+    definition_scaling_t scaling = {};
+    scaling.scale  = channel->scale;
+    scaling.offset = channel->offset;
+    scaling.linear = true;
+    values[c] = NAN;
+    if (channel->source != CELLTRACE_SOURCE_RAM) continue;
+    for (size_t s = 0; s < trace->numSpans; s++) {
+      const celltrace_span_t* span = &trace->spans[s];
+      if (channel->address < span->address || channel->address - span->address >= span->length) continue;
+      definition_decode(ram[s], span->length, channel->address - span->address, 1, channel->storage, true, &scaling, &values[c]);
+      break;
+    }
+  }
+  celltrace_sample(trace, values);
+  return 0;
+}
+
+size_t celltrace_cells_visited(const celltrace_t* trace)
+{
+  size_t visited = 0;
+  for (size_t t = 0; t < trace->numTables; t++) {
+    const celltrace_table_t* table = &trace->tables[t];
+    for (size_t i = 0; i < (size_t)table->rows * table->columns; i++)
+      visited += table->hits[i] != 0;
+  }
+  return visited;
+}
+
+/* Config file */
+
+// next word or "quoted string" of a line, false at the end of it
+static bool celltrace_token(char** cursor, char* out, size_t outLength)
+{
+  char* s = *cursor;
+  size_t n = 0;
+  while (isspace((unsigned char)*s)) s++;
+  if (!*s || *s == '#') return false;
+  if (*s == '"') {
+    for (s++; *s && *s != '"'; s++)
+      if (n < outLength - 1) out[n++] = *s;
+    if (*s) s++;
+  } else {
+    for (; *s && !isspace((unsigned char)*s) && *s != '#'; s++)
+      if (n < outLength - 1) out[n++] = *s;
+  }
+  out[n] = 0;
+  *cursor = s;
+  return true;
+}
+
+// channel with the narrowest min/max range that holds every breakpoint, -1 if there is none
+static int celltrace_bind(const celltrace_t* trace, const float* values, uint16_t length)
+{
+  int best = -1;
+  for (size_t c = 0; c < trace->numChannels; c++) {
+    const celltrace_channel_t* channel = &trace->channels[c];
+    float span = channel->max - channel->min;
+    if (span <= 0) continue;
+    // breakpoints a little outside the range are still fine
+    float slack = span * 0.01f;
+    if (values[0] < channel->min - slack || values[length - 1] > channel->max + slack) continue;
+    if (best < 0 || span < trace->channels[best].max - trace->channels[best].min) best = (int)c;
+  }
+  return best;
+}
+
+// decode the axes of a definition table and add it. `xChannel`/`yChannel` -1 binds them by range
+static size_t celltrace_add_definition_table(celltrace_t* trace, const definition_table_t* table,
+                                             const uint8_t* rom, size_t romLength, int xChannel, int yChannel,
+                                             const int* averages, size_t numAverages)
+{
+  // longer axes than this aren't something an ECU interpolates over
+  float x[1024], y[1024];
+  bool hasX = table->dimensions == 3;
+
+  if (table->dimensions < 2 || !table->y.length || (hasX && !table->x.length)) return EINVAL;
+  if ((hasX && table->x.length > sizeof(x) / sizeof(x[0])) || table->y.length > sizeof(y) / sizeof(y[0])) return EINVAL;
+  if ((hasX && definition_decode_axis(&table->x, rom, romLength, x)) || definition_decode_axis(&table->y, rom, romLength, y))
+    return ERANGE;
+  if (hasX && !celltrace_ascending(x, table->x.length)) return EINVAL;
+  if (!celltrace_ascending(y, table->y.length)) return EINVAL;
+
+  if (hasX && xChannel < 0) xChannel = celltrace_bind(trace, x, table->x.length);
+  if (yChannel < 0) yChannel = celltrace_bind(trace, y, table->y.length);
+  if ((hasX && xChannel < 0) || yChannel < 0) return ENOENT;
+
+  return celltrace_add_table(trace, table->name, hasX ? x : NULL, table->x.length, xChannel,
+                             y, table->y.length, yChannel, averages, numAverages);
+}
+
+// the optional [scale [offset [min max]]] of a channel, then add it
+static size_t celltrace_parse_scaling(celltrace_t* trace, celltrace_channel_t* channel, char* cursor, unsigned line)
+{
+  char token[64];
+  if (channel->source == CELLTRACE_SOURCE_DIFFERENCE) {
+    if (celltrace_token(&cursor, token, sizeof(token))) channel->min = strtof(token, NULL);
+    if (celltrace_token(&cursor, token, sizeof(token))) channel->max = strtof(token, NULL);
+  } else {
+    if (celltrace_token(&cursor, token, sizeof(token))) channel->scale  = strtof(token, NULL);
+    if (celltrace_token(&cursor, token, sizeof(token))) channel->offset = strtof(token, NULL);
+    if (celltrace_token(&cursor, token, sizeof(token))) channel->min    = strtof(token, NULL);
+    if (celltrace_token(&cursor, token, sizeof(token))) channel->max    = strtof(token, NULL);
+  }
+
+  if (celltrace_channel(trace, channel->name) >= 0) {
+    LOGE(TAG, "line %u: channel %s is defined twice", line, channel->name);
+    return EINVAL;
+  }
+  if (celltrace_add_channel(trace, channel) < 0) {
+    LOGE(TAG, "line %u: bad storage type or more than %zu channels", line, CELLTRACE_MAX_CHANNELS);
+    return EINVAL;
+  }
+  return 0;
+}
+
+static size_t celltrace_parse_channel(celltrace_t* trace, char* cursor, unsigned line)
+{
+  celltrace_channel_t channel;
+  char token[64];
+  memset(&channel, 0, sizeof(channel));
+  channel.scale = 1;
+
+  if (!celltrace_token(&cursor, channel.name, sizeof(channel.name))) return EINVAL;
+  if (!celltrace_token(&cursor, token, sizeof(token))) return EINVAL;
+  channel.address = (uint32_t)strtoul(token, NULL, 0);
+  if (!celltrace_token(&cursor, token, sizeof(token))) return EINVAL;
+  channel.storage = definition_storage(token);
+  return celltrace_parse_scaling(trace, &channel, cursor, line);
+}
+
+static size_t celltrace_parse_column(celltrace_t* trace, char* cursor, unsigned line)
+{
+  celltrace_channel_t channel;
+  memset(&channel, 0, sizeof(channel));
+  channel.source = CELLTRACE_SOURCE_COLUMN;
+  channel.scale  = 1;
+
+  if (!celltrace_token(&cursor, channel.name, sizeof(channel.name))) return EINVAL;
+  if (!celltrace_token(&cursor, channel.column, sizeof(channel.column))) return EINVAL;
+  return celltrace_parse_scaling(trace, &channel, cursor, line);
+}
+
+static size_t celltrace_parse_difference(celltrace_t* trace, char* cursor, unsigned line)
+{
+  celltrace_channel_t channel;
+  char a[32], b[32];
+  memset(&channel, 0, sizeof(channel));
+  channel.source = CELLTRACE_SOURCE_DIFFERENCE;
+  channel.scale  = 1;
+
+  if (!celltrace_token(&cursor, channel.name, sizeof(channel.name)) ||
+      !celltrace_token(&cursor, a, sizeof(a)) || !celltrace_token(&cursor, b, sizeof(b)))
+    return EINVAL;
+  channel.minuend    = celltrace_channel(trace, a);
+  channel.subtrahend = celltrace_channel(trace, b);
+  if (channel.minuend < 0 || channel.subtrahend < 0) {
+    LOGE(TAG, "line %u: unknown channel %s", line, channel.minuend < 0 ? a : b);
+    return EINVAL;
+  }
+  // scale and offset don't apply, only the range
+  return celltrace_parse_scaling(trace, &channel, cursor, line);
+}
+
+// "-" or a channel name into `channel`, false for an unknown name
+static bool celltrace_parse_channel_name(const celltrace_t* trace, const char* name, int* channel, unsigned line)
+{
+  *channel = strcmp(name, "-") == 0 ? -1 : celltrace_channel(trace, name);
+  if (*channel < 0 && strcmp(name, "-") != 0) {
+    LOGE(TAG, "line %u: unknown channel %s", line, name);
+    return false;
+  }
+  return true;
+}
+
+// the rest of the line as averaged channels, false for an unknown name or too many
+static bool celltrace_parse_averages(const celltrace_t* trace, char* cursor, int* averages, size_t* numAverages, unsigned line)
+{
+  char name[32];
+  *numAverages = 0;
+  while (celltrace_token(&cursor, name, sizeof(name))) {
+    if (*numAverages == CELLTRACE_MAX_AVERAGES) {
+      LOGE(TAG, "line %u: more than %zu average channels", line, CELLTRACE_MAX_AVERAGES);
+      return false;
+    }
+    if (!celltrace_parse_channel_name(trace, name, &averages[*numAverages], line)) return false;
+    if (averages[*numAverages] >= 0) (*numAverages)++;
+  }
+  return true;
+}
+
+static size_t celltrace_parse_table(celltrace_t* trace, char* cursor, unsigned line, const definition_t* definition,
+                                    const uint8_t* rom, size_t romLength)
+{
+  char name[128], xName[32], yName[32];
+  int xChannel, yChannel, averages[CELLTRACE_MAX_AVERAGES];
+  size_t numAverages;
+
+  if (!celltrace_token(&cursor, name, sizeof(name)) || !celltrace_token(&cursor, xName, sizeof(xName)) ||
+      !celltrace_token(&cursor, yName, sizeof(yName)))
+    return EINVAL;
+  if (!celltrace_parse_channel_name(trace, xName, &xChannel, line) ||
+      !celltrace_parse_channel_name(trace, yName, &yChannel, line) ||
+      !celltrace_parse_averages(trace, cursor, averages, &numAverages, line))
+    return EINVAL;
+
+  const definition_table_t* table = definition_find(definition, name);
+  if (!table) {
+    LOGE(TAG, "line %u: no table named %s", line, name);
+    return ENOENT;
+  }
+  if (yChannel < 0 || (table->dimensions == 3) != (xChannel >= 0)) {
+    LOGE(TAG, "line %u: %s is a %uD table, %s", line, name, table->dimensions,
+      table->dimensions == 3 ? "it needs an x and a y channel" : "its x channel is -");
+    return EINVAL;
+  }
+  size_t ret = celltrace_add_definition_table(trace, table, rom, romLength, xChannel, yChannel, averages, numAverages);
+  if (ret) LOGE(TAG, "line %u: can't trace %s, its axes are missing, outside the ROM or not ascending", line, name);
+  return ret;
+}
+
+static size_t celltrace_parse_tables(celltrace_t* trace, char* cursor, unsigned line, const definition_t* definition,
+                                     const uint8_t* rom, size_t romLength)
+{
+  char pattern[8];
+  int averages[CELLTRACE_MAX_AVERAGES];
+  size_t numAverages;
+
+  if (!celltrace_token(&cursor, pattern, sizeof(pattern)) || strcmp(pattern, "*") != 0) return EINVAL;
+  if (!celltrace_parse_averages(trace, cursor, averages, &numAverages, line)) return EINVAL;
+
+  for (size_t i = 0; i < definition->numTables; i++) {
+    const definition_table_t* table = &definition->tables[i];
+    if (table->dimensions < 2 || definition_find(definition, table->name) != table) continue;
+    // explicit table lines win over the wildcard
+    bool traced = false;
+    for (size_t t = 0; t < trace->numTables && !traced; t++)
+      traced = strcmp(trace->tables[t].name, table->name) == 0;
+    if (traced) continue;
+
+    size_t ret = celltrace_add_definition_table(trace, table, rom, romLength, -1, -1, averages, numAverages);
+    if (ret == ENOMEM) return ret;
+    if (ret) trace->skipped++;
+  }
+  return 0;
+}
+
+size_t celltrace_load(celltrace_t* trace, const char* path, const definition_t* definition,
+                      const uint8_t* rom, size_t romLength)
+{
+  FILE* file = fopen(path, "r");
+  char text[512], directive[16];
+  unsigned line = 0;
+  size_t ret = 0;
+
+  if (!file) {
+    LOGE(TAG, "failed to open %s %s", path, strerror(errno));
+    return errno;
+  }
+  while (!ret && fgets(text, sizeof(text), file)) {
+    char* cursor = text;
+    line++;
+    if (!celltrace_token(&cursor, directive, sizeof(directive))) continue;
+    if (strcmp(directive, "channel") == 0)
+      ret = celltrace_parse_channel(trace, cursor, line);
+    else if (strcmp(directive, "column") == 0)
+      ret = celltrace_parse_column(trace, cursor, line);
+    else if (strcmp(directive, "difference") == 0)
+      ret = celltrace_parse_difference(trace, cursor, line);
+    else if (strcmp(directive, "table") == 0)
+      ret = celltrace_parse_table(trace, cursor, line, definition, rom, romLength);
+    else if (strcmp(directive, "tables") == 0)
+      ret = celltrace_parse_tables(trace, cursor, line, definition, rom, romLength);
+    else
+      ret = EINVAL;
+    if (ret == EINVAL) LOGE(TAG, "%s:%u: can't parse \"%s\"", path, line, directive);
+  }
+  fclose(file);
+  if (ret) return ret;
+
+  if (!trace->numTables) {
+    LOGE(TAG, "%s binds no tables", path);
+    return EINVAL;
+  }
+  return 0;
+}
+
+/* CSV */
+
+// hits, or the weighted average of average channel `average` when it is >= 0
+static void celltrace_write_grid(const celltrace_t* trace, const celltrace_table_t* table, FILE* file, int average)
+{
+  const celltrace_axis_t* y = &trace->axes[table->y];
+
+  if (average >= 0)
+    fprintf(file, "%s average %s\n", table->name, trace->channels[table->averages[average]].name);
+  else
+    fprintf(file, "%s hits\n", table->name);
+
+  if (table->x >= 0) {
+    const celltrace_axis_t* x = &trace->axes[table->x];
+    for (uint16_t c = 0; c < table->columns; c++)
+      fprintf(file, ",%g", x->values[c]);
+    fputc('\n', file);
+  }
+  for (uint16_t r = 0; r < table->rows; r++) {
+    fprintf(file, "%g", y->values[r]);
+    for (uint16_t c = 0; c < table->columns; c++) {
+      size_t cell = (size_t)r * table->columns + c;
+      if (average < 0)
+        fprintf(file, ",%u", table->hits[cell]);
+      else if (table->averageWeights[average][cell] > 0)
+        fprintf(file, ",%g", table->sums[average][cell] / table->averageWeights[average][cell]);
+      else
+        fputc(',', file);
+    }
+    fputc('\n', file);
+  }
+  fputc('\n', file);
+}
+
+size_t celltrace_write_csv(const celltrace_t* trace, FILE* file)
+{
+  for (size_t t = 0; t < trace->numTables; t++) {
+    const celltrace_table_t* table = &trace->tables[t];
+    celltrace_write_grid(trace, table, file, -1);
+    for (size_t a = 0; a < table->numAverages; a++)
+      celltrace_write_grid(trace, table, file, (int)a);
+  }
+  return ferror(file) ? EIO : 0;
+}
+
+size_t celltrace_open(celltrace_t* trace, definition_t* definition, const char* path, const char* definitionPath,
+                      const char* romPath)
+{
+  size_t romLength = 0;
+  uint8_t* rom = load_file(romPath, &romLength);
+  size_t ret;
+
+  if (!rom) {
+    LOGE(TAG, "Failed to read ROM %s %s", romPath, strerror(errno));
+    return errno ? errno : EIO;
+  }
+  if ((ret = defresolve_load_path(definition, definitionPath, rom, romLength))) {
+    free(rom);
+    return ret;
+  }
+  celltrace_init(trace);
+  ret = celltrace_load(trace, path, definition, rom, romLength);
+  free(rom);
+  if (ret)
+    return ret;
+
+  LOGI(TAG, "Tracing %zu tables (%zu distinct axes) from %zu channels", trace->numTables, trace->numAxes, trace->numChannels);
+  if (trace->skipped)
+    LOGI(TAG, "%zu tables have axes no channel covers", trace->skipped);
+  return 0;
+}
+
+size_t celltrace_save_csv(const celltrace_t* trace, const char* path)
+{
+  FILE* file = fopen(path, "w");
+  if (!file || celltrace_write_csv(trace, file)) {
+    LOGE(TAG, "Failed to write %s %s", path, strerror(errno));
+    if (file) fclose(file);
+    return errno ? errno : EIO;
+  }
+  return fclose(file) ? EIO : 0;
+}
+
+static size_t celltrace_read_ecu(void* ctx, uint32_t address, uint8_t* out, size_t length)
+{
+  return ((RX8*)ctx)->readMemory(address, rx8_span_t{ out, length }).error;
+}
+
+size_t celltrace_log_ecu(celltrace_t* trace, RX8* ecu, uint64_t samples, const char* csvPath)
+{
+  uint64_t start = monotonic_us(), lastReport = start;
+  size_t ret = 0;
+
+  interrupt_catch();
+  LOGI(TAG, "Logging, Ctrl+C to stop");
+  ecu->beginTransfer();
+  while (!interrupt_requested() && (!samples || trace->samples < samples)) {
+    if ((ret = celltrace_poll(trace, celltrace_read_ecu, ecu)))
+      break;
+    uint64_t now = monotonic_us();
+    if (now - lastReport >= 1000000) {
+      LOGI(TAG, "%llu samples, %.1f/s, %zu cells visited", (unsigned long long)trace->samples,
+        (double)trace->samples * 1000000.0 / (double)(now - start), celltrace_cells_visited(trace));
+      lastReport = now;
+    }
+  }
+  ecu->endTransfer();
+  interrupt_release();
+  if (ret)
+    LOGE(TAG, "Reading RAM failed after %llu samples", (unsigned long long)trace->samples);
+
+  size_t written = celltrace_save_csv(trace, csvPath);
+  if (written)
+    return ret ? ret : written;
+  LOGI(TAG, "%llu samples over %zu reads each, %zu cells visited. Wrote %s", (unsigned long long)trace->samples,
+    trace->numSpans, celltrace_cells_visited(trace), csvPath);
+  return ret;
+}
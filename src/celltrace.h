@@ -0,0 +1,201 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "definition.h"
+
+class RX8;
+
+/* Map cell tracing.
+ *
+ * Logged values (RPM, load, ECT, ...) are projected onto the axes of ROM tables to
+ * find out which cells the engine actually uses. Every sample adds a hit to the
+ * nearest cell of each table and spreads a weight of 1 over the (up to) four cells
+ * around it, the same bilinear weights the ECU interpolates with. A table can also
+ * average one more channel per cell, e.g. AFR or knock, weighted the same way.
+ *
+ * Axes are shared: tables whose axes have the same breakpoints and channel use one
+ * lookup. Each axis has a bucket table over its range, so finding the breakpoint
+ * interval is a multiply, a table load and at most a step or two instead of a binary
+ * search. Samples are processed in batches, one axis at a time over the whole batch
+ * (four samples per step with SSE2), then one table at a time.
+ *
+ * Config file, one directive per line, '#' starts a comment:
+ *   channel <name> <address> <uint8|uint16|int8|int16|uint32|int32|float> [scale [offset [min max]]]
+ *   column <name> "<log column>" [scale [offset [min max]]]
+ *   difference <name> <channel> <channel>
+ *   table "<name>" <x channel|-> <y channel> [average channels...]
+ *   tables * [average channels...]
+ * Channels are read from RAM every sample, value = raw * scale + offset. Columns only
+ * exist in recorded logs (see loganalyze.h), where channels are also matched to columns
+ * by name. A difference is the first channel minus the second, e.g. AFR error. `tables *`
+ * binds every table of the definition whose axes fall inside the min/max range of a
+ * channel, picking the channel with the narrowest range. The definitions from
+ * ScoobyRom have no axis names, so that is the only way to bind them in bulk.
+ * The only axis of a 2D table is its Y axis, so its x channel is "-".
+ */
+
+static const size_t CELLTRACE_MAX_CHANNELS = 16;
+static const size_t CELLTRACE_BUCKETS      = 256;
+// samples located per axis at a time
+static const size_t CELLTRACE_BATCH        = 256;
+// channels closer together than this are read with one request
+static const size_t CELLTRACE_MAX_SPAN     = 0x100;
+static const size_t CELLTRACE_MAX_AVERAGES = 4;
+
+enum celltrace_source {
+  CELLTRACE_SOURCE_RAM = 0,
+  CELLTRACE_SOURCE_COLUMN,      // recorded logs only
+  CELLTRACE_SOURCE_DIFFERENCE,  // computed from two other channels
+};
+
+typedef struct Celltrace_Channel {
+  char     name[32];
+  enum celltrace_source source;
+  uint32_t address;
+  definition_storage_t storage;
+  char     column[64];   // log column header, matched instead of the name when set
+  int      minuend;      // difference channels
+  int      subtrahend;
+  float    scale;
+  float    offset;
+  float    min;      // range of plausible values, used by `tables *`. min == max if unknown
+  float    max;
+} celltrace_channel_t;
+
+// one RAM read per sample, covering one or more channels
+typedef struct Celltrace_Span {
+  uint32_t address;
+  uint16_t length;
+} celltrace_span_t;
+
+/** Read `length` bytes of RAM at `address` into `out`. Returns 0 or an error */
+typedef size_t (*celltrace_read_fn)(void* ctx, uint32_t address, uint8_t* out, size_t length);
+
+typedef struct Celltrace_Axis {
+  float*   values;    // ascending breakpoints
+  uint16_t length;
+  int      channel;
+  float    origin;    // bucket = (value - origin) * inverseStep
+  float    inverseStep;
+  uint16_t buckets[CELLTRACE_BUCKETS];  // last breakpoint at or below the start of each bucket
+  // scratch for the batch being processed
+  uint16_t* index;    // breakpoint interval [index, index + 1]
+  float*    fraction; // position inside it, 0-1
+} celltrace_axis_t;
+
+typedef struct Celltrace_Table {
+  char     name[128];
+  int      x;         // axis, -1 for 2D tables
+  int      y;
+  uint16_t columns;   // x axis length, 1 for 2D tables
+  uint16_t rows;
+  uint64_t samples;
+  uint32_t* hits;     // rows * columns, row major
+  double*   weights;
+  // channels averaged per cell. Each has its own weights, samples where it is NaN don't count
+  size_t    numAverages;
+  int       averages[CELLTRACE_MAX_AVERAGES];
+  double*   averageWeights[CELLTRACE_MAX_AVERAGES];
+  double*   sums[CELLTRACE_MAX_AVERAGES];   // weight * value
+} celltrace_table_t;
+
+typedef struct Celltrace {
+  size_t numChannels;
+  celltrace_channel_t channels[CELLTRACE_MAX_CHANNELS];
+  size_t numAxes;
+  celltrace_axis_t* axes;
+  size_t numTables;
+  celltrace_table_t* tables;
+  size_t numSpans;
+  celltrace_span_t spans[CELLTRACE_MAX_CHANNELS];
+  float* differences[CELLTRACE_MAX_CHANNELS];   // scratch for the batch being processed
+  uint64_t samples;
+  size_t skipped;     // tables `tables *` couldn't bind
+} celltrace_t;
+
+void celltrace_init(celltrace_t* trace);
+void celltrace_free(celltrace_t* trace);
+
+/** Copy of the channels, axes and tables with empty histograms, e.g. one per worker thread. Returns 0 or errno */
+size_t celltrace_clone(celltrace_t* clone, const celltrace_t* trace);
+
+/** Add the histograms of `from`, a clone of `trace`, to `trace` */
+void celltrace_merge(celltrace_t* trace, const celltrace_t* from);
+
+/** Returns the channel index, or -1 if there are too many */
+int celltrace_add_channel(celltrace_t* trace, const celltrace_channel_t* channel);
+
+/** Channel by name, -1 if there is none */
+int celltrace_channel(const celltrace_t* trace, const char* name);
+
+/**
+ * Trace a table with the given breakpoints. `x` is NULL for a 2D table, `averages` lists
+ * up to CELLTRACE_MAX_AVERAGES channels averaged per cell. Axes must be ascending.
+ * Returns 0 or errno
+ */
+size_t celltrace_add_table(celltrace_t* trace, const char* name,
+                           const float* x, uint16_t columns, int xChannel,
+                           const float* y, uint16_t rows, int yChannel,
+                           const int* averages, size_t numAverages);
+
+/** Read a config file, binding tables of `definition` with axes decoded from `rom`. Returns 0 or errno */
+size_t celltrace_load(celltrace_t* trace, const char* path, const definition_t* definition,
+                      const uint8_t* rom, size_t romLength);
+
+/**
+ * Add `count` samples. `columns[c]` holds the values of channel c, one per sample, NULL
+ * or NaN where a channel wasn't logged. Difference channels are computed, their column is ignored
+ */
+void celltrace_add(celltrace_t* trace, const float* const* columns, size_t count);
+
+/** Add one sample, `values[c]` is channel c */
+void celltrace_sample(celltrace_t* trace, const float* values);
+
+/** Read every channel through `read`, one request per span, and add them as one sample. Returns 0 or the read error */
+size_t celltrace_poll(celltrace_t* trace, celltrace_read_fn read, void* ctx);
+
+/** Cells with at least one hit, over every table */
+size_t celltrace_cells_visited(const celltrace_t* trace);
+
+/**
+ * Every table as a grid, like definitions/table.csv: the table name, a header row with
+ * the x breakpoints (3D only), then one row per y breakpoint. Hits first, then the
+ * weighted average of each average channel. Returns 0 or errno
+ */
+size_t celltrace_write_csv(const celltrace_t* trace, FILE* file);
+
+/**
+ * The definition from `definitionPath` for the ROM in `romPath`, then the config in `path`
+ * bound to it. `definition` outlives the trace, free both once done. Returns 0 or errno
+ */
+size_t celltrace_open(celltrace_t* trace, definition_t* definition, const char* path, const char* definitionPath,
+                      const char* romPath);
+
+/** celltrace_write_csv() into a new file at `path`. Returns 0 or errno */
+size_t celltrace_save_csv(const celltrace_t* trace, const char* path);
+
+/**
+ * Poll the RAM of an unlocked `ecu` until `samples` samples, forever if 0, or Ctrl+C, then
+ * write the cells to `csvPath` even if a read failed along the way. Returns 0 or the first error
+ */
+size_t celltrace_log_ecu(celltrace_t* trace, RX8* ecu, uint64_t samples, const char* csvPath);
@@ -0,0 +1,124 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+
+#include "crc32c.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define CRC32C_HW
+#include <intrin.h>
+#include <nmmintrin.h>
+#define CRC32C_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32C_HW
+#include <nmmintrin.h>
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#endif
+
+static const uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;  // reflected
+
+typedef struct Crc32c_Tables {
+  uint32_t table[8][256];
+  bool hardware;
+} crc32c_tables_t;
+
+static crc32c_tables_t crc32c_init()
+{
+  crc32c_tables_t tables;
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0u - (crc & 1)));
+    tables.table[0][i] = crc;
+  }
+  for (uint32_t i = 0; i < 256; i++) {
+    for (int t = 1; t < 8; t++)
+      tables.table[t][i] = (tables.table[t - 1][i] >> 8) ^ tables.table[0][tables.table[t - 1][i] & 0xff];
+  }
+
+  tables.hardware = false;
+#if defined(CRC32C_HW) && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  tables.hardware = (info[2] >> 20) & 1;
+#elif defined(CRC32C_HW)
+  tables.hardware = __builtin_cpu_supports("sse4.2");
+#endif
+  return tables;
+}
+
+// built on first use, thread safe as a function local static
+static const crc32c_tables_t* crc32c_tables()
+{
+  static const crc32c_tables_t tables = crc32c_init();
+  return &tables;
+}
+
+static uint32_t crc32c_software(const crc32c_tables_t* tables, uint32_t crc, const uint8_t* p, size_t length)
+{
+  const uint32_t (*t)[256] = tables->table;
+  for (; length >= 8; p += 8, length -= 8) {
+    uint32_t lo, hi;
+    memcpy(&lo, p, 4);
+    memcpy(&hi, p + 4, 4);
+    lo ^= crc;  // the tables assume a little endian host, like the rest of the file formats
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+          t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+  }
+  while (length--)
+    crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+  return crc;
+}
+
+#if defined(CRC32C_HW)
+CRC32C_TARGET static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* p, size_t length)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+  uint64_t crc64 = crc;
+  for (; length >= 8; p += 8, length -= 8) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  crc = (uint32_t)crc64;
+#endif
+  for (; length >= 4; p += 4, length -= 4) {
+    uint32_t word;
+    memcpy(&word, p, 4);
+    crc = _mm_crc32_u32(crc, word);
+  }
+  while (length--)
+    crc = _mm_crc32_u8(crc, *p++);
+  return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t length)
+{
+  const crc32c_tables_t* tables = crc32c_tables();
+  crc = ~crc;
+#if defined(CRC32C_HW)
+  if (tables->hardware)
+    return ~crc32c_sse42(crc, (const uint8_t*)data, length);
+#endif
+  return ~crc32c_software(tables, crc, (const uint8_t*)data, length);
+}
+
+bool crc32c_hardware()
+{
+  return crc32c_tables()->hardware;
+}
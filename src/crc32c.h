@@ -0,0 +1,34 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* CRC32C (Castagnoli).
+ *
+ * With the SSE4.2 crc32 instruction when the CPU has it, checked once at runtime so
+ * the build doesn't need -msse4.2, otherwise slicing-by-8 tables. Both give the same
+ * result, the standard CRC32C (crc32c("123456789") == 0xE3069283).
+ */
+
+/** CRC of `length` more bytes, starting from `crc`, 0 for the first call */
+uint32_t crc32c(uint32_t crc, const void* data, size_t length);
+
+/** True if crc32c() uses the crc32 instruction */
+bool crc32c_hardware();
@@ -0,0 +1,804 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#include <io.h>
+#include <direct.h>
+#define F_OK 0
+#define access _access
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "defconvert.h"
+#include "crc32c.h"
+#include "util.h"
+
+static const char* TAG = "Defconvert";
+
+static const char* defconvert_format_names[2] = { "romraider", "ecuflash" };
+
+bool defconvert_format(const char* name, defconvert_format_t* format)
+{
+  for (size_t f = 0; f < 2; f++) {
+    if (strcmp(name, defconvert_format_names[f]) == 0) {
+      *format = (defconvert_format_t)f;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Writing */
+
+static void defconvert_escape(FILE* file, const char* text)
+{
+  for (;;) {
+    // runs without anything to escape go out in one piece
+    size_t length = strcspn(text, "&<>\"");
+    fwrite(text, 1, length, file);
+    text += length;
+    switch (*text++) {
+      case '&': fputs("&amp;", file);  break;
+      case '<': fputs("&lt;", file);   break;
+      case '>': fputs("&gt;", file);   break;
+      case '"': fputs("&quot;", file); break;
+      default:  return;
+    }
+  }
+}
+
+static void defconvert_attr(FILE* file, const char* name, const char* value)
+{
+  fprintf(file, " %s=\"", name);
+  defconvert_escape(file, value);
+  fputc('"', file);
+}
+
+static void defconvert_element(FILE* file, const char* indent, const char* name, const char* value)
+{
+  fprintf(file, "%s<%s>", indent, name);
+  defconvert_escape(file, value);
+  fprintf(file, "</%s>\n", name);
+}
+
+// decimals of a RomRaider (DecimalFormat, "0.00") or EcuFlash (printf, "%0.2f") format, -1 for integers
+static int defconvert_decimals(const char* format)
+{
+  const char* dot = strchr(format, '.');
+  if (format[0] == '%') {
+    if (dot) return atoi(dot + 1);
+    return strpbrk(format, "fFeEgG") ? 6 : -1;
+  }
+  if (!dot) return -1;
+  int decimals = 0;
+  for (dot++; *dot == '0' || *dot == '#'; dot++) decimals++;
+  return decimals;
+}
+
+// `format` as printf's for EcuFlash or DecimalFormat's for RomRaider, whichever it was written in
+static void defconvert_format_string(char* out, size_t size, const char* format, bool ecuflash)
+{
+  if (!format[0] || (format[0] == '%') == ecuflash) {
+    snprintf(out, size, "%s", format);
+    return;
+  }
+  int decimals = defconvert_decimals(format);
+  if (ecuflash) {
+    if (decimals < 0) snprintf(out, size, "%%d");
+    else snprintf(out, size, "%%0.%df", decimals);
+  } else if (decimals <= 0) {
+    snprintf(out, size, "0");
+  } else {
+    int n = snprintf(out, size, "0.");
+    for (int d = 0; d < decimals && (size_t)n < size - 1; d++) out[n++] = '0';
+    out[n] = 0;
+  }
+}
+
+// romid fields both formats share, `indent` for the fields themselves
+static void defconvert_romid(FILE* file, const definition_t* definition, const char* indent)
+{
+  const definition_romid_t* romid = &definition->romid;
+  defconvert_element(file, indent, "xmlid", romid->xmlID);
+  // base definitions have no ID of their own
+  if (romid->internalIDAddress || romid->internalIDString[0]) {
+    fprintf(file, "%s<internalidaddress>%x</internalidaddress>\n", indent, romid->internalIDAddress);
+    defconvert_element(file, indent, "internalidstring", romid->internalIDString);
+  }
+  if (romid->ecuID[0])
+    defconvert_element(file, indent, "ecuid", romid->ecuID);
+  for (size_t f = 0; f < definition->numFields; f++)
+    defconvert_element(file, indent, definition->fields[f].name, definition->fields[f].value);
+  if (romid->fileSize) {
+    if (romid->fileSize % 1024 == 0) fprintf(file, "%s<filesize>%uKB</filesize>\n", indent, romid->fileSize / 1024);
+    else fprintf(file, "%s<filesize>%u</filesize>\n", indent, romid->fileSize);
+  }
+}
+
+static const char* defconvert_types[4] = { "1D", "1D", "2D", "3D" };
+
+static void defconvert_romraider_storage(FILE* file, definition_storage_t storage, bool bigEndian, uint32_t address)
+{
+  if (storage != DEFINITION_STORAGE_NONE) {
+    defconvert_attr(file, "storagetype", definition_storage_name(storage));
+    defconvert_attr(file, "endian", bigEndian ? "big" : "little");
+  }
+  if (address)
+    fprintf(file, " storageaddress=\"0x%X\"", address);
+}
+
+static void defconvert_romraider_scaling(FILE* file, const char* indent, const definition_scaling_t* scaling)
+{
+  char format[24];
+  defconvert_format_string(format, sizeof(format), scaling->format, false);
+  fprintf(file, "%s<scaling", indent);
+  defconvert_attr(file, "units", scaling->units);
+  defconvert_attr(file, "expression", scaling->expression);
+  defconvert_attr(file, "to_byte", scaling->toByte);
+  if (format[0]) defconvert_attr(file, "format", format);
+  fputs(" />\n", file);
+}
+
+// static axes have neither, their values aren't kept
+static bool defconvert_has_axis(const definition_axis_t* axis)
+{
+  return axis->length || axis->address;
+}
+
+size_t defconvert_write_romraider(const definition_t* definition, FILE* file)
+{
+  fputs("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<roms>\n  <rom", file);
+  if (definition->base[0]) defconvert_attr(file, "base", definition->base);
+  fputs(">\n    <romid>\n", file);
+  defconvert_romid(file, definition, "      ");
+  fputs("    </romid>\n", file);
+
+  for (size_t t = 0; t < definition->numTables; t++) {
+    const definition_table_t* table = &definition->tables[t];
+    fprintf(file, "    <table type=\"%s\"", defconvert_types[table->dimensions & 3]);
+    defconvert_attr(file, "name", table->name);
+    if (table->category[0]) defconvert_attr(file, "category", table->category);
+    if (table->storage != DEFINITION_STORAGE_NONE) {
+      defconvert_attr(file, "storagetype", definition_storage_name(table->storage));
+      defconvert_attr(file, "endian", table->bigEndian ? "big" : "little");
+    }
+    if (table->dimensions == 3) fprintf(file, " sizex=\"%u\" sizey=\"%u\"", table->sizeX, table->sizeY);
+    if (table->dimensions == 2) fprintf(file, " sizey=\"%u\"", table->sizeY);
+    if (table->address) fprintf(file, " storageaddress=\"0x%X\"", table->address);
+    if (table->swapXY) fputs(" swapxy=\"true\"", file);
+    fputs(">\n", file);
+    defconvert_romraider_scaling(file, "      ", &table->scaling);
+
+    const definition_axis_t* axes[2] = { &table->x, &table->y };
+    for (size_t a = table->dimensions == 3 ? 0 : 1; a < 2 && table->dimensions > 1; a++) {
+      if (!defconvert_has_axis(axes[a])) continue;
+      fprintf(file, "      <table type=\"%s\"", a ? "Y Axis" : "X Axis");
+      defconvert_attr(file, "name", axes[a]->name);
+      defconvert_romraider_storage(file, axes[a]->storage, axes[a]->bigEndian, axes[a]->address);
+      fputs(">\n", file);
+      defconvert_romraider_scaling(file, "        ", &axes[a]->scaling);
+      fputs("      </table>\n", file);
+    }
+    fputs("    </table>\n", file);
+  }
+  fputs("  </rom>\n</roms>\n", file);
+  return ferror(file) ? EIO : 0;
+}
+
+/* EcuFlash scalings, deduplicated */
+
+typedef struct Defconvert_Scaling {
+  const definition_scaling_t* scaling;
+  definition_storage_t storage;
+  bool     bigEndian;
+  char     name[64];
+} defconvert_scaling_t;
+
+typedef struct Defconvert_Scalings {
+  std::vector<defconvert_scaling_t> list;
+  std::vector<uint32_t> byContent;  // list index + 1 by hash of everything but the name, 0 is free
+  std::vector<uint32_t> byName;     // list index + 1 by hash of the name
+  size_t mask;
+} defconvert_scalings_t;
+
+static uint64_t defconvert_hash(uint64_t hash, const char* s)
+{
+  // FNV-1a, the terminator included so "ab" "c" and "a" "bc" differ
+  do {
+    hash ^= (uint8_t)*s;
+    hash *= 0x100000001b3ull;
+  } while (*s++);
+  return hash;
+}
+
+static uint64_t defconvert_content_hash(const definition_scaling_t* scaling, definition_storage_t storage, bool bigEndian)
+{
+  uint64_t hash = 0xcbf29ce484222325ull ^ ((uint64_t)storage << 1 | bigEndian);
+  hash = defconvert_hash(hash, scaling->expression);
+  hash = defconvert_hash(hash, scaling->toByte);
+  hash = defconvert_hash(hash, scaling->units);
+  return defconvert_hash(hash, scaling->format);
+}
+
+static bool defconvert_same(const defconvert_scaling_t* entry, const definition_scaling_t* scaling,
+                            definition_storage_t storage, bool bigEndian)
+{
+  return entry->storage == storage && entry->bigEndian == bigEndian &&
+         !strcmp(entry->scaling->expression, scaling->expression) && !strcmp(entry->scaling->toByte, scaling->toByte) &&
+         !strcmp(entry->scaling->units, scaling->units) && !strcmp(entry->scaling->format, scaling->format);
+}
+
+// list index of a scaling with the same content, -1 if there is none. `slot` is where it goes
+static long defconvert_find_content(const defconvert_scalings_t* set, const definition_scaling_t* scaling,
+                                    definition_storage_t storage, bool bigEndian, size_t* slot)
+{
+  size_t s = (size_t)defconvert_content_hash(scaling, storage, bigEndian) & set->mask;
+  for (; set->byContent[s]; s = (s + 1) & set->mask) {
+    uint32_t e = set->byContent[s] - 1;
+    if (defconvert_same(&set->list[e], scaling, storage, bigEndian)) return (long)e;
+  }
+  *slot = s;
+  return -1;
+}
+
+static long defconvert_find_name(const defconvert_scalings_t* set, const char* name, size_t* slot)
+{
+  size_t s = (size_t)defconvert_hash(0xcbf29ce484222325ull, name) & set->mask;
+  for (; set->byName[s]; s = (s + 1) & set->mask) {
+    uint32_t e = set->byName[s] - 1;
+    if (!strcmp(set->list[e].name, name)) return (long)e;
+  }
+  *slot = s;
+  return -1;
+}
+
+// the scaling's own name, its units or its expression, then with the storage type and a number until it is free
+static void defconvert_add(defconvert_scalings_t* set, const definition_scaling_t* scaling,
+                           definition_storage_t storage, bool bigEndian, size_t contentSlot)
+{
+  defconvert_scaling_t entry;
+  size_t nameSlot = 0;
+  const char* base = scaling->name[0] ? scaling->name : scaling->units[0] ? scaling->units : scaling->expression;
+
+  entry.scaling   = scaling;
+  entry.storage   = storage;
+  entry.bigEndian = bigEndian;
+  snprintf(entry.name, sizeof(entry.name), "%s", base);
+  for (unsigned n = 1; defconvert_find_name(set, entry.name, &nameSlot) >= 0; n++) {
+    if (n == 1) snprintf(entry.name, sizeof(entry.name), "%.40s %s", base, definition_storage_name(storage));
+    else snprintf(entry.name, sizeof(entry.name), "%.40s %s %u", base, definition_storage_name(storage), n);
+  }
+  set->list.push_back(entry);
+  set->byName[nameSlot] = (uint32_t)set->list.size();
+  if (contentSlot != (size_t)-1) set->byContent[contentSlot] = (uint32_t)set->list.size();
+}
+
+static void defconvert_ecuflash_scaling(FILE* file, const defconvert_scaling_t* entry)
+{
+  char format[24];
+  defconvert_format_string(format, sizeof(format), entry->scaling->format, true);
+  fputs("\t<scaling", file);
+  defconvert_attr(file, "name", entry->name);
+  if (entry->scaling->units[0]) defconvert_attr(file, "units", entry->scaling->units);
+  defconvert_attr(file, "toexpr", entry->scaling->expression);
+  defconvert_attr(file, "frexpr", entry->scaling->toByte[0] ? entry->scaling->toByte : "x");
+  if (format[0]) defconvert_attr(file, "format", format);
+  if (entry->storage != DEFINITION_STORAGE_NONE) {
+    defconvert_attr(file, "storagetype", definition_storage_name(entry->storage));
+    defconvert_attr(file, "endian", entry->bigEndian ? "big" : "little");
+  }
+  fputs("/>\n", file);
+}
+
+size_t defconvert_write_ecuflash(const definition_t* definition, FILE* file, size_t* scalings)
+{
+  defconvert_scalings_t set;
+  size_t capacity = definition->numScalings + 3 * definition->numTables;
+  size_t slots = 16, slot = 0;
+  while (slots < 2 * capacity) slots *= 2;
+  set.list.reserve(capacity);
+  set.byContent.assign(slots, 0);
+  set.byName.assign(slots, 0);
+  set.mask = slots - 1;
+
+  // the named ones keep their names, anything inline with the same content shares them
+  for (size_t s = 0; s < definition->numScalings; s++) {
+    const definition_named_scaling_t* named = &definition->scalings[s];
+    if (defconvert_find_name(&set, named->scaling.name, &slot) >= 0) continue;
+    size_t contentSlot = (size_t)-1;
+    if (defconvert_find_content(&set, &named->scaling, named->storage, named->bigEndian, &slot) < 0)
+      contentSlot = slot;
+    defconvert_add(&set, &named->scaling, named->storage, named->bigEndian, contentSlot);
+  }
+
+  // the scaling of every table and axis, by name
+  std::vector<const char*> names(3 * definition->numTables, NULL);
+  std::vector<long> refs(3 * definition->numTables, -1);
+  for (size_t t = 0; t < definition->numTables; t++) {
+    const definition_table_t* table = &definition->tables[t];
+    const struct { const definition_scaling_t* scaling; definition_storage_t storage; bool bigEndian; bool used; } uses[3] = {
+      { &table->scaling,   table->storage,   table->bigEndian,   true },
+      { &table->x.scaling, table->x.storage, table->x.bigEndian, table->dimensions == 3 && defconvert_has_axis(&table->x) },
+      { &table->y.scaling, table->y.storage, table->y.bigEndian, table->dimensions > 1 && defconvert_has_axis(&table->y) },
+    };
+    for (size_t u = 0; u < 3; u++) {
+      if (!uses[u].used) continue;
+      const definition_scaling_t* scaling = uses[u].scaling;
+      // named here, or in the include when there is no storage type
+      if (scaling->name[0] && (uses[u].storage == DEFINITION_STORAGE_NONE || defconvert_find_name(&set, scaling->name, &slot) >= 0)) {
+        names[3 * t + u] = scaling->name;
+        continue;
+      }
+      size_t contentSlot = 0;
+      long e = defconvert_find_content(&set, scaling, uses[u].storage, uses[u].bigEndian, &contentSlot);
+      if (e < 0) {
+        defconvert_add(&set, scaling, uses[u].storage, uses[u].bigEndian, contentSlot);
+        e = (long)set.list.size() - 1;
+      }
+      refs[3 * t + u] = e;
+    }
+  }
+  if (scalings) *scalings = set.list.size();
+
+  fputs("<rom>\n\t<romid>\n", file);
+  defconvert_romid(file, definition, "\t\t");
+  fputs("\t</romid>\n", file);
+  if (definition->base[0]) {
+    fputs("\n", file);
+    defconvert_element(file, "\t", "include", definition->base);
+  }
+  if (!set.list.empty()) fputs("\n", file);
+  for (size_t s = 0; s < set.list.size(); s++)
+    defconvert_ecuflash_scaling(file, &set.list[s]);
+  if (definition->numTables) fputs("\n", file);
+
+  for (size_t t = 0; t < definition->numTables; t++) {
+    const definition_table_t* table = &definition->tables[t];
+    const char* scaling[3];
+    for (size_t u = 0; u < 3; u++)
+      scaling[u] = refs[3 * t + u] >= 0 ? set.list[refs[3 * t + u]].name : names[3 * t + u];
+
+    fputs("\t<table", file);
+    defconvert_attr(file, "name", table->name);
+    if (table->category[0]) defconvert_attr(file, "category", table->category);
+    if (table->address) fprintf(file, " address=\"%x\"", table->address);
+    fprintf(file, " type=\"%s\"", defconvert_types[table->dimensions & 3]);
+    if (table->swapXY) fputs(" swapxy=\"true\"", file);
+    if (table->dimensions == 2) fprintf(file, " elements=\"%u\"", table->sizeY);
+    if (scaling[0]) defconvert_attr(file, "scaling", scaling[0]);
+
+    const definition_axis_t* axes[2] = { &table->x, &table->y };
+    bool open = false;
+    for (size_t a = 0; a < 2; a++) {
+      if (!scaling[a + 1]) continue;
+      if (!open) fputs(">\n", file);
+      open = true;
+      fputs("\t\t<table", file);
+      defconvert_attr(file, "name", axes[a]->name);
+      if (axes[a]->address) fprintf(file, " address=\"%x\"", axes[a]->address);
+      fprintf(file, " type=\"%s\" elements=\"%u\"", a ? "Y Axis" : "X Axis", axes[a]->length);
+      defconvert_attr(file, "scaling", scaling[a + 1]);
+      fputs("/>\n", file);
+    }
+    fputs(open ? "\t</table>\n" : "/>\n", file);
+  }
+  fputs(definition->numTables ? "\n</rom>\n" : "</rom>\n", file);
+  return ferror(file) ? EIO : 0;
+}
+
+/* Directories */
+
+// one (input, output) pair of the manifest
+typedef struct Defconvert_Output {
+  char     input[384];    // relative to the input directory
+  char     output[128];   // file name in the output directory
+  uint32_t hash;          // CRC32C of the input
+  uint64_t length;
+} defconvert_output_t;
+
+typedef struct Defconvert_Input {
+  char*    path;
+  const char* name;       // as kept in the manifest
+  uint32_t hash;
+  uint64_t length;
+  bool     unchanged;
+  bool     failed;
+  size_t   roms, tables, scalings;
+  std::vector<defconvert_output_t> outputs;
+} defconvert_input_t;
+
+typedef struct Defconvert_Job {
+  const char* output;
+  defconvert_format_t format;
+  const std::vector<defconvert_output_t>* manifest;   // sorted by input
+  defconvert_input_t* inputs;
+  size_t numInputs;
+  std::atomic<size_t> next;
+} defconvert_job_t;
+
+typedef struct Defconvert_Rom {
+  size_t offset;
+  char   xmlID[64];
+} defconvert_rom_t;
+
+static bool defconvert_by_input(const defconvert_output_t& a, const defconvert_output_t& b)
+{
+  int c = strcmp(a.input, b.input);
+  return c ? c < 0 : strcmp(a.output, b.output) < 0;
+}
+
+static bool defconvert_by_output(const defconvert_output_t& a, const defconvert_output_t& b)
+{
+  int c = strcmp(a.output, b.output);
+  return c ? c < 0 : strcmp(a.input, b.input) < 0;
+}
+
+static size_t defconvert_replace(const char* temporary, const char* path)
+{
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  if (!MoveFileExA(temporary, path, MOVEFILE_REPLACE_EXISTING)) {
+    LOGE(TAG, "Failed to replace %s (%lu)", path, GetLastError());
+    remove(temporary);
+    return EIO;
+  }
+#else
+  if (rename(temporary, path)) {
+    size_t ret = errno;
+    LOGE(TAG, "Failed to replace %s %s", path, strerror(errno));
+    remove(temporary);
+    return ret;
+  }
+#endif
+  return 0;
+}
+
+static void defconvert_collect_rom(void* ctx, const definition_rom_t* rom)
+{
+  std::vector<defconvert_rom_t>* roms = (std::vector<defconvert_rom_t>*)ctx;
+  defconvert_rom_t entry;
+  entry.offset = rom->offset;
+  snprintf(entry.xmlID, sizeof(entry.xmlID), "%s", rom->romid.xmlID);
+  roms->push_back(entry);
+}
+
+// <xmlid>.xml, or the input's file name for a <rom> without one, numbered if the file has several
+static void defconvert_output_name(char* out, size_t size, const char* path, const char* xmlID, size_t rom, size_t numRoms)
+{
+  if (xmlID[0]) {
+    snprintf(out, size, "%s.xml", xmlID);
+  } else {
+    const char* name = path;
+    for (const char* s = path; *s; s++)
+      if (*s == '/' || *s == '\\') name = s + 1;
+    int length = (int)strlen(name);
+    if (length > 4 && !strcmp(name + length - 4, ".xml")) length -= 4;
+    if (numRoms == 1) snprintf(out, size, "%.*s.xml", length, name);
+    else snprintf(out, size, "%.*s-%zu.xml", length, name, rom + 1);
+  }
+  for (char* s = out; *s; s++)
+    if (strchr("/\\:*?\"<>|", *s)) *s = '_';
+}
+
+// the manifest has the same hash for it and every output is still there
+static bool defconvert_unchanged(const defconvert_job_t* job, defconvert_input_t* input)
+{
+  defconvert_output_t key;
+  char path[640];
+  snprintf(key.input, sizeof(key.input), "%s", input->name);
+  key.output[0] = 0;
+  auto first = std::lower_bound(job->manifest->begin(), job->manifest->end(), key, defconvert_by_input);
+  auto last = first;
+  for (; last != job->manifest->end() && !strcmp(last->input, input->name); last++) {
+    snprintf(path, sizeof(path), "%s/%s", job->output, last->output);
+    if (last->hash != input->hash || last->length != input->length || access(path, F_OK) != 0)
+      return false;
+  }
+  if (first == last) return false;
+  input->outputs.assign(first, last);
+  return true;
+}
+
+static void defconvert_file(const defconvert_job_t* job, defconvert_input_t* input, unsigned worker)
+{
+  size_t length = 0;
+  char* text = (char*)load_file(input->path, &length);
+  if (!text) {
+    LOGE(TAG, "Failed to read %s %s", input->path, strerror(errno));
+    input->failed = true;
+    return;
+  }
+  input->length = length;
+  input->hash   = crc32c(0, text, length);
+  if (defconvert_unchanged(job, input)) {
+    input->unchanged = true;
+    free(text);
+    return;
+  }
+
+  std::vector<defconvert_rom_t> roms;
+  definition_scan(text, length, defconvert_collect_rom, &roms);
+  for (size_t r = 0; r < roms.size(); r++) {
+    defconvert_output_t output;
+    definition_t definition;
+    char path[640], temporary[672];
+    size_t scalings = 0, ret;
+
+    if (definition_parse_rom(&definition, input->path, text, length, roms[r].offset)) {
+      LOGE(TAG, "Skipping <rom> %zu of %s", r + 1, input->path);
+      input->failed = true;
+      continue;
+    }
+    memset(&output, 0, sizeof(output));
+    snprintf(output.input, sizeof(output.input), "%s", input->name);
+    defconvert_output_name(output.output, sizeof(output.output), input->path, roms[r].xmlID, r, roms.size());
+    output.hash   = input->hash;
+    output.length = input->length;
+    snprintf(path, sizeof(path), "%s/%s", job->output, output.output);
+    snprintf(temporary, sizeof(temporary), "%s.%u.tmp", path, worker);
+
+    // written next to it and renamed over it, EcuFlash or RomRaider never see half a file
+    FILE* file = fopen(temporary, "wb");
+    if (!file) {
+      LOGE(TAG, "Failed to create %s %s", temporary, strerror(errno));
+      definition_free(&definition);
+      input->failed = true;
+      continue;
+    }
+    if (job->format == DEFCONVERT_ECUFLASH) ret = defconvert_write_ecuflash(&definition, file, &scalings);
+    else ret = defconvert_write_romraider(&definition, file);
+    if (fclose(file) || ret) {
+      LOGE(TAG, "Failed to write %s", temporary);
+      remove(temporary);
+      ret = EIO;
+    } else {
+      ret = defconvert_replace(temporary, path);
+    }
+    if (!ret) {
+      input->outputs.push_back(output);
+      input->roms++;
+      input->tables   += definition.numTables;
+      input->scalings += scalings;
+    } else {
+      input->failed = true;
+    }
+    definition_free(&definition);
+  }
+  if (roms.empty()) {
+    LOGE(TAG, "No <rom> in %s", input->path);
+    input->failed = true;
+  }
+  free(text);
+}
+
+static void defconvert_worker(defconvert_job_t* job, unsigned worker)
+{
+  for (;;) {
+    size_t i = job->next++;
+    if (i >= job->numInputs) break;
+    defconvert_file(job, &job->inputs[i], worker);
+  }
+}
+
+// header line "defconvert <version> <format>", then "hash\tlength\toutput\tinput" per output
+static void defconvert_load_manifest(const char* path, defconvert_format_t format, std::vector<defconvert_output_t>& manifest)
+{
+  char line[1024], expected[64];
+  FILE* file = fopen(path, "rb");
+  if (!file) return;
+
+  snprintf(expected, sizeof(expected), "defconvert %u %s\n", DEFCONVERT_VERSION, defconvert_format_names[format]);
+  // another version or format converts everything again
+  if (!fgets(line, sizeof(line), file) || strcmp(line, expected)) {
+    fclose(file);
+    return;
+  }
+  while (fgets(line, sizeof(line), file)) {
+    defconvert_output_t entry;
+    unsigned long long length = 0;
+    char* fields[4];
+    char* s = line;
+    size_t n = 0;
+    line[strcspn(line, "\r\n")] = 0;
+    for (; n < 4 && s; n++) {
+      fields[n] = s;
+      s = n < 3 ? strchr(s, '\t') : NULL;
+      if (s) *s++ = 0;
+    }
+    if (n < 4 || strlen(fields[2]) >= sizeof(entry.output) || strlen(fields[3]) >= sizeof(entry.input)) continue;
+    memset(&entry, 0, sizeof(entry));
+    entry.hash = (uint32_t)strtoul(fields[0], NULL, 16);
+    length = strtoull(fields[1], NULL, 10);
+    entry.length = length;
+    strcpy(entry.output, fields[2]);
+    strcpy(entry.input, fields[3]);
+    manifest.push_back(entry);
+  }
+  fclose(file);
+  std::sort(manifest.begin(), manifest.end(), defconvert_by_input);
+}
+
+static size_t defconvert_save_manifest(const char* path, defconvert_format_t format, const std::vector<defconvert_output_t>& manifest)
+{
+  char temporary[640];
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+  FILE* file = fopen(temporary, "wb");
+  if (!file) {
+    size_t ret = errno;
+    LOGE(TAG, "Failed to create %s %s", temporary, strerror(errno));
+    return ret;
+  }
+  fprintf(file, "defconvert %u %s\n", DEFCONVERT_VERSION, defconvert_format_names[format]);
+  for (size_t e = 0; e < manifest.size(); e++)
+    fprintf(file, "%08x\t%llu\t%s\t%s\n", manifest[e].hash, (unsigned long long)manifest[e].length,
+            manifest[e].output, manifest[e].input);
+  if (fclose(file)) {
+    LOGE(TAG, "Failed to write %s", temporary);
+    remove(temporary);
+    return EIO;
+  }
+  return defconvert_replace(temporary, path);
+}
+
+size_t defconvert_run(const char* input, const char* output, defconvert_format_t format, unsigned threads,
+                      defconvert_stats_t* stats)
+{
+  uint64_t start = monotonic_us();
+  std::vector<defconvert_output_t> manifest, outputs;
+  std::vector<defconvert_input_t> inputs;
+  char manifestPath[512];
+  char** paths = NULL;
+  size_t numPaths = 0, ret = 0;
+
+  memset(stats, 0, sizeof(defconvert_stats_t));
+  if (snprintf(manifestPath, sizeof(manifestPath), "%s/%s", output, DEFCONVERT_MANIFEST) >= (int)sizeof(manifestPath))
+    return ENAMETOOLONG;
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  if (_mkdir(output) && errno != EEXIST) {
+#else
+  if (mkdir(output, 0755) && errno != EEXIST) {
+#endif
+    ret = errno;
+    LOGE(TAG, "Failed to create %s %s", output, strerror(errno));
+    return ret;
+  }
+
+  bool directory = is_directory(input);
+  size_t prefix = directory ? strlen(input) + 1 : 0;
+  size_t outputLength = strlen(output);
+  if (directory) {
+    paths = list_files_recursive(input, ".xml", &numPaths);
+    if (!paths) {
+      ret = errno ? errno : ENOENT;
+      LOGE(TAG, "Failed to list %s %s", input, strerror((int)ret));
+      return ret;
+    }
+  } else {
+    paths = (char**)malloc(sizeof(char*));
+    if (!paths || !(paths[0] = strdup(input))) {
+      free(paths);
+      return ENOMEM;
+    }
+    numPaths = 1;
+  }
+  inputs.resize(numPaths);
+  size_t numInputs = 0;
+  for (size_t p = 0; p < numPaths; p++) {
+    // a conversion into a directory below the input isn't converted again
+    if (directory && !strncmp(paths[p], output, outputLength) && (paths[p][outputLength] == '/' || paths[p][outputLength] == '\\'))
+      continue;
+    inputs[numInputs].path = paths[p];
+    inputs[numInputs].name = paths[p] + prefix;
+    numInputs++;
+  }
+  inputs.resize(numInputs);
+  stats->files = numInputs;
+
+  defconvert_load_manifest(manifestPath, format, manifest);
+  if (numInputs) {
+    defconvert_job_t job;
+    if (!threads) threads = std::thread::hardware_concurrency();
+    if (!threads) threads = 1;
+    if (threads > numInputs) threads = (unsigned)numInputs;
+    stats->threads = threads;
+
+    job.output    = output;
+    job.format    = format;
+    job.manifest  = &manifest;
+    job.inputs    = inputs.data();
+    job.numInputs = numInputs;
+    job.next      = 0;
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++)
+      pool.push_back(std::thread(defconvert_worker, &job, t));
+    defconvert_worker(&job, 0);
+    for (size_t t = 0; t < pool.size(); t++)
+      pool[t].join();
+  }
+
+  for (size_t i = 0; i < inputs.size(); i++) {
+    const defconvert_input_t* in = &inputs[i];
+    stats->bytes += in->length;
+    if (in->unchanged) stats->unchanged++;
+    else if (in->failed) stats->failed++;
+    else stats->converted++;
+    stats->roms     += in->roms;
+    stats->tables   += in->tables;
+    stats->scalings += in->scalings;
+    outputs.insert(outputs.end(), in->outputs.begin(), in->outputs.end());
+    // no length never matches, what failed is tried again next time
+    if (in->failed)
+      for (size_t o = outputs.size() - in->outputs.size(); o < outputs.size(); o++) outputs[o].length = 0;
+  }
+
+  // two inputs writing the same file, the last one converted wins
+  std::sort(outputs.begin(), outputs.end(), defconvert_by_output);
+  for (size_t o = 1; o < outputs.size(); o++)
+    if (!strcmp(outputs[o].output, outputs[o - 1].output))
+      LOGW(TAG, "%s is converted from both %s and %s", outputs[o].output, outputs[o - 1].input, outputs[o].input);
+
+  // whatever the last run wrote that this one didn't is left over from inputs that are gone or changed
+  for (size_t m = 0; m < manifest.size(); m++) {
+    defconvert_output_t key = manifest[m];
+    key.input[0] = 0;
+    auto found = std::lower_bound(outputs.begin(), outputs.end(), key, defconvert_by_output);
+    if (found != outputs.end() && !strcmp(found->output, key.output)) continue;
+    char path[640];
+    snprintf(path, sizeof(path), "%s/%s", output, manifest[m].output);
+    if (!remove(path)) stats->removed++;
+  }
+
+  if (stats->converted || stats->failed || stats->removed || outputs.size() != manifest.size()) {
+    std::sort(outputs.begin(), outputs.end(), defconvert_by_input);
+    ret = defconvert_save_manifest(manifestPath, format, outputs);
+  }
+  free_list(paths, numPaths);
+  stats->elapsedUs = monotonic_us() - start;
+  return ret;
+}
+
+size_t defconvert_convert(const char* input, const char* output, const char* formatName, unsigned threads)
+{
+  defconvert_stats_t stats;
+  defconvert_format_t format = DEFCONVERT_ROMRAIDER;
+  size_t ret;
+
+  defconvert_format(formatName, &format);
+  if ((ret = defconvert_run(input, output, format, threads, &stats)))
+    return ret;
+  LOGI(TAG, "%zu definition files, %zu converted with %u threads (%.1f MB read) in %.1f ms, %zu unchanged, %zu outputs removed",
+       stats.files, stats.converted, stats.threads, (double)stats.bytes / (1024.0 * 1024.0),
+       (double)stats.elapsedUs / 1000.0, stats.unchanged, stats.removed);
+  if (stats.converted && format == DEFCONVERT_ECUFLASH)
+    LOGI(TAG, "Wrote %zu definitions into %s, %zu tables sharing %zu named scalings", stats.roms, output,
+         stats.tables, stats.scalings);
+  else if (stats.converted)
+    LOGI(TAG, "Wrote %zu definitions into %s, %zu tables", stats.roms, output, stats.tables);
+  if (stats.failed)
+    LOGE(TAG, "%zu definition files couldn't be converted", stats.failed);
+  return stats.failed ? EIO : 0;
+}
@@ -0,0 +1,96 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "definition.h"
+
+/* Definition converter.
+ *
+ * Translates definitions between RomRaider and EcuFlash, either way, through
+ * definition_t. A file is read once and converted one <rom> at a time: each is parsed,
+ * written and freed before the next, so a RomRaider file with hundreds of them never
+ * holds more than one. EcuFlash keeps one <rom> per file, so every <rom> of a RomRaider
+ * file becomes a file of its own, named after its xmlid. A RomRaider file is written
+ * per input <rom> too.
+ *
+ * RomRaider gives every table an inline scaling, EcuFlash names them. Going to EcuFlash,
+ * identical scalings (same expressions, units, format and storage type) are written once
+ * and shared: they are hashed into a table as the tables are walked. Going to RomRaider,
+ * named scalings are copied into the tables using them. Scalings an EcuFlash definition
+ * takes from its <include> aren't known, tables using them are written without a storage
+ * type. Descriptions, static axis values and editor hints (min, max, increments, user
+ * level) aren't kept by definition_t, so they are dropped.
+ *
+ * A directory is converted with worker threads, one input file at a time. The output
+ * directory keeps a manifest of the CRC32C of every input and the files made from it.
+ * An input whose hash and outputs are still there is skipped without being parsed, and
+ * outputs of inputs that are gone are removed.
+ */
+
+#define DEFCONVERT_MANIFEST "defconvert.manifest"
+static const uint32_t DEFCONVERT_VERSION = 1;
+
+typedef enum Defconvert_Format {
+  DEFCONVERT_ROMRAIDER = 0,
+  DEFCONVERT_ECUFLASH,
+} defconvert_format_t;
+
+typedef struct Defconvert_Stats {
+  size_t   files;       // inputs
+  size_t   converted;
+  size_t   unchanged;   // same hash as last time
+  size_t   failed;
+  size_t   removed;     // outputs of inputs that are gone
+  size_t   roms;        // written
+  size_t   tables;
+  size_t   scalings;    // named scalings written, EcuFlash only
+  uint64_t bytes;       // read
+  unsigned threads;
+  uint64_t elapsedUs;
+} defconvert_stats_t;
+
+/** "romraider" or "ecuflash", false for anything else */
+bool defconvert_format(const char* name, defconvert_format_t* format);
+
+/** Write a definition as a RomRaider <roms> with one <rom>. Returns 0 or errno */
+size_t defconvert_write_romraider(const definition_t* definition, FILE* file);
+
+/**
+ * Write a definition as an EcuFlash <rom>, identical scalings shared under one name.
+ * `scalings` is how many named scalings it has, may be NULL. Returns 0 or errno
+ */
+size_t defconvert_write_ecuflash(const definition_t* definition, FILE* file, size_t* scalings);
+
+/**
+ * Convert a definition file, or every .xml below a directory, into `output`, which is
+ * created if needed. 0 threads is one per CPU. Returns 0 or errno; inputs that can't be
+ * converted are only counted
+ */
+size_t defconvert_run(const char* input, const char* output, defconvert_format_t format, unsigned threads,
+                      defconvert_stats_t* stats);
+
+/**
+ * --convert: defconvert_run() into the format named `formatName`, logging what it did.
+ * Returns 0, EIO if some inputs couldn't be converted, or errno
+ */
+size_t defconvert_convert(const char* input, const char* output, const char* formatName, unsigned threads);
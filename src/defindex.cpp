@@ -0,0 +1,239 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <algorithm>
+
+#include "defindex.h"
+#include "util.h"
+
+static const char* TAG = "Defindex";
+
+static uint64_t defindex_hash(uint32_t address, const void* id, size_t length)
+{
+  const uint8_t* p = (const uint8_t*)id;
+  uint64_t hash = 0xcbf29ce484222325ull;  // FNV-1a
+  for (int b = 0; b < 4; b++) {
+    hash ^= (address >> (8 * b)) & 0xff;
+    hash *= 0x100000001b3ull;
+  }
+  for (size_t i = 0; i < length; i++) {
+    hash ^= p[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+typedef struct Defindex_Scan {
+  defindex_t* index;
+  size_t capacity;
+  uint32_t path;
+  bool failed;
+} defindex_scan_t;
+
+static void defindex_add(void* ctx, const definition_rom_t* rom)
+{
+  defindex_scan_t* scan = (defindex_scan_t*)ctx;
+  defindex_t* index = scan->index;
+  if (index->numEntries == scan->capacity) {
+    size_t grown = scan->capacity ? scan->capacity * 2 : 64;
+    defindex_entry_t* entries = (defindex_entry_t*)realloc(index->entries, grown * sizeof(defindex_entry_t));
+    if (!entries) {
+      scan->failed = true;
+      return;
+    }
+    index->entries = entries;
+    scan->capacity = grown;
+  }
+  defindex_entry_t* entry = &index->entries[index->numEntries++];
+  entry->rom  = *rom;
+  entry->path = scan->path;
+  entry->base = -1;
+}
+
+// entry with `xmlID`, one of the same format if there are several
+static long defindex_lookup(const defindex_t* index, const char* xmlID, bool ecuflash)
+{
+  if (!xmlID[0]) return -1;
+  const uint32_t* begin = index->byXmlID;
+  const uint32_t* end = begin + index->numEntries;
+  const uint32_t* first = std::lower_bound(begin, end, xmlID, [index](uint32_t e, const char* id) {
+    return strcmp(index->entries[e].rom.romid.xmlID, id) < 0;
+  });
+  long found = -1;
+  for (const uint32_t* e = first; e < end && !strcmp(index->entries[*e].rom.romid.xmlID, xmlID); e++) {
+    if (found < 0) found = (long)*e;
+    if (index->entries[*e].rom.ecuflash == ecuflash) return (long)*e;
+  }
+  return found;
+}
+
+static size_t defindex_hash_ids(defindex_t* index)
+{
+  size_t hashed = 0;
+  for (size_t e = 0; e < index->numEntries; e++)
+    if (index->entries[e].rom.romid.internalIDString[0]) hashed++;
+
+  index->numSlots = 16;
+  while (index->numSlots < hashed * 2) index->numSlots *= 2;
+  index->slots  = (uint32_t*)calloc(index->numSlots, sizeof(uint32_t));
+  index->probes = (defindex_probe_t*)calloc(hashed ? hashed : 1, sizeof(defindex_probe_t));
+  if (!index->slots || !index->probes) return ENOMEM;
+
+  for (size_t e = 0; e < index->numEntries; e++) {
+    const definition_romid_t* romid = &index->entries[e].rom.romid;
+    size_t length = strlen(romid->internalIDString);
+    if (!length) continue;
+    size_t slot = defindex_hash(romid->internalIDAddress, romid->internalIDString, length) & (index->numSlots - 1);
+    while (index->slots[slot]) slot = (slot + 1) & (index->numSlots - 1);
+    index->slots[slot] = (uint32_t)e + 1;
+    index->probes[index->numProbes].address = romid->internalIDAddress;
+    index->probes[index->numProbes].length  = (uint32_t)length;
+    index->numProbes++;
+  }
+
+  std::sort(index->probes, index->probes + index->numProbes, [](const defindex_probe_t& a, const defindex_probe_t& b) {
+    return a.address != b.address ? a.address < b.address : a.length < b.length;
+  });
+  index->numProbes = std::unique(index->probes, index->probes + index->numProbes, [](const defindex_probe_t& a, const defindex_probe_t& b) {
+    return a.address == b.address && a.length == b.length;
+  }) - index->probes;
+  return 0;
+}
+
+size_t defindex_build(defindex_t* index, const char* directory)
+{
+  defindex_scan_t scan;
+  size_t ret = 0;
+
+  memset(index, 0, sizeof(defindex_t));
+  memset(&scan, 0, sizeof(scan));
+  scan.index = index;
+  index->paths = list_files_recursive(directory, ".xml", &index->numPaths);
+  if (!index->paths) {
+    ret = errno ? errno : ENOENT;
+    LOGE(TAG, "Failed to list %s %s", directory, strerror((int)ret));
+    return ret;
+  }
+
+  for (size_t p = 0; p < index->numPaths && !scan.failed; p++) {
+    size_t length = 0;
+    char* text = (char*)load_file(index->paths[p], &length);
+    if (!text) {
+      LOGE(TAG, "Skipping %s %s", index->paths[p], strerror(errno));
+      continue;
+    }
+    scan.path = (uint32_t)p;
+    definition_scan(text, length, defindex_add, &scan);
+    free(text);
+  }
+  if (scan.failed) {
+    defindex_free(index);
+    return ENOMEM;
+  }
+
+  index->byXmlID = (uint32_t*)calloc(index->numEntries ? index->numEntries : 1, sizeof(uint32_t));
+  if (!index->byXmlID || (ret = defindex_hash_ids(index))) {
+    defindex_free(index);
+    return ENOMEM;
+  }
+  for (size_t e = 0; e < index->numEntries; e++)
+    index->byXmlID[e] = (uint32_t)e;
+  std::sort(index->byXmlID, index->byXmlID + index->numEntries, [index](uint32_t a, uint32_t b) {
+    return strcmp(index->entries[a].rom.romid.xmlID, index->entries[b].rom.romid.xmlID) < 0;
+  });
+  for (size_t e = 0; e < index->numEntries; e++) {
+    defindex_entry_t* entry = &index->entries[e];
+    if (!entry->rom.base[0]) continue;
+    entry->base = (int32_t)defindex_lookup(index, entry->rom.base, entry->rom.ecuflash);
+    if (entry->base < 0)
+      LOGI(TAG, "%s builds on %s, which isn't in %s", entry->rom.romid.xmlID, entry->rom.base, directory);
+  }
+  return 0;
+}
+
+void defindex_free(defindex_t* index)
+{
+  if (index->paths) free_list(index->paths, index->numPaths);
+  free(index->entries);
+  free(index->probes);
+  free(index->slots);
+  free(index->byXmlID);
+  memset(index, 0, sizeof(defindex_t));
+}
+
+size_t defindex_identify(const defindex_t* index, const uint8_t* rom, size_t length, uint32_t* matches, size_t max)
+{
+  size_t found = 0;
+  for (size_t p = 0; p < index->numProbes; p++) {
+    const defindex_probe_t* probe = &index->probes[p];
+    if (probe->address > length || probe->length > length - probe->address) continue;
+    const uint8_t* id = rom + probe->address;
+    size_t slot = defindex_hash(probe->address, id, probe->length) & (index->numSlots - 1);
+    for (; index->slots[slot]; slot = (slot + 1) & (index->numSlots - 1)) {
+      uint32_t e = index->slots[slot] - 1;
+      const definition_romid_t* romid = &index->entries[e].rom.romid;
+      // a shorter ID followed by a 0 in the ROM would match a longer probe otherwise
+      if (romid->internalIDAddress != probe->address || romid->internalIDString[probe->length] ||
+          !romid->internalIDString[probe->length - 1] || memcmp(romid->internalIDString, id, probe->length))
+        continue;
+      if (found < max) matches[found] = e;
+      found++;
+    }
+  }
+  return found;
+}
+
+long defindex_find(const defindex_t* index, const char* xmlID)
+{
+  return defindex_lookup(index, xmlID, false);
+}
+
+size_t defindex_chain(const defindex_t* index, uint32_t entry, uint32_t* chain)
+{
+  size_t length = 0;
+  long e = (long)entry;
+  while (e >= 0 && length < DEFINDEX_MAX_CHAIN) {
+    for (size_t i = 0; i < length; i++)
+      if (chain[i] == (uint32_t)e) return length;
+    chain[length++] = (uint32_t)e;
+    e = index->entries[e].base;
+  }
+  return length;
+}
+
+const char* defindex_path(const defindex_t* index, uint32_t entry)
+{
+  return index->paths[index->entries[entry].path];
+}
+
+void defindex_log_matches(const defindex_t* index, const uint32_t* matches, size_t found, size_t max)
+{
+  uint32_t chain[DEFINDEX_MAX_CHAIN];
+  for (size_t m = 0; m < found && m < max; m++) {
+    const definition_rom_t* rom = &index->entries[matches[m]].rom;
+    LOGI(TAG, "  %s (%s) %s, ID %s at 0x%x", rom->romid.xmlID, rom->ecuflash ? "EcuFlash" : "RomRaider",
+      defindex_path(index, matches[m]), rom->romid.internalIDString, rom->romid.internalIDAddress);
+    size_t length = defindex_chain(index, matches[m], chain);
+    for (size_t c = 1; c < length; c++)
+      LOGI(TAG, "    based on %s, %s", index->entries[chain[c]].rom.romid.xmlID, defindex_path(index, chain[c]));
+    if (rom->base[0] && index->entries[matches[m]].base < 0)
+      LOGE(TAG, "    based on %s, which isn't in the library", rom->base);
+  }
+}
@@ -0,0 +1,84 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "definition.h"
+
+/* Definition library.
+ *
+ * Picks the definition for a ROM out of a directory of them, the way EcuFlash and
+ * RomRaider do: a definition names an address in the ROM (internalidaddress) and the
+ * string found there (internalidstring), N3K1EU000 at 0x6c646 for the RX8 ROMs here.
+ *
+ * Only the romid of every <rom> is read when the library is indexed, tables are left
+ * for when a definition is picked. IDs are kept in a hash table keyed by address and
+ * string, and the library remembers the distinct (address, length) pairs IDs have.
+ * Identifying a ROM hashes the bytes at each of those, usually one or two, and looks
+ * them up, so it costs the same for ten definitions as for a thousand.
+ *
+ * Definitions can build on others: RomRaider's <rom base="..."> and EcuFlash's
+ * <include>, both by xmlid. A match comes with the chain of its bases, nearest first.
+ */
+
+static const size_t DEFINDEX_MAX_CHAIN = 8;
+
+typedef struct Defindex_Entry {
+  definition_rom_t rom;
+  uint32_t path;        // into `paths`
+  int32_t  base;        // entry of rom.base, -1 if there is none or it isn't in the library
+} defindex_entry_t;
+
+// ID strings of one length at one address, read and hashed as one
+typedef struct Defindex_Probe {
+  uint32_t address;
+  uint32_t length;
+} defindex_probe_t;
+
+typedef struct Defindex {
+  char**   paths;
+  size_t   numPaths;
+  defindex_entry_t* entries;
+  size_t   numEntries;
+  defindex_probe_t* probes;
+  size_t   numProbes;
+  uint32_t* slots;      // entry + 1 by hash of address and ID, 0 is free
+  size_t   numSlots;    // a power of 2
+  uint32_t* byXmlID;    // entries sorted by xmlid
+} defindex_t;
+
+/** Index every .xml below `directory`. Returns 0 or errno */
+size_t defindex_build(defindex_t* index, const char* directory);
+void defindex_free(defindex_t* index);
+
+/** Entries whose ID the ROM holds, up to `max` of them into `matches`. Returns how many there are */
+size_t defindex_identify(const defindex_t* index, const uint8_t* rom, size_t length, uint32_t* matches, size_t max);
+
+/** Entry by xmlid, -1 if there is none */
+long defindex_find(const defindex_t* index, const char* xmlID);
+
+/** `entry` and its bases, nearest first, up to DEFINDEX_MAX_CHAIN. Stops at a loop. Returns the length */
+size_t defindex_chain(const defindex_t* index, uint32_t entry, uint32_t* chain);
+
+/** File of an entry */
+const char* defindex_path(const defindex_t* index, uint32_t entry);
+
+/** Log `found` matches of defindex_identify() and the bases they build on, at most `max` */
+void defindex_log_matches(const defindex_t* index, const uint32_t* matches, size_t found, size_t max);
@@ -0,0 +1,779 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+
+#include "definition.h"
+#include "util.h"
+
+static const char* TAG = "Definition";
+
+/* Just enough XML for definition files: elements, attributes and text. Comments,
+ * declarations and processing instructions are skipped, there is no DTD or namespace
+ * handling. */
+
+typedef struct Definition_Tag {
+  const char* name;
+  size_t      nameLength;
+  const char* attributes;
+  const char* attributesEnd;
+  const char* text;         // right after the tag
+  bool        closing;      // </name>
+  bool        selfClosing;  // <name/>
+} definition_tag_t;
+
+static bool definition_next_tag(const char** cursor, const char* end, definition_tag_t* tag)
+{
+  const char* s = *cursor;
+  for (;;) {
+    s = (const char*)memchr(s, '<', end - s);
+    if (!s || end - s < 2) return false;
+    if (end - s >= 4 && memcmp(s, "<!--", 4) == 0) {
+      for (s += 4; end - s >= 3 && memcmp(s, "-->", 3) != 0; s++);
+      if (end - s < 3) return false;
+      s += 3;
+      continue;
+    }
+    if (s[1] == '?' || s[1] == '!') {
+      s = (const char*)memchr(s, '>', end - s);
+      if (!s) return false;
+      continue;
+    }
+    break;
+  }
+
+  s++;
+  tag->closing = *s == '/';
+  if (tag->closing) s++;
+  tag->name = s;
+  while (s < end && !isspace((unsigned char)*s) && *s != '>' && *s != '/') s++;
+  tag->nameLength = s - tag->name;
+  tag->attributes = s;
+
+  char quote = 0;
+  for (; s < end; s++) {
+    if (quote) {
+      if (*s == quote) quote = 0;
+    } else if (*s == '"' || *s == '\'') {
+      quote = *s;
+    } else if (*s == '>') {
+      break;
+    }
+  }
+  if (s >= end) return false;
+  tag->selfClosing   = s[-1] == '/';
+  tag->attributesEnd = tag->selfClosing ? s - 1 : s;
+  tag->text = *cursor = s + 1;
+  return true;
+}
+
+static bool definition_is(const definition_tag_t* tag, const char* name)
+{
+  return strlen(name) == tag->nameLength && memcmp(tag->name, name, tag->nameLength) == 0;
+}
+
+// copy [in, in + length) to out, decoding the predefined entities
+static void definition_unescape(char* out, size_t outLength, const char* in, size_t length)
+{
+  static const struct { const char* entity; char c; } entities[] = {
+    { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '"' }, { "&apos;", '\'' },
+  };
+  size_t n = 0;
+  for (size_t i = 0; i < length && n < outLength - 1; i++) {
+    char c = in[i];
+    if (c == '&') {
+      for (size_t e = 0; e < sizeof(entities) / sizeof(entities[0]); e++) {
+        size_t entityLength = strlen(entities[e].entity);
+        if (length - i >= entityLength && memcmp(in + i, entities[e].entity, entityLength) == 0) {
+          c = entities[e].c;
+          i += entityLength - 1;
+          break;
+        }
+      }
+    }
+    out[n++] = c;
+  }
+  out[n] = 0;
+}
+
+/** value of attribute `name`, false if the tag doesn't have it */
+static bool definition_attr(const definition_tag_t* tag, const char* name, char* out, size_t outLength)
+{
+  const char* s = tag->attributes;
+  const char* end = tag->attributesEnd;
+  size_t nameLength = strlen(name);
+
+  while (s < end) {
+    while (s < end && isspace((unsigned char)*s)) s++;
+    const char* attr = s;
+    while (s < end && *s != '=' && !isspace((unsigned char)*s)) s++;
+    size_t attrLength = s - attr;
+    while (s < end && (isspace((unsigned char)*s) || *s == '=')) s++;
+    if (s >= end || (*s != '"' && *s != '\'')) return false;
+    char quote = *s++;
+    const char* value = s;
+    while (s < end && *s != quote) s++;
+    if (attrLength == nameLength && memcmp(attr, name, nameLength) == 0) {
+      definition_unescape(out, outLength, value, s - value);
+      return true;
+    }
+    s++;
+  }
+  return false;
+}
+
+/** text between the tag and the next one, whitespace trimmed */
+static void definition_text(const definition_tag_t* tag, const char* end, char* out, size_t outLength)
+{
+  const char* s = tag->text;
+  const char* e = (const char*)memchr(s, '<', end - s);
+  if (!e) e = end;
+  while (s < e && isspace((unsigned char)*s)) s++;
+  while (e > s && isspace((unsigned char)e[-1])) e--;
+  definition_unescape(out, outLength, s, e - s);
+}
+
+/* Scaling expressions */
+
+typedef struct Definition_Parser {
+  const char* s;
+  double x;
+  bool failed;
+} definition_parser_t;
+
+static double definition_parse_sum(definition_parser_t* parser);
+
+static void definition_skip_spaces(definition_parser_t* parser)
+{
+  while (isspace((unsigned char)*parser->s)) parser->s++;
+}
+
+static double definition_parse_factor(definition_parser_t* parser)
+{
+  definition_skip_spaces(parser);
+  char c = *parser->s;
+  if (c == '-' || c == '+') {
+    parser->s++;
+    double value = definition_parse_factor(parser);
+    return c == '-' ? -value : value;
+  }
+  if (c == 'x' || c == 'X') {
+    parser->s++;
+    return parser->x;
+  }
+  if (c == '(') {
+    parser->s++;
+    double value = definition_parse_sum(parser);
+    definition_skip_spaces(parser);
+    if (*parser->s != ')') parser->failed = true;
+    else parser->s++;
+    return value;
+  }
+  char* end = NULL;
+  double value = strtod(parser->s, &end);
+  if (end == parser->s) parser->failed = true;
+  parser->s = end;
+  return value;
+}
+
+static double definition_parse_product(definition_parser_t* parser)
+{
+  double value = definition_parse_factor(parser);
+  for (;;) {
+    definition_skip_spaces(parser);
+    char c = *parser->s;
+    if (c != '*' && c != '/') return value;
+    parser->s++;
+    double rhs = definition_parse_factor(parser);
+    value = c == '*' ? value * rhs : value / rhs;
+  }
+}
+
+static double definition_parse_sum(definition_parser_t* parser)
+{
+  double value = definition_parse_product(parser);
+  for (;;) {
+    definition_skip_spaces(parser);
+    char c = *parser->s;
+    if (c != '+' && c != '-') return value;
+    parser->s++;
+    double rhs = definition_parse_product(parser);
+    value = c == '+' ? value + rhs : value - rhs;
+  }
+}
+
+double definition_eval(const char* expression, double x)
+{
+  definition_parser_t parser = { expression, x, false };
+  double value = definition_parse_sum(&parser);
+  definition_skip_spaces(&parser);
+  if (parser.failed || *parser.s) return NAN;
+  return value;
+}
+
+// RomRaider's expression and to_byte are EcuFlash's toexpr and frexpr
+static void definition_parse_scaling(const definition_tag_t* tag, definition_scaling_t* scaling)
+{
+  definition_attr(tag, "name", scaling->name, sizeof(scaling->name));
+  definition_attr(tag, "units", scaling->units, sizeof(scaling->units));
+  if (!definition_attr(tag, "to_byte", scaling->toByte, sizeof(scaling->toByte)))
+    definition_attr(tag, "frexpr", scaling->toByte, sizeof(scaling->toByte));
+  definition_attr(tag, "format", scaling->format, sizeof(scaling->format));
+  if (!definition_attr(tag, "expression", scaling->expression, sizeof(scaling->expression)) &&
+      !definition_attr(tag, "toexpr", scaling->expression, sizeof(scaling->expression)))
+    strcpy(scaling->expression, "x");
+
+  // almost every scaling is x*a+b, those are decoded without going through the parser
+  double f0 = definition_eval(scaling->expression, 0);
+  double f1 = definition_eval(scaling->expression, 1);
+  double f2 = definition_eval(scaling->expression, 2);
+  double step = f1 - f0;
+  scaling->scale  = (float)step;
+  scaling->offset = (float)f0;
+  scaling->linear = isfinite(f0) && isfinite(f1) && isfinite(f2) &&
+                    fabs((f2 - f1) - step) <= 1e-9 * (fabs(step) > 1 ? fabs(step) : 1);
+}
+
+static const definition_scaling_t definition_identity = { "", "x", "x", "", 1.0f, 0.0f, true, "" };
+
+static const char* definition_storage_names[] = { "", "uint8", "uint16", "uint32", "int8", "int16", "int32", "float" };
+
+definition_storage_t definition_storage(const char* type)
+{
+  for (size_t i = 1; i < sizeof(definition_storage_names) / sizeof(definition_storage_names[0]); i++)
+    if (strcmp(type, definition_storage_names[i]) == 0) return (definition_storage_t)i;
+  return DEFINITION_STORAGE_NONE;
+}
+
+const char* definition_storage_name(definition_storage_t storage)
+{
+  return (size_t)storage < sizeof(definition_storage_names) / sizeof(definition_storage_names[0])
+    ? definition_storage_names[storage] : "";
+}
+
+// storagetype, endian and storageaddress (EcuFlash's address), shared by tables, axes and named scalings.
+// Returns the DEFINITION_SET_* bits of those given
+static uint8_t definition_parse_storage_attrs(const definition_tag_t* tag, definition_storage_t* storage,
+                                              bool* bigEndian, uint32_t* address)
+{
+  char value[32];
+  uint8_t set = 0;
+  if (definition_attr(tag, "storagetype", value, sizeof(value))) {
+    *storage = definition_storage(value);
+    set |= DEFINITION_SET_STORAGE;
+  }
+  if (definition_attr(tag, "endian", value, sizeof(value))) {
+    *bigEndian = strcmp(value, "little") != 0;
+    set |= DEFINITION_SET_STORAGE;
+  }
+  if (address && (definition_attr(tag, "storageaddress", value, sizeof(value)) ||
+                  definition_attr(tag, "address", value, sizeof(value)))) {
+    *address = (uint32_t)strtoul(value, NULL, 16);
+    set |= DEFINITION_SET_ADDRESS;
+  }
+  return set;
+}
+
+static uint16_t definition_attr_size(const definition_tag_t* tag, const char* name, uint16_t fallback)
+{
+  char value[16];
+  if (!definition_attr(tag, name, value, sizeof(value))) return fallback;
+  long size = strtol(value, NULL, 10);
+  return size > 0 && size <= 0xffff ? (uint16_t)size : fallback;
+}
+
+// "512KB", "1MB" or plain bytes
+static uint32_t definition_parse_filesize(const char* text)
+{
+  char* unit = NULL;
+  unsigned long size = strtoul(text, &unit, 10);
+  if (unit && (*unit == 'k' || *unit == 'K')) size *= 1024;
+  if (unit && (*unit == 'm' || *unit == 'M')) size *= 1024 * 1024;
+  return (uint32_t)size;
+}
+
+// false for the fields definition_romid_t doesn't keep. Strings go straight into their field,
+// cut to its size
+static bool definition_romid_field(definition_romid_t* romid, const definition_tag_t* tag, const char* end)
+{
+  char number[32];
+  if (definition_is(tag, "xmlid")) {
+    definition_text(tag, end, romid->xmlID, sizeof(romid->xmlID));
+  } else if (definition_is(tag, "internalidaddress")) {
+    definition_text(tag, end, number, sizeof(number));
+    romid->internalIDAddress = (uint32_t)strtoul(number, NULL, 16);
+  } else if (definition_is(tag, "internalidstring")) {
+    definition_text(tag, end, romid->internalIDString, sizeof(romid->internalIDString));
+  } else if (definition_is(tag, "ecuid")) {
+    definition_text(tag, end, romid->ecuID, sizeof(romid->ecuID));
+  } else if (definition_is(tag, "filesize")) {
+    definition_text(tag, end, number, sizeof(number));
+    romid->fileSize = definition_parse_filesize(number);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static void definition_add_field(definition_t* definition, const definition_tag_t* tag, const char* end)
+{
+  if (definition->numFields == DEFINITION_MAX_FIELDS || tag->nameLength >= sizeof(definition->fields[0].name))
+    return;
+  definition_field_t* field = &definition->fields[definition->numFields];
+  definition_text(tag, end, field->value, sizeof(field->value));
+  if (!field->value[0]) return;
+  memcpy(field->name, tag->name, tag->nameLength);
+  field->name[tag->nameLength] = 0;
+  definition->numFields++;
+}
+
+static definition_named_scaling_t* definition_add_scaling(definition_t* definition, size_t* capacity)
+{
+  if (definition->numScalings == *capacity) {
+    size_t grown = *capacity ? *capacity * 2 : 64;
+    definition_named_scaling_t* scalings =
+      (definition_named_scaling_t*)realloc(definition->scalings, grown * sizeof(definition_named_scaling_t));
+    if (!scalings) return NULL;
+    definition->scalings = scalings;
+    *capacity = grown;
+  }
+  definition_named_scaling_t* scaling = &definition->scalings[definition->numScalings++];
+  memset(scaling, 0, sizeof(*scaling));
+  scaling->scaling   = definition_identity;
+  scaling->bigEndian = true;
+  return scaling;
+}
+
+static definition_table_t* definition_add_table(definition_t* definition, size_t* capacity)
+{
+  if (definition->numTables == *capacity) {
+    size_t grown = *capacity ? *capacity * 2 : 256;
+    definition_table_t* tables = (definition_table_t*)realloc(definition->tables, grown * sizeof(definition_table_t));
+    if (!tables) return NULL;
+    definition->tables = tables;
+    *capacity = grown;
+  }
+  definition_table_t* table = &definition->tables[definition->numTables++];
+  memset(table, 0, sizeof(*table));
+  table->bigEndian = true;
+  table->scaling   = definition_identity;
+  return table;
+}
+
+static void definition_parse_table(definition_table_t* table, const definition_tag_t* tag)
+{
+  char type[16] = { 0 }, swapXY[8] = { 0 };
+  definition_attr(tag, "name", table->name, sizeof(table->name));
+  if (definition_attr(tag, "category", table->category, sizeof(table->category)))
+    table->set |= DEFINITION_SET_CATEGORY;
+  if (definition_attr(tag, "type", type, sizeof(type)))
+    table->set |= DEFINITION_SET_TYPE;
+  if (definition_attr(tag, "scaling", table->scaling.name, sizeof(table->scaling.name)))
+    table->set |= DEFINITION_SET_SCALING;
+  if (definition_attr(tag, "swapxy", swapXY, sizeof(swapXY)))
+    table->set |= DEFINITION_SET_SWAPXY;
+  table->set |= definition_parse_storage_attrs(tag, &table->storage, &table->bigEndian, &table->address);
+
+  table->dimensions = type[0] >= '1' && type[0] <= '3' ? (uint8_t)(type[0] - '0') : 1;
+  table->swapXY = strcmp(swapXY, "true") == 0;
+  table->sizeX = table->sizeY = 1;
+  if (table->dimensions == 3) {
+    table->sizeX = definition_attr_size(tag, "sizex", 0);
+    table->sizeY = definition_attr_size(tag, "sizey", 0);
+  } else if (table->dimensions == 2 || !(table->set & DEFINITION_SET_TYPE)) {
+    // any of them gives the length of the only axis
+    table->sizeY = definition_attr_size(tag, "sizey", definition_attr_size(tag, "sizex", definition_attr_size(tag, "elements", 0)));
+  }
+  if (table->sizeX) table->set |= table->dimensions == 3 ? DEFINITION_SET_SIZE_X : 0;
+  else table->sizeX = 1;
+  if (table->sizeY) table->set |= DEFINITION_SET_SIZE_Y;
+  else table->sizeY = 1;
+}
+
+// an axis inside `table`, NULL for anything that isn't one
+static definition_axis_t* definition_parse_axis(definition_table_t* table, const definition_tag_t* tag)
+{
+  char type[32] = { 0 };
+  definition_axis_t* axis;
+  bool typed = definition_attr(tag, "type", type, sizeof(type));
+
+  bool isX = strstr(type, "X Axis") != NULL;
+  if (typed && !isX && !strstr(type, "Y Axis")) return NULL;
+  // EcuFlash definitions naming a table of their base only name its axes, they are matched by name when merged
+  if (!typed) isX = table->y.set != 0;
+  if (table->dimensions == 2) {
+    axis = &table->y;
+    axis->length = table->sizeY;
+  } else {
+    axis = isX ? &table->x : &table->y;
+    axis->length = isX ? table->sizeX : table->sizeY;
+  }
+
+  axis->bigEndian = table->bigEndian;
+  axis->scaling   = definition_identity;
+  axis->set       = DEFINITION_SET_TYPE;
+  definition_attr(tag, "name", axis->name, sizeof(axis->name));
+  if (definition_attr(tag, "scaling", axis->scaling.name, sizeof(axis->scaling.name)))
+    axis->set |= DEFINITION_SET_SCALING;
+  axis->set |= definition_parse_storage_attrs(tag, &axis->storage, &axis->bigEndian, &axis->address);
+  // EcuFlash sizes tables by their axes
+  uint16_t elements = definition_attr_size(tag, "elements", 0);
+  if (elements) {
+    axis->length = elements;
+    axis->set |= isX && table->dimensions != 2 ? DEFINITION_SET_SIZE_X : DEFINITION_SET_SIZE_Y;
+    if (table->dimensions == 3 && isX) table->sizeX = elements;
+    else if (table->dimensions == 3 || table->sizeY == 1) table->sizeY = elements;
+  }
+  // static axes list their values as <data> children instead
+  if (strncmp(type, "Static", 6) == 0) {
+    axis->storage = DEFINITION_STORAGE_NONE;
+    axis->length  = 0;
+    axis->set     = 0;
+  }
+  return axis;
+}
+
+static int definition_compare_scalings(const void* a, const void* b)
+{
+  return strcmp(((const definition_named_scaling_t*)a)->scaling.name, ((const definition_named_scaling_t*)b)->scaling.name);
+}
+
+size_t definition_resolve(definition_t* definition)
+{
+  size_t unknown = 0;
+  // looked up by binary search over a sorted copy, merged definitions have hundreds of tables and scalings
+  definition_named_scaling_t* sorted = NULL;
+  if (definition->numScalings) {
+    sorted = (definition_named_scaling_t*)malloc(definition->numScalings * sizeof(definition_named_scaling_t));
+    if (!sorted) return definition->numTables;
+    memcpy(sorted, definition->scalings, definition->numScalings * sizeof(definition_named_scaling_t));
+    qsort(sorted, definition->numScalings, sizeof(definition_named_scaling_t), definition_compare_scalings);
+  }
+
+  for (size_t t = 0; t < definition->numTables; t++) {
+    definition_table_t* table = &definition->tables[t];
+    struct { definition_scaling_t* scaling; definition_storage_t* storage; bool* bigEndian; bool used; } refs[3] = {
+      { &table->scaling,   &table->storage,   &table->bigEndian,   true },
+      { &table->x.scaling, &table->x.storage, &table->x.bigEndian, table->x.set != 0 },
+      { &table->y.scaling, &table->y.storage, &table->y.bigEndian, table->y.set != 0 },
+    };
+    for (size_t r = 0; r < 3; r++) {
+      if (!refs[r].used || !refs[r].scaling->name[0]) continue;
+      const definition_named_scaling_t* named = NULL;
+      if (sorted) {
+        definition_named_scaling_t key;
+        memcpy(key.scaling.name, refs[r].scaling->name, sizeof(key.scaling.name));
+        named = (const definition_named_scaling_t*)bsearch(&key, sorted, definition->numScalings,
+                                                          sizeof(definition_named_scaling_t), definition_compare_scalings);
+      }
+      if (!named) {
+        unknown++;
+        continue;
+      }
+      *refs[r].scaling   = named->scaling;
+      *refs[r].storage   = named->storage;
+      *refs[r].bigEndian = named->bigEndian;
+    }
+  }
+  free(sorted);
+  return unknown;
+}
+
+// every <rom> of the text when `oneRom` is false, only the one at `offset` otherwise
+static size_t definition_parse(definition_t* definition, const char* name, const char* text, size_t size,
+                               size_t offset, bool oneRom)
+{
+  memset(definition, 0, sizeof(*definition));
+  if (offset > size) return ERANGE;
+
+  const char* cursor = text + offset;
+  const char* end = text + size;
+  definition_tag_t tag;
+  definition_table_t* table = NULL;
+  definition_axis_t* axis = NULL;
+  size_t capacity = 0, scalingCapacity = 0;
+  bool romid = false, axisOpen = false;
+
+  while (definition_next_tag(&cursor, end, &tag)) {
+    if (oneRom && tag.closing && definition_is(&tag, "rom")) {
+      break;
+    } else if (definition_is(&tag, "rom")) {
+      if (!tag.closing && !definition->base[0])
+        definition_attr(&tag, "base", definition->base, sizeof(definition->base));
+    } else if (definition_is(&tag, "romid")) {
+      romid = !tag.closing && !tag.selfClosing;
+    } else if (romid) {
+      if (!tag.closing && !definition_romid_field(&definition->romid, &tag, end))
+        definition_add_field(definition, &tag, end);
+    } else if (definition_is(&tag, "include")) {
+      if (!tag.closing && !definition->base[0])
+        definition_text(&tag, end, definition->base, sizeof(definition->base));
+    } else if (definition_is(&tag, "table")) {
+      if (tag.closing) {
+        // closes the axis if one is open, the table otherwise
+        if (axisOpen) axisOpen = false;
+        else table = NULL;
+        axis = NULL;
+      } else if (!table) {
+        table = definition_add_table(definition, &capacity);
+        if (!table) {
+          definition_free(definition);
+          return ENOMEM;
+        }
+        definition_parse_table(table, &tag);
+        if (tag.selfClosing) table = NULL;
+      } else {
+        axis = definition_parse_axis(table, &tag);
+        axisOpen = !tag.selfClosing;
+        if (!axisOpen) axis = NULL;
+      }
+    } else if (definition_is(&tag, "scaling") && !tag.closing) {
+      if (axis) {
+        definition_parse_scaling(&tag, &axis->scaling);
+        axis->set |= DEFINITION_SET_SCALING;
+      } else if (table) {
+        definition_parse_scaling(&tag, &table->scaling);
+        table->set |= DEFINITION_SET_SCALING;
+      } else {
+        definition_named_scaling_t* scaling = definition_add_scaling(definition, &scalingCapacity);
+        if (!scaling) {
+          definition_free(definition);
+          return ENOMEM;
+        }
+        definition_parse_scaling(&tag, &scaling->scaling);
+        definition_parse_storage_attrs(&tag, &scaling->storage, &scaling->bigEndian, NULL);
+      }
+    }
+  }
+
+  // an EcuFlash definition can be nothing but an <include>
+  if (!definition->numTables && !definition->numScalings && !definition->base[0]) {
+    LOGE(TAG, "no tables in %s", name);
+    return EINVAL;
+  }
+  size_t unknown = definition_resolve(definition);
+  // the include has them otherwise
+  if (unknown && !definition->base[0])
+    LOGW(TAG, "%zu scalings used by tables of %s are not defined", unknown, name);
+  return 0;
+}
+
+static size_t definition_parse_file(definition_t* definition, const char* path, size_t offset, bool oneRom)
+{
+  size_t size = 0;
+  char* text = (char*)load_file(path, &size);
+  if (!text) {
+    memset(definition, 0, sizeof(*definition));
+    LOGE(TAG, "failed to read %s %s", path, strerror(errno));
+    return errno ? errno : EIO;
+  }
+  size_t ret = definition_parse(definition, path, text, size, offset, oneRom);
+  free(text);
+  return ret;
+}
+
+size_t definition_load(definition_t* definition, const char* path)
+{
+  return definition_parse_file(definition, path, 0, false);
+}
+
+size_t definition_load_rom(definition_t* definition, const char* path, size_t offset)
+{
+  return definition_parse_file(definition, path, offset, true);
+}
+
+size_t definition_parse_rom(definition_t* definition, const char* name, const char* text, size_t length, size_t offset)
+{
+  return definition_parse(definition, name, text, length, offset, true);
+}
+
+size_t definition_scan(const char* text, size_t length, definition_rom_fn fn, void* ctx)
+{
+  const char* cursor = text;
+  const char* end = text + length;
+  definition_tag_t tag;
+  definition_rom_t rom;
+  size_t count = 0, depth = 0;
+  bool inRom = false, romid = false;
+
+  while (definition_next_tag(&cursor, end, &tag)) {
+    if (definition_is(&tag, "rom")) {
+      if (!tag.closing) {
+        memset(&rom, 0, sizeof(rom));
+        rom.offset   = (size_t)(tag.name - 1 - text);
+        // a <rom> of its own is EcuFlash, RomRaider keeps them all in a <roms>
+        rom.ecuflash = depth == 0;
+        definition_attr(&tag, "base", rom.base, sizeof(rom.base));
+        inRom = !tag.selfClosing;
+      }
+      if (tag.closing || tag.selfClosing) {
+        if (fn) fn(ctx, &rom);
+        count++;
+        inRom = false;
+      }
+    } else if (!inRom) {
+      if (tag.closing) {
+        if (depth) depth--;
+      } else if (!tag.selfClosing) {
+        depth++;
+      }
+    } else if (definition_is(&tag, "romid")) {
+      romid = !tag.closing && !tag.selfClosing;
+    } else if (romid) {
+      if (!tag.closing) definition_romid_field(&rom.romid, &tag, end);
+    } else if (definition_is(&tag, "include") && !tag.closing && !rom.base[0]) {
+      // EcuFlash includes its base definition by xmlid
+      definition_text(&tag, end, rom.base, sizeof(rom.base));
+    }
+  }
+  return count;
+}
+
+void definition_free(definition_t* definition)
+{
+  free(definition->tables);
+  free(definition->scalings);
+  definition->tables = NULL;
+  definition->numTables = 0;
+  definition->scalings = NULL;
+  definition->numScalings = 0;
+}
+
+const definition_table_t* definition_find(const definition_t* definition, const char* name)
+{
+  for (size_t i = 0; i < definition->numTables; i++)
+    if (strcmp(definition->tables[i].name, name) == 0)
+      return &definition->tables[i];
+  return NULL;
+}
+
+const definition_named_scaling_t* definition_find_scaling(const definition_t* definition, const char* name)
+{
+  for (size_t i = 0; i < definition->numScalings; i++)
+    if (strcmp(definition->scalings[i].scaling.name, name) == 0)
+      return &definition->scalings[i];
+  return NULL;
+}
+
+size_t definition_storage_size(definition_storage_t storage)
+{
+  switch (storage) {
+    case DEFINITION_STORAGE_UINT8:
+    case DEFINITION_STORAGE_INT8:   return 1;
+    case DEFINITION_STORAGE_UINT16:
+    case DEFINITION_STORAGE_INT16:  return 2;
+    case DEFINITION_STORAGE_UINT32:
+    case DEFINITION_STORAGE_INT32:
+    case DEFINITION_STORAGE_FLOAT:  return 4;
+    default:                        return 0;
+  }
+}
+
+static double definition_raw(const uint8_t* p, definition_storage_t storage, bool bigEndian)
+{
+  uint32_t u;
+  switch (storage) {
+    case DEFINITION_STORAGE_UINT8:  return p[0];
+    case DEFINITION_STORAGE_INT8:   return (int8_t)p[0];
+    case DEFINITION_STORAGE_UINT16:
+    case DEFINITION_STORAGE_INT16:
+      u = bigEndian ? (uint32_t)(p[0] << 8 | p[1]) : (uint32_t)(p[1] << 8 | p[0]);
+      return storage == DEFINITION_STORAGE_INT16 ? (double)(int16_t)u : (double)u;
+    default:
+      u = bigEndian ? (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]
+                    : (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+      if (storage == DEFINITION_STORAGE_INT32) return (int32_t)u;
+      if (storage == DEFINITION_STORAGE_UINT32) return u;
+      float f;
+      memcpy(&f, &u, sizeof(f));
+      return f;
+  }
+}
+
+size_t definition_decode(const uint8_t* rom, size_t romLength, uint32_t address, size_t count,
+                         definition_storage_t storage, bool bigEndian, const definition_scaling_t* scaling, float* out)
+{
+  size_t size = definition_storage_size(storage);
+  if (!size || address > romLength || count > (romLength - address) / size) return ERANGE;
+  if (!scaling) scaling = &definition_identity;
+
+  const uint8_t* p = rom + address;
+  for (size_t i = 0; i < count; i++, p += size) {
+    double raw = definition_raw(p, storage, bigEndian);
+    out[i] = scaling->linear ? (float)(raw * scaling->scale + scaling->offset)
+                             : (float)definition_eval(scaling->expression, raw);
+  }
+  return 0;
+}
+
+static void definition_store(uint8_t* p, double raw, definition_storage_t storage, bool bigEndian)
+{
+  static const struct { double min, max; } ranges[] = {
+    { 0, 0 }, { 0, 255 }, { 0, 65535 }, { 0, 4294967295.0 },
+    { -128, 127 }, { -32768, 32767 }, { -2147483648.0, 2147483647.0 },
+  };
+  uint32_t u;
+  if (storage == DEFINITION_STORAGE_FLOAT) {
+    float f = (float)raw;
+    memcpy(&u, &f, sizeof(u));
+  } else {
+    raw = floor(raw + 0.5);
+    if (raw < ranges[storage].min) raw = ranges[storage].min;
+    if (raw > ranges[storage].max) raw = ranges[storage].max;
+    u = storage >= DEFINITION_STORAGE_INT8 ? (uint32_t)(int32_t)raw : (uint32_t)raw;
+  }
+
+  size_t size = definition_storage_size(storage);
+  for (size_t i = 0; i < size; i++) {
+    size_t shift = 8 * (bigEndian ? size - 1 - i : i);
+    p[i] = (uint8_t)(u >> shift);
+  }
+}
+
+size_t definition_encode(uint8_t* rom, size_t romLength, uint32_t address, size_t count,
+                         definition_storage_t storage, bool bigEndian, const definition_scaling_t* scaling, const float* in)
+{
+  size_t size = definition_storage_size(storage);
+  if (!size || address > romLength || count > (romLength - address) / size) return ERANGE;
+  if (!scaling) scaling = &definition_identity;
+
+  uint8_t* p = rom + address;
+  for (size_t i = 0; i < count; i++, p += size) {
+    double raw;
+    if (scaling->linear && scaling->scale != 0)
+      raw = ((double)in[i] - scaling->offset) / scaling->scale;
+    else
+      raw = definition_eval(scaling->toByte[0] ? scaling->toByte : "x", in[i]);
+    if (!isfinite(raw)) return EINVAL;
+    definition_store(p, raw, storage, bigEndian);
+  }
+  return 0;
+}
+
+uint32_t definition_cell_address(const definition_table_t* table, uint16_t row, uint16_t column)
+{
+  size_t index = table->swapXY ? (size_t)column * table->sizeY + row : (size_t)row * table->sizeX + column;
+  return table->address + (uint32_t)(index * definition_storage_size(table->storage));
+}
+
+size_t definition_decode_axis(const definition_axis_t* axis, const uint8_t* rom, size_t romLength, float* out)
+{
+  return definition_decode(rom, romLength, axis->address, axis->length, axis->storage, axis->bigEndian, &axis->scaling, out);
+}
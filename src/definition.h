@@ -0,0 +1,204 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* ROM definitions.
+ *
+ * Tables, their axes and scalings as described by a RomRaider ECU definition, like
+ * definitions/RomRaider/EcuEditor/N3K1EU0001.xml, or an EcuFlash one, like
+ * definitions/EcuFlash/rommetadata/N3K1EU000.xml. Only what is needed to find a table
+ * in a ROM image and decode it is kept; descriptions, comments and anything else the
+ * editor shows are skipped.
+ *
+ * RomRaider gives every table its own scaling and storage type. EcuFlash declares named
+ * scalings once, with the storage type, and tables refer to them by name: those tables
+ * get a copy of the scaling they name, `scaling.name` keeps the reference. A name that
+ * isn't declared in the same file (it comes from an <include>) leaves the table with
+ * DEFINITION_STORAGE_NONE until it is merged with its base, see defresolve.h.
+ *
+ * RomRaider calls the only axis of a 2D table its Y axis, so 2D tables have `y` set
+ * and `x.length` 0. 3D tables are `sizeX` columns by `sizeY` rows, stored row by row
+ * unless `swapXY`, then column by column.
+ */
+
+typedef enum Definition_Storage {
+  DEFINITION_STORAGE_NONE = 0,  // static axes, values are in the definition
+  DEFINITION_STORAGE_UINT8,
+  DEFINITION_STORAGE_UINT16,
+  DEFINITION_STORAGE_UINT32,
+  DEFINITION_STORAGE_INT8,
+  DEFINITION_STORAGE_INT16,
+  DEFINITION_STORAGE_INT32,
+  DEFINITION_STORAGE_FLOAT,
+} definition_storage_t;
+
+typedef struct Definition_Scaling {
+  char  units[32];
+  char  expression[64];  // raw value `x` to display units
+  char  toByte[64];      // display units `x` back to the raw value
+  char  format[16];
+  // display = raw * scale + offset, only when `linear`. Anything else goes through definition_eval()
+  float scale;
+  float offset;
+  bool  linear;
+  char  name[48];        // EcuFlash's, empty for RomRaider's inline scalings
+} definition_scaling_t;
+
+// an EcuFlash <scaling name=""> at the top of a <rom>
+typedef struct Definition_Named_Scaling {
+  definition_scaling_t scaling;
+  definition_storage_t storage;
+  bool     bigEndian;
+} definition_named_scaling_t;
+
+// attributes a table or axis was given, the only ones it overrides of its base, see defresolve.h
+static const uint8_t DEFINITION_SET_ADDRESS  = 0x01;
+static const uint8_t DEFINITION_SET_STORAGE  = 0x02;   // storagetype, endian
+static const uint8_t DEFINITION_SET_SCALING  = 0x04;   // inline or by name
+static const uint8_t DEFINITION_SET_SIZE_X   = 0x08;   // sizex, an X axis' elements
+static const uint8_t DEFINITION_SET_SIZE_Y   = 0x10;   // sizey, elements
+static const uint8_t DEFINITION_SET_TYPE     = 0x20;
+static const uint8_t DEFINITION_SET_CATEGORY = 0x40;
+static const uint8_t DEFINITION_SET_SWAPXY   = 0x80;
+
+typedef struct Definition_Axis {
+  char     name[64];
+  definition_storage_t storage;
+  bool     bigEndian;
+  uint32_t address;
+  uint16_t length;
+  uint8_t  set;          // DEFINITION_SET_*, 0 for an axis that isn't there or is static
+  definition_scaling_t scaling;
+} definition_axis_t;
+
+typedef struct Definition_Table {
+  char     name[128];
+  char     category[64];
+  uint8_t  dimensions;   // 1, 2 or 3
+  definition_storage_t storage;
+  bool     bigEndian;
+  uint32_t address;
+  uint16_t sizeX;        // columns, 1 for 1D and 2D tables
+  uint16_t sizeY;        // rows
+  bool     swapXY;
+  uint8_t  set;          // DEFINITION_SET_*
+  definition_scaling_t scaling;
+  definition_axis_t x;
+  definition_axis_t y;
+} definition_table_t;
+
+typedef struct Definition_ROM_ID {
+  char     xmlID[64];
+  uint32_t internalIDAddress;
+  char     internalIDString[64];
+  char     ecuID[32];
+  uint32_t fileSize;     // bytes, 0 if not given
+} definition_romid_t;
+
+// any other <romid> field that isn't empty: make, model, year, ...
+typedef struct Definition_Field {
+  char     name[32];
+  char     value[64];
+} definition_field_t;
+
+static const size_t DEFINITION_MAX_FIELDS = 16;
+
+typedef struct Definition {
+  definition_romid_t romid;
+  char   base[64];       // xmlid this one builds on, see definition_rom_t
+  size_t numFields;
+  definition_field_t fields[DEFINITION_MAX_FIELDS];
+  size_t numTables;
+  definition_table_t* tables;
+  size_t numScalings;
+  definition_named_scaling_t* scalings;
+} definition_t;
+
+typedef struct Definition_ROM {
+  definition_romid_t romid;
+  char     base[64];     // xmlid this one builds on, RomRaider's base="" or EcuFlash's <include>
+  size_t   offset;       // of its <rom> in the file
+  bool     ecuflash;     // a file of its own instead of one of RomRaider's <roms>
+} definition_rom_t;
+
+typedef void (*definition_rom_fn)(void* ctx, const definition_rom_t* rom);
+
+/** Load a RomRaider or EcuFlash definition. Returns 0 or errno */
+size_t definition_load(definition_t* definition, const char* path);
+
+/** Load only the <rom> at `offset` of a file that holds several, see definition_scan() */
+size_t definition_load_rom(definition_t* definition, const char* path, size_t offset);
+
+/** Same as definition_load_rom(), from the text of a file already in memory. `name` is for messages */
+size_t definition_parse_rom(definition_t* definition, const char* name, const char* text, size_t length, size_t offset);
+
+/**
+ * Call `fn` with the romid of every <rom> in the text of a definition file, without
+ * keeping any of its tables. Returns how many there are
+ */
+size_t definition_scan(const char* text, size_t length, definition_rom_fn fn, void* ctx);
+
+void definition_free(definition_t* definition);
+
+/** Table by name, NULL if there is none */
+const definition_table_t* definition_find(const definition_t* definition, const char* name);
+
+/** Named scaling by name, NULL if there is none */
+const definition_named_scaling_t* definition_find_scaling(const definition_t* definition, const char* name);
+
+/**
+ * Copy the named scaling, and its storage type, into every table and axis that refers
+ * to one, again after tables or scalings changed. Returns how many names aren't defined
+ */
+size_t definition_resolve(definition_t* definition);
+
+/** "uint8", "int16", "float", ... as used by storagetype, DEFINITION_STORAGE_NONE for anything else */
+definition_storage_t definition_storage(const char* type);
+
+/** The storagetype of `storage`, "" for DEFINITION_STORAGE_NONE */
+const char* definition_storage_name(definition_storage_t storage);
+
+/** Bytes per element, 0 for DEFINITION_STORAGE_NONE */
+size_t definition_storage_size(definition_storage_t storage);
+
+/** Evaluate a scaling expression (+ - * / and parentheses over `x` and numbers) */
+double definition_eval(const char* expression, double x);
+
+/**
+ * Decode `count` elements at `address` of a ROM image into display units.
+ * Returns 0, or ERANGE if they don't fit in the image
+ */
+size_t definition_decode(const uint8_t* rom, size_t romLength, uint32_t address, size_t count,
+                         definition_storage_t storage, bool bigEndian, const definition_scaling_t* scaling, float* out);
+
+/**
+ * Encode `count` display values into `count` elements at `address`, through `to_byte`.
+ * Integers are rounded and clamped to their storage type. Returns 0, ERANGE if they
+ * don't fit in the image, or EINVAL if `to_byte` gives no number
+ */
+size_t definition_encode(uint8_t* rom, size_t romLength, uint32_t address, size_t count,
+                         definition_storage_t storage, bool bigEndian, const definition_scaling_t* scaling, const float* in);
+
+/** Address of the cell at `row`, `column` of a table */
+uint32_t definition_cell_address(const definition_table_t* table, uint16_t row, uint16_t column);
+
+/** Decode an axis, `out` holds `axis->length` values */
+size_t definition_decode_axis(const definition_axis_t* axis, const uint8_t* rom, size_t romLength, float* out);
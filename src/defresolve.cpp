@@ -0,0 +1,469 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "defresolve.h"
+#include "crc32c.h"
+#include "util.h"
+#include "log.h"
+#include "mapfile.h"
+
+static const char* TAG = "Defresolve";
+
+static const int32_t DEFRESOLVE_UNRESOLVED = -1;
+static const int32_t DEFRESOLVE_RESOLVING  = -2;   // on the chain being merged, seeing it again is a loop
+
+static uint64_t defresolve_hash_name(const char* name)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;  // FNV-1a
+  for (const uint8_t* p = (const uint8_t*)name; *p; p++) {
+    hash ^= *p;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+/*
+ * Names of tables or scalings, element + 1 by hash of the name. `names` is the first
+ * name, `stride` the size of an element
+ */
+typedef struct Defresolve_Names {
+  uint32_t* slots;
+  size_t    mask;
+  const char* names;
+  size_t    stride;
+} defresolve_names_t;
+
+static bool defresolve_names_init(defresolve_names_t* names, size_t count, const char* first, size_t stride)
+{
+  size_t size = 16;
+  while (size < count * 2) size *= 2;
+  names->slots  = (uint32_t*)calloc(size, sizeof(uint32_t));
+  names->mask   = size - 1;
+  names->names  = first;
+  names->stride = stride;
+  return names->slots != NULL;
+}
+
+// element named `name`, or -1 with `*slot` where to add it
+static long defresolve_names_find(const defresolve_names_t* names, const char* name, size_t* slot)
+{
+  size_t s = (size_t)defresolve_hash_name(name) & names->mask;
+  for (; names->slots[s]; s = (s + 1) & names->mask) {
+    uint32_t element = names->slots[s] - 1;
+    if (!strcmp(names->names + element * names->stride, name)) return element;
+  }
+  *slot = s;
+  return -1;
+}
+
+static void defresolve_merge_axis(definition_axis_t* axis, const definition_axis_t* from)
+{
+  if (!axis->set) {
+    // the base has no such axis
+    *axis = *from;
+    return;
+  }
+  if (from->name[0]) memcpy(axis->name, from->name, sizeof(axis->name));
+  if (from->set & DEFINITION_SET_ADDRESS) axis->address = from->address;
+  if (from->set & DEFINITION_SET_STORAGE) {
+    axis->storage   = from->storage;
+    axis->bigEndian = from->bigEndian;
+  }
+  if (from->set & DEFINITION_SET_SCALING) axis->scaling = from->scaling;
+  if (from->set & (DEFINITION_SET_SIZE_X | DEFINITION_SET_SIZE_Y)) axis->length = from->length;
+  axis->set |= from->set;
+}
+
+// axis of `table` that `from`, an axis of the table merged into it, overrides
+static definition_axis_t* defresolve_match_axis(definition_table_t* table, const definition_table_t* into,
+                                                const definition_axis_t* from)
+{
+  if (from->name[0]) {
+    if (table->x.set && !strcmp(table->x.name, from->name)) return &table->x;
+    if (table->y.set && !strcmp(table->y.name, from->name)) return &table->y;
+  }
+  if (table->dimensions != 3) return &table->y;
+  return from == &into->x ? &table->x : &table->y;
+}
+
+static void defresolve_merge_table(definition_table_t* table, const definition_table_t* from)
+{
+  uint8_t set = from->set;
+  if (set & DEFINITION_SET_TYPE) table->dimensions = from->dimensions;
+  if (set & DEFINITION_SET_CATEGORY) memcpy(table->category, from->category, sizeof(table->category));
+  if (set & DEFINITION_SET_ADDRESS) table->address = from->address;
+  if (set & DEFINITION_SET_STORAGE) {
+    table->storage   = from->storage;
+    table->bigEndian = from->bigEndian;
+  }
+  if (set & DEFINITION_SET_SCALING) table->scaling = from->scaling;
+  if (set & DEFINITION_SET_SWAPXY) table->swapXY = from->swapXY;
+  if (set & DEFINITION_SET_SIZE_X) table->sizeX = from->sizeX;
+  if (set & DEFINITION_SET_SIZE_Y) table->sizeY = from->sizeY;
+  table->set |= set;
+
+  // an axis given a length sizes the table, the table's size sizes the axis otherwise
+  bool sizedX = false, sizedY = false;
+  const definition_axis_t* axes[2] = { &from->x, &from->y };
+  for (int a = 0; a < 2; a++) {
+    if (!axes[a]->set) continue;
+    definition_axis_t* axis = defresolve_match_axis(table, from, axes[a]);
+    defresolve_merge_axis(axis, axes[a]);
+    if (axes[a]->set & (DEFINITION_SET_SIZE_X | DEFINITION_SET_SIZE_Y)) {
+      if (axis == &table->x) sizedX = true;
+      else sizedY = true;
+    }
+  }
+  if (table->dimensions == 3 && table->x.set) {
+    if (sizedX) table->sizeX = table->x.length;
+    else table->x.length = table->sizeX;
+  }
+  if (table->dimensions >= 2 && table->y.set) {
+    if (sizedY) table->sizeY = table->y.length;
+    else table->y.length = table->sizeY;
+  }
+}
+
+// `definition` on top of `base`, into `merged`. Returns 0 or errno
+static size_t defresolve_merge(const definition_t* base, const definition_t* definition, definition_t* merged,
+                               size_t* skipped)
+{
+  memset(merged, 0, sizeof(*merged));
+  merged->romid     = definition->romid;
+  merged->numFields = definition->numFields;
+  memcpy(merged->fields, definition->fields, sizeof(merged->fields));
+  memcpy(merged->base, definition->base, sizeof(merged->base));
+
+  size_t maxTables = base->numTables + definition->numTables;
+  size_t maxScalings = base->numScalings + definition->numScalings;
+  merged->tables   = (definition_table_t*)malloc((maxTables ? maxTables : 1) * sizeof(definition_table_t));
+  merged->scalings = (definition_named_scaling_t*)malloc((maxScalings ? maxScalings : 1) * sizeof(definition_named_scaling_t));
+  defresolve_names_t tables = { NULL, 0, NULL, 0 }, scalings = { NULL, 0, NULL, 0 };
+  if (!merged->tables || !merged->scalings ||
+      !defresolve_names_init(&tables, maxTables, merged->tables[0].name, sizeof(definition_table_t)) ||
+      !defresolve_names_init(&scalings, maxScalings, merged->scalings[0].scaling.name, sizeof(definition_named_scaling_t))) {
+    free(tables.slots);
+    definition_free(merged);
+    return ENOMEM;
+  }
+
+  size_t slot;
+  if (base->numScalings)
+    memcpy(merged->scalings, base->scalings, base->numScalings * sizeof(definition_named_scaling_t));
+  for (merged->numScalings = 0; merged->numScalings < base->numScalings; merged->numScalings++) {
+    if (defresolve_names_find(&scalings, merged->scalings[merged->numScalings].scaling.name, &slot) < 0)
+      scalings.slots[slot] = (uint32_t)merged->numScalings + 1;
+  }
+  for (size_t s = 0; s < definition->numScalings; s++) {
+    const definition_named_scaling_t* scaling = &definition->scalings[s];
+    long found = defresolve_names_find(&scalings, scaling->scaling.name, &slot);
+    if (found >= 0) {
+      merged->scalings[found] = *scaling;
+    } else {
+      scalings.slots[slot] = (uint32_t)merged->numScalings + 1;
+      merged->scalings[merged->numScalings++] = *scaling;
+    }
+  }
+
+  if (base->numTables)
+    memcpy(merged->tables, base->tables, base->numTables * sizeof(definition_table_t));
+  for (merged->numTables = 0; merged->numTables < base->numTables; merged->numTables++) {
+    if (defresolve_names_find(&tables, merged->tables[merged->numTables].name, &slot) < 0)
+      tables.slots[slot] = (uint32_t)merged->numTables + 1;
+  }
+  for (size_t t = 0; t < definition->numTables; t++) {
+    const definition_table_t* table = &definition->tables[t];
+    long found = defresolve_names_find(&tables, table->name, &slot);
+    if (found >= 0) {
+      defresolve_merge_table(&merged->tables[found], table);
+    } else if (table->set & DEFINITION_SET_TYPE) {
+      tables.slots[slot] = (uint32_t)merged->numTables + 1;
+      merged->tables[merged->numTables++] = *table;
+    } else {
+      // names a table none of its bases has, there's nothing to merge it with
+      (*skipped)++;
+    }
+  }
+  free(tables.slots);
+  free(scalings.slots);
+  return 0;
+}
+
+// bytes of the <rom> at `offset`, up to and including its </rom>
+static size_t defresolve_rom_length(const char* text, size_t length, size_t offset)
+{
+  static const char close[] = "</rom>";
+  const size_t closeLength = sizeof(close) - 1;
+  for (const char* p = text + offset; (size_t)(p - text) + closeLength <= length; p++) {
+    p = (const char*)memchr(p, '<', length - (size_t)(p - text));
+    if (!p || (size_t)(p - text) + closeLength > length) break;
+    if (!memcmp(p, close, closeLength)) return (size_t)(p - text) + closeLength - offset;
+  }
+  return length - offset;
+}
+
+static size_t defresolve_read(defresolve_t* resolver, uint32_t entry)
+{
+  long path = (long)resolver->index->entries[entry].path;
+  if (path == resolver->textPath) return 0;
+  free(resolver->text);
+  resolver->textPath = -1;
+  resolver->text = (char*)load_file(defindex_path(resolver->index, entry), &resolver->textLength);
+  if (!resolver->text) {
+    LOGE(TAG, "failed to read %s %s", defindex_path(resolver->index, entry), strerror(errno));
+    return errno ? errno : EIO;
+  }
+  resolver->textPath = path;
+  return 0;
+}
+
+// parse `entry` alone into `definition`, with the key of its text on top of `baseKey`
+static size_t defresolve_parse(defresolve_t* resolver, uint32_t entry, uint64_t baseKey, definition_t* definition,
+                               uint64_t* key)
+{
+  size_t ret = defresolve_read(resolver, entry);
+  if (ret) return ret;
+  size_t offset = resolver->index->entries[entry].rom.offset;
+  if (offset > resolver->textLength) return ERANGE;
+  size_t length = defresolve_rom_length(resolver->text, resolver->textLength, offset);
+  uint32_t crc = crc32c(0, resolver->text + offset, length);
+  *key = ((uint64_t)crc << 32 | (uint32_t)length) ^ (baseKey * 0x9e3779b97f4a7c15ull);
+  resolver->parsed++;
+  return definition_parse_rom(definition, defindex_path(resolver->index, entry), resolver->text,
+                              resolver->textLength, offset);
+}
+
+static size_t defresolve_insert(defresolve_t* resolver, uint64_t key, definition_t* definition)
+{
+  if (resolver->numNodes == resolver->capacity) {
+    size_t grown = resolver->capacity ? resolver->capacity * 2 : 16;
+    defresolve_node_t* nodes = (defresolve_node_t*)realloc(resolver->nodes, grown * sizeof(defresolve_node_t));
+    if (!nodes) return ENOMEM;
+    resolver->nodes = nodes;
+    resolver->capacity = grown;
+  }
+  // the key table stays at most half full, nodes can't outnumber entries
+  size_t s = (size_t)key & (resolver->numSlots - 1);
+  while (resolver->slots[s]) s = (s + 1) & (resolver->numSlots - 1);
+  resolver->slots[s] = (uint32_t)resolver->numNodes + 1;
+  resolver->nodes[resolver->numNodes].key = key;
+  resolver->nodes[resolver->numNodes].definition = *definition;
+  resolver->numNodes++;
+  return 0;
+}
+
+static long defresolve_lookup(const defresolve_t* resolver, uint64_t key)
+{
+  for (size_t s = (size_t)key & (resolver->numSlots - 1); resolver->slots[s]; s = (s + 1) & (resolver->numSlots - 1))
+    if (resolver->nodes[resolver->slots[s] - 1].key == key) return resolver->slots[s] - 1;
+  return -1;
+}
+
+// `definition` merged with the node of its base, if it has one, and its scalings resolved
+static size_t defresolve_on_base(defresolve_t* resolver, long node, uint32_t entry, definition_t* definition)
+{
+  size_t skipped = 0;
+  if (node >= 0) {
+    definition_t merged;
+    size_t ret = defresolve_merge(&resolver->nodes[node].definition, definition, &merged, &skipped);
+    definition_free(definition);
+    if (ret) return ret;
+    *definition = merged;
+    resolver->merges++;
+  }
+  size_t unknown = definition_resolve(definition);
+  const char* xmlID = resolver->index->entries[entry].rom.romid.xmlID;
+  if (skipped)
+    LOGW(TAG, "%zu tables of %s aren't in any of its bases", skipped, xmlID);
+  if (unknown)
+    LOGW(TAG, "%zu scalings used by tables of %s are defined by none of its bases", unknown, xmlID);
+  return 0;
+}
+
+// node of `entry` merged with its bases, -1 on failure
+static long defresolve_node(defresolve_t* resolver, uint32_t entry, size_t depth)
+{
+  int32_t known = resolver->byEntry[entry];
+  if (known >= 0) {
+    resolver->hits++;
+    return known;
+  }
+  if (known == DEFRESOLVE_RESOLVING || depth >= DEFINDEX_MAX_CHAIN) {
+    LOGW(TAG, "bases of %s loop or go too deep, ignoring the rest", resolver->index->entries[entry].rom.romid.xmlID);
+    return -1;
+  }
+
+  resolver->byEntry[entry] = DEFRESOLVE_RESOLVING;
+  long base = resolver->index->entries[entry].base;
+  long baseNode = base >= 0 ? defresolve_node(resolver, (uint32_t)base, depth + 1) : -1;
+  uint64_t baseKey = baseNode >= 0 ? resolver->nodes[baseNode].key : 0;
+  resolver->byEntry[entry] = DEFRESOLVE_UNRESOLVED;
+
+  definition_t definition;
+  uint64_t key;
+  if (defresolve_parse(resolver, entry, baseKey, &definition, &key)) return -1;
+  long node = defresolve_lookup(resolver, key);
+  if (node >= 0) {
+    // the same text on the same base, e.g. a copy of a file
+    definition_free(&definition);
+    resolver->hits++;
+  } else {
+    if (defresolve_on_base(resolver, baseNode, entry, &definition)) return -1;
+    if (defresolve_insert(resolver, key, &definition)) {
+      definition_free(&definition);
+      return -1;
+    }
+    node = (long)resolver->numNodes - 1;
+  }
+  resolver->byEntry[entry] = (int32_t)node;
+  return node;
+}
+
+size_t defresolve_init(defresolve_t* resolver, const defindex_t* index)
+{
+  memset(resolver, 0, sizeof(*resolver));
+  resolver->index    = index;
+  resolver->textPath = -1;
+  resolver->numSlots = 16;
+  while (resolver->numSlots < index->numEntries * 2) resolver->numSlots *= 2;
+  resolver->slots   = (uint32_t*)calloc(resolver->numSlots, sizeof(uint32_t));
+  resolver->byEntry = (int32_t*)malloc((index->numEntries ? index->numEntries : 1) * sizeof(int32_t));
+  if (!resolver->slots || !resolver->byEntry) {
+    defresolve_free(resolver);
+    return ENOMEM;
+  }
+  for (size_t e = 0; e < index->numEntries; e++) resolver->byEntry[e] = DEFRESOLVE_UNRESOLVED;
+  return 0;
+}
+
+void defresolve_free(defresolve_t* resolver)
+{
+  for (size_t n = 0; n < resolver->numNodes; n++) definition_free(&resolver->nodes[n].definition);
+  free(resolver->nodes);
+  free(resolver->byEntry);
+  free(resolver->slots);
+  free(resolver->text);
+  memset(resolver, 0, sizeof(*resolver));
+  resolver->textPath = -1;
+}
+
+size_t defresolve_load(defresolve_t* resolver, uint32_t entry, definition_t* definition)
+{
+  memset(definition, 0, sizeof(*definition));
+  if (entry >= resolver->index->numEntries) return EINVAL;
+  long base = resolver->index->entries[entry].base;
+  long baseNode = -1;
+  if (base >= 0) {
+    // a loop back to `entry` stops at it
+    int32_t known = resolver->byEntry[entry];
+    if (known == DEFRESOLVE_UNRESOLVED) resolver->byEntry[entry] = DEFRESOLVE_RESOLVING;
+    baseNode = defresolve_node(resolver, (uint32_t)base, 1);
+    resolver->byEntry[entry] = known;
+    if (baseNode < 0) LOGW(TAG, "using %s without its base", resolver->index->entries[entry].rom.romid.xmlID);
+  }
+
+  uint64_t key;
+  size_t ret = defresolve_parse(resolver, entry, 0, definition, &key);
+  if (ret) return ret;
+  return defresolve_on_base(resolver, baseNode, entry, definition);
+}
+
+size_t defresolve_load_path(definition_t* definition, const char* path, const uint8_t* rom, size_t romLength)
+{
+  defindex_t index;
+  uint32_t matches[16];
+  size_t max = sizeof(matches) / sizeof(matches[0]);
+
+  if (!is_directory(path)) {
+    size_t ret = definition_load(definition, path);
+    if (!ret && definition->base[0])
+      LOGW(TAG, "%s builds on %s, pass the directory holding both to merge them", path, definition->base);
+    return ret;
+  }
+  uint64_t start = monotonic_us();
+  if (defindex_build(&index, path))
+    return 1;
+  uint64_t built = monotonic_us();
+  size_t found = defindex_identify(&index, rom, romLength, matches, max);
+  LOGI(TAG, "Indexed %zu definitions in %.1f ms, %zu ID locations probed in %llu us", index.numEntries,
+    (double)(built - start) / 1000.0, index.numProbes, (unsigned long long)(monotonic_us() - built));
+  if (!found) {
+    LOGE(TAG, "No definition in %s matches the ROM", path);
+    defindex_free(&index);
+    return 1;
+  }
+  defindex_log_matches(&index, matches, found, max);
+
+  // the first match, merged with what it builds on
+  const defindex_entry_t* entry = &index.entries[matches[0]];
+  defresolve_t resolver;
+  size_t ret = defresolve_init(&resolver, &index);
+  if (!ret) {
+    LOGI(TAG, "Using %s", entry->rom.romid.xmlID);
+    ret = defresolve_load(&resolver, matches[0], definition);
+    if (!ret && entry->rom.base[0])
+      LOGI(TAG, "Merged with %zu bases, %zu tables and %zu scalings", resolver.merges, definition->numTables,
+        definition->numScalings);
+    defresolve_free(&resolver);
+  }
+  defindex_free(&index);
+  return ret;
+}
+
+size_t defresolve_identify(const char* directory, const char* romPath)
+{
+  defindex_t index;
+  uint32_t matches[16];
+  size_t max = sizeof(matches) / sizeof(matches[0]);
+  mapfile_t rom;
+
+  if (mapfile_open(&rom, romPath))
+    return 1;
+  uint64_t start = monotonic_us();
+  if (defindex_build(&index, directory)) {
+    mapfile_close(&rom);
+    return 1;
+  }
+  uint64_t built = monotonic_us();
+  size_t found = defindex_identify(&index, rom.data, rom.length, matches, max);
+  uint64_t elapsed = monotonic_us() - built;
+  LOGI(TAG, "Indexed %zu definitions from %zu files in %.1f ms, %zu ID locations", index.numEntries, index.numPaths,
+    (double)(built - start) / 1000.0, index.numProbes);
+  if (found)
+    LOGI(TAG, "%zu definitions match %s (%llu us)", found, romPath, (unsigned long long)elapsed);
+  else
+    LOGE(TAG, "No definition matches %s (%llu us)", romPath, (unsigned long long)elapsed);
+  defindex_log_matches(&index, matches, found, max);
+  // what the first one gives once merged with its bases
+  defresolve_t resolver;
+  definition_t merged;
+  if (found && !defresolve_init(&resolver, &index)) {
+    start = monotonic_us();
+    if (!defresolve_load(&resolver, matches[0], &merged)) {
+      LOGI(TAG, "%s resolves to %zu tables and %zu scalings (%zu merges, %.1f ms)", index.entries[matches[0]].rom.romid.xmlID,
+        merged.numTables, merged.numScalings, resolver.merges, (double)(monotonic_us() - start) / 1000.0);
+      definition_free(&merged);
+    }
+    defresolve_free(&resolver);
+  }
+  defindex_free(&index);
+  mapfile_close(&rom);
+  return found ? 0 : 1;
+}
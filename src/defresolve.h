@@ -0,0 +1,88 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "definition.h"
+#include "defindex.h"
+
+/* Definition inheritance.
+ *
+ * Merges a definition of a library (see defindex.h) with the chain of definitions it
+ * builds on, RomRaider's <rom base="..."> and EcuFlash's <include>. Going from the
+ * farthest base inward, each definition starts as a copy of its merged base:
+ *  - scalings it declares replace those of the same name, the others are added,
+ *  - tables it names are merged with those of the same name, only the attributes it
+ *    gives (DEFINITION_SET_*) override the base's, the others are added,
+ *  - axes are matched by name, else X with X and Y with Y. An axis that is given a
+ *    length sizes its table, the axes of a resized table follow it otherwise,
+ *  - the romid is its own.
+ * Then tables and axes take the named scalings again, so a scaling a definition
+ * redefines applies to every table of its bases that uses it.
+ *
+ * Merged bases are kept: every definition built on the same base reuses it instead of
+ * parsing and merging the whole chain again. They are also keyed by a hash of their
+ * own text and of their base, so two files with the same content are merged once.
+ * Only the definition that was asked for is merged for the caller, into its own copy.
+ *
+ * A resolver isn't thread safe.
+ */
+
+typedef struct Defresolve_Node {
+  uint64_t     key;       // hash of the <rom> text, its length and the key of its base
+  definition_t definition;
+} defresolve_node_t;
+
+typedef struct Defresolve {
+  const defindex_t* index;
+  defresolve_node_t* nodes;
+  size_t   numNodes;
+  size_t   capacity;
+  int32_t* byEntry;       // node of each entry, -1 until merged
+  uint32_t* slots;        // node + 1 by key, 0 is free
+  size_t   numSlots;      // a power of 2
+  // the last file read, bases of RomRaider definitions share one
+  char*    text;
+  size_t   textLength;
+  long     textPath;
+  // totals
+  size_t   parsed;        // <rom>s parsed
+  size_t   merges;        // definitions merged with their base
+  size_t   hits;          // merged bases reused
+} defresolve_t;
+
+/** Resolve the definitions of `index`, which must outlive the resolver. Returns 0 or errno */
+size_t defresolve_init(defresolve_t* resolver, const defindex_t* index);
+void defresolve_free(defresolve_t* resolver);
+
+/**
+ * Load `entry` merged with its bases into `definition`, freed with definition_free().
+ * A base that isn't in the library is skipped, defindex_build() warns about those. Returns 0 or errno
+ */
+size_t defresolve_load(defresolve_t* resolver, uint32_t entry, definition_t* definition);
+
+/**
+ * --definition for a ROM: `path` is a definition file, or a library directory whose first
+ * definition matching `rom` is loaded merged with its bases. Returns 0 or errno
+ */
+size_t defresolve_load_path(definition_t* definition, const char* path, const uint8_t* rom, size_t romLength);
+
+/** --identify, log the definitions of the library in `directory` matching the ROM in `romPath`. Returns 0 if any do */
+size_t defresolve_identify(const char* directory, const char* romPath);
@@ -0,0 +1,259 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "discovery.h"
+#include "OBD2.h"
+#include "UDS.h"
+#include "timing.h"
+#include "util.h"
+
+static const char* TAG = "Discovery";
+
+// usual assignments for 0x7E8, 0x7E9 and 0x7EA
+static const char* discovery_names[] = { "PCM", "TCM", "ABS" };
+
+typedef void (*discovery_parse_fn)(discovery_module_t* module, const uint8_t* data, uint32_t length);
+
+const char* discovery_module_name(uint16_t responseID)
+{
+  uint16_t index = responseID - ((UDS_RESPONSE_CANID_MSB << 8) | UDS_RESPONSE_CANID_LSB);
+  if (index < sizeof(discovery_names) / sizeof(discovery_names[0])) return discovery_names[index];
+  return "ECU";
+}
+
+// 41 00 A B C D
+static void discovery_parse_pids(discovery_module_t* module, const uint8_t* data, uint32_t length)
+{
+  if (length < 6) return;
+  module->supportedPIDs = ((uint32_t)data[2] << 24) | ((uint32_t)data[3] << 16) | ((uint32_t)data[4] << 8) | data[5];
+}
+
+// 49 PID 01 text, padded with spaces or nulls
+static void discovery_parse_text(char* out, size_t outLength, const uint8_t* data, uint32_t length)
+{
+  size_t n = 0;
+  if (length <= 3) return;
+  for (uint32_t i = 3; i < length && n < outLength - 1; i++)
+    out[n++] = (char)data[i];
+  while (n && (out[n - 1] == ' ' || out[n - 1] == 0)) n--;
+  out[n] = 0;
+}
+
+static void discovery_parse_vin(discovery_module_t* module, const uint8_t* data, uint32_t length)
+{
+  discovery_parse_text(module->vin, sizeof(module->vin), data, length);
+}
+
+static void discovery_parse_calid(discovery_module_t* module, const uint8_t* data, uint32_t length)
+{
+  discovery_parse_text(module->calibrationID, sizeof(module->calibrationID), data, length);
+}
+
+static void discovery_frame(PASSTHRU_MSG* msg, uint8_t canLSB, uint8_t sid, uint8_t pid)
+{
+  memset(msg, 0, sizeof(PASSTHRU_MSG) - PM_DATA_LEN);
+  msg->ProtocolID = ISO15765;
+  msg->TxFlags    = ISO15765_FRAME_PAD;
+  msg->Data[0]    = 0x00;
+  msg->Data[1]    = 0x00;
+  msg->Data[2]    = UDS_REQUEST_CANID_MSB;
+  msg->Data[3]    = canLSB;
+  msg->Data[4]    = sid;
+  msg->Data[5]    = pid;
+  msg->DataSize   = 6;
+}
+
+static void discovery_can_id(PASSTHRU_MSG* msg, uint16_t canID)
+{
+  memset(msg, 0, sizeof(PASSTHRU_MSG) - PM_DATA_LEN);
+  msg->ProtocolID = ISO15765;
+  msg->TxFlags    = ISO15765_FRAME_PAD;
+  msg->Data[0]    = 0x00;
+  msg->Data[1]    = 0x00;
+  msg->Data[2]    = (uint8_t)(canID >> 8);
+  msg->Data[3]    = (uint8_t)canID;
+  msg->DataSize   = 4;
+}
+
+/**
+ * An ISO15765 channel only transmits to IDs that are the flow control ID of a filter, and
+ * j2534Connect only sets up the physical ones. Nothing ever sends from 0x7DF, so the pattern
+ * never matches; answers to a functional request come from 0x7E8+ and their flow control
+ * goes to the physical request IDs as usual.
+ */
+static size_t discovery_start_functional(J2534* j2534, unsigned long chanID, PASSTHRU_MSG* msgs, unsigned long* filterID)
+{
+  uint16_t functionalID = (uint16_t)((UDS_REQUEST_CANID_MSB << 8) | OBD2_FUNCTIONAL_CANID_LSB);
+  discovery_can_id(&msgs[0], 0x7FF);
+  discovery_can_id(&msgs[1], functionalID);
+  discovery_can_id(&msgs[2], functionalID);
+  return j2534->PassThruStartMsgFilter(chanID, FLOW_CONTROL_FILTER, &msgs[0], &msgs[1], &msgs[2], filterID);
+}
+
+// module answering from 0x7E8 + slot, added if `create` and not seen yet
+static discovery_module_t* discovery_module(discovery_t* discovery, uint8_t slot, bool create)
+{
+  uint16_t responseID = (uint16_t)(((UDS_RESPONSE_CANID_MSB << 8) | UDS_RESPONSE_CANID_LSB) + slot);
+  for (size_t i = 0; i < discovery->numModules; i++)
+    if (discovery->modules[i].responseID == responseID)
+      return &discovery->modules[i];
+  if (!create || discovery->numModules == DISCOVERY_MAX_MODULES) return NULL;
+
+  discovery_module_t* module = &discovery->modules[discovery->numModules++];
+  memset(module, 0, sizeof(*module));
+  module->responseID = responseID;
+  module->requestID  = (uint16_t)(((UDS_REQUEST_CANID_MSB << 8) | UDS_REQUEST_CANID_LSB) + slot);
+  return module;
+}
+
+/**
+ * One bus round trip: the request goes to 0x7DF, or to every known module in a single
+ * PassThruWriteMsgs, then responses are collected until every module answered or ran out of time.
+ * Each module gets its own P2, extended by 0x78 and multi frame responses like uds_request_send.
+ */
+static size_t discovery_round(discovery_t* discovery, J2534* j2534, unsigned long chanID, PASSTHRU_MSG* msgs,
+                              uint8_t sid, uint8_t pid, discovery_parse_fn parse, bool functional)
+{
+  uds_deadline_t window, deadlines[DISCOVERY_MAX_MODULES];
+  bool waiting[DISCOVERY_MAX_MODULES] = { false };  // by slot, responseID - 0x7E8
+  unsigned long numMsgs = 0;
+  uint64_t now, sent;
+  size_t ret, i;
+
+  if (functional) {
+    discovery_frame(&msgs[numMsgs++], OBD2_FUNCTIONAL_CANID_LSB, sid, pid);
+  } else {
+    for (i = 0; i < discovery->numModules; i++)
+      discovery_frame(&msgs[numMsgs++], discovery->modules[i].requestID & 0xff, sid, pid);
+  }
+  if (!numMsgs) return 0;
+
+  ret = j2534->PassThruWriteMsgs(chanID, msgs, &numMsgs, TX_TIMEOUT);
+  if (ret) return ret;
+  sent = now = monotonic_us();
+  discovery->roundTrips++;
+
+  // a functional request doesn't say who will answer, everyone gets until the window closes
+  uds_deadline_start(&window, sid, 0, now);
+  for (i = 0; i < DISCOVERY_MAX_MODULES; i++)
+    uds_deadline_start(&deadlines[i], sid, 0, now);
+  if (!functional)
+    for (i = 0; i < discovery->numModules; i++)
+      waiting[(discovery->modules[i].responseID & 0xff) - UDS_RESPONSE_CANID_LSB] = true;
+
+  for (;;) {
+    uint64_t until = functional ? window.deadline : 0;
+    for (i = 0; i < DISCOVERY_MAX_MODULES; i++)
+      if (waiting[i] && deadlines[i].deadline > until) until = deadlines[i].deadline;
+    if (now >= until) break;
+
+    unsigned long numRx = DISCOVERY_MAX_MODULES;
+    ret = j2534->PassThruReadMsgs(chanID, msgs, &numRx, (unsigned long)((until - now + 999) / 1000));
+    now = monotonic_us();
+    if (ret == ERR_BUFFER_EMPTY || ret == ERR_TIMEOUT) continue;
+    if (ret) return ret;
+
+    for (i = 0; i < numRx; i++) {
+      const PASSTHRU_MSG* msg = &msgs[i];
+      if (msg->DataSize < 4 || msg->Data[2] != UDS_RESPONSE_CANID_MSB) continue;
+      uint8_t slot = (uint8_t)(msg->Data[3] - UDS_RESPONSE_CANID_LSB);
+      if (slot >= DISCOVERY_MAX_MODULES) continue;
+      // late answers to an earlier round are dropped
+      if (!functional && !waiting[slot]) continue;
+      discovery_module_t* module = discovery_module(discovery, slot, functional);
+      if (!module) continue;
+
+      if (msg->RxStatus & START_OF_MESSAGE) {
+        waiting[slot] = true;
+        uds_deadline_first_frame(&deadlines[slot], now);
+        continue;
+      }
+      if (msg->DataSize < 6) continue;
+      const uint8_t* data = &msg->Data[4];
+      uint32_t length = msg->DataSize - 4;
+
+      if (data[0] == OBD2_NEGATIVE_RESPONSE) {
+        if (length >= 3 && data[2] == UDS_NEGATIVE_RESPONSE_REQUEST_RECEIVED_RESPONSE_PENDING) {
+          waiting[slot] = true;
+          uds_deadline_pending(&deadlines[slot], now);
+        } else {
+          // doesn't have it, nothing more is coming from this one
+          waiting[slot] = false;
+        }
+        continue;
+      }
+      if (data[0] != sid + OBD2_ACK_OFFSET || data[1] != pid) continue;
+
+      if (functional) module->responseUs = now - sent;
+      parse(module, data, length);
+      waiting[slot] = false;
+    }
+  }
+  return 0;
+}
+
+static int discovery_compare(const void* a, const void* b)
+{
+  return (int)((const discovery_module_t*)a)->responseID - (int)((const discovery_module_t*)b)->responseID;
+}
+
+size_t discovery_run(discovery_t* discovery, J2534* j2534, unsigned long chanID)
+{
+  uint64_t start = monotonic_us();
+  size_t ret;
+
+  memset(discovery, 0, sizeof(*discovery));
+  PASSTHRU_MSG* msgs = (PASSTHRU_MSG*)calloc(DISCOVERY_MAX_MODULES, sizeof(PASSTHRU_MSG));
+  if (!msgs) return ENOMEM;
+
+  // every OBD module has to support mode 01 PID 00, so this finds them all
+  unsigned long filterID = 0;
+  ret = discovery_start_functional(j2534, chanID, msgs, &filterID);
+  if (!ret) {
+    ret = discovery_round(discovery, j2534, chanID, msgs,
+      OBD2_SID_REQUEST_CURRENT_DATA, OBD2_PID_SUPPORTED_PIDS_01_20, discovery_parse_pids, true);
+    j2534->PassThruStopMsgFilter(chanID, filterID);
+  }
+  qsort(discovery->modules, discovery->numModules, sizeof(discovery_module_t), discovery_compare);
+
+  if (!ret)
+    ret = discovery_round(discovery, j2534, chanID, msgs,
+      OBD2_SID_REQUEST_VEHICLE_INFORMATION, OBD2_PID_REQUEST_VIN, discovery_parse_vin, false);
+  if (!ret)
+    ret = discovery_round(discovery, j2534, chanID, msgs,
+      OBD2_SID_REQUEST_VEHICLE_INFORMATION, OBD2_PID_REQUEST_CALID, discovery_parse_calid, false);
+
+  discovery->elapsedUs = monotonic_us() - start;
+  free(msgs);
+  return ret;
+}
+
+void discovery_report(const discovery_t* discovery)
+{
+  LOGI(TAG, "found %zu modules in %u round trips, %.1fms",
+    discovery->numModules, discovery->roundTrips, (double)discovery->elapsedUs / 1000.0);
+  for (size_t i = 0; i < discovery->numModules; i++) {
+    const discovery_module_t* module = &discovery->modules[i];
+    LOGI(TAG, "0x%03X -> 0x%03X %-3s VIN %-17s CALID %-16s PIDs %08X, answered in %.1fms",
+      module->requestID, module->responseID, discovery_module_name(module->responseID),
+      module->vin[0] ? module->vin : "-", module->calibrationID[0] ? module->calibrationID : "-",
+      module->supportedPIDs, (double)module->responseUs / 1000.0);
+  }
+}
@@ -0,0 +1,61 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "J2534.h"
+#include "librx8.h"
+
+/* Module discovery.
+ *
+ * One functionally addressed request (0x7DF, supported PIDs 01-20) reaches every
+ * emissions related module, and every module that answers from 0x7E8-0x7EF within
+ * P2 is recorded. The modules found are then asked for VIN and calibration ID all at
+ * once: one physically addressed request per module in a single PassThruWriteMsgs,
+ * and their responses collected in the same receive window. Finding and identifying
+ * any number of modules takes three bus round trips instead of probing 0x7E0-0x7E7
+ * one address and one timeout at a time.
+ */
+
+static const size_t DISCOVERY_MAX_MODULES = 8;
+
+typedef struct Discovery_Module {
+  uint16_t requestID;      // 0x7E0-0x7E7
+  uint16_t responseID;     // 0x7E8-0x7EF
+  uint32_t supportedPIDs;  // mode 01 PIDs 0x01-0x20, bit 31 is PID 0x01
+  char     vin[VIN_LENGTH];                        // empty if the module has none
+  char     calibrationID[CALIBRATION_ID_LENGTH];   // empty if the module has none
+  uint64_t responseUs;     // time to answer the functional request
+} discovery_module_t;
+
+typedef struct Discovery {
+  size_t   numModules;
+  discovery_module_t modules[DISCOVERY_MAX_MODULES];  // sorted by responseID
+  uint32_t roundTrips;
+  uint64_t elapsedUs;
+} discovery_t;
+
+/** Find and identify every module on the bus. Returns 0, or the passthru error */
+size_t discovery_run(discovery_t* discovery, J2534* j2534, unsigned long chanID);
+
+/** Usual role of the module answering from `responseID`, "PCM", "TCM" or "ABS". Manufacturers may differ */
+const char* discovery_module_name(uint16_t responseID);
+
+/** Log one line per module */
+void discovery_report(const discovery_t* discovery);
@@ -0,0 +1,560 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#include <io.h>
+#define F_OK 0
+#define access _access
+#else
+#include <unistd.h>
+#endif
+
+#include "dumpfile.h"
+#include "crc32c.h"
+#include "lzblock.h"
+#include "util.h"
+
+static const char* TAG = "Dumpfile";
+
+// levels of a tree over up to 2^32 leaves
+static const size_t DUMPFILE_MAX_LEVELS = 34;
+
+typedef struct Dumpfile_Levels {
+  size_t   count;
+  uint32_t offset[DUMPFILE_MAX_LEVELS];  // first node of each level, leaves at 0
+  uint32_t length[DUMPFILE_MAX_LEVELS];
+} dumpfile_levels_t;
+
+static void dumpfile_levels(uint32_t numBlocks, dumpfile_levels_t* levels)
+{
+  uint32_t offset = 0, length = numBlocks;
+  levels->count = 0;
+  for (;;) {
+    levels->offset[levels->count] = offset;
+    levels->length[levels->count] = length;
+    levels->count++;
+    if (length <= 1) break;
+    offset += length;
+    length = (length + 1) / 2;
+  }
+}
+
+static uint64_t dumpfile_align(uint64_t value, uint64_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+uint32_t dumpfile_tree_nodes(uint32_t numBlocks)
+{
+  dumpfile_levels_t levels;
+  dumpfile_levels(numBlocks, &levels);
+  return levels.offset[levels.count - 1] + levels.length[levels.count - 1];
+}
+
+uint32_t dumpfile_build_tree(uint32_t* tree, uint32_t numBlocks)
+{
+  dumpfile_levels_t levels;
+  if (!numBlocks) return 0;
+  dumpfile_levels(numBlocks, &levels);
+  for (size_t l = 1; l < levels.count; l++) {
+    const uint32_t* children = tree + levels.offset[l - 1];
+    uint32_t* parents = tree + levels.offset[l];
+    for (uint32_t i = 0; i < levels.length[l]; i++) {
+      if (2 * i + 1 < levels.length[l - 1])
+        parents[i] = crc32c(0, children + 2 * i, 8);
+      else
+        parents[i] = children[2 * i];
+    }
+  }
+  return tree[levels.offset[levels.count - 1]];
+}
+
+void dumpfile_init(dumpfile_t* dump, const char* vin, const char* calid, uint32_t chunkSize, bool compress)
+{
+  memset(dump, 0, sizeof(dumpfile_t));
+  dump->header.flags     = compress ? DUMPFILE_COMPRESSED : 0;
+  memcpy(dump->header.magic, DUMPFILE_MAGIC, sizeof(dump->header.magic));
+  dump->header.version   = DUMPFILE_VERSION;
+  dump->header.blockSize = DUMPFILE_BLOCK;
+  dump->header.chunkSize = chunkSize;
+  dump->header.startTime = (uint64_t)time(NULL);
+  snprintf(dump->header.vin, sizeof(dump->header.vin), "%s", vin ? vin : "");
+  snprintf(dump->header.calid, sizeof(dump->header.calid), "%s", calid ? calid : "");
+}
+
+void dumpfile_free(dumpfile_t* dump)
+{
+  free(dump->tree);
+  free(dump->timings);
+  free(dump->block);
+  free(dump->stored);
+  free(dump->frames);
+  memset(dump, 0, sizeof(dumpfile_t));
+}
+
+size_t dumpfile_add_region(dumpfile_t* dump, const char* name, uint32_t address, uint32_t length)
+{
+  dumpfile_header_t* header = &dump->header;
+  if (header->numRegions == DUMPFILE_MAX_REGIONS || dump->received) return ENOSPC;
+
+  uint64_t dataLength = header->dataLength + length;
+  uint32_t numBlocks = (uint32_t)((dataLength + DUMPFILE_BLOCK - 1) / DUMPFILE_BLOCK);
+  uint32_t numNodes = dumpfile_tree_nodes(numBlocks);
+  uint32_t* tree = (uint32_t*)realloc(dump->tree, numNodes * sizeof(uint32_t));
+  if (!tree) return ENOMEM;
+  dump->tree = tree;
+  uint32_t* timings = (uint32_t*)realloc(dump->timings, numBlocks * sizeof(uint32_t));
+  if (!timings) return ENOMEM;
+  dump->timings = timings;
+  memset(dump->timings + header->numBlocks, 0, (numBlocks - header->numBlocks) * sizeof(uint32_t));
+  if (header->flags & DUMPFILE_COMPRESSED) {
+    if (!dump->block && !(dump->block = (uint8_t*)malloc(DUMPFILE_BLOCK))) return ENOMEM;
+    uint8_t* stored = (uint8_t*)realloc(dump->stored, (size_t)numBlocks * DUMPFILE_BLOCK);
+    if (!stored) return ENOMEM;
+    dump->stored = stored;
+    uint32_t* frames = (uint32_t*)realloc(dump->frames, (numBlocks + 1) * sizeof(uint32_t));
+    if (!frames) return ENOMEM;
+    dump->frames = frames;
+    dump->frames[0] = 0;
+  }
+
+  dumpfile_region_t* region = &dump->regions[header->numRegions++];
+  memset(region, 0, sizeof(dumpfile_region_t));
+  snprintf(region->name, sizeof(region->name), "%s", name);
+  region->address = address;
+  region->length  = length;
+  region->offset  = header->dataLength;
+  header->dataLength = dataLength;
+  header->numBlocks  = numBlocks;
+  header->numNodes   = numNodes;
+  return 0;
+}
+
+// compress a finished block, kept as is unless that makes it smaller
+static void dumpfile_store(dumpfile_t* dump, uint32_t b, size_t length)
+{
+  uint8_t* out = dump->stored + dump->frames[b];
+  size_t stored = lzblock_compress(dump->block, length, out, length - 1);
+  if (!stored) {
+    memcpy(out, dump->block, length);
+    stored = length;
+  }
+  dump->frames[b + 1] = dump->frames[b] + (uint32_t)stored;
+}
+
+void dumpfile_update(dumpfile_t* dump, const void* data, size_t length, uint64_t elapsedUs)
+{
+  const uint8_t* p = (const uint8_t*)data;
+  if (length > dump->header.dataLength - dump->received)
+    length = (size_t)(dump->header.dataLength - dump->received);
+  if (!length) return;
+
+  dump->timings[dump->received / DUMPFILE_BLOCK] += (uint32_t)elapsedUs;
+  dump->header.elapsedUs += elapsedUs;
+  while (length) {
+    size_t offset = (size_t)(dump->received % DUMPFILE_BLOCK);
+    size_t take = DUMPFILE_BLOCK - offset < length ? DUMPFILE_BLOCK - offset : length;
+    dump->crc = crc32c(dump->crc, p, take);
+    if (dump->block)
+      memcpy(dump->block + offset, p, take);
+    p += take;
+    length -= take;
+    dump->received += take;
+    if (dump->received % DUMPFILE_BLOCK == 0 || dump->received == dump->header.dataLength) {
+      uint32_t b = (uint32_t)((dump->received - 1) / DUMPFILE_BLOCK);
+      dump->tree[b] = dump->crc;
+      dump->crc = 0;
+      if (dump->block)
+        dumpfile_store(dump, b, offset + take);
+    }
+  }
+}
+
+size_t dumpfile_save(dumpfile_t* dump, const char* path, const uint8_t* data)
+{
+  dumpfile_header_t* header = &dump->header;
+  static const uint8_t padding[DUMPFILE_BLOCK] = { 0 };
+  size_t ret = 0;
+
+  if (!header->numBlocks) return EINVAL;
+  header->bytesRead = (uint32_t)dump->received;
+  // what the read loop didn't get to
+  if (dump->received < header->dataLength)
+    dumpfile_update(dump, data + dump->received, (size_t)(header->dataLength - dump->received), 0);
+  header->root = dumpfile_build_tree(dump->tree, header->numBlocks);
+  bool compressed = (header->flags & DUMPFILE_COMPRESSED) != 0;
+  uint32_t numFrames = compressed ? header->numBlocks + 1 : 0;
+  header->storedLength = compressed ? dump->frames[header->numBlocks] : header->dataLength;
+
+  header->regionsOffset = sizeof(dumpfile_header_t);
+  header->treeOffset    = dumpfile_align(header->regionsOffset + header->numRegions * sizeof(dumpfile_region_t), 8);
+  header->timingsOffset = dumpfile_align(header->treeOffset + header->numNodes * sizeof(uint32_t), 8);
+  header->framesOffset  = compressed ? dumpfile_align(header->timingsOffset + header->numBlocks * sizeof(uint32_t), 8) : 0;
+  header->dataOffset    = dumpfile_align(compressed ? header->framesOffset + numFrames * sizeof(uint32_t) :
+                                         header->timingsOffset + header->numBlocks * sizeof(uint32_t), DUMPFILE_BLOCK);
+
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    ret = errno;
+    LOGE(TAG, "Failed to create %s %s", path, strerror(errno));
+    return ret;
+  }
+  // tables, each padded up to where the next one starts
+  struct { const void* data; uint64_t length, end; } parts[] = {
+    { header,        sizeof(dumpfile_header_t),                      header->regionsOffset },
+    { dump->regions, header->numRegions * sizeof(dumpfile_region_t), header->treeOffset },
+    { dump->tree,    header->numNodes * sizeof(uint32_t),            header->timingsOffset },
+    { dump->timings, header->numBlocks * sizeof(uint32_t),           compressed ? header->framesOffset : header->dataOffset },
+    { dump->frames,  numFrames * sizeof(uint32_t),                   header->dataOffset },
+  };
+  uint64_t position = 0;
+  for (size_t i = 0; !ret && i < sizeof(parts) / sizeof(parts[0]); i++) {
+    if (parts[i].length && fwrite(parts[i].data, (size_t)parts[i].length, 1, file) != 1) ret = EIO;
+    position += parts[i].length;
+    if (!ret && parts[i].end > position && fwrite(padding, (size_t)(parts[i].end - position), 1, file) != 1) ret = EIO;
+    position = parts[i].end;
+  }
+  if (!ret && fwrite(compressed ? dump->stored : data, (size_t)header->storedLength, 1, file) != 1) ret = EIO;
+  if (fclose(file) && !ret) ret = EIO;
+  if (ret) LOGE(TAG, "Failed to write %s", path);
+  return ret;
+}
+
+static bool dumpfile_fits(uint64_t offset, uint64_t size, uint64_t length)
+{
+  return offset <= length && size <= length - offset;
+}
+
+size_t dumpfile_open(dumpfile_reader_t* reader, const char* path)
+{
+  size_t ret;
+  memset(reader, 0, sizeof(dumpfile_reader_t));
+  if ((ret = mapfile_open(&reader->map, path))) return ret;
+
+  const uint8_t* base = reader->map.data;
+  uint64_t length = reader->map.length;
+  const dumpfile_header_t* header = (const dumpfile_header_t*)base;
+  bool valid = length >= sizeof(dumpfile_header_t) && !memcmp(header->magic, DUMPFILE_MAGIC, sizeof(header->magic)) &&
+               header->version == DUMPFILE_VERSION && header->blockSize == DUMPFILE_BLOCK &&
+               header->numRegions <= DUMPFILE_MAX_REGIONS && header->numBlocks &&
+               header->numBlocks == (header->dataLength + DUMPFILE_BLOCK - 1) / DUMPFILE_BLOCK &&
+               header->numNodes == dumpfile_tree_nodes(header->numBlocks) &&
+               dumpfile_fits(header->regionsOffset, header->numRegions * sizeof(dumpfile_region_t), length) &&
+               header->treeOffset % 4 == 0 && dumpfile_fits(header->treeOffset, header->numNodes * sizeof(uint32_t), length) &&
+               header->timingsOffset % 4 == 0 && dumpfile_fits(header->timingsOffset, header->numBlocks * sizeof(uint32_t), length) &&
+               !(header->flags & ~DUMPFILE_COMPRESSED) &&
+               (header->flags & DUMPFILE_COMPRESSED ?
+                 header->framesOffset % 4 == 0 && dumpfile_fits(header->framesOffset, (header->numBlocks + 1) * sizeof(uint32_t), length) :
+                 header->storedLength == header->dataLength) &&
+               dumpfile_fits(header->dataOffset, header->storedLength, length);
+  if (!valid) {
+    LOGE(TAG, "%s is not a dump container", path);
+    mapfile_close(&reader->map);
+    return EINVAL;
+  }
+  reader->header  = header;
+  reader->regions = (const dumpfile_region_t*)(base + header->regionsOffset);
+  reader->tree    = (const uint32_t*)(base + header->treeOffset);
+  reader->timings = (const uint32_t*)(base + header->timingsOffset);
+  reader->frames  = header->flags & DUMPFILE_COMPRESSED ? (const uint32_t*)(base + header->framesOffset) : NULL;
+  reader->data    = base + header->dataOffset;
+  for (uint32_t r = 0; r < header->numRegions; r++) {
+    if (reader->regions[r].offset > header->dataLength || reader->regions[r].length > header->dataLength - reader->regions[r].offset) {
+      LOGE(TAG, "%s has a region past its data", path);
+      dumpfile_close(reader);
+      return EINVAL;
+    }
+  }
+  return 0;
+}
+
+void dumpfile_close(dumpfile_reader_t* reader)
+{
+  mapfile_close(&reader->map);
+  reader->header  = NULL;
+  reader->regions = NULL;
+  reader->tree    = NULL;
+  reader->timings = NULL;
+  reader->frames  = NULL;
+  reader->data    = NULL;
+}
+
+size_t dumpfile_block(const dumpfile_reader_t* reader, uint32_t b, uint8_t* out)
+{
+  const dumpfile_header_t* header = reader->header;
+  if (b >= header->numBlocks) return 0;
+  uint64_t offset = (uint64_t)b * DUMPFILE_BLOCK;
+  size_t length = header->dataLength - offset < DUMPFILE_BLOCK ? (size_t)(header->dataLength - offset) : DUMPFILE_BLOCK;
+  if (!reader->frames) {
+    memcpy(out, reader->data + offset, length);
+    return length;
+  }
+
+  uint32_t start = reader->frames[b], end = reader->frames[b + 1];
+  if (start > end || end > header->storedLength) return 0;
+  if (end - start == length) {
+    memcpy(out, reader->data + start, length);
+    return length;
+  }
+  return lzblock_decompress(reader->data + start, end - start, out, length) == (long)length ? length : 0;
+}
+
+size_t dumpfile_read(const dumpfile_reader_t* reader, uint32_t address, uint8_t* out, uint32_t length)
+{
+  uint8_t block[DUMPFILE_BLOCK];
+  for (uint32_t r = 0; r < reader->header->numRegions; r++) {
+    const dumpfile_region_t* region = &reader->regions[r];
+    if (address < region->address || length > region->length || address - region->address > region->length - length)
+      continue;
+    uint64_t offset = region->offset + (address - region->address);
+    if (!reader->frames) {
+      memcpy(out, reader->data + offset, length);
+      return 0;
+    }
+    // only the blocks the range touches are decompressed
+    while (length) {
+      uint32_t b = (uint32_t)(offset / DUMPFILE_BLOCK), within = (uint32_t)(offset % DUMPFILE_BLOCK);
+      size_t blockLength = dumpfile_block(reader, b, block);
+      if (blockLength <= within) return EINVAL;
+      uint32_t take = (uint32_t)(blockLength - within) < length ? (uint32_t)(blockLength - within) : length;
+      memcpy(out, block + within, take);
+      out += take;
+      offset += take;
+      length -= take;
+    }
+    return 0;
+  }
+  return ERANGE;
+}
+
+size_t dumpfile_verify(const dumpfile_reader_t* reader, uint32_t* blocks, size_t max)
+{
+  const dumpfile_header_t* header = reader->header;
+  size_t bad = 0;
+  uint32_t* tree = (uint32_t*)malloc(header->numNodes * sizeof(uint32_t));
+  if (!tree) return header->numBlocks;
+
+  uint8_t block[DUMPFILE_BLOCK];
+  for (uint32_t b = 0; b < header->numBlocks; b++) {
+    uint64_t offset = (uint64_t)b * DUMPFILE_BLOCK;
+    size_t length = reader->frames ? dumpfile_block(reader, b, block) :
+                    header->dataLength - offset < DUMPFILE_BLOCK ? (size_t)(header->dataLength - offset) : DUMPFILE_BLOCK;
+    // a block that doesn't decompress gets the CRC of nothing, which won't match
+    tree[b] = crc32c(0, reader->frames ? block : reader->data + offset, length);
+    if (tree[b] != reader->tree[b]) {
+      if (bad < max) blocks[bad] = b;
+      bad++;
+    }
+  }
+  // the blocks may all match a tree that was damaged above them
+  if (!bad && (dumpfile_build_tree(tree, header->numBlocks) != header->root ||
+               memcmp(tree, reader->tree, header->numNodes * sizeof(uint32_t))))
+    bad = 1;
+  free(tree);
+  return bad;
+}
+
+static void dumpfile_walk(const uint32_t* a, const uint32_t* b, const dumpfile_levels_t* levels, size_t level,
+                          uint32_t index, uint32_t* blocks, size_t max, long* count)
+{
+  uint32_t node = levels->offset[level] + index;
+  if (a[node] == b[node]) return;
+  if (!level) {
+    if ((size_t)*count < max) blocks[*count] = index;
+    (*count)++;
+    return;
+  }
+  dumpfile_walk(a, b, levels, level - 1, 2 * index, blocks, max, count);
+  if (2 * index + 1 < levels->length[level - 1])
+    dumpfile_walk(a, b, levels, level - 1, 2 * index + 1, blocks, max, count);
+}
+
+long dumpfile_diff(const dumpfile_reader_t* a, const dumpfile_reader_t* b, uint32_t* blocks, size_t max)
+{
+  dumpfile_levels_t levels;
+  long count = 0;
+  if (a->header->numBlocks != b->header->numBlocks || a->header->dataLength != b->header->dataLength)
+    return -1;
+  dumpfile_levels(a->header->numBlocks, &levels);
+  dumpfile_walk(a->tree, b->tree, &levels, levels.count - 1, 0, blocks, max, &count);
+  return count;
+}
+
+// blocks as addresses, like "block 6 at 0xffff6000", cut short past `max`
+static void dumpfile_log_blocks(const dumpfile_reader_t* reader, const uint32_t* blocks, size_t count, size_t max)
+{
+  for (size_t i = 0; i < count && i < max; i++) {
+    uint64_t offset = (uint64_t)blocks[i] * DUMPFILE_BLOCK;
+    uint32_t address = (uint32_t)offset;
+    // data offsets to addresses through the region holding them
+    for (uint32_t r = 0; r < reader->header->numRegions; r++) {
+      const dumpfile_region_t* region = &reader->regions[r];
+      if (offset >= region->offset && offset < region->offset + region->length)
+        address = region->address + (uint32_t)(offset - region->offset);
+    }
+    LOGI(TAG, "  block %u at 0x%08x", blocks[i], address);
+  }
+  if (count > max)
+    LOGI(TAG, "  ... %zu more", count - max);
+}
+
+size_t dumpfile_info(const char* path, const char* comparePath)
+{
+  dumpfile_reader_t reader, other;
+  uint32_t blocks[64];
+  size_t max = sizeof(blocks) / sizeof(blocks[0]);
+  size_t ret;
+
+  if ((ret = dumpfile_open(&reader, path)))
+    return ret;
+  const dumpfile_header_t* header = reader.header;
+  time_t startTime = (time_t)header->startTime;
+  char date[64] = { 0 };
+  strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&startTime));
+  LOGI(TAG, "%s: VIN %s CALID %s, read %s", path, header->vin, header->calid, date);
+  for (uint32_t r = 0; r < header->numRegions; r++)
+    LOGI(TAG, "  %-8s 0x%08x-0x%08x", reader.regions[r].name, reader.regions[r].address,
+         reader.regions[r].address + reader.regions[r].length - 1);
+  if (header->bytesRead < header->dataLength)
+    LOGE(TAG, "Only 0x%x of 0x%llx bytes were read, the rest is zeros", header->bytesRead,
+         (unsigned long long)header->dataLength);
+
+  uint32_t slowest = 0;
+  for (uint32_t b = 1; b < header->numBlocks; b++)
+    if (reader.timings[b] > reader.timings[slowest]) slowest = b;
+  LOGI(TAG, "%u blocks of %u bytes in %.3fs with 0x%x byte requests, %.1f KB/s, slowest block %u took %.1f ms",
+       header->numBlocks, header->blockSize, (double)header->elapsedUs / 1e6, header->chunkSize,
+       header->elapsedUs ? (double)header->bytesRead * 1e6 / 1024.0 / (double)header->elapsedUs : 0.0,
+       slowest, (double)reader.timings[slowest] / 1000.0);
+  LOGI(TAG, "Root 0x%08x", header->root);
+  if (reader.frames)
+    LOGI(TAG, "Compressed to %.1f KB of %.1f KB, %.1f:1", (double)header->storedLength / 1024.0,
+         (double)header->dataLength / 1024.0, (double)header->dataLength / (double)header->storedLength);
+
+  if (comparePath) {
+    if ((ret = dumpfile_open(&other, comparePath))) {
+      dumpfile_close(&reader);
+      return ret;
+    }
+    long differ = dumpfile_diff(&reader, &other, blocks, max);
+    if (differ < 0) {
+      LOGE(TAG, "%s has a different layout", comparePath);
+      ret = EIO;
+    } else if (!differ) {
+      LOGI(TAG, "Same as %s", comparePath);
+    } else {
+      LOGI(TAG, "%ld blocks differ from %s", differ, comparePath);
+      dumpfile_log_blocks(&reader, blocks, (size_t)differ, max);
+      ret = EIO;
+    }
+    dumpfile_close(&other);
+  } else {
+    size_t bad = dumpfile_verify(&reader, blocks, max);
+    if (bad) {
+      LOGE(TAG, "%zu blocks don't match their CRC", bad);
+      dumpfile_log_blocks(&reader, blocks, bad, max);
+      ret = EIO;
+    } else {
+      LOGI(TAG, "Every block matches its CRC");
+    }
+  }
+  dumpfile_close(&reader);
+  return ret;
+}
+
+size_t dumpfile_extract(const char* path, const char* outPath)
+{
+  dumpfile_reader_t reader;
+  uint8_t block[DUMPFILE_BLOCK];
+  size_t ret;
+
+  if ((ret = dumpfile_open(&reader, path)))
+    return ret;
+  FILE* file = fopen(outPath, "wb");
+  if (!file) {
+    ret = errno;
+    LOGE(TAG, "Failed to open %s %s", outPath, strerror(errno));
+    dumpfile_close(&reader);
+    return ret;
+  }
+  // a block at a time, decompressed if need be
+  for (uint32_t b = 0; !ret && b < reader.header->numBlocks; b++) {
+    size_t length = dumpfile_block(&reader, b, block);
+    if (!length) {
+      LOGE(TAG, "Block %u is damaged", b);
+      ret = EIO;
+    } else if (fwrite(block, length, 1, file) != 1) {
+      ret = errno ? errno : EIO;
+      LOGE(TAG, "Failed to write %s %s", outPath, strerror((int)ret));
+    }
+  }
+  if (fclose(file) && !ret)
+    ret = errno ? errno : EIO;
+  if (!ret)
+    LOGI(TAG, "Wrote %s", outPath);
+  dumpfile_close(&reader);
+  return ret;
+}
+
+size_t dumpfile_pack(const char* path, uint32_t address, bool compress, bool overwrite)
+{
+  dumpfile_t dump;
+  char fileName[255];
+  size_t length = 0;
+  size_t ret = 0;
+
+  snprintf(fileName, sizeof(fileName), "%s", path);
+  char* extension = strrchr(fileName, '.');
+  if (extension && !strchr(extension, '/') && !strchr(extension, '\\'))
+    *extension = 0;
+  if (strlen(fileName) + strlen(DUMPFILE_EXTENSION) >= sizeof(fileName)) {
+    LOGE(TAG, "%s is too long", path);
+    return ENAMETOOLONG;
+  }
+  strcat(fileName, DUMPFILE_EXTENSION);
+  if (!overwrite && access(fileName, F_OK) == 0) {
+    LOGE(TAG, "Not overwriting old file %s (use --overwrite if you want this)", fileName);
+    return EEXIST;
+  }
+
+  uint8_t* data = load_file(path, &length);
+  if (!data) {
+    ret = errno ? errno : EIO;
+    LOGE(TAG, "Failed to read %s %s", path, strerror((int)ret));
+    return ret;
+  }
+  uint64_t start = monotonic_us();
+  dumpfile_init(&dump, NULL, NULL, 0, compress);
+  if (!length || dumpfile_add_region(&dump, address >= 0xffff0000 ? "ram" : "rom", address, (uint32_t)length)) {
+    LOGE(TAG, "Can't pack %s", path);
+    ret = EINVAL;
+  }
+  if (!ret)
+    ret = dumpfile_save(&dump, fileName, data);
+  if (!ret)
+    LOGI(TAG, "Wrote %s, %zu bytes stored as %llu in %.1f ms", fileName, length,
+         (unsigned long long)(sizeof(dumpfile_header_t) + dump.header.storedLength),
+         (double)(monotonic_us() - start) / 1000.0);
+  dumpfile_free(&dump);
+  free(data);
+  return ret;
+}
@@ -0,0 +1,171 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "mapfile.h"
+
+/* Dump container.
+ *
+ * A dump with what is known about it: VIN, CALID, the address ranges it holds, how
+ * long each block took to read, and a CRC32C of every DUMPFILE_BLOCK bytes arranged
+ * as a Merkle tree. The CRCs are computed as the chunks come in, so a finished dump
+ * costs nothing extra to hash. Two dumps whose roots match hold the same bytes; if
+ * they don't, walking down the nodes that differ finds the blocks that differ without
+ * touching the data. CRC32C is no cryptographic hash, a change slips through a node
+ * with a chance of 1 in 2^32, dumpfile_verify() reads everything.
+ *
+ * Compressed containers store every block as its own LZ4 block (see lzblock.h), or as
+ * is if it doesn't get smaller, so any block can be read without the ones before it.
+ * Blocks are compressed as they complete, the read loop never waits on a whole dump.
+ *
+ * File layout, every table 8 byte aligned:
+ *   dumpfile_header_t
+ *   dumpfile_region_t[numRegions]
+ *   uint32_t tree[numNodes]       leaves (block CRCs) first, then each level up, the root last
+ *   uint32_t timings[numBlocks]   microseconds spent reading each block
+ *   uint32_t frames[numBlocks + 1] compressed only, where each block starts in the data
+ *   data, DUMPFILE_BLOCK aligned, the regions back to back
+ * A parent is the CRC32C of its two children, or the child itself if it has no sibling.
+ */
+
+#define DUMPFILE_MAGIC     "RX8DUMP"
+#define DUMPFILE_EXTENSION ".rxd"
+static const uint32_t DUMPFILE_VERSION     = 2;
+static const uint32_t DUMPFILE_BLOCK       = 0x1000;
+static const size_t   DUMPFILE_MAX_REGIONS = 8;
+static const uint32_t DUMPFILE_COMPRESSED  = 1;
+
+typedef struct Dumpfile_Header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t blockSize;
+  char     vin[32];
+  char     calid[32];
+  uint64_t startTime;     // seconds since the epoch
+  uint64_t elapsedUs;     // reading
+  uint32_t chunkSize;     // bytes per request
+  uint32_t numRegions;
+  uint32_t numBlocks;
+  uint32_t numNodes;
+  uint64_t regionsOffset;
+  uint64_t treeOffset;
+  uint64_t timingsOffset;
+  uint64_t dataOffset;
+  uint64_t dataLength;
+  uint32_t root;
+  uint32_t bytesRead;     // less than dataLength if the read stopped early, the rest is zeros
+  uint32_t flags;         // DUMPFILE_COMPRESSED
+  uint32_t reserved;
+  uint64_t framesOffset;  // compressed only
+  uint64_t storedLength;  // of the data as stored, dataLength unless compressed
+} dumpfile_header_t;
+
+typedef struct Dumpfile_Region {
+  char     name[16];
+  uint32_t address;
+  uint32_t length;
+  uint64_t offset;        // in the data
+} dumpfile_region_t;
+
+/* Writer, fed chunk by chunk from the read loop */
+typedef struct Dumpfile {
+  dumpfile_header_t header;
+  dumpfile_region_t regions[DUMPFILE_MAX_REGIONS];
+  uint32_t* tree;
+  uint32_t* timings;
+  uint64_t  received;     // bytes hashed so far
+  uint32_t  crc;          // of the block being received
+  // compressed only
+  uint8_t*  block;        // the block being received
+  uint8_t*  stored;       // compressed blocks back to back
+  uint32_t* frames;
+} dumpfile_t;
+
+/* Reader, everything points into the mapping */
+typedef struct Dumpfile_Reader {
+  mapfile_t map;
+  const dumpfile_header_t* header;
+  const dumpfile_region_t* regions;
+  const uint32_t* tree;
+  const uint32_t* timings;
+  const uint32_t* frames;  // NULL unless compressed
+  const uint8_t*  data;
+} dumpfile_reader_t;
+
+/** Nodes of a tree over `numBlocks` leaves, leaves included */
+uint32_t dumpfile_tree_nodes(uint32_t numBlocks);
+
+/** Build the levels above `numBlocks` leaves in `tree`. Returns the root */
+uint32_t dumpfile_build_tree(uint32_t* tree, uint32_t numBlocks);
+
+void dumpfile_init(dumpfile_t* dump, const char* vin, const char* calid, uint32_t chunkSize, bool compress);
+void dumpfile_free(dumpfile_t* dump);
+
+/** Add an address range, before any data. Returns 0, ENOMEM or ENOSPC */
+size_t dumpfile_add_region(dumpfile_t* dump, const char* name, uint32_t address, uint32_t length);
+
+/** Hash the next `length` bytes of data, read in `elapsedUs` */
+void dumpfile_update(dumpfile_t* dump, const void* data, size_t length, uint64_t elapsedUs);
+
+/**
+ * Write the container. `data` holds every region back to back; whatever wasn't passed to
+ * dumpfile_update() is hashed here. Returns 0 or errno
+ */
+size_t dumpfile_save(dumpfile_t* dump, const char* path, const uint8_t* data);
+
+/** Map a container and check its tables fit. Returns 0 or errno, nothing needs closing on failure */
+size_t dumpfile_open(dumpfile_reader_t* reader, const char* path);
+void dumpfile_close(dumpfile_reader_t* reader);
+
+/** Copy block `b` into `out`, DUMPFILE_BLOCK bytes. Returns its length, 0 if it is damaged */
+size_t dumpfile_block(const dumpfile_reader_t* reader, uint32_t b, uint8_t* out);
+
+/** Copy `length` bytes at `address` into `out`. Returns 0, ERANGE if no region holds them all, or EINVAL */
+size_t dumpfile_read(const dumpfile_reader_t* reader, uint32_t address, uint8_t* out, uint32_t length);
+
+/**
+ * Recompute every block CRC and the tree. Up to `max` blocks that don't match go into
+ * `blocks`. Returns how many don't match, the root counts as one more if only it is wrong
+ */
+size_t dumpfile_verify(const dumpfile_reader_t* reader, uint32_t* blocks, size_t max);
+
+/**
+ * Blocks that differ between two containers of the same layout, found by walking the
+ * trees. Up to `max` go into `blocks`. Returns how many differ, or -1 if the layouts differ
+ */
+long dumpfile_diff(const dumpfile_reader_t* a, const dumpfile_reader_t* b, uint32_t* blocks, size_t max);
+
+/**
+ * --dump-info: log what the container at `path` holds, then check it against its CRCs, or
+ * against the container at `comparePath` if that isn't NULL. Returns 0 if it is intact or
+ * the same, EIO if not, or errno
+ */
+size_t dumpfile_info(const char* path, const char* comparePath);
+
+/** The data of the container at `path` written to `outPath` as a raw dump. Returns 0 or errno */
+size_t dumpfile_extract(const char* path, const char* outPath);
+
+/**
+ * --pack: the raw dump at `path` saved as a container next to it, its extension replaced by
+ * DUMPFILE_EXTENSION, with the dump starting at `address`. Returns 0 or errno, EEXIST if the
+ * container is there already and `overwrite` isn't set
+ */
+size_t dumpfile_pack(const char* path, uint32_t address, bool compress, bool overwrite);
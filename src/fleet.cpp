@@ -0,0 +1,228 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#include <io.h>
+#define F_OK 0
+#define access _access
+#else
+#include <unistd.h>
+#endif
+
+#include "fleet.h"
+#include "util.h"
+#include "progressbar.h"
+
+static const char* TAG = "Fleet";
+
+static const long FLEET_FAIL_PASSTHRU = 1;
+static const long FLEET_FAIL_VINCHECK = 2;
+static const long FLEET_FAIL_CALID    = 3;
+static const long FLEET_FAIL_DIAG     = 4;
+static const long FLEET_FAIL_SEED     = 5;
+static const long FLEET_FAIL_UNLOCK   = 7;
+static const long FLEET_FAIL_DOWNLOAD = 8;
+
+size_t fleet_parse(fleet_t* fleet, const char* spec, bool simulated)
+{
+  char* end = NULL;
+  long count = strtol(spec, &end, 10);
+
+  fleet->numDevices = 0;
+  if (*spec && *end == 0) {
+    if (!simulated) {
+      LOGE(TAG, "a fleet of real adapters needs their device names, a count only works with --simulate");
+      return 1;
+    }
+    if (count < 1 || count > (long)FLEET_MAX_DEVICES) {
+      LOGE(TAG, "fleet size must be between 1 and %zu", FLEET_MAX_DEVICES);
+      return 1;
+    }
+    for (long i = 0; i < count; i++)
+      fleet->devices[fleet->numDevices++].name[0] = 0;
+    return 0;
+  }
+
+  while (*spec) {
+    const char* comma = strchr(spec, ',');
+    size_t length = comma ? (size_t)(comma - spec) : strlen(spec);
+    if (fleet->numDevices == FLEET_MAX_DEVICES) {
+      LOGE(TAG, "at most %zu devices are supported", FLEET_MAX_DEVICES);
+      return 1;
+    }
+    if (length == 0 || length >= sizeof(fleet->devices[0].name)) {
+      LOGE(TAG, "invalid device name in fleet list");
+      return 1;
+    }
+    fleet_device_t* device = &fleet->devices[fleet->numDevices++];
+    memcpy(device->name, spec, length);
+    device->name[length] = 0;
+    spec += length;
+    if (*spec == ',') spec++;
+  }
+  return fleet->numDevices == 0;
+}
+
+static long fleet_dump(fleet_t* fleet, fleet_device_t* device, RX8* ecu)
+{
+  rx8_vin_t vin;
+  rx8_calibration_id_t calibrationID;
+  rx8_seed_t seed;
+  rx8_key_t key;
+  unsigned int failed;
+  char* buffer = NULL;
+  FILE* file = NULL;
+  long status = 0;
+  uint32_t address = fleet->startAddress;
+  uint32_t endAddress = fleet->startAddress + fleet->transferSize;
+
+  if (!ecu->readVIN(vin).ok()) return FLEET_FAIL_VINCHECK;
+  memcpy(device->vin, vin.data(), VIN_LENGTH);
+
+  if (!ecu->readCalibrationID(calibrationID).ok()) return FLEET_FAIL_CALID;
+  memcpy(device->calibrationID, calibrationID.data(), CALIBRATION_ID_LENGTH);
+
+  if (!ecu->securityAccess(RX8_ACCESS_ALL, seed, key, &failed).ok())
+    return failed == RX8_ACCESS_SESSION ? FLEET_FAIL_DIAG : failed == RX8_ACCESS_SEED ? FLEET_FAIL_SEED : FLEET_FAIL_UNLOCK;
+
+  // example: JM1FE173370212600-N3M5EF00013H6020.bin
+  snprintf(device->fileName, sizeof(device->fileName), "%s-%s.bin", device->vin, device->calibrationID);
+  if (access(device->fileName, F_OK) == 0) {
+    if (!fleet->overwrite) {
+      LOGE(TAG, "[%s] Not overwriting old file %s (use --overwrite if you want this)", device->vin, device->fileName);
+      return FLEET_FAIL_DOWNLOAD;
+    }
+    remove(device->fileName);
+  }
+
+  buffer = (char*)malloc(fleet->transferSize);
+  if (!buffer) return ENOMEM;
+
+  ecu->beginTransfer();
+  while (address < endAddress) {
+    uint32_t chunk = endAddress - address < fleet->chunkSize ? endAddress - address : fleet->chunkSize;
+    rx8_span_t out = { (uint8_t*)buffer + (address - fleet->startAddress), chunk };
+    rx8_result_t result = ecu->readMemory(address, out);
+    if (!result.ok()) {
+      LOGE(TAG, "[%s] read failed at 0x%08X %s", device->vin, address, ecu->errorString(result));
+      status = FLEET_FAIL_DOWNLOAD;
+      break;
+    }
+    address += chunk;
+    device->bytesTransfered += chunk;
+  }
+  ecu->endTransfer();
+
+  if (!status) {
+    file = fopen(device->fileName, "wb");
+    if (!file || fwrite(buffer, fleet->transferSize, 1, file) != 1) {
+      LOGE(TAG, "[%s] Failed to write %s %s", device->vin, device->fileName, strerror(errno));
+      status = FLEET_FAIL_DOWNLOAD;
+    }
+    if (file) fclose(file);
+  }
+  free(buffer);
+  return status;
+}
+
+static void fleet_worker(fleet_t* fleet, fleet_device_t* device)
+{
+  J2534 j2534;
+  unsigned long devID = 0, chanID = 0;
+
+  device->startUs = monotonic_us();
+  if (fleet->api ? !j2534.init(fleet->api) : !j2534.init()) {
+    LOGE(TAG, "failed to connect to J2534 DLL.");
+    device->status = FLEET_FAIL_PASSTHRU;
+  } else if (j2534Connect(&j2534, device->name[0] ? device->name : NULL, &devID, &chanID)) {
+    LOGE(TAG, "failed to open device %s", device->name[0] ? device->name : "(next available)");
+    device->status = FLEET_FAIL_PASSTHRU;
+  } else {
+    RX8* ecu = new RX8(&j2534, devID, chanID);
+    device->status = fleet_dump(fleet, device, ecu);
+    delete ecu;
+    // the single device path skips this, here other adapters keep the process alive after this one is done
+    j2534.PassThruDisconnect(chanID);
+    j2534.PassThruClose(devID);
+  }
+  device->endUs = monotonic_us();
+  device->done = true;
+}
+
+size_t fleet_run(fleet_t* fleet)
+{
+  std::vector<std::thread> workers;
+  uint64_t total = (uint64_t)fleet->transferSize * fleet->numDevices;
+  uint64_t start = monotonic_us();
+  size_t failed = 0, i;
+  progress_t progress;
+
+  LOGI(TAG, "Dumping 0x%08X-0x%08X from %zu devices",
+    fleet->startAddress, fleet->startAddress + fleet->transferSize, fleet->numDevices);
+
+  progress_init(&progress, stdout, fleet->progressRate);
+  progress_start(&progress, "fleet", total);
+  for (i = 0; i < fleet->numDevices; i++) {
+    fleet->devices[i].status = 0;
+    fleet->devices[i].bytesTransfered = 0;
+    fleet->devices[i].done = false;
+    workers.push_back(std::thread(fleet_worker, fleet, &fleet->devices[i]));
+  }
+
+  // aggregate progress until every worker finished
+  for (;;) {
+    uint64_t transfered = 0;
+    bool running = false;
+    for (i = 0; i < fleet->numDevices; i++) {
+      transfered += fleet->devices[i].bytesTransfered;
+      if (!fleet->devices[i].done) running = true;
+    }
+    progress_update(&progress, transfered);
+    if (!running) break;
+    sleep_ms(FLEET_PROGRESS_INTERVAL_MS);
+  }
+  progress_finish(&progress);
+  for (i = 0; i < workers.size(); i++)
+    workers[i].join();
+
+  double seconds = (double)(monotonic_us() - start) / 1000000.0;
+  uint64_t transfered = 0;
+  for (i = 0; i < fleet->numDevices; i++) {
+    fleet_device_t* device = &fleet->devices[i];
+    double deviceSeconds = (double)(device->endUs - device->startUs) / 1000000.0;
+    transfered += device->bytesTransfered;
+    if (device->status) {
+      failed++;
+      LOGE(TAG, "[%zu] %s failed status=%ld after %u bytes", i, device->vin[0] ? device->vin : "?",
+        device->status, (uint32_t)device->bytesTransfered);
+    } else {
+      LOGI(TAG, "[%zu] %s -> %s %.1fs %.0f B/s", i, device->vin, device->fileName,
+        deviceSeconds, deviceSeconds > 0 ? device->bytesTransfered / deviceSeconds : 0.0);
+    }
+  }
+  LOGI(TAG, "%zu/%zu devices ok, %llu bytes in %.1fs, %.0f B/s aggregate",
+    fleet->numDevices - failed, fleet->numDevices, (unsigned long long)transfered,
+    seconds, seconds > 0 ? transfered / seconds : 0.0);
+  return failed;
+}
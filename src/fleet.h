@@ -0,0 +1,73 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <atomic>
+
+#include "J2534.h"
+#include "librx8.h"
+
+/* Fleet mode.
+ *
+ * Dumps several ECUs at once, one passthru device per ECU. Every device gets its own
+ * J2534 instance, RX8 session and thread; the only shared state is the progress
+ * counters. With the simulator throughput scales with the number of devices; with
+ * real adapters that depends on the driver and the USB bus. Each dump is written
+ * to VIN-CALID.bin like a single dump.
+ */
+
+static const size_t FLEET_MAX_DEVICES = 16;
+
+// how often the workers' byte counts are summed up for the progress reporter
+static const int FLEET_PROGRESS_INTERVAL_MS = 250;
+
+typedef struct Fleet_Device {
+  char     name[64];  // passed to PassThruOpen, empty for a simulated device
+  char     vin[VIN_LENGTH];
+  char     calibrationID[CALIBRATION_ID_LENGTH];
+  char     fileName[255];
+  long     status;    // 0 when the dump was written
+  uint64_t startUs;
+  uint64_t endUs;
+  std::atomic<uint32_t> bytesTransfered;
+  std::atomic<bool>     done;
+} fleet_device_t;
+
+typedef struct Fleet {
+  size_t   numDevices;
+  fleet_device_t devices[FLEET_MAX_DEVICES];
+  const PASSTHRU_API* api;  // in-process passthru, NULL to load the DLL
+  uint32_t startAddress;
+  uint32_t transferSize;
+  uint16_t chunkSize;
+  bool     overwrite;
+  unsigned int progressRate;  // see progress_init
+} fleet_t;
+
+/**
+ * Parse a device list, comma separated device names ("J2534-1,J2534-2"). A count ("4")
+ * is only accepted for `simulated` devices, which don't need a name; opening real ones
+ * with NULL would give every thread the same first adapter.
+ */
+size_t fleet_parse(fleet_t* fleet, const char* spec, bool simulated);
+
+/** Dump every device in parallel. Returns the number of devices that failed */
+size_t fleet_run(fleet_t* fleet);
@@ -0,0 +1,264 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HEXDUMP_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "hexdump.h"
+#include "util.h"
+
+static const char* TAG = "Hexdump";
+
+#define HEXDUMP_HIGHLIGHT "\x1b[31m"
+#define HEXDUMP_RESET     "\x1b[0m"
+
+// "00".."ff" and "00".."FF", two chars per byte
+static const char* hexdump_table(bool uppercase)
+{
+  static char tables[2][512];
+  static bool ready = [] {
+    static const char digits[2][17] = { "0123456789abcdef", "0123456789ABCDEF" };
+    for (int t = 0; t < 2; t++)
+      for (int i = 0; i < 256; i++) {
+        tables[t][i * 2]     = digits[t][i >> 4];
+        tables[t][i * 2 + 1] = digits[t][i & 0xf];
+      }
+    return true;
+  }();
+  (void)ready;
+  return tables[uppercase ? 1 : 0];
+}
+
+// 16 bytes as "xx xx ... " (48 chars)
+static inline void hexdump_hex16(char* out, const uint8_t* in, bool uppercase)
+{
+#if defined(HEXDUMP_SSE2)
+  const __m128i low = _mm_set1_epi8(0x0f);
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i zero = _mm_set1_epi8('0');
+  // distance from '9' + 1 to 'a' or 'A'
+  const __m128i letters = _mm_set1_epi8(uppercase ? 'A' - '0' - 10 : 'a' - '0' - 10);
+  alignas(16) uint16_t pairs[16];
+
+  __m128i v  = _mm_loadu_si128((const __m128i*)in);
+  __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low);
+  __m128i lo = _mm_and_si128(v, low);
+  hi = _mm_add_epi8(_mm_add_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), letters));
+  lo = _mm_add_epi8(_mm_add_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), letters));
+  _mm_store_si128((__m128i*)pairs, _mm_unpacklo_epi8(hi, lo));
+  _mm_store_si128((__m128i*)(pairs + 8), _mm_unpackhi_epi8(hi, lo));
+
+  for (size_t i = 0; i < 16; i++) {
+    memcpy(out + i * 3, &pairs[i], 2);
+    out[i * 3 + 2] = ' ';
+  }
+#else
+  const char* table = hexdump_table(uppercase);
+  for (size_t i = 0; i < 16; i++) {
+    memcpy(out + i * 3, table + in[i] * 2, 2);
+    out[i * 3 + 2] = ' ';
+  }
+#endif
+}
+
+// 16 bytes as printable ASCII, '.' for everything else
+static inline void hexdump_ascii16(char* out, const uint8_t* in)
+{
+#if defined(HEXDUMP_SSE2)
+  __m128i v = _mm_loadu_si128((const __m128i*)in);
+  // signed compares, everything >= 0x80 is negative and falls out
+  __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f)), _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f)));
+  _mm_storeu_si128((__m128i*)out,
+    _mm_or_si128(_mm_and_si128(printable, v), _mm_andnot_si128(printable, _mm_set1_epi8('.'))));
+#else
+  for (size_t i = 0; i < 16; i++)
+    out[i] = in[i] >= 0x20 && in[i] < 0x7f ? (char)in[i] : '.';
+#endif
+}
+
+size_t hexdump_hex(char* out, const uint8_t* data, size_t length, bool uppercase)
+{
+  const char* table = hexdump_table(uppercase);
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16)
+    hexdump_hex16(out + i * 3, data + i, uppercase);
+  for (; i < length; i++) {
+    memcpy(out + i * 3, table + data[i] * 2, 2);
+    out[i * 3 + 2] = ' ';
+  }
+  return length * 3;
+}
+
+// worst case row: address, every byte highlighted, ASCII and newline
+static size_t hexdump_row_max(size_t width)
+{
+  return 8 + 2 + width * (3 + sizeof(HEXDUMP_HIGHLIGHT) + sizeof(HEXDUMP_RESET)) + 1 + width + 1;
+}
+
+static char* hexdump_address(char* out, uint32_t address, int digits)
+{
+  const char* table = hexdump_table(false);
+  if (digits == 8) {
+    memcpy(out, table + (address >> 24) * 2, 2);
+    out += 2;
+  }
+  memcpy(out,     table + ((address >> 16) & 0xff) * 2, 2);
+  memcpy(out + 2, table + ((address >> 8) & 0xff) * 2, 2);
+  memcpy(out + 4, table + (address & 0xff) * 2, 2);
+  out[6] = ':';
+  out[7] = ' ';
+  return out + 8;
+}
+
+// one row of `count` bytes (count <= width)
+static char* hexdump_row(char* out, const uint8_t* data, const uint8_t* compare, size_t count,
+                         uint32_t address, int digits, const hexdump_options_t* options, size_t width)
+{
+  const char* table = hexdump_table(options->uppercase);
+  size_t i = 0;
+
+  out = hexdump_address(out, address, digits);
+
+  if (!compare) {
+    for (; i + 16 <= count; i += 16)
+      hexdump_hex16(out + i * 3, data + i, options->uppercase);
+    for (; i < count; i++) {
+      memcpy(out + i * 3, table + data[i] * 2, 2);
+      out[i * 3 + 2] = ' ';
+    }
+    out += count * 3;
+  } else {
+    for (; i < count; i++) {
+      bool differs = data[i] != compare[i];
+      if (differs && options->color) {
+        memcpy(out, HEXDUMP_HIGHLIGHT, sizeof(HEXDUMP_HIGHLIGHT) - 1);
+        out += sizeof(HEXDUMP_HIGHLIGHT) - 1;
+      }
+      memcpy(out, table + data[i] * 2, 2);
+      out += 2;
+      if (differs && options->color) {
+        memcpy(out, HEXDUMP_RESET, sizeof(HEXDUMP_RESET) - 1);
+        out += sizeof(HEXDUMP_RESET) - 1;
+      }
+      *out++ = differs && !options->color ? '*' : ' ';
+    }
+  }
+  // short last row, keep the ASCII column aligned
+  for (i = count; i < width; i++) {
+    memcpy(out, "   ", 3);
+    out += 3;
+  }
+  *out++ = ' ';
+
+  for (i = 0; i + 16 <= count; i += 16)
+    hexdump_ascii16(out + i, data + i);
+  for (; i < count; i++)
+    out[i] = data[i] >= 0x20 && data[i] < 0x7f ? (char)data[i] : '.';
+  out += count;
+  *out++ = '\n';
+  return out;
+}
+
+static bool hexdump_row_differs(const uint8_t* data, const uint8_t* compare, size_t count)
+{
+  size_t i = 0;
+#if defined(HEXDUMP_SSE2)
+  for (; i + 16 <= count; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(data + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(compare + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xffff) return true;
+  }
+#endif
+  return memcmp(data + i, compare + i, count - i) != 0;
+}
+
+size_t hexdump_write(FILE* file, const uint8_t* data, size_t length, const hexdump_options_t* options)
+{
+  static const hexdump_options_t defaults = { 0, 0, 0, NULL, false, false, false };
+  if (!options) options = &defaults;
+
+  size_t width  = options->width ? options->width : HEXDUMP_DEFAULT_WIDTH;
+  size_t stride = options->stride ? options->stride : width;
+  if (width > HEXDUMP_MAX_WIDTH || stride < width) return EINVAL;
+
+  size_t rowMax = hexdump_row_max(width);
+  int digits = (uint64_t)options->address + length > 0x1000000 ? 8 : 6;
+  char* buffer = (char*)malloc(HEXDUMP_BUFFER_LENGTH);
+  char* out = buffer;
+  size_t offset;
+  if (!buffer) return ENOMEM;
+
+  for (offset = 0; offset < length; offset += stride) {
+    size_t count = length - offset < width ? length - offset : width;
+    const uint8_t* compare = options->compare ? options->compare + offset : NULL;
+
+    if (compare && !hexdump_row_differs(data + offset, compare, count)) {
+      if (options->diffOnly) continue;
+      compare = NULL;
+    }
+    if ((size_t)(out - buffer) + rowMax > HEXDUMP_BUFFER_LENGTH) {
+      fwrite(buffer, 1, out - buffer, file);
+      out = buffer;
+    }
+    out = hexdump_row(out, data + offset, compare, count, options->address + (uint32_t)offset, digits, options, width);
+  }
+  if (out != buffer) fwrite(buffer, 1, out - buffer, file);
+  free(buffer);
+  return ferror(file) ? EIO : 0;
+}
+
+static uint8_t* hexdump_load(const char* path, size_t* length)
+{
+  uint8_t* data = load_file(path, length);
+  if (!data) LOGE(TAG, "failed to read %s %s", path, strerror(errno));
+  return data;
+}
+
+size_t hexdump_file(FILE* out, const char* path, uint32_t start, uint32_t length, const char* comparePath, const hexdump_options_t* options)
+{
+  hexdump_options_t dump = options ? *options : hexdump_options_t{ 0, 0, 0, NULL, false, false, false };
+  size_t dataLength = 0, compareLength = 0, ret;
+  uint8_t* data = hexdump_load(path, &dataLength);
+  uint8_t* compare = NULL;
+  if (!data) return EIO;
+
+  if (comparePath) {
+    compare = hexdump_load(comparePath, &compareLength);
+    if (!compare) {
+      free(data);
+      return EIO;
+    }
+    // only the part both files have can be compared
+    if (compareLength < dataLength) dataLength = compareLength;
+  }
+
+  if (start > dataLength) start = (uint32_t)dataLength;
+  if (!length || length > dataLength - start) length = (uint32_t)(dataLength - start);
+
+  dump.address = start;
+  dump.compare = compare ? compare + start : NULL;
+  ret = hexdump_write(out, data + start, length, &dump);
+
+  free(compare);
+  free(data);
+  return ret;
+}
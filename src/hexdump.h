@@ -0,0 +1,53 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Hex and ASCII dumps.
+ *
+ * Rows look like the classic hexdump():
+ *   000100: 4d 33 00 ff ...  M3..
+ * Bytes are converted 16 at a time (SSE2 where available, a lookup table otherwise)
+ * into a large buffer that is handed to stdio in one write per HEXDUMP_BUFFER_LENGTH.
+ */
+
+static const size_t HEXDUMP_DEFAULT_WIDTH = 16;
+static const size_t HEXDUMP_MAX_WIDTH     = 64;
+static const size_t HEXDUMP_BUFFER_LENGTH = 256 * 1024;
+
+typedef struct Hexdump_Options {
+  uint32_t       address;   // printed for data[0]
+  size_t         width;     // bytes per row, 0 for HEXDUMP_DEFAULT_WIDTH
+  size_t         stride;    // distance between the starts of two rows, 0 for width
+  const uint8_t* compare;   // optional, as long as data. Bytes that differ are highlighted
+  bool           diffOnly;  // with compare, only print rows that differ
+  bool           color;     // highlight with ANSI colors instead of a '*' after the byte
+  bool           uppercase;
+} hexdump_options_t;
+
+/** "xx " for every byte, returns the number of chars written (3 * length) */
+size_t hexdump_hex(char* out, const uint8_t* data, size_t length, bool uppercase);
+
+/** Dump `length` bytes of `data` to `file`. Returns 0 or errno */
+size_t hexdump_write(FILE* file, const uint8_t* data, size_t length, const hexdump_options_t* options);
+
+/** Dump part of a file, optionally against a second one. Returns 0 or errno */
+size_t hexdump_file(FILE* out, const char* path, uint32_t start, uint32_t length, const char* comparePath, const hexdump_options_t* options);
@@ -44,233 +44,218 @@ static const char* TAG = "RX8";
  */
 RX8::RX8(J2534* j2534, unsigned long devID, unsigned long chanID)
 {
+	downloading = false;
 	if(uds_request_init(&request, j2534, devID, chanID)) {
 		LOGE(TAG, "Failed to allocate UDS data");
 		request = NULL;
 	}
+	uds_session_init(&session, j2534, chanID);
+}
+
+RX8::~RX8()
+{
+	uds_session_deinit(&session);
+	if(request) {
+		uds_request_deinit(request);
+		free(request);
+	}
+	request = NULL;
 }
 
 /**
- * @brief get the VIN from the ECU
- * 
- * @param vin     pointer to a buffer to store the vin
- * @return size_t 0 on success > 0 otherwise
+ * @brief stop the TesterPresent keepalive while a burst of requests keeps the ECU awake.
+ *        the keepalive frame would otherwise interleave with multi frame transfers.
+ *        must be paired with `endTransfer()`
  */
-size_t RX8::getVIN(char** vin)
+void RX8::beginTransfer()
 {
-	if(!request) return 1;
-	size_t  ret = 1; 
-	uint8_t i   = 0;
-	*vin = (char*)malloc(VIN_LENGTH);
-	if (!(*vin)) return ENOMEM;
-	memset(*vin, 0, VIN_LENGTH);
+	uds_session_pause(&session);
+}
 
-	ret = uds_request_prepare(request);
-	if(ret) {
-		LOGE(TAG, "[getVIN] failed to prepare request %s", uds_request_error_string(request, ret));
-		goto cleanup;
+void RX8::endTransfer()
+{
+	uds_session_resume(&session);
+}
+
+// the keepalive comes back however the download ends: exit, a failed transfer or a reset
+void RX8::endDownload()
+{
+	if(!downloading) return;
+	downloading = false;
+	endTransfer();
+}
+
+/**
+ * @brief log the response time distribution of every request sent so far
+ */
+void RX8::printTimingReport()
+{
+	if(!request || !request->metrics) return;
+	metrics_report(request->metrics);
+}
+
+
+/**
+ * @brief describe a result returned by one of the rx8_result_t calls
+ */
+const char* RX8::errorString(rx8_result_t result)
+{
+	switch(result.error) {
+	case RX8_ERROR_NOT_INITIALIZED:     return "request not initialized";
+	case RX8_ERROR_UNEXPECTED_RESPONSE: return "unexpected response";
+	case RX8_ERROR_INVALID_ARGUMENT:    return "invalid argument";
+	case UDS_ERROR_NEGATIVE_RESPONSE:   return uds_negative_response_string(result.nrc);
+	default:
+		if(!request) return "request not initialized";
+		return uds_request_error_string(request, result.error);
+	}
+}
+
+/**
+ * @brief send the request filled in after `uds_request_prepare()` and check the response SID.
+ *        every failure is logged once here as `[name] ...`
+ *
+ * @param name    caller, for the log
+ * @param ackSID  positive response SID expected
+ */
+rx8_result_t RX8::exchange(const char* name, uint8_t ackSID)
+{
+	rx8_result_t result = { 0, 0 };
+	result.error = uds_request_send(request);
+	if(result.error == UDS_ERROR_NEGATIVE_RESPONSE) {
+		result.nrc = request->length > 1 ? request->payload[1] : 0;
+		LOGE(TAG, "[%s] request failed %s", name, uds_negative_response_string(result.nrc));
+	} else if(result.error) {
+		LOGE(TAG, "[%s] request failed %s", name, uds_request_error_string(request, result.error));
+	} else if(request->sid != ackSID) {
+		LOGE(TAG, "[%s] unexpected response %02X", name, request->sid);
+		result.error = RX8_ERROR_UNEXPECTED_RESPONSE;
 	}
+	return result;
+}
+
+static rx8_result_t rx8_error(size_t error)
+{
+	rx8_result_t result = { error, 0 };
+	return result;
+}
+
+/**
+ * @brief get the VIN from the ECU
+ *
+ * @param vin     filled with the VIN, null padded
+ */
+rx8_result_t RX8::readVIN(rx8_vin_t& vin)
+{
+	if(!request) return rx8_error(RX8_ERROR_NOT_INITIALIZED);
+	vin.fill(0);
 
+	uds_request_prepare(request);
 	request->sid = OBD2_SID_REQUEST_VEHICLE_INFORMATION;
 	request->payload[0] = OBD2_PID_REQUEST_VIN;
 	request->length = 1;
+	request->expectedLength = 3 + VIN_LENGTH - 1;
 
-	ret = uds_request_send(request);
-	if(ret == UDS_ERROR_NEGATIVE_RESPONSE) {
-		LOGE(TAG, "[getVIN] request failed %s", uds_request_negative_response_error_string(request));
-		goto cleanup;
-	} else if(ret) {
-		LOGE(TAG, "[getVIN] request failed %s", uds_request_error_string(request, ret));
-		goto cleanup;
-	} else if(request->sid == OBD2_SID_REQUEST_VEHICLE_INFORMATION_ACK) {
-		if(request->payload[0] != OBD2_PID_REQUEST_VIN) {
-			LOGE(TAG, "[getVIN] request failed");
-			goto cleanup;
-		}
-		if(request->payload[1] != 0x01) {
-			LOGE(TAG, "[getVIN] request failed");
-			goto cleanup;
-		}
-		request->length-=2;
-		request->payload+=2;
-		assert(request->length == VIN_LENGTH-1);
-
-		//hack: replace space characters with null. This is required for non USDM VINs.
-		for(i=0; i < request->length; i++) {
-			if(request->payload[i] == 0x20) {// ascii space character
-				request->payload[i] = 0;
-			}
-		}
-		request->length = i;
-		memcpy(*vin, request->payload, request->length);
-		return 0;
-	} else {
-		LOGE(TAG, "[getVIN] unknown error!");
-		goto cleanup;
+	rx8_result_t result = exchange("readVIN", OBD2_SID_REQUEST_VEHICLE_INFORMATION_ACK);
+	if(!result.ok()) return result;
+
+	if(request->length != 2 + VIN_LENGTH - 1 || request->payload[0] != OBD2_PID_REQUEST_VIN || request->payload[1] != 0x01) {
+		LOGE(TAG, "[readVIN] malformed response");
+		return rx8_error(RX8_ERROR_UNEXPECTED_RESPONSE);
 	}
 
-cleanup:
-	if((*vin) != NULL)
-		free(*vin);
-	*vin = NULL;
-	return ret;
+	//hack: replace space characters with null. This is required for non USDM VINs.
+	for(size_t i = 0; i < VIN_LENGTH - 1; i++)
+		vin[i] = request->payload[2 + i] == 0x20 ? 0 : (char)request->payload[2 + i];
+	return result;
 }
 
 /**
  * @brief reads the calid from the ECU
- * 
- * @param calibrationID pointer to a buffer to store the id
- * @return size_t       0 if successful, >0 if not
+ *
+ * @param calibrationID filled with the id, null terminated
  */
-size_t RX8::getCalibrationID(char** calibrationID)
+rx8_result_t RX8::readCalibrationID(rx8_calibration_id_t& calibrationID)
 {
-	if(!request) return 1;
-	size_t ret = 0;
-	*calibrationID = (char*)malloc(CALIBRATION_ID_LENGTH);
-	if (!(*calibrationID)) return ENOMEM;
-	memset(*calibrationID, 0, CALIBRATION_ID_LENGTH);
-
-	ret = uds_request_prepare(request);
-	if(ret) {
-		LOGE(TAG, "[getCalibrationID] failed to prepare request %s", uds_request_error_string(request, ret));
-		goto cleanup;
-	}
+	if(!request) return rx8_error(RX8_ERROR_NOT_INITIALIZED);
+	calibrationID.fill(0);
 
+	uds_request_prepare(request);
 	request->sid = OBD2_SID_REQUEST_VEHICLE_INFORMATION;
 	request->payload[0] = OBD2_PID_REQUEST_CALID;
 	request->length = 1;
+	request->expectedLength = 3 + CALIBRATION_ID_LENGTH - 1;
 
-	ret = uds_request_send(request);
-	if(ret == UDS_ERROR_NEGATIVE_RESPONSE) {
-		LOGE(TAG, "[getCalibrationID] request failed %s", uds_request_negative_response_error_string(request));
-		goto cleanup;
-	} else if(ret) {
-		LOGE(TAG, "[getCalibrationID] request failed %s", uds_request_error_string(request, ret));
-		goto cleanup;
-	} else if(request->sid == OBD2_SID_REQUEST_VEHICLE_INFORMATION_ACK) {
-		if(request->payload[0] != OBD2_PID_REQUEST_CALID) {
-			LOGE(TAG, "[getCalibrationID] request failed");
-			goto cleanup;
-		}
-		if(request->payload[1] != 0x01) {
-			LOGE(TAG, "[getCalibrationID] request failed");
-			goto cleanup;
-		}
-		request->length-=2;
-		request->payload+=2;
-
-		assert(request->length == CALIBRATION_ID_LENGTH-1);
-		memcpy(*calibrationID, request->payload, request->length);
-		return 0;
-	} else {
-		LOGE(TAG, "[getCalibrationID] unknown error!");
-		goto cleanup;
-	}
+	rx8_result_t result = exchange("readCalibrationID", OBD2_SID_REQUEST_VEHICLE_INFORMATION_ACK);
+	if(!result.ok()) return result;
 
-cleanup:
-	if ((*calibrationID) != NULL)
-		free(*calibrationID);
-	*calibrationID = NULL;
-	return ret;
+	if(request->length != 2 + CALIBRATION_ID_LENGTH - 1 || request->payload[0] != OBD2_PID_REQUEST_CALID || request->payload[1] != 0x01) {
+		LOGE(TAG, "[readCalibrationID] malformed response");
+		return rx8_error(RX8_ERROR_UNEXPECTED_RESPONSE);
+	}
+	memcpy(calibrationID.data(), request->payload + 2, CALIBRATION_ID_LENGTH - 1);
+	return result;
 }
 
 /**
  * @brief enter diag mode
- * 
+ *
  * @param session one of:
  * 							MAZDA_SBF_SESSION_81
  *							MAZDA_SBF_SESSION_85
  *							MAZDA_SBF_SESSION_87
- * @return size_t 0 if successful > 0 if not
  */
-size_t RX8::initDiagSession(uint8_t session)
+rx8_result_t RX8::startSession(uint8_t session)
 {
-	if(!request) return 0;
-	size_t ret = 0;
-	ret = uds_request_prepare(request);
-	if(ret) {
-		LOGE(TAG, "[initDiagSession] failed to prepare request %s", uds_request_error_string(request, ret));
-		return 0;
-	}
+	if(!request) return rx8_error(RX8_ERROR_NOT_INITIALIZED);
 
+	uds_request_prepare(request);
 	request->sid        = UDS_SID_SESSION;
 	request->payload[0] = session;
-	request->length = 1;
+	request->length     = 1;
 
-	ret = uds_request_send(request);
-	if(ret == UDS_ERROR_NEGATIVE_RESPONSE) {
-		LOGE(TAG, "[initDiagSession] request failed %s", uds_request_negative_response_error_string(request));
-		return 0;
-	} else if(ret) {
-		LOGE(TAG, "[initDiagSession] request failed %s", uds_request_error_string(request, ret));
-		return 0;
-	} else {
-		assert(request->length == 1);
-		return (request->sid == UDS_SID_SESSION_ACK) && (request->payload[0] == session);
-	}
+	rx8_result_t result = exchange("startSession", UDS_SID_SESSION_ACK);
+	if(!result.ok()) return result;
 
-	LOGE(TAG, "[initDiagSession] unknown error!");
-	return 0;
+	if(request->length != 1 || request->payload[0] != session) {
+		LOGE(TAG, "[startSession] ECU entered session %02X", request->length ? request->payload[0] : 0);
+		return rx8_error(RX8_ERROR_UNEXPECTED_RESPONSE);
+	}
+	uds_session_enter(&this->session, session);
+	return result;
 }
 
 /**
  * @brief get the seed from the ECU to be used in the unlock procedure
- * 
- * @param seed    pointer to a buffer to store the seed
- * @return size_t 0 if successful, > 0 otherwise
  */
-size_t RX8::getSeed(uint8_t** seed)
+rx8_result_t RX8::requestSeed(rx8_seed_t& seed)
 {
-	if(!request) return 1;
-	size_t ret;
-	*seed = (uint8_t*)malloc(SEED_LENGTH);
-	if (!(*seed)) return ENOMEM;
-	memset(*seed, 0, SEED_LENGTH);
-
-	ret = uds_request_prepare(request);
-	if(ret) {
-		LOGE(TAG, "[getSeed] failed to prepare request %s", uds_request_error_string(request, ret));
-		goto cleanup;
-	}
+	if(!request) return rx8_error(RX8_ERROR_NOT_INITIALIZED);
 
+	uds_request_prepare(request);
 	request->sid        = UDS_SID_SECURITY;
 	request->payload[0] = MAZDA_SBF_REQUEST_SEED;
 	request->length     = 1;
 
-	ret = uds_request_send(request);
-	if(ret == UDS_ERROR_NEGATIVE_RESPONSE) {
-		LOGE(TAG, "[getSeed] request failed %s", uds_request_negative_response_error_string(request));
-		goto cleanup;
-	} else if(ret) {
-		LOGE(TAG, "[getSeed] request failed %s", uds_request_error_string(request, ret));
-		goto cleanup;
-	} else if(request->sid == UDS_SID_SECURITY_ACK) {
-		assert(request->length == SEED_LENGTH+1);
-		memcpy(*seed, request->payload+1, SEED_LENGTH);
-		return 0;
-	} else {
-		LOGE(TAG, "[getSeed] unknown error!");
-		goto cleanup;
-	}
+	rx8_result_t result = exchange("requestSeed", UDS_SID_SECURITY_ACK);
+	if(!result.ok()) return result;
 
-cleanup:
-	if ((*seed) != NULL)
-		free(*seed);
-	*seed = NULL;
-	return ret;
+	if(request->length != SEED_LENGTH + 1) {
+		LOGE(TAG, "[requestSeed] malformed response");
+		return rx8_error(RX8_ERROR_UNEXPECTED_RESPONSE);
+	}
+	memcpy(seed.data(), request->payload + 1, SEED_LENGTH);
+	return result;
 }
+
 /**
  * @brief calculate the key with a given seed
- * 
- * @param seedInput three bytes as retrieved from the ECU
- * @param keyOut    pointer to a buffer to store the result
- * @return size_t   0 if successful, < 0 if not. (from malloc)
+ *
+ * @param seed three bytes as retrieved from the ECU
  */
-size_t RX8::calculateKey(uint8_t* seedInput, uint8_t** keyOut)
+rx8_key_t RX8::calculateKey(const rx8_seed_t& seedInput)
 {
-	*keyOut = (uint8_t*)malloc(3);
-	if (!(*keyOut)) return ENOMEM;
-
+	rx8_key_t keyOut;
 	uint8_t secret[5] = MAZDA_KEY_SECRET;
 	uint32_t seed = (seedInput[0] << 16) + (seedInput[1] << 8) + seedInput[2];
 	uint32_t or_ed_seed = ((seed & 0xFF0000) >> 16) | (seed & 0xFF00) | (secret[0] << 24) | (seed & 0xff) << 16;
@@ -289,28 +274,22 @@ size_t RX8::calculateKey(uint8_t* seedInput, uint8_t** keyOut)
 		mucked_value = v14 & 0xEF6FD7 | ((((v13 & 0x100000) >> 20) ^ ((v12 & 0x800000) >> 23)) << 20) | (((((mucked_value >> 1) & 0x8000) >> 15) ^ ((v12 & 0x800000) >> 23)) << 15) | (((((mucked_value >> 1) & 0x1000) >> 12) ^ ((v12 & 0x800000) >> 23)) << 12) | 32 * ((((mucked_value >> 1) & 0x20) >> 5) ^ ((v12 & 0x800000) >> 23)) | 8 * ((((mucked_value >> 1) & 8) >> 3) ^ ((v12 & 0x800000) >> 23));
 	}
 	uint32_t key = ((mucked_value & 0xF0000) >> 16) | 16 * (mucked_value & 0xF) | ((((mucked_value & 0xF00000) >> 20) | ((mucked_value & 0xF000) >> 8)) << 8) | ((mucked_value & 0xFF0) >> 4 << 16);
-	(*keyOut)[0] = (key & 0xff0000) >> 16;
-	(*keyOut)[1] = (key & 0xff00) >> 8;
-	(*keyOut)[2] = key & 0xff;
-	return 0;
+	keyOut[0] = (key & 0xff0000) >> 16;
+	keyOut[1] = (key & 0xff00) >> 8;
+	keyOut[2] = key & 0xff;
+	return keyOut;
 }
 
 /**
  * @brief unlock the ECU to allow read/writes
- * 
+ *
  * @param key the key calculated with the seed
- * @return size_t 1 if successful, 0 if not.
  */
-size_t RX8::unlock(uint8_t* key) 
+rx8_result_t RX8::sendKey(const rx8_key_t& key)
 {
-	if(!request) return 0;
-	size_t ret = 0;
-	ret = uds_request_prepare(request);
-	if(ret) {
-		LOGE(TAG, "[unlock] failed to prepare request %s", uds_request_error_string(request, ret));
-		return 0;
-	}
+	if(!request) return rx8_error(RX8_ERROR_NOT_INITIALIZED);
 
+	uds_request_prepare(request);
 	request->sid        = UDS_SID_SECURITY;
 	request->payload[0] = MAZDA_SBF_CHECK_KEY;
 	request->payload[1] = key[0];
@@ -318,116 +297,114 @@ size_t RX8::unlock(uint8_t* key)
 	request->payload[3] = key[2];
 	request->length     = 4;
 
-	ret = uds_request_send(request);
-	if(ret == UDS_ERROR_NEGATIVE_RESPONSE) {
-		LOGE(TAG, "[unlock] request failed %s", uds_request_negative_response_error_string(request));
-		return 0;
-	} else if(ret) {
-		LOGE(TAG, "[unlock] request failed %s", uds_request_error_string(request, ret));
-		return 0;
-	} else {
-		assert(request->length == 1);
-		return (request->sid == UDS_SID_SECURITY_ACK) && (request->payload[0] == 0x02);
+	rx8_result_t result = exchange("sendKey", UDS_SID_SECURITY_ACK);
+	if(!result.ok()) return result;
+
+	if(request->length != 1 || request->payload[0] != MAZDA_SBF_CHECK_KEY) {
+		LOGE(TAG, "[sendKey] malformed response");
+		return rx8_error(RX8_ERROR_UNEXPECTED_RESPONSE);
 	}
+	uds_session_unlocked(&session);
+	return result;
+}
 
-	LOGE(TAG, "[unlock] unknown error!");
-	return 0;
+/**
+ * @brief diag session, seed and key, as --unlock does and again after a reset
+ *
+ * @param steps  RX8_ACCESS_* to run
+ * @param failed the step that failed, 0 if none did
+ */
+rx8_result_t RX8::securityAccess(unsigned int steps, rx8_seed_t& seed, rx8_key_t& key, unsigned int* failed)
+{
+	rx8_result_t result = {};
+	*failed = 0;
+
+	if(steps & RX8_ACCESS_SESSION) {
+		result = startSession(MAZDA_SBF_SESSION_81);
+		if(result.ok()) result = startSession(MAZDA_SBF_SESSION_85);
+		if(!result.ok()) {
+			*failed = RX8_ACCESS_SESSION;
+			return result;
+		}
+	}
+	if(steps & RX8_ACCESS_SEED) {
+		result = requestSeed(seed);
+		if(!result.ok()) {
+			*failed = RX8_ACCESS_SEED;
+			return result;
+		}
+		key = calculateKey(seed);
+	}
+	if(steps & RX8_ACCESS_KEY) {
+		result = sendKey(key);
+		if(!result.ok()) *failed = RX8_ACCESS_KEY;
+	}
+	return result;
 }
 
 /**
- * @brief Reads memory at address of size ChunkSize into data
- * 
- * if address is >= 0xffff6000, the read will be from RAM. 
+ * @brief Reads memory at address into `out`, `out.length` bytes in a single request
+ *
+ * if address is >= 0xffff6000, the read will be from RAM.
  * reads between 0x80000 and 0xffff6000 are undefined, but will not error.
- * 
+ *
  * @param address - start address of the read
- * @param chunkSize - amount of data to read
- * @param data - pointer to a buffer. If this pointer is null, it will be malloc'd.
- * @return size_t 0 if successful, > 0 otherwise
+ * @param out     - caller owned buffer, at most RX8_MAX_TRANSFER_LENGTH bytes
  */
-size_t RX8::readMem(uint32_t address, uint16_t chunkSize, char* data)
+rx8_result_t RX8::readMemory(uint32_t address, rx8_span_t out)
 {
-	if(!request) return 1;
-	size_t ret = 0;
-	ret = uds_request_prepare(request);
-	if(ret) {
-		LOGE(TAG, "[unlock] failed to prepare request %s", uds_request_error_string(request, ret));
-		return ret;
-	}
+	if(!request) return rx8_error(RX8_ERROR_NOT_INITIALIZED);
+	if(out.length == 0 || out.length > RX8_MAX_TRANSFER_LENGTH) return rx8_error(RX8_ERROR_INVALID_ARGUMENT);
 
+	uds_request_prepare(request);
 	request->sid        = UDS_SID_READ_MEMORY_BY_ADDRESS;
 	request->payload[0] = 0;
 	request->payload[1] = address >> 16;
 	request->payload[2] = address >> 8;
 	request->payload[3] = address;
-	request->payload[4] = chunkSize >> 8;
-	request->payload[5] = chunkSize;
+	request->payload[4] = (uint8_t)(out.length >> 8);
+	request->payload[5] = (uint8_t)out.length;
 	request->length     = 6;
+	request->expectedLength = 1 + (uint32_t)out.length;
 
-	ret = uds_request_send(request);
-	if(ret == UDS_ERROR_NEGATIVE_RESPONSE) {
-		LOGE(TAG, "[readMem] request failed %s", uds_request_negative_response_error_string(request));
-		return 1;
-	} else if(ret) {
-		LOGE(TAG, "[readMem] request failed %s", uds_request_error_string(request, ret));
-		return 1;
-	} else if(request->sid == UDS_SID_READ_MEMORY_BY_ADDRESS_ACK) {
-		assert(request->length == chunkSize);
-		memcpy(data, request->payload, chunkSize);
-		return 0;
-	}
+	rx8_result_t result = exchange("readMemory", UDS_SID_READ_MEMORY_BY_ADDRESS_ACK);
+	if(!result.ok()) return result;
 
-	LOGE(TAG, "[readMem] unknown error!");
-	return 1;
+	if(request->length != out.length) {
+		LOGE(TAG, "[readMemory] got %u of %zu bytes", request->length, out.length);
+		return rx8_error(RX8_ERROR_UNEXPECTED_RESPONSE);
+	}
+	memcpy(out.data, request->payload, out.length);
+	return result;
 }
 
 /**
  * 7E0#04 B1 00 B2 00 00 00 00 ????
  * 7E8#03 F1 00 B2 00 00 00 00 ????
  */
-size_t RX8::requestBootloaderMode()
+rx8_result_t RX8::enterBootloader()
 {
-	if(!request) return 0;
-	size_t ret = 0;
-	ret = uds_request_prepare(request);
-	if(ret) {
-		LOGE(TAG, "[requestBootloaderMode] failed to prepare request %s", uds_request_error_string(request, ret));
-		return 0;
-	}
+	if(!request) return rx8_error(RX8_ERROR_NOT_INITIALIZED);
 
+	uds_request_prepare(request);
 	request->sid        = 0xB1;
 	request->payload[0] = 0x0;
 	request->payload[1] = 0xB2;
 	request->payload[2] = 0x0;
 	request->length     = 3;
 
-	ret = uds_request_send(request);
-	if(ret == UDS_ERROR_NEGATIVE_RESPONSE) {
-		LOGE(TAG, "[requestBootloaderMode] request failed %s", uds_request_negative_response_error_string(request));
-	} else if(ret) {
-		LOGE(TAG, "[requestBootloaderMode] request failed %s", uds_request_error_string(request, ret));
-	} else {
-		return (request->sid == 0xB1);
-	}
-
-	LOGE(TAG, "[requestBootloaderMode] unknown error!");
-	return 0;
+	return exchange("enterBootloader", 0xB1 + OBD2_ACK_OFFSET);
 }
 
 /*
 7E0#10 09 34 00 00 40 00 00 
 7E0#21 07 F8 00 00 00 00 00
 */
-size_t RX8::requestDownload(uint32_t address, uint32_t size)
+rx8_result_t RX8::startDownload(uint32_t address, uint32_t size)
 {
-	if(!request) return 0;
-	size_t ret = 0;
-	ret = uds_request_prepare(request);
-	if(ret) {
-		LOGE(TAG, "[requestDownload] failed to prepare request %s", uds_request_error_string(request, ret));
-		return 0;
-	}
+	if(!request) return rx8_error(RX8_ERROR_NOT_INITIALIZED);
 
+	uds_request_prepare(request);
 	request->sid        = UDS_SID_REQUEST_DOWNLOAD;
 	request->payload[0] = 0;
 	request->payload[1] = address >> 24;
@@ -439,105 +416,219 @@ size_t RX8::requestDownload(uint32_t address, uint32_t size)
 	request->payload[7] = size;
 	request->length     = 8;
 
-	ret = uds_request_send(request);
-	if(ret == UDS_ERROR_NEGATIVE_RESPONSE) {
-		LOGE(TAG, "[requestDownload] request failed %s", uds_request_negative_response_error_string(request));
-		return 0;
-	} else if(ret) {
-		LOGE(TAG, "[requestDownload] request failed %s", uds_request_error_string(request, ret));
-		return 0;
-	} else {
-		assert(request->length == 0x2);
-		return (request->sid == UDS_SID_REQUEST_DOWNLOAD_ACK);
+	rx8_result_t result = exchange("startDownload", UDS_SID_REQUEST_DOWNLOAD_ACK);
+	if(result.ok() && !downloading) {
+		// TransferData keeps the ECU busy until exitTransfer()
+		downloading = true;
+		beginTransfer();
 	}
-
-	LOGE(TAG, "[requestDownload] unknown error!");
-	return 0;
+	return result;
 }
 
 /*
 7E0#14 01 36 9D 6F 4D 0B 00 - 36 - transfer data
 */
-size_t RX8::transferData(uint32_t chunkSize, unsigned char* data)
+rx8_result_t RX8::transferData(rx8_const_span_t data)
 {
-	if(!request) return 1;
-	size_t ret = 1;
-	ret = uds_request_prepare(request);
-	if(ret) {
-		LOGE(TAG, "[transferData] failed to prepare request %s", uds_request_error_string(request, ret));
-		return 0;
-	}
+	if(!request) return rx8_error(RX8_ERROR_NOT_INITIALIZED);
+	if(data.length > RX8_MAX_TRANSFER_LENGTH) return rx8_error(RX8_ERROR_INVALID_ARGUMENT);
 
+	uds_request_prepare(request);
 	request->sid    = UDS_SID_TRANSFER_DATA;
-	request->length = chunkSize; 
-	memcpy(request->payload, data, chunkSize);
-
-	ret = uds_request_send(request);
-	if(ret == UDS_ERROR_NEGATIVE_RESPONSE) {
-		LOGE(TAG, "[transferData] request failed %s", uds_request_negative_response_error_string(request));
-		return 1;
-	} else if(ret) {
-		LOGE(TAG, "[transferData] request failed %s", uds_request_error_string(request, ret));
-		return 1;
-	} else {
-		return !(request->sid == UDS_SID_TRANSFER_DATA_ACK);
-	}
+	request->length = (uint32_t)data.length;
+	memcpy(request->payload, data.data, data.length);
 
-	LOGE(TAG, "[transferData] unknown error!");
-	return 1;
+	rx8_result_t result = exchange("transferData", UDS_SID_TRANSFER_DATA_ACK);
+	if(!result.ok())
+		endDownload();
+	return result;
 }
 
-size_t RX8::requestTransferExit()
+rx8_result_t RX8::exitTransfer()
 {
-	if(!request) return 0;
-	size_t ret = 0;
-	ret = uds_request_prepare(request);
-	if(ret) {
-		LOGE(TAG, "[requestTransferExit] failed to prepare request %s", uds_request_error_string(request, ret));
-		return 0;
-	}
+	if(!request) return rx8_error(RX8_ERROR_NOT_INITIALIZED);
 
+	uds_request_prepare(request);
 	request->sid    = UDS_SID_REQUEST_TRANSFER_EXIT;
-	request->length = 0; 
-
-	ret = uds_request_send(request);
-	if(ret == UDS_ERROR_NEGATIVE_RESPONSE) {
-		LOGE(TAG, "[requestTransferExit] request failed %s", uds_request_negative_response_error_string(request));
-	} else if(ret) {
-		LOGE(TAG, "[requestTransferExit] request failed %s", uds_request_error_string(request, ret));
-	} else {
-		return (request->sid == UDS_SID_REQUEST_TRANSFER_EXIT_ACK);
+	request->length = 0;
+
+	rx8_result_t result = exchange("exitTransfer", UDS_SID_REQUEST_TRANSFER_EXIT_ACK);
+	endDownload();
+	return result;
+}
+
+rx8_result_t RX8::resetECU()
+{
+	if(!request) return rx8_error(RX8_ERROR_NOT_INITIALIZED);
+
+	uds_request_prepare(request);
+	request->sid        = UDS_SID_RESET;
+	request->payload[0] = 0x01;
+	request->length     = 1;
+
+	rx8_result_t result = exchange("resetECU", UDS_SID_RESET_ACK);
+	if(result.ok()) {
+		// the ECU comes back up in the default session
+		uds_session_reset(&session);
 	}
+	endDownload();
+	return result;
+}
+
+/*
+ * Original API. These keep their return conventions and allocations for existing callers.
+ */
 
-	LOGE(TAG, "[requestTransferExit] unknown error!");
+/**
+ * @brief get the VIN from the ECU
+ * 
+ * @param vin     pointer to a buffer to store the vin
+ * @return size_t 0 on success > 0 otherwise
+ */
+size_t RX8::getVIN(char** vin)
+{
+	rx8_vin_t value;
+	rx8_result_t result = readVIN(value);
+	if(!result.ok()) {
+		*vin = NULL;
+		return result.error;
+	}
+	*vin = (char*)malloc(VIN_LENGTH);
+	if (!(*vin)) return ENOMEM;
+	memcpy(*vin, value.data(), VIN_LENGTH);
 	return 0;
 }
 
-size_t RX8::reset()
+/**
+ * @brief reads the calid from the ECU
+ * 
+ * @param calibrationID pointer to a buffer to store the id
+ * @return size_t       0 if successful, >0 if not
+ */
+size_t RX8::getCalibrationID(char** calibrationID)
 {
-	if(!request) return 0;
-	size_t ret = 0;
-	ret = uds_request_prepare(request);
-	if(ret) {
-		LOGE(TAG, "[requestTransferExit] failed to prepare request %s", uds_request_error_string(request, ret));
-		return 0;
+	rx8_calibration_id_t value;
+	rx8_result_t result = readCalibrationID(value);
+	if(!result.ok()) {
+		*calibrationID = NULL;
+		return result.error;
 	}
+	*calibrationID = (char*)malloc(CALIBRATION_ID_LENGTH);
+	if (!(*calibrationID)) return ENOMEM;
+	memcpy(*calibrationID, value.data(), CALIBRATION_ID_LENGTH);
+	return 0;
+}
 
-	request->sid        = UDS_SID_RESET;
-	request->payload[0] = 0x01;
-	request->length     = 1; 
-
-	ret = uds_request_send(request);
-	if(ret == UDS_ERROR_NEGATIVE_RESPONSE) {
-		LOGE(TAG, "[requestTransferExit] request failed %s", uds_request_negative_response_error_string(request));
-		return 0;
-	} else if(ret) {
-		LOGE(TAG, "[requestTransferExit] request failed %s", uds_request_error_string(request, ret));
-		return 0;
-	} else {
-		return (request->sid == UDS_SID_RESET_ACK);
+/**
+ * @brief enter diag mode
+ * 
+ * @return size_t 1 if successful 0 if not
+ */
+size_t RX8::initDiagSession(uint8_t session)
+{
+	return startSession(session).ok();
+}
+
+/**
+ * @brief get the seed from the ECU to be used in the unlock procedure
+ * 
+ * @param seed    pointer to a buffer to store the seed
+ * @return size_t 0 if successful, > 0 otherwise
+ */
+size_t RX8::getSeed(uint8_t** seed)
+{
+	rx8_seed_t value;
+	rx8_result_t result = requestSeed(value);
+	if(!result.ok()) {
+		*seed = NULL;
+		return result.error;
 	}
+	*seed = (uint8_t*)malloc(SEED_LENGTH);
+	if (!(*seed)) return ENOMEM;
+	memcpy(*seed, value.data(), SEED_LENGTH);
+	return 0;
+}
+
+/**
+ * @brief calculate the key with a given seed
+ * 
+ * @param seedInput three bytes as retrieved from the ECU
+ * @param keyOut    pointer to a buffer to store the result
+ * @return size_t   0 if successful, < 0 if not. (from malloc)
+ */
+size_t RX8::calculateKey(uint8_t* seedInput, uint8_t** keyOut)
+{
+	*keyOut = (uint8_t*)malloc(SEED_LENGTH);
+	if (!(*keyOut)) return ENOMEM;
 
-	LOGE(TAG, "[requestTransferExit] unknown error!");
+	rx8_seed_t seed;
+	memcpy(seed.data(), seedInput, SEED_LENGTH);
+	rx8_key_t key = calculateKey(seed);
+	memcpy(*keyOut, key.data(), SEED_LENGTH);
 	return 0;
 }
+
+/**
+ * @brief unlock the ECU to allow read/writes
+ * 
+ * @param key the key calculated with the seed
+ * @return size_t 1 if successful, 0 if not.
+ */
+size_t RX8::unlock(uint8_t* key) 
+{
+	rx8_key_t value;
+	memcpy(value.data(), key, SEED_LENGTH);
+	return sendKey(value).ok();
+}
+
+/**
+ * @brief Reads memory at address of size ChunkSize into data
+ * 
+ * @return size_t 0 if successful, > 0 otherwise
+ */
+size_t RX8::readMem(uint32_t address, uint16_t chunkSize, char* data)
+{
+	rx8_span_t out = { (uint8_t*)data, chunkSize };
+	return readMemory(address, out).error;
+}
+
+/**
+ * @return size_t 0 if successful, > 0 otherwise
+ */
+size_t RX8::requestBootloaderMode()
+{
+	return enterBootloader().error;
+}
+
+/**
+ * @return size_t 1 if successful, 0 if not.
+ */
+size_t RX8::requestDownload(uint32_t address, uint32_t size)
+{
+	return startDownload(address, size).ok();
+}
+
+/**
+ * @return size_t 0 if successful, > 0 otherwise
+ */
+size_t RX8::transferData(uint32_t chunkSize, unsigned char* data)
+{
+	rx8_const_span_t in = { data, chunkSize };
+	return transferData(in).error;
+}
+
+/**
+ * @return size_t 1 if successful, 0 if not.
+ */
+size_t RX8::requestTransferExit()
+{
+	return exitTransfer().ok();
+}
+
+/**
+ * @return size_t 1 if successful, 0 if not.
+ */
+size_t RX8::reset()
+{
+	return resetECU().ok();
+}
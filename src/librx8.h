@@ -16,9 +16,13 @@ limitations under the License.
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
+
+#include <array>
 
 #include "J2534.h"
 #include "UDS.h"
+#include "session.h"
 
 // 17 characters + a null terminator
 static const uint8_t VIN_LENGTH = 18;
@@ -44,13 +48,112 @@ static const uint16_t MAZDA_SBL_LENGTH      = 6144;
 static const uint16_t MAZDA_ROM_START_OFFSET = 0x2000;
 static const uint32_t MAZDA_ROM_LENGTH      = 516096 + MAZDA_ROM_START_OFFSET;
 
+// largest readMemory()/transferData() that fits in one PASSTHRU_MSG next to the CAN ID and SID
+static const uint16_t RX8_MAX_TRANSFER_LENGTH = PM_DATA_LEN - 5;
+
+// null terminated, shorter VINs are padded with nulls
+typedef std::array<char, VIN_LENGTH>            rx8_vin_t;
+typedef std::array<char, CALIBRATION_ID_LENGTH> rx8_calibration_id_t;
+typedef std::array<uint8_t, SEED_LENGTH>        rx8_seed_t;
+typedef std::array<uint8_t, SEED_LENGTH>        rx8_key_t;
+
+// errors that come from neither the passthru device (< UDS_ERROR_START) nor uds_error
+static const size_t RX8_ERROR_START = 0x200;
+enum rx8_error {
+	/* the request object could not be allocated */
+	RX8_ERROR_NOT_INITIALIZED     = RX8_ERROR_START+1,
+	/* positive response that does not answer the request */
+	RX8_ERROR_UNEXPECTED_RESPONSE = RX8_ERROR_START+2,
+	RX8_ERROR_INVALID_ARGUMENT    = RX8_ERROR_START+3,
+};
+
+typedef struct RX8_Result {
+	/* 0, a passthru error, a uds_error or a rx8_error */
+	size_t  error;
+	/* negative response code, only set when error is UDS_ERROR_NEGATIVE_RESPONSE */
+	uint8_t nrc;
+
+	bool ok() const { return error == 0; }
+} rx8_result_t;
+
+/* steps of RX8::securityAccess(), or-ed together to pick the ones to run */
+enum rx8_access_step {
+	/* diag sessions 0x81 then 0x85 */
+	RX8_ACCESS_SESSION = 1 << 0,
+	/* request the seed and calculate the key */
+	RX8_ACCESS_SEED    = 1 << 1,
+	/* send the key */
+	RX8_ACCESS_KEY     = 1 << 2,
+	RX8_ACCESS_ALL     = RX8_ACCESS_SESSION | RX8_ACCESS_SEED | RX8_ACCESS_KEY,
+};
+
+/* caller owned memory for readMemory()/transferData() */
+typedef struct RX8_Span {
+	uint8_t* data;
+	size_t   length;
+} rx8_span_t;
+
+typedef struct RX8_Const_Span {
+	const uint8_t* data;
+	size_t         length;
+} rx8_const_span_t;
+
 class RX8
 {
 private:
 	uds_request_t* request;
+	uds_session_t  session;
+	// startDownload() paused the keepalive, until the download ends one way or another
+	bool           downloading;
+
+	rx8_result_t exchange(const char* name, uint8_t ackSID);
+	void endDownload();
 
 public:
 	RX8(J2534* j2534, unsigned long devID, unsigned long chanID);
+	~RX8();
+
+	/** Current diag session and security state */
+	uds_session_state_t sessionState() const { return session.state; }
+
+	/** Pause the TesterPresent keepalive around a burst of readMem()/transferData() calls */
+	void beginTransfer();
+	void endTransfer();
+
+	/** Log per service response times and request phases. See metrics.h */
+	void printTimingReport();
+
+	/** Describe a result for logging */
+	const char* errorString(rx8_result_t result);
+
+	/* Every call below writes into caller owned memory and never allocates */
+
+	rx8_result_t readVIN(rx8_vin_t& vin);
+	rx8_result_t readCalibrationID(rx8_calibration_id_t& calibrationID);
+
+	/** One of MAZDA_SBF_SESSION_81, MAZDA_SBF_SESSION_85, MAZDA_SBF_SESSION_87 */
+	rx8_result_t startSession(uint8_t session);
+
+	rx8_result_t requestSeed(rx8_seed_t& seed);
+	static rx8_key_t calculateKey(const rx8_seed_t& seed);
+	rx8_result_t sendKey(const rx8_key_t& key);
+
+	/**
+	 * Programming session and security access, the `steps` of it in order. Without
+	 * RX8_ACCESS_SEED the key sent is the one passed in. `failed` gets the step that failed
+	 */
+	rx8_result_t securityAccess(unsigned int steps, rx8_seed_t& seed, rx8_key_t& key, unsigned int* failed);
+
+	/** Read `out.length` bytes at `address` in one request. ECU must be unlocked */
+	rx8_result_t readMemory(uint32_t address, rx8_span_t out);
+
+	rx8_result_t enterBootloader();
+	rx8_result_t startDownload(uint32_t address, uint32_t size);
+	rx8_result_t transferData(rx8_const_span_t data);
+	rx8_result_t exitTransfer();
+	rx8_result_t resetECU();
+
+	/* Original API, kept as wrappers of the calls above. Buffers returned through `**` must be free()d */
 
 	/** Get the VIN stored in the ECU*/
 	size_t getVIN(char** vin);
@@ -0,0 +1,224 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "log.h"
+// log_location, shared with the legacy debug()/error() macros
+#include "util.h"
+
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+// Windows console doesn't support colors
+#define ANSI_COLOR_RED     ""
+#define ANSI_COLOR_YELLOW  ""
+#define ANSI_COLOR_MAGENTA ""
+#define ANSI_COLOR_CYAN    ""
+#define ANSI_COLOR_RESET   ""
+#else
+#define ANSI_COLOR_RED     "\x1b[31m"
+#define ANSI_COLOR_YELLOW  "\x1b[33m"
+#define ANSI_COLOR_MAGENTA "\x1b[35m"
+#define ANSI_COLOR_CYAN    "\x1b[36m"
+#define ANSI_COLOR_RESET   "\x1b[0m"
+#endif
+
+// bytes the writer collects before handing them to stdio
+static const size_t LOG_WRITE_BATCH = 32 * 1024;
+
+// the writer wakes up on its own this often, producers only wake it for errors or a filling ring,
+// which batches bursts of lines into a single write
+static const int LOG_FLUSH_INTERVAL_MS = 10;
+static const size_t LOG_WAKE_THRESHOLD = LOG_QUEUE_LENGTH / 4;
+
+static const char* log_colors[] = {
+  "", ANSI_COLOR_RED, ANSI_COLOR_YELLOW, ANSI_COLOR_CYAN, ANSI_COLOR_MAGENTA,
+};
+
+typedef struct Log_Record {
+  // Vyukov style: equals the slot's position when free, position + 1 once written
+  std::atomic<size_t> sequence;
+  uint16_t length;
+  char text[LOG_RECORD_LENGTH];
+} log_record_t;
+
+static struct {
+  log_record_t ring[LOG_QUEUE_LENGTH];
+  std::atomic<size_t> head;  // next position a producer claims
+  size_t tail;               // next position the writer reads, writer only
+  std::atomic<size_t> tailHint;  // tail as of the writer's last pass, for producers
+
+  std::atomic<bool> running;
+  std::atomic<bool> idle;    // writer is, or is about to be, waiting on wake
+  std::mutex lock;
+  std::condition_variable wake;
+  std::thread writer;
+  bool registered;
+} logger;
+
+int log_level = LOG_LEVEL_INFO;
+
+void log_set_level(int level)
+{
+  log_level = level;
+}
+
+// "[TAG] message\r\n", truncated to fit a record
+static uint16_t log_format(char* out, int level, const char* tag, const char* format, va_list args)
+{
+  size_t room = LOG_RECORD_LENGTH - 2;
+  int n = snprintf(out, room, "[%s%s" ANSI_COLOR_RESET "] ",
+    log_colors[level < LOG_LEVEL_ERROR || level > LOG_LEVEL_DEBUG ? 0 : level], tag);
+  size_t length = n < 0 ? 0 : (size_t)n >= room ? room - 1 : (size_t)n;
+
+  n = vsnprintf(out + length, room - length, format, args);
+  length += n < 0 ? 0 : (size_t)n >= room - length ? room - length - 1 : (size_t)n;
+
+  // callers coming from printf style code may end their lines themselves
+  while (length && (out[length - 1] == '\n' || out[length - 1] == '\r')) length--;
+  out[length++] = '\r';
+  out[length++] = '\n';
+  return (uint16_t)length;
+}
+
+static void log_writer()
+{
+  static char batch[LOG_WRITE_BATCH];
+  size_t used = 0;
+
+  for (;;) {
+    log_record_t* record = &logger.ring[logger.tail & (LOG_QUEUE_LENGTH - 1)];
+    size_t sequence = record->sequence.load(std::memory_order_acquire);
+
+    if (sequence == logger.tail + 1) {
+      if (used + record->length > sizeof(batch)) {
+        fwrite(batch, 1, used, log_location);
+        used = 0;
+      }
+      memcpy(batch + used, record->text, record->length);
+      used += record->length;
+      record->sequence.store(logger.tail + LOG_QUEUE_LENGTH, std::memory_order_release);
+      logger.tail++;
+      continue;
+    }
+
+    // queue drained, put everything on the console before waiting
+    logger.tailHint.store(logger.tail, std::memory_order_relaxed);
+    if (used) {
+      fwrite(batch, 1, used, log_location);
+      fflush(log_location);
+      used = 0;
+    }
+    if (!logger.running.load(std::memory_order_acquire)) {
+      // a producer may have claimed a slot but not finished writing it yet
+      if (logger.head.load(std::memory_order_acquire) == logger.tail) break;
+      std::this_thread::yield();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> guard(logger.lock);
+    logger.idle.store(true, std::memory_order_seq_cst);
+    record = &logger.ring[logger.tail & (LOG_QUEUE_LENGTH - 1)];
+    if (record->sequence.load(std::memory_order_seq_cst) != logger.tail + 1 &&
+        logger.running.load(std::memory_order_acquire))
+      logger.wake.wait_for(guard, std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+    logger.idle.store(false, std::memory_order_relaxed);
+  }
+}
+
+void log_start()
+{
+  size_t i;
+  if (logger.running.load()) return;
+
+  for (i = 0; i < LOG_QUEUE_LENGTH; i++)
+    logger.ring[i].sequence.store(i, std::memory_order_relaxed);
+  logger.head.store(0, std::memory_order_relaxed);
+  logger.tail = 0;
+  logger.tailHint.store(0, std::memory_order_relaxed);
+  logger.running.store(true, std::memory_order_release);
+  logger.writer = std::thread(log_writer);
+
+  if (!logger.registered) {
+    atexit(log_stop);
+    logger.registered = true;
+  }
+}
+
+void log_stop()
+{
+  if (!logger.running.exchange(false)) return;
+  {
+    std::lock_guard<std::mutex> guard(logger.lock);
+    logger.wake.notify_one();
+  }
+  logger.writer.join();
+}
+
+void log_vwrite(int level, const char* tag, const char* format, va_list args)
+{
+  if (!logger.running.load(std::memory_order_acquire)) {
+    char line[LOG_RECORD_LENGTH];
+    uint16_t length = log_format(line, level, tag, format, args);
+    fwrite(line, 1, length, log_location);
+    fflush(log_location);
+    return;
+  }
+
+  // claim a slot
+  size_t position = logger.head.load(std::memory_order_relaxed);
+  log_record_t* record;
+  for (;;) {
+    record = &logger.ring[position & (LOG_QUEUE_LENGTH - 1)];
+    size_t sequence = record->sequence.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+    if (diff == 0) {
+      if (logger.head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      // full, let the writer catch up
+      std::this_thread::yield();
+      position = logger.head.load(std::memory_order_relaxed);
+    } else {
+      position = logger.head.load(std::memory_order_relaxed);
+    }
+  }
+
+  record->length = log_format(record->text, level, tag, format, args);
+  // seq_cst pairs with the writer setting idle before it looks at the slot one last time
+  record->sequence.store(position + 1, std::memory_order_seq_cst);
+
+  if ((level == LOG_LEVEL_ERROR || position - logger.tailHint.load(std::memory_order_relaxed) >= LOG_WAKE_THRESHOLD) &&
+      logger.idle.load(std::memory_order_seq_cst)) {
+    std::lock_guard<std::mutex> guard(logger.lock);
+    logger.wake.notify_one();
+  }
+}
+
+void log_write(int level, const char* tag, const char* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  log_vwrite(level, tag, format, args);
+  va_end(args);
+}
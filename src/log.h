@@ -0,0 +1,91 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Logging.
+ *
+ * LOGE/LOGW/LOGI/LOGD format the line on the calling thread straight into a slot of a
+ * lock-free ring, a background thread writes the slots to stderr in batches. Callers
+ * never touch the console, so verbose and debug output during a dump costs one
+ * vsnprintf per line. Until log_start() is called lines are written synchronously
+ * with a single fwrite, if the ring is full the caller waits for the writer.
+ *
+ * Levels above LOG_COMPILE_LEVEL compile to nothing, levels above log_set_level()
+ * cost one compare.
+ */
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// one formatted line including the tag, longer lines are truncated
+static const size_t LOG_RECORD_LENGTH = 480;
+
+// number of lines the writer can fall behind, must be a power of two
+static const size_t LOG_QUEUE_LENGTH = 2048;
+
+extern int log_level;
+
+static inline bool log_enabled(int level)
+{
+  return level <= log_level;
+}
+
+void log_set_level(int level);
+
+/** Start the writer thread. log_stop() drains the queue, it also runs at exit */
+void log_start();
+void log_stop();
+
+void log_write(int level, const char* tag, const char* format, ...);
+void log_vwrite(int level, const char* tag, const char* format, va_list args);
+
+#define LOG_AT(LEVEL, TAG, ...) do { if (log_enabled(LEVEL)) log_write(LEVEL, TAG, __VA_ARGS__); } while(0)
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_ERROR
+#define LOGE(TAG, ...) LOG_AT(LOG_LEVEL_ERROR, TAG, __VA_ARGS__)
+#else
+#define LOGE(TAG, ...) do {} while(0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_WARN
+#define LOGW(TAG, ...) LOG_AT(LOG_LEVEL_WARN, TAG, __VA_ARGS__)
+#else
+#define LOGW(TAG, ...) do {} while(0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_INFO
+#define LOGI(TAG, ...) LOG_AT(LOG_LEVEL_INFO, TAG, __VA_ARGS__)
+#else
+#define LOGI(TAG, ...) do {} while(0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_DEBUG
+#define LOGD(TAG, ...) LOG_AT(LOG_LEVEL_DEBUG, TAG, __VA_ARGS__)
+#else
+#define LOGD(TAG, ...) do {} while(0)
+#endif
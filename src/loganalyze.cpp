@@ -0,0 +1,431 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "loganalyze.h"
+#include "mapfile.h"
+#include "util.h"
+
+static const char* TAG = "Loganalyze";
+
+typedef struct Loganalyze_Log {
+  mapfile_t map;
+  size_t    body;       // offset of the first row after the header
+  size_t    numFields;
+  int*      fields;     // channel of each header field, -1 for none
+  size_t    lastField;  // rows need at least this many fields + 1
+  bool      present[CELLTRACE_MAX_CHANNELS];
+  float     scale[CELLTRACE_MAX_CHANNELS];
+  float     offset[CELLTRACE_MAX_CHANNELS];
+} loganalyze_log_t;
+
+typedef struct Loganalyze_Unit {
+  size_t log;
+  size_t begin;
+  size_t end;
+} loganalyze_unit_t;
+
+typedef struct Loganalyze_Worker {
+  celltrace_t trace;
+  unsigned index;
+  uint64_t rows;
+  uint64_t badRows;
+  float columns[CELLTRACE_MAX_CHANNELS][CELLTRACE_BATCH];
+} loganalyze_worker_t;
+
+typedef struct Loganalyze_Job {
+  const loganalyze_log_t*  logs;
+  const loganalyze_unit_t* units;
+  size_t numUnits;
+  loganalyze_batch_fn fn;
+  void* ctx;
+  std::atomic<size_t> next;
+} loganalyze_job_t;
+
+float loganalyze_parse_float(const char* s, const char* end)
+{
+  static const double powers[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+  uint64_t mantissa = 0;
+  int exponent = 0, digits = 0;
+  bool negative = false;
+
+  while (s < end && (*s == ' ' || *s == '\t' || *s == '"')) s++;
+  if (s < end && (*s == '-' || *s == '+')) negative = *s++ == '-';
+  // digits past what fits in the mantissa only move the exponent
+  for (; s < end && (unsigned)(*s - '0') < 10; s++, digits++) {
+    if (mantissa < 100000000000000000ull) mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+    else exponent++;
+  }
+  if (s < end && *s == '.') {
+    for (s++; s < end && (unsigned)(*s - '0') < 10; s++, digits++) {
+      if (mantissa < 100000000000000000ull) {
+        mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+        exponent--;
+      }
+    }
+  }
+  if (!digits) return NAN;
+  if (s < end && (*s == 'e' || *s == 'E')) {
+    bool negativeExponent = false;
+    int e = 0;
+    s++;
+    if (s < end && (*s == '-' || *s == '+')) negativeExponent = *s++ == '-';
+    for (; s < end && (unsigned)(*s - '0') < 10; s++)
+      if (e < 1000) e = e * 10 + (*s - '0');
+    exponent += negativeExponent ? -e : e;
+  }
+
+  double value = (double)mantissa;
+  if (exponent < 0)
+    value = exponent >= -22 ? value / powers[-exponent] : value * pow(10.0, exponent);
+  else if (exponent > 0)
+    value = exponent <= 22 ? value * powers[exponent] : value * pow(10.0, exponent);
+  return (float)(negative ? -value : value);
+}
+
+// header field without surrounding spaces and quotes equals `name`, ignoring case
+static bool loganalyze_field_is(const char* field, const char* end, const char* name)
+{
+  while (field < end && (*field == ' ' || *field == '"')) field++;
+  while (end > field && (end[-1] == ' ' || end[-1] == '"' || end[-1] == '\r')) end--;
+  size_t length = strlen(name);
+  if ((size_t)(end - field) != length) return false;
+  for (size_t i = 0; i < length; i++)
+    if (tolower((unsigned char)field[i]) != tolower((unsigned char)name[i])) return false;
+  return true;
+}
+
+// map a log and match its header to the channels. Returns 0, or ENOENT if no channel is in it
+static size_t loganalyze_open(loganalyze_log_t* log, const char* path, const celltrace_t* trace)
+{
+  size_t ret;
+  memset(log, 0, sizeof(loganalyze_log_t));
+  if ((ret = mapfile_open(&log->map, path))) return ret;
+
+  const char* data = (const char*)log->map.data;
+  const char* eol  = data ? (const char*)memchr(data, '\n', log->map.length) : NULL;
+  if (!eol) return ENOENT;
+  log->body = (size_t)(eol - data) + 1;
+
+  log->numFields = 1;
+  for (const char* p = data; p < eol; p++) log->numFields += *p == ',';
+  log->fields = (int*)malloc(log->numFields * sizeof(int));
+  if (!log->fields) return ENOMEM;
+
+  bool matched = false;
+  const char* field = data;
+  for (size_t f = 0; f < log->numFields; f++) {
+    const char* comma = (const char*)memchr(field, ',', (size_t)(eol - field));
+    const char* end = comma ? comma : eol;
+    log->fields[f] = -1;
+    for (size_t c = 0; c < trace->numChannels; c++) {
+      const celltrace_channel_t* channel = &trace->channels[c];
+      if (log->present[c] || channel->source == CELLTRACE_SOURCE_DIFFERENCE) continue;
+      if (!loganalyze_field_is(field, end, channel->column[0] ? channel->column : channel->name)) continue;
+      // RAM channels are logged in display units already, only columns are scaled
+      bool column = channel->source == CELLTRACE_SOURCE_COLUMN;
+      log->fields[f]    = (int)c;
+      log->lastField    = f;
+      log->present[c]   = true;
+      log->scale[c]     = column ? channel->scale : 1;
+      log->offset[c]    = column ? channel->offset : 0;
+      matched = true;
+      break;
+    }
+    field = end + 1;
+  }
+  return matched ? 0 : ENOENT;
+}
+
+static void loganalyze_close(loganalyze_log_t* log)
+{
+  free(log->fields);
+  mapfile_close(&log->map);
+}
+
+static void loganalyze_add(const loganalyze_job_t* job, loganalyze_worker_t* worker, const float* const* columns, size_t count)
+{
+  celltrace_add(&worker->trace, columns, count);
+  if (job->fn) job->fn(job->ctx, worker->index, columns, count);
+}
+
+static void loganalyze_unit(const loganalyze_job_t* job, loganalyze_worker_t* worker, const loganalyze_log_t* log,
+                            const loganalyze_unit_t* unit)
+{
+  const char* p   = (const char*)log->map.data + unit->begin;
+  const char* end = (const char*)log->map.data + unit->end;
+  const float* columns[CELLTRACE_MAX_CHANNELS];
+  size_t numChannels = worker->trace.numChannels, n = 0;
+
+  for (size_t c = 0; c < numChannels; c++)
+    columns[c] = log->present[c] ? worker->columns[c] : NULL;
+
+  while (p < end) {
+    const char* eol = (const char*)memchr(p, '\n', (size_t)(end - p));
+    if (!eol) eol = end;
+    if (eol - p <= 1) {   // blank line, or just the \r of one
+      p = eol + 1;
+      continue;
+    }
+
+    const char* field = p;
+    size_t f = 0;
+    for (size_t c = 0; c < numChannels; c++)
+      worker->columns[c][n] = NAN;
+    while (f <= log->lastField) {
+      const char* comma = (const char*)memchr(field, ',', (size_t)(eol - field));
+      const char* fieldEnd = comma ? comma : eol;
+      int c = log->fields[f++];
+      if (c >= 0) worker->columns[c][n] = loganalyze_parse_float(field, fieldEnd) * log->scale[c] + log->offset[c];
+      if (!comma) break;
+      field = comma + 1;
+    }
+    if (f <= log->lastField) worker->badRows++;
+    worker->rows++;
+    if (++n == CELLTRACE_BATCH) {
+      loganalyze_add(job, worker, columns, n);
+      n = 0;
+    }
+    p = eol + 1;
+  }
+  if (n) loganalyze_add(job, worker, columns, n);
+}
+
+static void loganalyze_worker(loganalyze_job_t* job, loganalyze_worker_t* worker)
+{
+  for (;;) {
+    size_t u = job->next.fetch_add(1);
+    if (u >= job->numUnits) return;
+    loganalyze_unit(job, worker, &job->logs[job->units[u].log], &job->units[u]);
+  }
+}
+
+// cut the rows of every log into units that end on a line break
+static loganalyze_unit_t* loganalyze_split(const loganalyze_log_t* logs, size_t numLogs, size_t* numUnits)
+{
+  size_t capacity = 0;
+  *numUnits = 0;
+  for (size_t l = 0; l < numLogs; l++)
+    if (logs[l].fields) capacity += logs[l].map.length / LOGANALYZE_CHUNK + 1;
+
+  loganalyze_unit_t* units = (loganalyze_unit_t*)malloc((capacity ? capacity : 1) * sizeof(loganalyze_unit_t));
+  if (!units) return NULL;
+  for (size_t l = 0; l < numLogs; l++) {
+    const loganalyze_log_t* log = &logs[l];
+    if (!log->fields) continue;
+    const char* data = (const char*)log->map.data;
+    for (size_t begin = log->body; begin < log->map.length;) {
+      size_t end = begin + LOGANALYZE_CHUNK;
+      if (end >= log->map.length) {
+        end = log->map.length;
+      } else {
+        const char* eol = (const char*)memchr(data + end, '\n', log->map.length - end);
+        end = eol ? (size_t)(eol - data) + 1 : log->map.length;
+      }
+      units[(*numUnits)++] = loganalyze_unit_t{ l, begin, end };
+      begin = end;
+    }
+  }
+  return units;
+}
+
+size_t loganalyze_paths(const char* spec, char*** paths, size_t* count)
+{
+  char path[1024];
+  *paths = NULL;
+  *count = 0;
+
+  for (const char* s = spec; *s;) {
+    const char* comma = strchr(s, ',');
+    size_t length = comma ? (size_t)(comma - s) : strlen(s);
+    snprintf(path, sizeof(path), "%.*s", (int)length, s);
+    s += length + (comma ? 1 : 0);
+    if (!path[0]) continue;
+
+    struct stat st;
+    if (stat(path, &st)) {
+      LOGE(TAG, "%s %s", path, strerror(errno));
+      free_list(*paths, *count);
+      return ENOENT;
+    }
+    char** found = NULL;
+    size_t numFound = 0;
+    if ((st.st_mode & S_IFMT) == S_IFDIR) {
+      if (!(found = list_files(path, ".csv", &numFound))) {
+        LOGE(TAG, "failed to list %s %s", path, strerror(errno));
+        free_list(*paths, *count);
+        return errno ? errno : EIO;
+      }
+    }
+
+    char** grown = (char**)realloc(*paths, (*count + (found ? numFound : 1)) * sizeof(char*));
+    if (!grown) {
+      if (found) free_list(found, numFound);
+      free_list(*paths, *count);
+      return ENOMEM;
+    }
+    *paths = grown;
+    if (found) {
+      memcpy(*paths + *count, found, numFound * sizeof(char*));
+      *count += numFound;
+      free(found);
+    } else {
+      (*paths)[(*count)++] = strdup(path);
+    }
+  }
+  return *count ? 0 : ENOENT;
+}
+
+unsigned loganalyze_threads(unsigned threads)
+{
+  if (!threads) threads = std::thread::hardware_concurrency();
+  return threads ? threads : 1;
+}
+
+size_t loganalyze_run(celltrace_t* trace, char* const* paths, size_t numPaths, unsigned threads, loganalyze_stats_t* stats)
+{
+  return loganalyze_replay(trace, paths, numPaths, threads, NULL, NULL, stats);
+}
+
+size_t loganalyze_replay(celltrace_t* trace, char* const* paths, size_t numPaths, unsigned threads,
+                         loganalyze_batch_fn fn, void* ctx, loganalyze_stats_t* stats)
+{
+  uint64_t start = monotonic_us();
+  loganalyze_log_t* logs = (loganalyze_log_t*)calloc(numPaths ? numPaths : 1, sizeof(loganalyze_log_t));
+  loganalyze_worker_t* workers = NULL;
+  loganalyze_unit_t* units = NULL;
+  loganalyze_job_t job;
+  size_t numUnits = 0, opened = 0, ret = 0;
+
+  memset(stats, 0, sizeof(loganalyze_stats_t));
+  if (!logs) return ENOMEM;
+  for (size_t l = 0; l < numPaths; l++) {
+    ret = loganalyze_open(&logs[l], paths[l], trace);
+    opened++;
+    if (ret == ENOMEM) goto done;
+    if (ret) {
+      LOGI(TAG, "skipping %s, no header or no column of a channel", paths[l]);
+      stats->skippedFiles++;
+      free(logs[l].fields);
+      logs[l].fields = NULL;
+      continue;
+    }
+    stats->files++;
+    stats->bytes += logs[l].map.length;
+  }
+  ret = 0;
+  if (!(units = loganalyze_split(logs, numPaths, &numUnits))) {
+    ret = ENOMEM;
+    goto done;
+  }
+
+  threads = loganalyze_threads(threads);
+  if (threads > numUnits) threads = numUnits ? (unsigned)numUnits : 1;
+  stats->threads = threads;
+
+  workers = (loganalyze_worker_t*)calloc(threads, sizeof(loganalyze_worker_t));
+  if (!workers) {
+    ret = ENOMEM;
+    goto done;
+  }
+  for (unsigned t = 0; t < threads && !ret; t++) {
+    workers[t].index = t;
+    ret = celltrace_clone(&workers[t].trace, trace);
+  }
+  if (ret) goto done;
+
+  job.logs     = logs;
+  job.units    = units;
+  job.numUnits = numUnits;
+  job.fn       = fn;
+  job.ctx      = ctx;
+  job.next     = 0;
+  {
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++)
+      pool.push_back(std::thread(loganalyze_worker, &job, &workers[t]));
+    loganalyze_worker(&job, &workers[0]);
+    for (size_t t = 0; t < pool.size(); t++)
+      pool[t].join();
+  }
+
+  for (unsigned t = 0; t < threads; t++) {
+    celltrace_merge(trace, &workers[t].trace);
+    stats->rows    += workers[t].rows;
+    stats->badRows += workers[t].badRows;
+  }
+
+done:
+  if (workers) {
+    for (unsigned t = 0; t < threads; t++)
+      celltrace_free(&workers[t].trace);
+    free(workers);
+  }
+  for (size_t l = 0; l < opened; l++)
+    loganalyze_close(&logs[l]);
+  free(logs);
+  free(units);
+  stats->elapsedUs = monotonic_us() - start;
+  return ret;
+}
+
+size_t loganalyze_report(const celltrace_t* trace, const loganalyze_stats_t* stats, const char* csvPath)
+{
+  if (stats->badRows)
+    LOGI(TAG, "%llu rows have fewer fields than their header", (unsigned long long)stats->badRows);
+  LOGI(TAG, "%zu logs (%zu skipped), %.1f MB, %llu rows in %.3fs on %u threads, %.0f MB/s", stats->files,
+       stats->skippedFiles, (double)stats->bytes / 1e6, (unsigned long long)stats->rows,
+       (double)stats->elapsedUs / 1e6, stats->threads,
+       stats->elapsedUs ? (double)stats->bytes / (double)stats->elapsedUs : 0.0);
+
+  size_t ret = celltrace_save_csv(trace, csvPath);
+  if (!ret)
+    LOGI(TAG, "%zu cells visited. Wrote %s", celltrace_cells_visited(trace), csvPath);
+  return ret;
+}
+
+size_t loganalyze_logs(celltrace_t* trace, const char* logs, unsigned threads, const char* csvPath)
+{
+  loganalyze_stats_t stats;
+  char** paths = NULL;
+  size_t numPaths = 0;
+
+  if (loganalyze_paths(logs, &paths, &numPaths)) {
+    LOGE(TAG, "No logs in %s", logs);
+    return ENOENT;
+  }
+  size_t ret = loganalyze_run(trace, paths, numPaths, threads, &stats);
+  free_list(paths, numPaths);
+  if (ret) {
+    LOGE(TAG, "Analyzing logs failed %s", strerror((int)ret));
+    return ret;
+  }
+  return loganalyze_report(trace, &stats, csvPath);
+}
@@ -0,0 +1,85 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "celltrace.h"
+
+/* Offline log analysis.
+ *
+ * Runs recorded CSV logs (RomRaider logger, or anything with a header row and one
+ * sample per line) through a celltrace, the same way live samples go through it.
+ * The header of every log is matched against the channels: a `column` channel by
+ * its column name, any other by the channel name, ignoring case. Columns a log
+ * doesn't have are NaN for its rows, so tables on those channels skip them.
+ *
+ * Logs are memory mapped and cut into work units of about LOGANALYZE_CHUNK bytes
+ * that end on a line break. Worker threads take the next unit, parse it straight
+ * into CELLTRACE_BATCH sample columns and add them to their own clone of the
+ * celltrace. The clones are merged into the celltrace at the end, so the result
+ * is the same for any number of threads.
+ */
+
+// big enough that the per unit overhead disappears, small enough to keep threads busy at the end
+static const size_t LOGANALYZE_CHUNK = 4 * 1024 * 1024;
+
+typedef struct Loganalyze_Stats {
+  size_t   files;
+  size_t   skippedFiles;  // no header, or no column any table uses
+  uint64_t bytes;
+  uint64_t rows;
+  uint64_t badRows;       // fewer fields than the header
+  unsigned threads;
+  uint64_t elapsedUs;
+} loganalyze_stats_t;
+
+/**
+ * Comma separated files and directories into a list of files, directories add their
+ * *.csv files. Free with free_list(). Returns 0 or errno
+ */
+size_t loganalyze_paths(const char* spec, char*** paths, size_t* count);
+
+/**
+ * Called by every worker with each batch of up to CELLTRACE_BATCH rows it parsed, after
+ * adding them to its celltrace. `columns` are as for celltrace_add(), `worker` is below
+ * loganalyze_threads()
+ */
+typedef void (*loganalyze_batch_fn)(void* ctx, unsigned worker, const float* const* columns, size_t count);
+
+/** Add every row of the logs to `trace` with `threads` workers, 0 for one per core. Returns 0 or errno */
+size_t loganalyze_run(celltrace_t* trace, char* const* paths, size_t numPaths, unsigned threads, loganalyze_stats_t* stats);
+
+/** loganalyze_run(), also handing every batch to `fn` */
+size_t loganalyze_replay(celltrace_t* trace, char* const* paths, size_t numPaths, unsigned threads,
+                         loganalyze_batch_fn fn, void* ctx, loganalyze_stats_t* stats);
+
+/** Log what a loganalyze_run() read, then write the cells of `trace` to `csvPath`. Returns 0 or errno */
+size_t loganalyze_report(const celltrace_t* trace, const loganalyze_stats_t* stats, const char* csvPath);
+
+/**
+ * The comma separated files and directories in `logs` through `trace` with `threads` workers,
+ * then loganalyze_report(). Returns 0 or errno
+ */
+size_t loganalyze_logs(celltrace_t* trace, const char* logs, unsigned threads, const char* csvPath);
+
+/** Most workers loganalyze_run() starts for `threads` */
+unsigned loganalyze_threads(unsigned threads);
+
+/** Parse a decimal number like "-12.5e3" at `s`, up to `end`. NaN if there is none. Skips spaces and quotes */
+float loganalyze_parse_float(const char* s, const char* end);
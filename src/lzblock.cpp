@@ -0,0 +1,180 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+
+#include "lzblock.h"
+
+static const size_t   LZBLOCK_MIN_MATCH  = 4;
+// the format ends with literals: the last match starts 12 bytes before the end and ends 5 before it
+static const size_t   LZBLOCK_MF_LIMIT   = 12;
+static const size_t   LZBLOCK_LAST_LITERALS = 5;
+static const unsigned LZBLOCK_HASH_BITS  = 12;
+static const unsigned LZBLOCK_SKIP_TRIGGER = 6;
+
+static uint32_t lzblock_read32(const uint8_t* p)
+{
+  uint32_t value;
+  memcpy(&value, p, 4);
+  return value;
+}
+
+static uint32_t lzblock_hash(uint32_t sequence)
+{
+  return (sequence * 2654435761u) >> (32 - LZBLOCK_HASH_BITS);
+}
+
+// length of the common run of `a` and `b`, stopping at `limit`
+static size_t lzblock_count(const uint8_t* a, const uint8_t* b, const uint8_t* limit)
+{
+  const uint8_t* start = a;
+  while (a + 8 <= limit) {
+    uint64_t x, y;
+    memcpy(&x, a, 8);
+    memcpy(&y, b, 8);
+    if (x != y) break;
+    a += 8;
+    b += 8;
+  }
+  while (a < limit && *a == *b) {
+    a++;
+    b++;
+  }
+  return (size_t)(a - start);
+}
+
+static uint8_t* lzblock_put_length(uint8_t* out, size_t length)
+{
+  for (; length >= 255; length -= 255) *out++ = 255;
+  *out++ = (uint8_t)length;
+  return out;
+}
+
+size_t lzblock_bound(size_t length)
+{
+  return length + length / 255 + 16;
+}
+
+// literals [anchor, ip), then a match of `match` bytes `offset` back, 0 for the last literals
+static uint8_t* lzblock_sequence(uint8_t* op, const uint8_t* oend, const uint8_t* anchor, const uint8_t* ip,
+                                 size_t offset, size_t match)
+{
+  size_t literals = (size_t)(ip - anchor);
+  size_t worst = 1 + literals + literals / 255 + 1 + (match ? 2 + (match - LZBLOCK_MIN_MATCH) / 255 + 1 : 0);
+  if (worst > (size_t)(oend - op)) return NULL;
+
+  uint8_t* token = op++;
+  *token = (uint8_t)((literals < 15 ? literals : 15) << 4);
+  if (literals >= 15) op = lzblock_put_length(op, literals - 15);
+  memcpy(op, anchor, literals);
+  op += literals;
+  if (!match) return op;
+
+  *op++ = (uint8_t)offset;
+  *op++ = (uint8_t)(offset >> 8);
+  match -= LZBLOCK_MIN_MATCH;
+  *token |= (uint8_t)(match < 15 ? match : 15);
+  if (match >= 15) op = lzblock_put_length(op, match - 15);
+  return op;
+}
+
+size_t lzblock_compress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity)
+{
+  uint16_t table[1 << LZBLOCK_HASH_BITS];
+  const uint8_t* ip = in;
+  const uint8_t* anchor = in;
+  const uint8_t* iend = in + length;
+  uint8_t* op = out;
+  const uint8_t* oend = out + capacity;
+
+  if (length > LZBLOCK_MAX_INPUT) return 0;
+  if (length >= LZBLOCK_MF_LIMIT + 1) {
+    const uint8_t* mflimit = iend - LZBLOCK_MF_LIMIT;
+    const uint8_t* matchlimit = iend - LZBLOCK_LAST_LITERALS;
+    // every slot starts out pointing at 0, a candidate is only used once its bytes are checked
+    memset(table, 0, sizeof(table));
+    ip++;
+    while (ip < mflimit) {
+      uint32_t sequence = lzblock_read32(ip);
+      uint32_t h = lzblock_hash(sequence);
+      const uint8_t* ref = in + table[h];
+      table[h] = (uint16_t)(ip - in);
+      if (ref >= ip || lzblock_read32(ref) != sequence) {
+        // the longer nothing matched, the bigger the steps
+        ip += 1 + ((size_t)(ip - anchor) >> LZBLOCK_SKIP_TRIGGER);
+        continue;
+      }
+      while (ip > anchor && ref > in && ip[-1] == ref[-1]) {
+        ip--;
+        ref--;
+      }
+      size_t match = LZBLOCK_MIN_MATCH + lzblock_count(ip + LZBLOCK_MIN_MATCH, ref + LZBLOCK_MIN_MATCH, matchlimit);
+      if (!(op = lzblock_sequence(op, oend, anchor, ip, (size_t)(ip - ref), match))) return 0;
+      ip += match;
+      anchor = ip;
+      if (ip < mflimit) table[lzblock_hash(lzblock_read32(ip - 2))] = (uint16_t)(ip - 2 - in);
+    }
+  }
+  if (!(op = lzblock_sequence(op, oend, anchor, iend, 0, 0))) return 0;
+  return (size_t)(op - out);
+}
+
+// an extended length, -1 if it runs past the end
+static long lzblock_get_length(const uint8_t** ip, const uint8_t* iend, size_t length)
+{
+  if (length != 15) return (long)length;
+  for (;;) {
+    if (*ip >= iend) return -1;
+    uint8_t b = *(*ip)++;
+    length += b;
+    if (b != 255) return (long)length;
+  }
+}
+
+long lzblock_decompress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity)
+{
+  const uint8_t* ip = in;
+  const uint8_t* iend = in + length;
+  uint8_t* op = out;
+  uint8_t* oend = out + capacity;
+
+  while (ip < iend) {
+    uint8_t token = *ip++;
+    long literals = lzblock_get_length(&ip, iend, token >> 4);
+    if (literals < 0 || literals > iend - ip || literals > oend - op) return -1;
+    memcpy(op, ip, (size_t)literals);
+    ip += literals;
+    op += literals;
+    if (ip == iend) break;
+
+    if (iend - ip < 2) return -1;
+    size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+    ip += 2;
+    long match = lzblock_get_length(&ip, iend, token & 15);
+    if (match < 0 || !offset || offset > (size_t)(op - out)) return -1;
+    match += LZBLOCK_MIN_MATCH;
+    if (match > oend - op) return -1;
+    const uint8_t* ref = op - offset;
+    if (offset >= (size_t)match) {
+      memcpy(op, ref, (size_t)match);
+      op += match;
+    } else {
+      // overlapping, e.g. a run of one byte repeated
+      for (long i = 0; i < match; i++) *op++ = *ref++;
+    }
+  }
+  return (long)(op - out);
+}
@@ -0,0 +1,43 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* LZ4 block compression.
+ *
+ * The LZ4 block format (sequences of literals and back references of 4 bytes or
+ * more), so anything that speaks LZ4 blocks can read what is written here. The
+ * compressor is the single pass greedy one: a hash of the next 4 bytes finds the last
+ * position they were seen at, runs without matches are skipped faster the longer they
+ * get. ROMs are mostly code, tables and long 0xFF runs, so that is enough to get them
+ * to about half; RAM snapshots compress much better.
+ *
+ * Inputs are at most LZBLOCK_MAX_INPUT bytes, every block is independent of the others.
+ */
+
+static const size_t LZBLOCK_MAX_INPUT = 0x10000;
+
+/** Largest compressed size of `length` bytes */
+size_t lzblock_bound(size_t length);
+
+/** Compress `length` bytes into at most `capacity`. Returns the compressed length, 0 if it doesn't fit */
+size_t lzblock_compress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity);
+
+/** Decompress a block into at most `capacity` bytes. Returns the decompressed length, -1 if the block is damaged */
+long lzblock_decompress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity);
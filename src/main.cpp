@@ -38,6 +38,24 @@ limitations under the License.
 #include "util.h"
 #include "progressbar.h"
 #include "args.h"
+#include "trace.h"
+#include "simecu.h"
+#include "fleet.h"
+#include "metrics.h"
+#include "hexdump.h"
+#include "discovery.h"
+#include "definition.h"
+#include "celltrace.h"
+#include "loganalyze.h"
+#include "tableeval.h"
+#include "romedit.h"
+#include "ramvideo.h"
+#include "dumpfile.h"
+#include "calindex.h"
+#include "defresolve.h"
+#include "defconvert.h"
+#include "sh2xref.h"
+#include "verify.h"
 
 static const char* TAG = "ECUDump";
 
@@ -53,11 +71,21 @@ static const long STATUS_FAIL_DOWNLOAD = 8;
 static const long STATUS_FAIL_BOOTLOADER = 9;
 static const long STATUS_FAIL_UPLOAD     = 9;
 static const long STATUS_FAIL_RESET      = 10;
+static const long STATUS_FAIL_VERIFY     = 11;
 
 static J2534 j2534;
 static RX8* ecu;
+static trace_t trace;
+static fleet_t fleet;
 static unsigned long devID, chanID;
-static const unsigned int CAN_BAUD = 500000;
+static char metricsFileName[255];
+static progress_t progress;
+static discovery_t discovery;
+static definition_t definition;
+static celltrace_t cells;
+static dumpfile_t dump;
+// block CRCs of the ROM as --upload streams it
+static dumpfile_t flashed;
 
 size_t j2534Initialize()
 {
@@ -65,89 +93,23 @@ size_t j2534Initialize()
 		LOGE(TAG, "failed to connect to J2534 DLL.");
 		return STATUS_FAIL_PASSTHRU;
 	}
-
-	if (j2534.PassThruOpen(NULL, &devID)) {
-		LOGE(TAG, "failed to PassThruOpen()");
-		return STATUS_FAIL_PASSTHRU;
-	}
-
-	if (j2534.PassThruConnect(devID, ISO15765, CAN_ID_BOTH, CAN_BAUD, &chanID)) {
-		reportJ2534Error(j2534);
+	if (j2534Connect(&j2534, NULL, &devID, &chanID))
 		return STATUS_FAIL_PASSTHRU;
-	}
-	j2534.PassThruIoctl(chanID, CLEAR_MSG_FILTERS, NULL, NULL);
-
-	unsigned long filterID = 0;
-
-	PASSTHRU_MSG maskMSG = {0};
-	PASSTHRU_MSG maskPattern = {0};
-	PASSTHRU_MSG flowControlMsg = {0};
-	for (uint8_t i = 0; i < 7; i++) {
-		maskMSG.ProtocolID = ISO15765;
-		maskMSG.TxFlags = ISO15765_FRAME_PAD;
-		maskMSG.Data[0] = 0x00;
-		maskMSG.Data[1] = 0x00;
-		maskMSG.Data[2] = 0x07;
-		maskMSG.Data[3] = 0xff;
-		maskMSG.DataSize = 4;
-
-		maskPattern.ProtocolID = ISO15765;
-		maskPattern.TxFlags = ISO15765_FRAME_PAD;
-		maskPattern.Data[0] = 0x00;
-		maskPattern.Data[1] = 0x00;
-		maskPattern.Data[2] = 0x07;
-		maskPattern.Data[3] = (0xE8 + i);
-		maskPattern.DataSize = 4;
-
-		flowControlMsg.ProtocolID = ISO15765;
-		flowControlMsg.TxFlags = ISO15765_FRAME_PAD;
-		flowControlMsg.Data[0] = 0x00;
-		flowControlMsg.Data[1] = 0x00;
-		flowControlMsg.Data[2] = 0x07;
-		flowControlMsg.Data[3] = (0xE0 + i);
-		flowControlMsg.DataSize = 4;
-
-		if (j2534.PassThruStartMsgFilter(chanID, FLOW_CONTROL_FILTER, &maskMSG, &maskPattern, &flowControlMsg, &filterID))
-		{
-			reportJ2534Error(j2534);
-			return STATUS_FAIL_PASSTHRU;
-
-		}
-	}
-	maskMSG.ProtocolID = ISO15765;
-	maskMSG.TxFlags = ISO15765_FRAME_PAD;
-	maskMSG.Data[0] = 0x00;
-	maskMSG.Data[1] = 0x00;
-	maskMSG.Data[2] = 0x07;
-	maskMSG.Data[3] = 0xf8;
-	maskMSG.DataSize = 4;
-
-	maskPattern.ProtocolID = ISO15765;
-	maskPattern.TxFlags = ISO15765_FRAME_PAD;
-	maskPattern.Data[0] = 0x00;
-	maskPattern.Data[1] = 0x00;
-	maskPattern.Data[2] = 0x07;
-	maskPattern.Data[3] = 0xE8;
-	maskPattern.DataSize = 4;
-
-	if (j2534.PassThruStartMsgFilter(chanID, PASS_FILTER, &maskMSG, &maskPattern, NULL, &filterID)) {
-		LOGE(TAG, "Failed to set message filter");
-		reportJ2534Error(j2534);
-		return STATUS_FAIL_PASSTHRU;
-	}
+	return STATUS_OK;
+}
 
-	if (j2534.PassThruIoctl(chanID, CLEAR_TX_BUFFER, NULL, NULL)) {
-		LOGE(TAG, "Failed to clear j2534 TX buffer");
-		reportJ2534Error(j2534);
-		return STATUS_FAIL_PASSTHRU;
-	}
+// J2534 --debug output goes through the same queue as everything else
+static void j2534Log(void* ctx, const char* format, va_list args)
+{
+	(void)ctx;
+	log_vwrite(LOG_LEVEL_DEBUG, "J2534", format, args);
+}
 
-	if (j2534.PassThruIoctl(chanID, CLEAR_RX_BUFFER, NULL, NULL)) {
-		LOGE(TAG, "Failed to clear j2534 RX buffer");
-		reportJ2534Error(j2534);
-		return STATUS_FAIL_PASSTHRU;
-	}
-	return STATUS_OK;
+// every exit path, including fleet mode and early failures, leaves the metrics behind
+void exportMetrics()
+{
+	if (!metrics_export(metricsFileName))
+		LOGI(TAG, "Wrote metrics to %s", metricsFileName);
 }
 
 #if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
@@ -162,7 +124,8 @@ int main(int argc, char** argv)
 	char *vin            = NULL, 
 			 *calibrationID  = NULL, 
 			 *transferBuffer = NULL;
-	uint8_t *seed=NULL, *key=NULL;
+	rx8_seed_t seed = {};
+	rx8_key_t key = {};
 
 	time_t commandStart, commandEnd;
 	char transferFilename[255] = { 0 };
@@ -174,6 +137,12 @@ int main(int argc, char** argv)
 		printUsage(argc, argv, &args);
 		return 1;
 	}
+	if (args.logLevel)
+		log_set_level(args.logLevel);
+	if (args.debug)
+		log_set_level(LOG_LEVEL_DEBUG);
+	log_start();
+	progress_init(&progress, stdout, args.progressRate < 0 ? PROGRESS_DEFAULT_RATE_HZ : (unsigned int)args.progressRate);
 
 	// transfer params
 	uint16_t chunkSize = args.params.transfer.chunkSize;
@@ -215,10 +184,111 @@ int main(int argc, char** argv)
 							chunkRemainder
 		);
 	}
+	// offline viewers
+	if (args.editFileName[0])
+		return romedit_edit_file(args.editFileName, args.definitionFileName, args.patchFileName, args.undo, args.verbose) ? 1 : 0;
+	if (args.dumpInfoFileName[0]) {
+		if (dumpfile_info(args.dumpInfoFileName, args.compareFileName[0] ? args.compareFileName : NULL))
+			return 1;
+		return args.extractFileName[0] && dumpfile_extract(args.dumpInfoFileName, args.extractFileName) ? 1 : 0;
+	}
+	if (args.packFileName[0])
+		return dumpfile_pack(args.packFileName, args.params.transfer.startAddress, args.compress, args.overwrite) ? 1 : 0;
+	if (args.libraryDirectory[0])
+		return calindex_library(args.libraryDirectory, args.findCalibration, args.threads) ? 1 : 0;
+	if (args.identifyFileName[0])
+		return defresolve_identify(args.definitionFileName, args.identifyFileName) ? 1 : 0;
+	if (args.convertFormat[0])
+		return defconvert_convert(args.definitionFileName, args.outputDirectory, args.convertFormat, args.threads) ? 1 : 0;
+	if (args.xrefFileName[0])
+		return sh2xref_report(args.xrefFileName, args.xrefCacheDirectory, address, transferSize, args.definitionFileName,
+			args.xrefCsvFileName, args.threads, stdout) ? 1 : 0;
+	if (args.printTraceFileName[0])
+		return trace_print(args.printTraceFileName, stdout) ? 1 : 0;
+	if (args.hexdumpFileName[0] || args.playFileName[0]) {
+		hexdump_options_t options = {};
+		options.width    = args.hexdumpWidth;
+		options.stride   = args.hexdumpStride;
+		options.diffOnly = args.diffOnly;
+#if !defined(_WIN32) && !defined(WIN32) && !defined (_WIN64) && !defined (WIN64)
+		// Windows consoles don't do colors, differing bytes are marked with a '*' there
+		options.color    = progress.tty;
+#endif
+		if (args.playFileName[0] && !args.showFrame)
+			return ramvideo_list(args.playFileName, stdout) ? 1 : 0;
+		if (args.playFileName[0])
+			return ramvideo_show_frame(args.playFileName, args.frameByTime, args.frame, args.frameTime, &options,
+				stdout) ? 1 : 0;
+		return hexdump_file(stdout, args.hexdumpFileName, address, transferSize,
+			args.compareFileName[0] ? args.compareFileName : NULL, &options) ? 1 : 0;
+	}
+
 	if (command == 0)
 		return 1;
 	if (args.dryRun)
 		return 1;
+	if (_TRACE_CELLS(command) && celltrace_open(&cells, &definition, args.cellsFileName, args.definitionFileName,
+		args.romFileName[0] ? args.romFileName : args.simulateRomFileName))
+		return 1;
+	if (_TRACE_CELLS(command) && args.logs[0]) {
+		if (args.predictFileName[0])
+			status = tableeval_predict(&cells, &definition, args.logs, args.romFileName, args.predictFileName,
+				args.predictCsvFileName, args.cellsCsvFileName, args.threads) ? 1 : 0;
+		else
+			status = loganalyze_logs(&cells, args.logs, args.threads, args.cellsCsvFileName) ? 1 : 0;
+		celltrace_free(&cells);
+		definition_free(&definition);
+		return status ? 1 : 0;
+	}
+
+	j2534.debug(args.debug);
+	j2534.setLogHook(j2534Log, NULL);
+	// the report printed with --verbose is built from the same metrics
+	if (args.verbose || args.metricsFileName[0])
+		metrics_enable(true);
+	if (args.metricsFileName[0]) {
+		strcpy(metricsFileName, args.metricsFileName);
+		metrics_export_on_signal(metricsFileName);
+		atexit(exportMetrics);
+	}
+
+	if (args.simulate) {
+		if (args.simulateRomFileName[0] && simecu_load_rom(args.simulateRomFileName)) {
+			LOGE(TAG, "failed to load simulated ROM %s", args.simulateRomFileName);
+			return -STATUS_FAIL_PASSTHRU;
+		}
+		j2534.init(simecu_api());
+		LOGI(TAG, "Using a simulated ECU");
+	}
+
+	if (args.fleet[0]) {
+		if (fleet_parse(&fleet, args.fleet, args.simulate))
+			return -STATUS_FAIL_PASSTHRU;
+		fleet.api          = args.simulate ? simecu_api() : NULL;
+		fleet.startAddress = address;
+		fleet.transferSize = transferSize;
+		fleet.chunkSize    = chunkSize;
+		fleet.overwrite    = args.overwrite;
+		fleet.progressRate = progress.rateHz;
+		return fleet_run(&fleet) ? -STATUS_FAIL_DOWNLOAD : STATUS_OK;
+	}
+
+	if (args.replayFileName[0]) {
+		if (trace_replay_open(args.replayFileName, false) || !j2534.init(trace_replay_api())) {
+			LOGE(TAG, "failed to load replay %s", args.replayFileName);
+			return -STATUS_FAIL_PASSTHRU;
+		}
+	}
+
+	if (args.traceFileName[0]) {
+		if (trace_open(&trace, args.traceFileName, TRACE_DEFAULT_CAPACITY)) {
+			LOGE(TAG, "failed to open trace %s", args.traceFileName);
+			return -STATUS_FAIL_PASSTHRU;
+		}
+		// attached before connecting, the trace has the open, connect and filters too
+		trace_attach(&trace, &j2534);
+		LOGI(TAG, "Tracing passthru messages to %s", args.traceFileName);
+	}
 
 	if (j2534Initialize()) {
 		LOGE(TAG, "j2534Initialize() failed");
@@ -229,6 +299,16 @@ int main(int argc, char** argv)
 
 	ecu = new RX8(&j2534, devID, chanID);
 
+	if(_DISCOVER(command)) {
+		if (discovery_run(&discovery, &j2534, chanID)) {
+			LOGE(TAG, "module discovery failed");
+			reportJ2534Error(j2534);
+			status = -STATUS_FAIL_PASSTHRU;
+			goto cleanup;
+		}
+		discovery_report(&discovery);
+	}
+
 	if(_GET_VIN(command)) {
 		if (ecu->getVIN(&vin)) {
 			LOGE(TAG, "failed to get VIN");
@@ -246,45 +326,44 @@ int main(int argc, char** argv)
 		}
 		LOGI(TAG, "Got calibration ID = %s", calibrationID);
 	}
-	if(_DIAG(command)) {
-		if (!ecu->initDiagSession(MAZDA_SBF_SESSION_81)) {
-			LOGE(TAG, "failed to init diag session 81");
-			status = -STATUS_FAIL_DIAG;
-			goto cleanup;
-		}
-
-		if (!ecu->initDiagSession(MAZDA_SBF_SESSION_85)) {
-			LOGE(TAG, "failed to init diag session 85");
+	if(_DIAG(command) || _GET_SEED(command) || _UNLOCK(command)) {
+		unsigned int steps = (_DIAG(command) ? RX8_ACCESS_SESSION : 0) | (_GET_SEED(command) ? RX8_ACCESS_SEED : 0) |
+			(_UNLOCK(command) ? RX8_ACCESS_KEY : 0);
+		unsigned int failed = 0;
+		ecu->securityAccess(steps, seed, key, &failed);
+		if (failed == RX8_ACCESS_SESSION) {
+			LOGE(TAG, "failed to init diag session");
 			status = -STATUS_FAIL_DIAG;
 			goto cleanup;
 		}
-		LOGI(TAG, "Diag sesion initialized ok");
-	}
-	
-	if(_GET_SEED(command)) {
-		if (ecu->getSeed(&seed)) {
+		if (_DIAG(command))
+			LOGI(TAG, "Diag sesion initialized ok");
+		if (failed == RX8_ACCESS_SEED) {
 			LOGE(TAG, "failed to get seed");
 			status = -STATUS_FAIL_SEED;
 			goto cleanup;
 		}
-		LOGI(TAG, "Got seed = { %02X, %02X, %02X }", seed[0], seed[1], seed[2]);
-	}
-	if(_CALCULATE_KEY(command)) {
-		if (ecu->calculateKey(seed, &key)) {
-			LOGE(TAG, "failed to calculate key");
-			status = -STATUS_FAIL_KEY;
-			goto cleanup;
+		if (_GET_SEED(command)) {
+			LOGI(TAG, "Got seed = { %02X, %02X, %02X }", seed[0], seed[1], seed[2]);
+			LOGI(TAG, "Got key  = { %02X, %02X, %02X }", key[0], key[1], key[2]);
 		}
-		LOGI(TAG, "Got key  = { %02X, %02X, %02X }", key[0], key[1], key[2]);
-	}
-
-	if(_UNLOCK(command)) {
-		if (!ecu->unlock(key)) {
+		if (failed == RX8_ACCESS_KEY) {
 			LOGE(TAG, "failed to unlock ECU using key");
 			status = -STATUS_FAIL_UNLOCK;
 			goto cleanup;
 		}
-		LOGI(TAG, "Unlocked ECU");
+		if (_UNLOCK(command))
+			LOGI(TAG, "Unlocked ECU");
+	}
+
+	if(_TRACE_CELLS(command)) {
+		status = celltrace_log_ecu(&cells, ecu, args.samples, args.cellsCsvFileName) ? -STATUS_FAIL_DOWNLOAD : STATUS_OK;
+		goto cleanup;
+	}
+	if(_RAM_VIDEO(command)) {
+		status = ramvideo_record(ecu, args.ramVideoFileName, args.params.transfer.startAddress,
+			args.params.transfer.transferSize, args.params.transfer.chunkSize, args.samples) ? -STATUS_FAIL_DOWNLOAD : STATUS_OK;
+		goto cleanup;
 	}
 
 	time(&commandStart);
@@ -299,7 +378,7 @@ int main(int argc, char** argv)
 			strcpy(transferFilename, vin);
 			strcpy(transferFilename + strlen(vin), "-");
 			strcpy(transferFilename + strlen(vin) + 1, calibrationID);
-			strcpy(transferFilename + strlen(vin) + 1 + strlen(calibrationID), ".bin");
+			strcpy(transferFilename + strlen(vin) + 1 + strlen(calibrationID), args.container ? DUMPFILE_EXTENSION : ".bin");
 		} else {
 			strcpy(transferFilename, args.fileName);
 		}
@@ -324,12 +403,15 @@ int main(int argc, char** argv)
 			}
 		}
 
-		transferFile = fopen(transferFilename, "ab+");
-		if(!transferFile) {
-			LOGE(TAG, "Failed to open %s %s", transferFilename, strerror(errno));
-			transferFile = NULL;
-			status = -errno;
-			goto cleanup;
+		// the container is written in one go once the read is done
+		if (!args.container) {
+			transferFile = fopen(transferFilename, "ab+");
+			if(!transferFile) {
+				LOGE(TAG, "Failed to open %s %s", transferFilename, strerror(errno));
+				transferFile = NULL;
+				status = -errno;
+				goto cleanup;
+			}
 		}
 		transferBuffer = (char*)malloc(transferSize);
 		if(!transferBuffer) {
@@ -337,34 +419,72 @@ int main(int argc, char** argv)
 			goto cleanup;
 		}
 		memset(transferBuffer, 0, transferSize);
+		if (args.container) {
+			dumpfile_init(&dump, vin, calibrationID, chunkSize, args.compress);
+			if (dumpfile_add_region(&dump, address >= 0xffff0000 ? "ram" : "rom", address, transferSize)) {
+				status = -ENOMEM;
+				goto cleanup;
+			}
+		}
 
 		LOGI(TAG, "Starting memory read 0x%08X-0x%08X into %s", 
 					address, 
 					endAddress,
 					transferFilename
 		);
-		for (bytesTransfered = 0; address < endAddress; address += chunkSize, bytesTransfered += chunkSize, transferBuffer += chunkSize) {
+		ecu->beginTransfer();
+		progress_start(&progress, "download", transferSize);
+		// whole chunks, then the remainder. A failed read stops the download, the
+		// container keeps what was read so far and records where it stopped
+		bool stopped = false;
+		for (bytesTransfered = 0; bytesTransfered + chunkSize <= transferSize; address += chunkSize, bytesTransfered += chunkSize) {
 			assert(endAddress > address);
-			if (ecu->readMem(address, chunkSize, transferBuffer))
+			uint64_t chunkStart = monotonic_us();
+			if (ecu->readMem(address, chunkSize, transferBuffer + bytesTransfered)) {
+				stopped = true;
 				break;
-			printProgress(bytesTransfered, transferSize);
-		}
-		if(chunkRemainder > 0) {
-			if (ecu->readMem(address, chunkRemainder, transferBuffer)) {
+			}
+			uint64_t chunkUs = monotonic_us() - chunkStart;
+			if (args.container)
+				dumpfile_update(&dump, transferBuffer + bytesTransfered, chunkSize, chunkUs);
+			progress_chunk(&progress, chunkSize, chunkUs);
+		}
+		if(!stopped && chunkRemainder > 0) {
+			uint64_t chunkStart = monotonic_us();
+			if (ecu->readMem(address, chunkRemainder, transferBuffer + bytesTransfered)) {
 				LOGE(TAG, "Failed to read remainder of memory %04X", address);
+				ecu->endTransfer();
 				status = -STATUS_FAIL_DOWNLOAD;
 				goto cleanup;
 			}
+			uint64_t chunkUs = monotonic_us() - chunkStart;
+			if (args.container)
+				dumpfile_update(&dump, transferBuffer + bytesTransfered, chunkRemainder, chunkUs);
 			bytesTransfered += chunkRemainder;
-			printProgress(bytesTransfered, transferSize);
+			progress_chunk(&progress, chunkRemainder, chunkUs);
 		}
+		progress_finish(&progress);
+		ecu->endTransfer();
 
 		if (bytesTransfered != transferSize) {
 			LOGE(TAG, "Only transfered %08X / %08X bytes", bytesTransfered, transferSize);
+			status = -STATUS_FAIL_DOWNLOAD;
 		}
-		bytesTransfered = fwrite(transferBuffer-transferSize, transferSize, 1, transferFile);
+		if (args.container) {
+			if (dumpfile_save(&dump, transferFilename, (uint8_t*)transferBuffer)) {
+				status = -STATUS_FAIL_DOWNLOAD;
+				goto cleanup;
+			}
+			LOGI(TAG, "%u blocks, root 0x%08x, %.1f KB stored", dump.header.numBlocks, dump.header.root,
+				(double)dump.header.storedLength / 1024.0);
+		} else {
+			fwrite(transferBuffer, transferSize, 1, transferFile);
+		}
+		if (status)
+			goto cleanup;
 
-		fflush(transferFile);
+		if (transferFile)
+			fflush(transferFile);
 		time(&commandEnd);
 		LOGI(TAG, "Successfully read memory to %s Took %.0lf seconds", args.fileName, difftime(commandEnd,commandStart));
 	}
@@ -458,17 +578,27 @@ int main(int argc, char** argv)
 
 		address = 0;
 		transferSize = sblLength + rom_length - MAZDA_ROM_START_OFFSET;
+		// the ROM part of the payload is hashed as it goes out, for the readback once the ECU runs it
+		dumpfile_init(&flashed, NULL, NULL, chunkSize, false);
+		if (dumpfile_add_region(&flashed, "rom", MAZDA_ROM_START_OFFSET, rom_length - MAZDA_ROM_START_OFFSET)) {
+			status = -ENOMEM;
+			goto cleanup;
+		}
+		const uint8_t* payload = writePayload;
+		progress_start(&progress, "kernel", sblLength);
 		for (bytesTransfered = 0; address < transferSize; address += chunkSize, writePayload += chunkSize) {
+			uint64_t chunkStart = monotonic_us();
 			status = ecu->transferData(chunkSize, writePayload);
+			progress_chunk(&progress, chunkSize, monotonic_us() - chunkStart);
+			if (bytesTransfered + chunkSize > sblLength) {
+				uint32_t skip = bytesTransfered < sblLength ? (uint32_t)sblLength - bytesTransfered : 0;
+				dumpfile_update(&flashed, writePayload + skip, chunkSize - skip, 0);
+			}
 			bytesTransfered += chunkSize;
-			if (bytesTransfered <= sblLength) {
-				printProgress(bytesTransfered, sblLength);
-				if (bytesTransfered == sblLength) {
-					resetProgress();
-					LOGI(TAG, "kernel transfered");
-				}
-			} else {
-				printProgress(bytesTransfered, transferSize);
+			if (bytesTransfered == sblLength) {
+				progress_finish(&progress);
+				LOGI(TAG, "kernel transfered");
+				progress_start(&progress, "rom", transferSize - sblLength);
 			}
 
 			if (status) {
@@ -477,6 +607,7 @@ int main(int argc, char** argv)
 				goto cleanup;
 			}
 		}
+		progress_finish(&progress);
 		status = 0;
 
 		time(&commandEnd);
@@ -518,8 +649,24 @@ int main(int argc, char** argv)
 		LOGI(TAG, "Got calibration ID = %s", calibrationID);
 
 		status = 0;
+		if (args.params.write.verify != ECUDUMP_VERIFY_NONE) {
+			size_t verified = verify_flash(ecu, &flashed, payload + sblLength,
+				args.params.write.verify == ECUDUMP_VERIFY_CHANGED ? args.compareFileName : NULL, &progress);
+			if (verified == VERIFY_ERROR_UNLOCK)
+				status = -STATUS_FAIL_UNLOCK;
+			else if (verified == VERIFY_ERROR_MISMATCH)
+				status = -STATUS_FAIL_VERIFY;
+			else if (verified == ENOMEM)
+				status = -ENOMEM;
+			else if (verified)
+				status = -STATUS_FAIL_DOWNLOAD;
+			if (status)
+				goto cleanup;
+		}
 	}
 cleanup:
+	// a failed transfer jumps here with the reporter still running
+	progress_finish(&progress);
 	if(transferFile) {
 		fflush(transferFile);
 		fclose(transferFile);
@@ -529,6 +676,26 @@ cleanup:
 		fclose(sblFile);
 		sblFile = NULL;
 	}
+	free(transferBuffer);
+	transferBuffer = NULL;
+	dumpfile_free(&dump);
+	dumpfile_free(&flashed);
+	if (ecu && args.verbose)
+		ecu->printTimingReport();
+
+	// stops the TesterPresent keepalive, otherwise the passthru device keeps sending it
+	if (ecu) {
+		delete ecu;
+		ecu = NULL;
+	}
+	j2534.setMessageHook(NULL, NULL);
+	j2534.setCallHook(NULL, NULL);
+	trace_close(&trace);
+	if (args.replayFileName[0]) {
+		if (trace_replay_mismatches())
+			LOGE(TAG, "replay diverged from the recording in %zu places", trace_replay_mismatches());
+		trace_replay_close();
+	}
 // TODO: it seems like calling PassThruDisconnect or PassThruClose causes
 //       error inside the J2534 dll. For now, skip it
 	goto skip_cleanup;
@@ -0,0 +1,117 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+#include <errno.h>
+
+#if !defined(_WIN32) && !defined(WIN32) && !defined (_WIN64) && !defined (WIN64)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mapfile.h"
+#include "util.h"
+
+static const char* TAG = "Mapfile";
+
+static size_t mapfile_map(mapfile_t* map, const char* path, bool copyOnWrite)
+{
+  memset(map, 0, sizeof(mapfile_t));
+
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  LARGE_INTEGER size;
+  map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (map->file == INVALID_HANDLE_VALUE) {
+    LOGE(TAG, "failed to open %s (%lu)", path, GetLastError());
+    map->file = NULL;
+    return ENOENT;
+  }
+  if (!GetFileSizeEx(map->file, &size)) {
+    LOGE(TAG, "failed to size %s (%lu)", path, GetLastError());
+    mapfile_close(map);
+    return EIO;
+  }
+  map->length = (size_t)size.QuadPart;
+  if (!map->length) return 0;
+  map->mapping = CreateFileMappingA(map->file, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+  if (!map->mapping) {
+    LOGE(TAG, "failed to map %s (%lu)", path, GetLastError());
+    mapfile_close(map);
+    return EIO;
+  }
+  map->data = (uint8_t*)MapViewOfFile(map->mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+  if (!map->data) {
+    LOGE(TAG, "failed to map %s (%lu)", path, GetLastError());
+    mapfile_close(map);
+    return EIO;
+  }
+#else
+  struct stat st;
+  map->fd = open(path, O_RDONLY);
+  if (map->fd < 0) {
+    size_t ret = errno;
+    LOGE(TAG, "failed to open %s %s", path, strerror(errno));
+    return ret;
+  }
+  if (fstat(map->fd, &st)) {
+    size_t ret = errno;
+    LOGE(TAG, "failed to size %s %s", path, strerror(errno));
+    mapfile_close(map);
+    return ret;
+  }
+  map->length = (size_t)st.st_size;
+  if (!map->length) return 0;
+  void* data = mmap(NULL, map->length, copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, map->fd, 0);
+  if (data == MAP_FAILED) {
+    size_t ret = errno;
+    LOGE(TAG, "failed to map %s %s", path, strerror(errno));
+    mapfile_close(map);
+    return ret;
+  }
+  // read front to back, let the kernel read ahead
+  if (!copyOnWrite) madvise(data, map->length, MADV_SEQUENTIAL);
+  map->data = (uint8_t*)data;
+#endif
+  return 0;
+}
+
+size_t mapfile_open(mapfile_t* map, const char* path)
+{
+  return mapfile_map(map, path, false);
+}
+
+size_t mapfile_open_private(mapfile_t* map, const char* path)
+{
+  return mapfile_map(map, path, true);
+}
+
+void mapfile_close(mapfile_t* map)
+{
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  if (map->data) UnmapViewOfFile(map->data);
+  if (map->mapping) CloseHandle(map->mapping);
+  if (map->file) CloseHandle(map->file);
+#else
+  if (map->data) munmap(map->data, map->length);
+  if (map->fd >= 0) close(map->fd);
+#endif
+  memset(map, 0, sizeof(mapfile_t));
+#if !defined(_WIN32) && !defined(WIN32) && !defined (_WIN64) && !defined (WIN64)
+  map->fd = -1;
+#endif
+}
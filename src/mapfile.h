@@ -0,0 +1,52 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#include <windows.h>
+#endif
+
+/* Memory mapped files.
+ *
+ * Logs and ROM images are scanned in place instead of being read into a buffer
+ * first; the page cache holds them and several threads can read the same mapping.
+ * A private mapping is copy-on-write: writes to `data` only copy the pages they touch
+ * and never reach the file. An empty file maps to `data` NULL and `length` 0.
+ */
+
+typedef struct Mapfile {
+  uint8_t* data;     // only writable in a private mapping
+  size_t length;
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  HANDLE file;
+  HANDLE mapping;
+#else
+  int fd;
+#endif
+} mapfile_t;
+
+/** Map `path` read only. Returns 0 or errno, nothing needs closing on failure */
+size_t mapfile_open(mapfile_t* map, const char* path);
+
+/** Map `path` copy-on-write. Returns 0 or errno, nothing needs closing on failure */
+size_t mapfile_open_private(mapfile_t* map, const char* path);
+
+/** Also fine on a mapping that failed to open */
+void mapfile_close(mapfile_t* map);
@@ -0,0 +1,425 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <mutex>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "metrics.h"
+#include "util.h"
+
+static const char* TAG = "Metrics";
+
+static const char* metrics_phase_names[METRICS_PHASE_COUNT] = {
+  "write", "read", "first_frame", "pending", "transfer", "host",
+};
+
+static const char* metrics_counter_names[METRICS_COUNTER_COUNT] = {
+  "requests", "responses", "negative_responses", "pending", "timeouts",
+  "empty_reads", "driver_errors", "bytes_tx", "bytes_rx",
+};
+
+static const double metrics_percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+static const size_t METRICS_NUM_PERCENTILES = sizeof(metrics_percentiles) / sizeof(metrics_percentiles[0]);
+
+static struct {
+  std::mutex lock;
+  metrics_t* head;
+  metrics_t* retired;  // totals of requests already freed
+  bool enabled;
+  const char* signalPath;
+  std::atomic<bool> signalled;
+} metrics;
+
+void metrics_enable(bool enable)
+{
+  metrics.enabled = enable;
+}
+
+bool metrics_enabled()
+{
+  return metrics.enabled;
+}
+
+void metrics_histogram_reset(metrics_histogram_t* histogram)
+{
+  memset((void*)histogram, 0, sizeof(metrics_histogram_t));
+  histogram->min = UINT64_MAX;
+}
+
+static void metrics_reset(metrics_t* m)
+{
+  size_t i;
+  memset((void*)m, 0, sizeof(metrics_t));
+  for (i = 0; i < METRICS_PHASE_COUNT; i++)
+    metrics_histogram_reset(&m->phases[i]);
+  for (i = 0; i <= METRICS_SERVICE_OTHER; i++)
+    metrics_histogram_reset(&m->services[i]);
+}
+
+static void metrics_histogram_merge(metrics_histogram_t* dst, const metrics_histogram_t* src)
+{
+  size_t i;
+  uint64_t count = src->count.load(std::memory_order_relaxed);
+  if (!count) return;
+  dst->count = dst->count + count;
+  dst->total = dst->total + src->total.load(std::memory_order_relaxed);
+  if (src->min < dst->min) dst->min = src->min.load(std::memory_order_relaxed);
+  if (src->max > dst->max) dst->max = src->max.load(std::memory_order_relaxed);
+  for (i = 0; i < METRICS_HDR_BUCKETS; i++)
+    dst->buckets[i] = dst->buckets[i] + src->buckets[i].load(std::memory_order_relaxed);
+}
+
+// slot of the response time histogram for `sid`, created on first use
+static size_t metrics_service_slot(metrics_t* m, uint8_t sid)
+{
+  uint8_t slot = m->serviceSlot[sid].load(std::memory_order_relaxed);
+  if (slot) return slot;
+
+  uint8_t count = m->numServices.load(std::memory_order_relaxed);
+  if (count == METRICS_MAX_SERVICES) {
+    // table full, lump into the overflow slot
+    m->serviceSlot[sid].store(METRICS_SERVICE_OTHER, std::memory_order_relaxed);
+    return METRICS_SERVICE_OTHER;
+  }
+  slot = count + 1;
+  m->serviceSID[slot].store(sid, std::memory_order_relaxed);
+  m->serviceSlot[sid].store(slot, std::memory_order_relaxed);
+  m->numServices.store(slot, std::memory_order_release);
+  return slot;
+}
+
+static void metrics_merge(metrics_t* dst, const metrics_t* src)
+{
+  size_t i;
+  for (i = 0; i < METRICS_COUNTER_COUNT; i++)
+    dst->counters[i] = dst->counters[i] + src->counters[i].load(std::memory_order_relaxed);
+  for (i = 0; i < 256; i++)
+    dst->nrc[i] = dst->nrc[i] + src->nrc[i].load(std::memory_order_relaxed);
+  for (i = 0; i < METRICS_PHASE_COUNT; i++)
+    metrics_histogram_merge(&dst->phases[i], &src->phases[i]);
+
+  uint8_t count = src->numServices.load(std::memory_order_acquire);
+  for (i = 1; i <= count; i++) {
+    uint8_t sid = src->serviceSID[i].load(std::memory_order_relaxed);
+    metrics_histogram_merge(&dst->services[metrics_service_slot(dst, sid)], &src->services[i]);
+  }
+  metrics_histogram_merge(&dst->services[METRICS_SERVICE_OTHER], &src->services[METRICS_SERVICE_OTHER]);
+}
+
+void metrics_init(metrics_t* m)
+{
+  metrics_reset(m);
+  std::lock_guard<std::mutex> guard(metrics.lock);
+  m->next = metrics.head;
+  metrics.head = m;
+}
+
+void metrics_deinit(metrics_t* m)
+{
+  std::lock_guard<std::mutex> guard(metrics.lock);
+  metrics_t** link = &metrics.head;
+  while (*link && *link != m) link = &(*link)->next;
+  if (!*link) return;
+  *link = m->next;
+
+  if (!metrics.retired) {
+    metrics.retired = new metrics_t;
+    metrics_reset(metrics.retired);
+  }
+  metrics_merge(metrics.retired, m);
+}
+
+static uint32_t metrics_msb(uint64_t value)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return (uint32_t)index;
+#else
+  return 63 - (uint32_t)__builtin_clzll(value);
+#endif
+}
+
+static size_t metrics_bucket(uint64_t us)
+{
+  if (us < ((uint64_t)1 << METRICS_HDR_SUB_BITS)) return (size_t)us;
+
+  uint32_t msb = metrics_msb(us);
+  if (msb >= METRICS_HDR_MAGNITUDES) return METRICS_HDR_BUCKETS - 1;
+  uint32_t shift = msb - METRICS_HDR_SUB_BITS;
+  return ((size_t)(shift + 1) << METRICS_HDR_SUB_BITS) + (size_t)((us >> shift) & ((1 << METRICS_HDR_SUB_BITS) - 1));
+}
+
+// middle of the range a bucket covers
+static uint64_t metrics_bucket_value(size_t bucket)
+{
+  size_t magnitude = bucket >> METRICS_HDR_SUB_BITS;
+  if (magnitude == 0) return bucket;
+
+  uint32_t shift = (uint32_t)magnitude - 1;
+  uint64_t lower = (((uint64_t)1 << METRICS_HDR_SUB_BITS) + (bucket & ((1 << METRICS_HDR_SUB_BITS) - 1))) << shift;
+  return lower + (((uint64_t)1 << shift) >> 1);
+}
+
+void metrics_histogram_record(metrics_histogram_t* h, uint64_t us)
+{
+  std::atomic<uint32_t>* bucket = &h->buckets[metrics_bucket(us)];
+  bucket->store(bucket->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  h->total.store(h->total.load(std::memory_order_relaxed) + us, std::memory_order_relaxed);
+  if (us < h->min.load(std::memory_order_relaxed)) h->min.store(us, std::memory_order_relaxed);
+  if (us > h->max.load(std::memory_order_relaxed)) h->max.store(us, std::memory_order_relaxed);
+  h->count.store(h->count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+uint64_t metrics_histogram_percentile(const metrics_histogram_t* h, double percentile)
+{
+  uint64_t count = h->count.load(std::memory_order_relaxed);
+  uint64_t rank, seen = 0;
+  size_t i;
+  if (!count) return 0;
+
+  rank = (uint64_t)(percentile * (double)count + 0.5);
+  if (rank < 1) rank = 1;
+  for (i = 0; i < METRICS_HDR_BUCKETS; i++) {
+    seen += h->buckets[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      // never report outside of the values actually seen
+      uint64_t value = metrics_bucket_value(i);
+      uint64_t min = h->min.load(std::memory_order_relaxed);
+      uint64_t max = h->max.load(std::memory_order_relaxed);
+      return value < min ? min : value > max ? max : value;
+    }
+  }
+  return h->max.load(std::memory_order_relaxed);
+}
+
+void metrics_service(metrics_t* m, uint8_t sid, uint64_t us)
+{
+  metrics_histogram_record(&m->services[metrics_service_slot(m, sid)], us);
+}
+
+void metrics_nrc(metrics_t* m, uint8_t nrc)
+{
+  metrics_count(m, METRICS_NEGATIVE_RESPONSES, 1);
+  m->nrc[nrc].store(m->nrc[nrc].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+static void metrics_report_histogram(const char* name, const metrics_histogram_t* h)
+{
+  uint64_t count = h->count;
+  if (!count) return;
+  LOGI(TAG, "%-12s count=%llu min=%lluus avg=%lluus p50=%lluus p90=%lluus p99=%lluus max=%lluus",
+    name,
+    (unsigned long long)count,
+    (unsigned long long)h->min.load(),
+    (unsigned long long)(h->total / count),
+    (unsigned long long)metrics_histogram_percentile(h, 0.5),
+    (unsigned long long)metrics_histogram_percentile(h, 0.9),
+    (unsigned long long)metrics_histogram_percentile(h, 0.99),
+    (unsigned long long)h->max.load()
+  );
+}
+
+void metrics_report(const metrics_t* m)
+{
+  char name[16];
+  size_t i;
+  uint8_t count = m->numServices;
+
+  for (i = 1; i <= count; i++) {
+    snprintf(name, sizeof(name), "sid=%02X", m->serviceSID[i].load());
+    metrics_report_histogram(name, &m->services[i]);
+  }
+  metrics_report_histogram("sid=other", &m->services[METRICS_SERVICE_OTHER]);
+  for (i = 0; i < METRICS_PHASE_COUNT; i++)
+    metrics_report_histogram(metrics_phase_names[i], &m->phases[i]);
+
+  LOGI(TAG, "requests=%llu pending=%llu timeouts=%llu nrc=%llu empty_reads=%llu driver_errors=%llu",
+    (unsigned long long)m->counters[METRICS_REQUESTS].load(),
+    (unsigned long long)m->counters[METRICS_PENDING].load(),
+    (unsigned long long)m->counters[METRICS_TIMEOUTS].load(),
+    (unsigned long long)m->counters[METRICS_NEGATIVE_RESPONSES].load(),
+    (unsigned long long)m->counters[METRICS_EMPTY_READS].load(),
+    (unsigned long long)m->counters[METRICS_DRIVER_ERRORS].load()
+  );
+}
+
+// everything recorded so far by live and freed requests. Caller deletes
+static metrics_t* metrics_snapshot()
+{
+  metrics_t* snapshot = new metrics_t;
+  metrics_reset(snapshot);
+
+  std::lock_guard<std::mutex> guard(metrics.lock);
+  for (metrics_t* m = metrics.head; m; m = m->next)
+    metrics_merge(snapshot, m);
+  if (metrics.retired)
+    metrics_merge(snapshot, metrics.retired);
+  return snapshot;
+}
+
+static void metrics_json_histogram(FILE* file, const metrics_histogram_t* h)
+{
+  size_t i;
+  uint64_t count = h->count;
+  fprintf(file, "{\"count\":%llu,\"sum_us\":%llu,\"min_us\":%llu,\"max_us\":%llu",
+    (unsigned long long)count,
+    (unsigned long long)h->total.load(),
+    (unsigned long long)(count ? h->min.load() : 0),
+    (unsigned long long)h->max.load()
+  );
+  for (i = 0; i < METRICS_NUM_PERCENTILES; i++)
+    fprintf(file, ",\"p%g_us\":%llu", metrics_percentiles[i] * 100,
+      (unsigned long long)metrics_histogram_percentile(h, metrics_percentiles[i]));
+  fputc('}', file);
+}
+
+size_t metrics_export_json(FILE* file)
+{
+  metrics_t* m = metrics_snapshot();
+  const char* separator = "";
+  size_t i;
+
+  fprintf(file, "{\n  \"counters\": {");
+  for (i = 0; i < METRICS_COUNTER_COUNT; i++)
+    fprintf(file, "%s\"%s\":%llu", i ? "," : "", metrics_counter_names[i], (unsigned long long)m->counters[i].load());
+
+  fprintf(file, "},\n  \"negative_responses\": {");
+  for (i = 0; i < 256; i++) {
+    if (!m->nrc[i]) continue;
+    fprintf(file, "%s\"0x%02X\":%llu", separator, (unsigned)i, (unsigned long long)m->nrc[i].load());
+    separator = ",";
+  }
+
+  fprintf(file, "},\n  \"phases\": {");
+  for (i = 0; i < METRICS_PHASE_COUNT; i++) {
+    fprintf(file, "%s\n    \"%s\": ", i ? "," : "", metrics_phase_names[i]);
+    metrics_json_histogram(file, &m->phases[i]);
+  }
+
+  fprintf(file, "\n  },\n  \"services\": {");
+  for (i = 1; i <= m->numServices; i++) {
+    fprintf(file, "%s\n    \"0x%02X\": ", i > 1 ? "," : "", m->serviceSID[i].load());
+    metrics_json_histogram(file, &m->services[i]);
+  }
+  if (m->services[METRICS_SERVICE_OTHER].count) {
+    fprintf(file, "%s\n    \"other\": ", m->numServices ? "," : "");
+    metrics_json_histogram(file, &m->services[METRICS_SERVICE_OTHER]);
+  }
+  fprintf(file, "\n  }\n}\n");
+
+  delete m;
+  return ferror(file) ? EIO : 0;
+}
+
+static void metrics_prometheus_summary(FILE* file, const char* metric, const char* label, const char* value, const metrics_histogram_t* h)
+{
+  size_t i;
+  for (i = 0; i < METRICS_NUM_PERCENTILES; i++)
+    fprintf(file, "%s{%s=\"%s\",quantile=\"%g\"} %.6f\n", metric, label, value, metrics_percentiles[i],
+      (double)metrics_histogram_percentile(h, metrics_percentiles[i]) / 1000000.0);
+  fprintf(file, "%s_sum{%s=\"%s\"} %.6f\n", metric, label, value, (double)h->total / 1000000.0);
+  fprintf(file, "%s_count{%s=\"%s\"} %llu\n", metric, label, value, (unsigned long long)h->count.load());
+}
+
+size_t metrics_export_prometheus(FILE* file)
+{
+  metrics_t* m = metrics_snapshot();
+  char value[8];
+  size_t i;
+
+  for (i = 0; i < METRICS_COUNTER_COUNT; i++) {
+    fprintf(file, "# TYPE ecudump_uds_%s_total counter\n", metrics_counter_names[i]);
+    fprintf(file, "ecudump_uds_%s_total %llu\n", metrics_counter_names[i], (unsigned long long)m->counters[i].load());
+  }
+
+  fprintf(file, "# TYPE ecudump_uds_nrc_total counter\n");
+  for (i = 0; i < 256; i++)
+    if (m->nrc[i])
+      fprintf(file, "ecudump_uds_nrc_total{nrc=\"0x%02X\"} %llu\n", (unsigned)i, (unsigned long long)m->nrc[i].load());
+
+  fprintf(file, "# TYPE ecudump_uds_phase_seconds summary\n");
+  for (i = 0; i < METRICS_PHASE_COUNT; i++)
+    metrics_prometheus_summary(file, "ecudump_uds_phase_seconds", "phase", metrics_phase_names[i], &m->phases[i]);
+
+  fprintf(file, "# TYPE ecudump_uds_response_seconds summary\n");
+  for (i = 1; i <= m->numServices; i++) {
+    snprintf(value, sizeof(value), "0x%02X", m->serviceSID[i].load());
+    metrics_prometheus_summary(file, "ecudump_uds_response_seconds", "sid", value, &m->services[i]);
+  }
+  if (m->services[METRICS_SERVICE_OTHER].count)
+    metrics_prometheus_summary(file, "ecudump_uds_response_seconds", "sid", "other", &m->services[METRICS_SERVICE_OTHER]);
+
+  delete m;
+  return ferror(file) ? EIO : 0;
+}
+
+static bool metrics_ends_with(const char* path, const char* suffix)
+{
+  size_t length = strlen(path), suffixLength = strlen(suffix);
+  return length >= suffixLength && strcmp(path + length - suffixLength, suffix) == 0;
+}
+
+size_t metrics_export(const char* path)
+{
+  size_t ret;
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    LOGE(TAG, "failed to open %s %s", path, strerror(errno));
+    return errno;
+  }
+  if (metrics_ends_with(path, ".prom") || metrics_ends_with(path, ".txt"))
+    ret = metrics_export_prometheus(file);
+  else
+    ret = metrics_export_json(file);
+  if (fclose(file)) ret = EIO;
+  if (ret) LOGE(TAG, "failed to write %s", path);
+  return ret;
+}
+
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+void metrics_export_on_signal(const char* path)
+{
+  (void)path;
+}
+#else
+static void metrics_signal(int sig)
+{
+  (void)sig;
+  metrics.signalled.store(true, std::memory_order_relaxed);
+}
+
+void metrics_export_on_signal(const char* path)
+{
+  metrics.signalPath = path;
+  signal(SIGUSR1, metrics_signal);
+}
+#endif
+
+void metrics_poll()
+{
+  if (!metrics.signalled.load(std::memory_order_relaxed)) return;
+  if (!metrics.signalled.exchange(false)) return;
+  if (metrics.signalPath && !metrics_export(metrics.signalPath))
+    LOGI(TAG, "wrote %s", metrics.signalPath);
+}
@@ -0,0 +1,133 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <atomic>
+
+/* Transaction metrics.
+ *
+ * Every uds_request_t owns a metrics_t. Only the thread sending requests writes to it,
+ * so recording is plain relaxed loads and stores without locked instructions. Exports
+ * read every registered metrics_t (plus those of requests already freed) and merge them,
+ * which is safe while transfers are running.
+ *
+ * Latencies go into HDR style log-linear histograms: values below 2^METRICS_HDR_SUB_BITS us
+ * are exact, above that every power of two is split into 2^METRICS_HDR_SUB_BITS buckets,
+ * which keeps percentiles within ~6% up to METRICS_HDR_MAGNITUDES.
+ */
+
+static const uint32_t METRICS_HDR_SUB_BITS   = 4;
+static const uint32_t METRICS_HDR_MAGNITUDES = 36;  // ~19 hours in us
+static const size_t   METRICS_HDR_BUCKETS    = (METRICS_HDR_MAGNITUDES - METRICS_HDR_SUB_BITS + 1) << METRICS_HDR_SUB_BITS;
+
+// services with their own response time histogram, anything after that shares the last one
+static const size_t METRICS_MAX_SERVICES = 16;
+static const size_t METRICS_SERVICE_OTHER = METRICS_MAX_SERVICES + 1;
+
+typedef std::atomic<uint64_t> metrics_counter_t;
+
+typedef struct Metrics_Histogram {
+  metrics_counter_t count;
+  metrics_counter_t total;
+  metrics_counter_t min;
+  metrics_counter_t max;
+  std::atomic<uint32_t> buckets[METRICS_HDR_BUCKETS];
+} metrics_histogram_t;
+
+enum metrics_phase {
+  METRICS_PHASE_WRITE = 0,    // PassThruWriteMsgs of the request
+  METRICS_PHASE_READ,         // every PassThruReadMsgs call, empty polls included
+  METRICS_PHASE_FIRST_FRAME,  // request on the bus until the first sign of a response
+  METRICS_PHASE_PENDING,      // first 0x78 until the real response starts
+  METRICS_PHASE_TRANSFER,     // first frame indication until the complete response
+  METRICS_PHASE_HOST,         // caller time between the end of one request and the next
+  METRICS_PHASE_COUNT
+};
+
+enum metrics_counter {
+  METRICS_REQUESTS = 0,
+  METRICS_RESPONSES,
+  METRICS_NEGATIVE_RESPONSES,
+  METRICS_PENDING,            // 0x78 responses
+  METRICS_TIMEOUTS,
+  METRICS_EMPTY_READS,        // PassThruReadMsgs retried because nothing had arrived yet
+  METRICS_DRIVER_ERRORS,
+  METRICS_BYTES_TX,
+  METRICS_BYTES_RX,
+  METRICS_COUNTER_COUNT
+};
+
+typedef struct Metrics {
+  metrics_counter_t   counters[METRICS_COUNTER_COUNT];
+  metrics_counter_t   nrc[256];
+  metrics_histogram_t phases[METRICS_PHASE_COUNT];
+
+  // response time per SID, slot 0 is unused so a zero in serviceSlot means "not assigned yet"
+  std::atomic<uint8_t> serviceSlot[256];
+  std::atomic<uint8_t> serviceSID[METRICS_SERVICE_OTHER + 1];
+  std::atomic<uint8_t> numServices;
+  metrics_histogram_t services[METRICS_SERVICE_OTHER + 1];
+
+  struct Metrics* next;
+} metrics_t;
+
+/** Recording is off until this is called, the transfer loop then pays only a branch */
+void metrics_enable(bool enable);
+bool metrics_enabled();
+
+/** Zero and register for exports. metrics_deinit folds the numbers into the process totals */
+void metrics_init(metrics_t* metrics);
+void metrics_deinit(metrics_t* metrics);
+
+static inline void metrics_count(metrics_t* metrics, enum metrics_counter counter, uint64_t n)
+{
+  metrics_counter_t* c = &metrics->counters[counter];
+  c->store(c->load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void metrics_histogram_reset(metrics_histogram_t* histogram);
+void metrics_histogram_record(metrics_histogram_t* histogram, uint64_t us);
+uint64_t metrics_histogram_percentile(const metrics_histogram_t* histogram, double percentile);
+
+static inline void metrics_phase(metrics_t* metrics, enum metrics_phase phase, uint64_t us)
+{
+  metrics_histogram_record(&metrics->phases[phase], us);
+}
+
+void metrics_service(metrics_t* metrics, uint8_t sid, uint64_t us);
+void metrics_nrc(metrics_t* metrics, uint8_t nrc);
+
+/** Log a summary of one set of metrics */
+void metrics_report(const metrics_t* metrics);
+
+/** Merge everything recorded in this process and write it out */
+size_t metrics_export_json(FILE* file);
+size_t metrics_export_prometheus(FILE* file);
+
+/** Write to `path`, Prometheus text if it ends in .prom or .txt, JSON otherwise */
+size_t metrics_export(const char* path);
+
+/** Export to `path` whenever SIGUSR1 arrives. No-op on Windows */
+void metrics_export_on_signal(const char* path);
+
+/** Called from the request path, performs a requested on demand export */
+void metrics_poll();
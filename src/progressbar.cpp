@@ -15,12 +15,13 @@ limitations under the License.
 */
 
 /*
-The Inspired by https://github.com/rpm-software-management/rpm/blob/a7c3886b356c2f3e3e640069623d44d62beabb33/lib/rpminstall.c#L30-L77
+The bar was inspired by https://github.com/rpm-software-management/rpm/blob/a7c3886b356c2f3e3e640069623d44d62beabb33/lib/rpminstall.c#L30-L77
 */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
 #include <io.h>
@@ -30,57 +31,159 @@ The Inspired by https://github.com/rpm-software-management/rpm/blob/a7c3886b356c
 #include <unistd.h>
 #endif
 
-static size_t charsCurrent = 0;
-static size_t charsTotal = 0;
-static size_t progressCurrent = 0;
-static size_t progressTotal = 0;
+#include "progressbar.h"
+#include "util.h"
 
-void resetProgress()
+static const size_t PROGRESS_BAR_WIDTH = 30;
+static const size_t PROGRESS_LINE_LENGTH = 320;
+
+void progress_init(progress_t* progress, FILE* out, unsigned int rateHz)
+{
+  progress->out    = out;
+  progress->rateHz = rateHz > PROGRESS_MAX_RATE_HZ ? PROGRESS_MAX_RATE_HZ : rateHz;
+  progress->tty    = isatty(fileno(out)) != 0;
+  progress->label  = "";
+  progress->total  = 0;
+  progress->amount = 0;
+  progress->running = false;
+  metrics_histogram_reset(&progress->chunkLatency);
+}
+
+// "512B", "12.5K" or "1.2M"
+static void progress_format_bytes(char* out, size_t length, double bytes)
 {
-    charsCurrent = 0;
-    charsTotal = 0;
-    progressCurrent = 0;
-    progressTotal = 0;
-    fprintf(stdout, "\r");
+  if (bytes >= 1024.0 * 1024.0) snprintf(out, length, "%.1fM", bytes / (1024.0 * 1024.0));
+  else if (bytes >= 1024.0)     snprintf(out, length, "%.1fK", bytes / 1024.0);
+  else                          snprintf(out, length, "%.0fB", bytes);
 }
 
-void printProgress(const size_t amount, const size_t total)
+static void progress_format_us(char* out, size_t length, uint64_t us)
 {
-  size_t charsNeeded;
-  charsTotal = (isatty(fileno(stdout)) ? 34 : 40);
-
-  if (charsCurrent != charsTotal) {
-    float pct = (total ? (((float) amount) / total) : 1.0);
-    charsNeeded = (charsTotal * pct) + 0.5;
-    while (charsNeeded > charsCurrent) {
-      if (isatty (fileno(stdout))) {
-        size_t i;
-        for (i = 0; i < charsCurrent; i++) 
-          putchar ('#');
-        for (; i < charsTotal; i++) 
-          putchar (' ');
-
-        fprintf(stdout, "(%3d%%)", (int)((100 * pct) + 0.5));
-
-        for (i = 0; i < (charsTotal + 6); i++) 
-          putchar ('\b');
-      } else {
-        fprintf(stdout, "#");
-      }
-      charsCurrent++;
+  if (us >= 1000) snprintf(out, length, "%.1fms", (double)us / 1000.0);
+  else            snprintf(out, length, "%lluus", (unsigned long long)us);
+}
+
+static void progress_render(progress_t* progress, bool final)
+{
+  char line[PROGRESS_LINE_LENGTH];
+  uint64_t now = monotonic_us();
+  uint64_t amount = progress->amount.load(std::memory_order_relaxed);
+  uint64_t total = progress->total;
+  double elapsed = (double)(now - progress->startUs) / 1000000.0;
+  int length;
+
+  if (amount > total) amount = total;
+  double pct = total ? (double)amount / (double)total : 1.0;
+  bool timed = progress->chunkLatency.count.load(std::memory_order_relaxed) != 0;
+  if (!final && amount == progress->lastAmount && !progress->tty) return;
+
+  // smooth the rate so one slow chunk doesn't throw the ETA around
+  if (now > progress->lastUs) {
+    double sample = (double)(amount - progress->lastAmount) * 1000000.0 / (double)(now - progress->lastUs);
+    progress->rate = progress->rate > 0 ? progress->rate + PROGRESS_RATE_SMOOTHING * (sample - progress->rate) : sample;
+  }
+  progress->lastAmount = amount;
+  progress->lastUs = now;
+
+  double rate = final ? (elapsed > 0 ? (double)amount / elapsed : 0.0) : progress->rate;
+  double eta = rate > 0 ? (double)(total - amount) / rate : -1.0;
+  uint64_t p50 = metrics_histogram_percentile(&progress->chunkLatency, 0.5);
+  uint64_t p90 = metrics_histogram_percentile(&progress->chunkLatency, 0.9);
+  uint64_t p99 = metrics_histogram_percentile(&progress->chunkLatency, 0.99);
+
+  if (!progress->tty) {
+    if (final) {
+      length = snprintf(line, sizeof(line),
+        "{\"event\":\"done\",\"label\":\"%s\",\"bytes\":%llu,\"total\":%llu,\"elapsed_s\":%.3f,\"bytes_per_sec\":%.0f}\n",
+        progress->label, (unsigned long long)amount, (unsigned long long)total, elapsed, rate);
+    } else {
+      char latency[96] = "";
+      if (timed)
+        snprintf(latency, sizeof(latency), ",\"chunk_p50_us\":%llu,\"chunk_p90_us\":%llu,\"chunk_p99_us\":%llu",
+          (unsigned long long)p50, (unsigned long long)p90, (unsigned long long)p99);
+      length = snprintf(line, sizeof(line),
+        "{\"event\":\"progress\",\"label\":\"%s\",\"bytes\":%llu,\"total\":%llu,\"bytes_per_sec\":%.0f%s,\"eta_s\":%.1f}\n",
+        progress->label, (unsigned long long)amount, (unsigned long long)total, rate, latency, eta);
     }
-    fflush(stdout);
-
-    if (charsCurrent == charsTotal) {
-      size_t i;
-      progressCurrent++;
-      if (isatty(fileno(stdout))) {
-        for (i = 1; i < charsCurrent; i++) putchar ('#');
-        pct = (progressTotal ? (((float) progressCurrent) / progressTotal): 1);
-        fprintf(stdout, " [%3d%%]", (int)((100 * pct) + 0.5));
-      }
-      fprintf(stdout, "\n");
+  } else {
+    char bar[PROGRESS_BAR_WIDTH + 1], speed[16], latency50[16], latency99[16], latency[48] = "", remaining[16];
+    size_t filled = (size_t)(pct * PROGRESS_BAR_WIDTH + 0.5), i;
+    for (i = 0; i < PROGRESS_BAR_WIDTH; i++) bar[i] = i < filled ? '#' : ' ';
+    bar[PROGRESS_BAR_WIDTH] = 0;
+
+    progress_format_bytes(speed, sizeof(speed), rate);
+    if (timed) {
+      progress_format_us(latency50, sizeof(latency50), p50);
+      progress_format_us(latency99, sizeof(latency99), p99);
+      snprintf(latency, sizeof(latency), " chunk p50 %s p99 %s", latency50, latency99);
+    }
+    if (final)         snprintf(remaining, sizeof(remaining), "%.1fs", elapsed);
+    else if (eta >= 0) snprintf(remaining, sizeof(remaining), "ETA %u:%02u", (unsigned)eta / 60, (unsigned)eta % 60);
+    else               snprintf(remaining, sizeof(remaining), "ETA --:--");
+
+    length = snprintf(line, sizeof(line), "\r%s [%s] %3d%% %s/s%s %s",
+      progress->label, bar, (int)(pct * 100 + 0.5), speed, latency, remaining);
+    if (length < 0) return;
+    if ((size_t)length >= sizeof(line) - 2) length = sizeof(line) - 3;
+
+    // pad over the previous line instead of relying on terminal escapes, Windows consoles lack them
+    size_t visible = (size_t)length;
+    while ((size_t)length < progress->lastLength && (size_t)length < sizeof(line) - 2)
+      line[length++] = ' ';
+    progress->lastLength = visible;
+    if (final) {
+      line[length++] = '\n';
+      progress->lastLength = 0;
     }
-    fflush(stdout);
+    line[length] = 0;
+  }
+
+  if (length > 0) {
+    fwrite(line, 1, (size_t)length < sizeof(line) ? (size_t)length : sizeof(line) - 1, progress->out);
+    fflush(progress->out);
+  }
+}
+
+static void progress_timer(progress_t* progress)
+{
+  std::unique_lock<std::mutex> guard(progress->lock);
+  while (progress->running.load(std::memory_order_acquire)) {
+    progress->wake.wait_for(guard, std::chrono::milliseconds(1000 / progress->rateHz));
+    if (progress->running.load(std::memory_order_acquire))
+      progress_render(progress, false);
+  }
+}
+
+void progress_start(progress_t* progress, const char* label, uint64_t total)
+{
+  if (progress->running.load()) progress_finish(progress);
+
+  progress->label      = label;
+  progress->total      = total;
+  progress->amount     = 0;
+  progress->startUs    = monotonic_us();
+  progress->lastAmount = 0;
+  progress->lastUs     = progress->startUs;
+  progress->rate       = 0;
+  progress->lastLength = 0;
+  metrics_histogram_reset(&progress->chunkLatency);
+  if (!progress->rateHz) return;
+
+  if (!progress->tty) {
+    fprintf(progress->out, "{\"event\":\"start\",\"label\":\"%s\",\"total\":%llu}\n", label, (unsigned long long)total);
+    fflush(progress->out);
+  }
+  progress->running = true;
+  progress->timer = std::thread(progress_timer, progress);
+}
+
+void progress_finish(progress_t* progress)
+{
+  if (!progress->running.exchange(false)) return;
+  {
+    std::lock_guard<std::mutex> guard(progress->lock);
+    progress->wake.notify_one();
   }
+  progress->timer.join();
+  progress_render(progress, true);
 }
@@ -17,5 +17,70 @@ limitations under the License.
 #pragma once
 
 #include <stdint.h>
-void printProgress(const size_t amount, const size_t total);
-void resetProgress();
+#include <stdio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "metrics.h"
+
+/* Progress reporting.
+ *
+ * The transfer loop only stores counters, a timer thread renders them at most rateHz
+ * times per second. On a terminal that is a single status line with a bar, throughput,
+ * chunk latency percentiles and an ETA. Anywhere else it is one JSON object per line
+ * (start, progress, done events) for scripts to parse.
+ */
+
+static const unsigned int PROGRESS_DEFAULT_RATE_HZ = 4;
+static const unsigned int PROGRESS_MAX_RATE_HZ     = 50;
+
+// weight of the newest throughput sample in the smoothed rate used for the ETA
+static const double PROGRESS_RATE_SMOOTHING = 0.3;
+
+typedef struct Progress {
+  FILE*        out;
+  unsigned int rateHz;     // 0 disables output
+  bool         tty;
+
+  const char*  label;
+  uint64_t     total;
+  uint64_t     startUs;
+  std::atomic<uint64_t> amount;
+  metrics_histogram_t   chunkLatency;  // written by the transfer thread only
+
+  // renderer state
+  uint64_t     lastAmount;
+  uint64_t     lastUs;
+  double       rate;        // smoothed bytes per second
+  size_t       lastLength;  // of the last status line on a terminal
+
+  std::atomic<bool> running;
+  std::mutex   lock;
+  std::condition_variable wake;
+  std::thread  timer;
+} progress_t;
+
+/** Pick the output and update rate, call once before progress_start */
+void progress_init(progress_t* progress, FILE* out, unsigned int rateHz);
+
+/** Begin reporting a transfer of `total` bytes */
+void progress_start(progress_t* progress, const char* label, uint64_t total);
+
+/** Set the number of bytes done so far */
+static inline void progress_update(progress_t* progress, uint64_t amount)
+{
+  progress->amount.store(amount, std::memory_order_relaxed);
+}
+
+/** Count a finished chunk and how long it took */
+static inline void progress_chunk(progress_t* progress, uint64_t bytes, uint64_t latencyUs)
+{
+  progress->amount.store(progress->amount.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+  metrics_histogram_record(&progress->chunkLatency, latencyUs);
+}
+
+/** Stop the timer and print the final state */
+void progress_finish(progress_t* progress);
@@ -0,0 +1,477 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAMVIDEO_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "ramvideo.h"
+#include "librx8.h"
+#include "util.h"
+
+static const char* TAG = "Ramvideo";
+
+// first byte at or after `from` where the frames differ, `length` if none
+static size_t ramvideo_next_change(const uint8_t* previous, const uint8_t* current, size_t from, size_t length)
+{
+  size_t i = from;
+#if defined(RAMVIDEO_SSE2)
+  for (; i + 16 <= length; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(previous + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(current + i));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) ^ 0xffffu;
+    if (mask) {
+      while (!(mask & 1)) {
+        mask >>= 1;
+        i++;
+      }
+      return i;
+    }
+  }
+#else
+  for (; i + 8 <= length; i += 8) {
+    uint64_t a, b;
+    memcpy(&a, previous + i, 8);
+    memcpy(&b, current + i, 8);
+    if (a != b) break;
+  }
+#endif
+  for (; i < length; i++)
+    if (previous[i] != current[i]) return i;
+  return length;
+}
+
+// end of the changed span starting at `from`. Unchanged gaps shorter than RAMVIDEO_MIN_RUN are part of it
+static size_t ramvideo_span_end(const uint8_t* previous, const uint8_t* current, size_t from, size_t length)
+{
+  size_t i = from;
+  while (i < length) {
+    if (previous[i] != current[i]) {
+      i++;
+      continue;
+    }
+    size_t same = i;
+    while (same < length && same - i < RAMVIDEO_MIN_RUN && previous[same] == current[same]) same++;
+    if (same - i >= RAMVIDEO_MIN_RUN || same == length) return i;
+    i = same;
+  }
+  return length;
+}
+
+static uint8_t* ramvideo_put_varint(uint8_t* out, size_t value)
+{
+  while (value >= 0x80) {
+    *out++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = (uint8_t)value;
+  return out;
+}
+
+static const uint8_t* ramvideo_get_varint(const uint8_t* in, const uint8_t* end, size_t* value)
+{
+  size_t result = 0;
+  for (unsigned shift = 0; in < end && shift < 35; shift += 7) {
+    uint8_t b = *in++;
+    result |= (size_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      *value = result;
+      return in;
+    }
+  }
+  return NULL;
+}
+
+size_t ramvideo_encoded_bound(size_t length)
+{
+  // every pair covers at least one changed byte and RAMVIDEO_MIN_RUN unchanged ones, two 5 byte varints at most
+  return length + (length / (RAMVIDEO_MIN_RUN + 1) + 1) * 10;
+}
+
+size_t ramvideo_encode(const uint8_t* previous, const uint8_t* current, size_t length, uint8_t* out)
+{
+  uint8_t* o = out;
+  size_t done = 0;
+  for (;;) {
+    size_t start = ramvideo_next_change(previous, current, done, length);
+    if (start == length) break;
+    size_t end = ramvideo_span_end(previous, current, start, length);
+    o = ramvideo_put_varint(o, start - done);
+    o = ramvideo_put_varint(o, end - start);
+    for (size_t i = start; i < end; i++)
+      *o++ = previous[i] ^ current[i];
+    done = end;
+  }
+  return (size_t)(o - out);
+}
+
+size_t ramvideo_decode(uint8_t* frame, size_t length, const uint8_t* in, size_t inLength)
+{
+  const uint8_t* end = in + inLength;
+  size_t position = 0;
+  while (in < end) {
+    size_t same, changed;
+    if (!(in = ramvideo_get_varint(in, end, &same)) || !(in = ramvideo_get_varint(in, end, &changed)))
+      return EINVAL;
+    if (same > length - position || changed > length - position - same || changed > (size_t)(end - in))
+      return EINVAL;
+    position += same;
+    for (size_t i = 0; i < changed; i++)
+      frame[position + i] ^= in[i];
+    position += changed;
+    in += changed;
+  }
+  return 0;
+}
+
+static size_t ramvideo_add_index(ramvideo_t* video, uint64_t offset, uint64_t timestampUs)
+{
+  if (video->frames == video->indexCapacity) {
+    size_t capacity = video->indexCapacity ? video->indexCapacity * 2 : 1024;
+    ramvideo_index_t* index = (ramvideo_index_t*)realloc(video->index, capacity * sizeof(ramvideo_index_t));
+    if (!index) return ENOMEM;
+    video->index = index;
+    video->indexCapacity = capacity;
+  }
+  video->index[video->frames++] = ramvideo_index_t{ offset, timestampUs };
+  return 0;
+}
+
+size_t ramvideo_create(ramvideo_t* video, const char* path, uint32_t address, uint32_t length)
+{
+  memset(video, 0, sizeof(ramvideo_t));
+  video->position = UINT64_MAX;
+  if (!length) return EINVAL;
+  memcpy(video->header.magic, RAMVIDEO_MAGIC, sizeof(video->header.magic));
+  video->header.version          = RAMVIDEO_VERSION;
+  video->header.address          = address;
+  video->header.length           = length;
+  video->header.keyframeInterval = RAMVIDEO_KEYFRAME_INTERVAL;
+  video->header.startTime        = (uint64_t)time(NULL);
+
+  video->frame   = (uint8_t*)calloc(length, 1);
+  video->zeros   = (uint8_t*)calloc(length, 1);
+  video->encoded = (uint8_t*)malloc(ramvideo_encoded_bound(length));
+  if (!video->frame || !video->zeros || !video->encoded) {
+    ramvideo_close(video);
+    return ENOMEM;
+  }
+  if (!(video->file = fopen(path, "wb"))) {
+    size_t ret = errno;
+    LOGE(TAG, "Failed to create %s %s", path, strerror(errno));
+    ramvideo_close(video);
+    return ret;
+  }
+  // frames and index are filled in when the recording is closed
+  if (fwrite(&video->header, sizeof(ramvideo_header_t), 1, video->file) != 1) {
+    ramvideo_close(video);
+    return EIO;
+  }
+  video->offset = sizeof(ramvideo_header_t);
+  return 0;
+}
+
+size_t ramvideo_append(ramvideo_t* video, const uint8_t* frame, uint64_t timestampUs)
+{
+  ramvideo_frame_t header;
+  bool keyframe = video->frames % video->header.keyframeInterval == 0;
+  size_t ret;
+
+  header.length      = (uint32_t)ramvideo_encode(keyframe ? video->zeros : video->frame, frame, video->header.length, video->encoded);
+  header.flags       = keyframe ? RAMVIDEO_KEYFRAME : 0;
+  header.timestampUs = timestampUs;
+  if (fwrite(&header, sizeof(header), 1, video->file) != 1 ||
+      (header.length && fwrite(video->encoded, header.length, 1, video->file) != 1))
+    return EIO;
+  if ((ret = ramvideo_add_index(video, video->offset, timestampUs))) return ret;
+  memcpy(video->frame, frame, video->header.length);
+  video->offset += sizeof(header) + header.length;
+  video->encodedBytes += sizeof(header) + header.length;
+  return 0;
+}
+
+// frames of a recording that was never closed. Stops at the first frame cut short
+static size_t ramvideo_rebuild_index(ramvideo_t* video)
+{
+  const uint8_t* data = video->map.data;
+  uint64_t offset = sizeof(ramvideo_header_t);
+  // a closed recording cut short, the frames end where its index starts
+  uint64_t end = video->header.indexOffset && video->header.indexOffset < video->map.length ?
+                 video->header.indexOffset : video->map.length;
+  ramvideo_frame_t frame;
+  size_t ret;
+  while (offset + sizeof(frame) <= end) {
+    memcpy(&frame, data + offset, sizeof(frame));
+    if (frame.length > end - offset - sizeof(frame) || (frame.flags & ~RAMVIDEO_KEYFRAME)) break;
+    if ((ret = ramvideo_add_index(video, offset, frame.timestampUs))) return ret;
+    offset += sizeof(frame) + frame.length;
+  }
+  return 0;
+}
+
+size_t ramvideo_open(ramvideo_t* video, const char* path)
+{
+  size_t ret;
+  memset(video, 0, sizeof(ramvideo_t));
+  video->position = UINT64_MAX;
+  if ((ret = mapfile_open(&video->map, path))) return ret;
+  video->reader = true;
+  if (video->map.length < sizeof(ramvideo_header_t)) {
+    LOGE(TAG, "%s is not a RAM video", path);
+    ramvideo_close(video);
+    return EINVAL;
+  }
+  memcpy(&video->header, video->map.data, sizeof(ramvideo_header_t));
+  const ramvideo_header_t* header = &video->header;
+  if (memcmp(header->magic, RAMVIDEO_MAGIC, sizeof(header->magic)) || header->version != RAMVIDEO_VERSION ||
+      !header->length || !header->keyframeInterval) {
+    LOGE(TAG, "%s is not a RAM video", path);
+    ramvideo_close(video);
+    return EINVAL;
+  }
+  if (!(video->frame = (uint8_t*)malloc(header->length))) {
+    ramvideo_close(video);
+    return ENOMEM;
+  }
+
+  uint64_t indexLength = header->frames * sizeof(ramvideo_index_t);
+  if (header->indexOffset && header->frames && header->indexOffset <= video->map.length &&
+      indexLength / sizeof(ramvideo_index_t) == header->frames && indexLength <= video->map.length - header->indexOffset) {
+    if (!(video->index = (ramvideo_index_t*)malloc((size_t)indexLength))) {
+      ramvideo_close(video);
+      return ENOMEM;
+    }
+    memcpy(video->index, video->map.data + header->indexOffset, (size_t)indexLength);
+    video->frames = video->indexCapacity = (size_t)header->frames;
+  } else {
+    LOGI(TAG, "%s has no index, it wasn't closed. Rebuilding it", path);
+    if ((ret = ramvideo_rebuild_index(video))) {
+      ramvideo_close(video);
+      return ret;
+    }
+  }
+  return 0;
+}
+
+// decode frame `n` on top of whatever is in video->frame
+static size_t ramvideo_apply(ramvideo_t* video, uint64_t n)
+{
+  ramvideo_frame_t frame;
+  uint64_t offset = video->index[n].offset;
+  if (offset > video->map.length || sizeof(frame) > video->map.length - offset) return EINVAL;
+  memcpy(&frame, video->map.data + offset, sizeof(frame));
+  if (frame.length > video->map.length - offset - sizeof(frame)) return EINVAL;
+  if (frame.flags & RAMVIDEO_KEYFRAME)
+    memset(video->frame, 0, video->header.length);
+  return ramvideo_decode(video->frame, video->header.length, video->map.data + offset + sizeof(frame), frame.length);
+}
+
+size_t ramvideo_seek(ramvideo_t* video, uint64_t n)
+{
+  size_t ret;
+  if (n >= video->frames) return ERANGE;
+  if (n == video->position) return 0;
+
+  // from the keyframe before `n`, unless the current frame is already between the two
+  uint64_t from = n - n % video->header.keyframeInterval;
+  if (video->position != UINT64_MAX && video->position >= from && video->position < n)
+    from = video->position + 1;
+  video->position = UINT64_MAX;
+  for (uint64_t i = from; i <= n; i++) {
+    if ((ret = ramvideo_apply(video, i))) return ret;
+  }
+  video->position = n;
+  return 0;
+}
+
+uint64_t ramvideo_find(const ramvideo_t* video, uint64_t timestampUs)
+{
+  uint64_t low = 0, high = video->frames;
+  while (low < high) {
+    uint64_t middle = low + (high - low) / 2;
+    if (video->index[middle].timestampUs <= timestampUs)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low ? low - 1 : 0;
+}
+
+size_t ramvideo_close(ramvideo_t* video)
+{
+  size_t ret = 0;
+  if (video->file) {
+    video->header.frames      = video->frames;
+    video->header.indexOffset = video->offset;
+    if ((video->frames && fwrite(video->index, sizeof(ramvideo_index_t), (size_t)video->frames, video->file) != video->frames) ||
+        fseek(video->file, 0, SEEK_SET) ||
+        fwrite(&video->header, sizeof(ramvideo_header_t), 1, video->file) != 1)
+      ret = EIO;
+    if (fclose(video->file) && !ret)
+      ret = EIO;
+  }
+  if (video->reader)
+    mapfile_close(&video->map);
+  free(video->frame);
+  free(video->zeros);
+  free(video->encoded);
+  free(video->index);
+  memset(video, 0, sizeof(ramvideo_t));
+  return ret;
+}
+
+size_t ramvideo_print(ramvideo_t* video, FILE* out)
+{
+  size_t length = video->header.length;
+  uint8_t* previous = (uint8_t*)calloc(length, 1);
+  uint64_t encoded = 0;
+  size_t ret = 0;
+  if (!previous) return ENOMEM;
+
+  fprintf(out, "%zu bytes at 0x%08X, %llu frames\n", length, video->header.address, (unsigned long long)video->frames);
+  fprintf(out, "%10s %12s %10s %10s\n", "frame", "time (s)", "encoded", "changed");
+  for (uint64_t n = 0; n < video->frames; n++) {
+    ramvideo_frame_t frame;
+    if ((ret = ramvideo_seek(video, n))) break;
+    memcpy(&frame, video->map.data + video->index[n].offset, sizeof(frame));
+    size_t changed = 0;
+    for (size_t i = 0; i < length; i++)
+      changed += previous[i] != video->frame[i];
+    memcpy(previous, video->frame, length);
+    encoded += sizeof(frame) + frame.length;
+    fprintf(out, "%10llu %12.6f %10u %10zu%s\n", (unsigned long long)n, (double)frame.timestampUs / 1e6,
+            frame.length, n ? changed : (size_t)0, frame.flags & RAMVIDEO_KEYFRAME ? " key" : "");
+  }
+  free(previous);
+  if (ret) return ret;
+
+  if (video->frames) {
+    double seconds = (double)video->index[video->frames - 1].timestampUs / 1e6;
+    fprintf(out, "%.3fs, %.1f frames/s, %.1f:1\n", seconds, seconds > 0 ? (double)(video->frames - 1) / seconds : 0.0,
+            encoded ? (double)(video->frames * length) / (double)encoded : 0.0);
+  }
+  return 0;
+}
+
+size_t ramvideo_record(RX8* ecu, const char* path, uint32_t address, uint32_t length, size_t chunkSize,
+                       uint64_t samples)
+{
+  ramvideo_t video;
+  size_t ret = 0, writeError = 0;
+
+  if (!chunkSize || chunkSize > RX8_MAX_TRANSFER_LENGTH)
+    chunkSize = RX8_MAX_TRANSFER_LENGTH;
+  uint8_t* frame = (uint8_t*)malloc(length);
+  if (!frame || (ret = ramvideo_create(&video, path, address, length))) {
+    LOGE(TAG, "Failed to start %s", path);
+    free(frame);
+    return frame ? ret : ENOMEM;
+  }
+
+  interrupt_catch();
+  LOGI(TAG, "Recording 0x%x bytes at 0x%08x, Ctrl+C to stop", length, address);
+  ecu->beginTransfer();
+  uint64_t start = monotonic_us(), lastReport = start;
+  while (!interrupt_requested() && (!samples || video.frames < samples)) {
+    uint64_t timestamp = monotonic_us() - start;
+    for (uint32_t offset = 0; offset < length && !ret; offset += (uint32_t)chunkSize) {
+      size_t size = length - offset < chunkSize ? length - offset : chunkSize;
+      ret = ecu->readMemory(address + offset, rx8_span_t{ frame + offset, size }).error;
+    }
+    if (ret)
+      break;
+    if ((writeError = ramvideo_append(&video, frame, timestamp)))
+      break;
+    uint64_t now = monotonic_us();
+    if (now - lastReport >= 1000000) {
+      LOGI(TAG, "%llu frames, %.1f/s, %.1f:1", (unsigned long long)video.frames,
+           (double)video.frames * 1000000.0 / (double)(now - start),
+           (double)(video.frames * length) / (double)video.encodedBytes);
+      lastReport = now;
+    }
+  }
+  ecu->endTransfer();
+  interrupt_release();
+  free(frame);
+  if (ret)
+    LOGE(TAG, "Reading RAM failed after %llu frames", (unsigned long long)video.frames);
+
+  uint64_t frames = video.frames, encodedBytes = video.encodedBytes;
+  size_t closeError = ramvideo_close(&video);
+  if (closeError || writeError) {
+    LOGE(TAG, "Failed to write %s", path);
+    return writeError ? writeError : closeError;
+  }
+  LOGI(TAG, "%llu frames, %.1f MB of RAM in %.1f MB. Wrote %s", (unsigned long long)frames,
+       (double)(frames * length) / 1e6, (double)encodedBytes / 1e6, path);
+  return ret;
+}
+
+size_t ramvideo_list(const char* path, FILE* out)
+{
+  ramvideo_t video;
+  size_t ret = ramvideo_open(&video, path);
+  if (ret)
+    return ret;
+  ret = ramvideo_print(&video, out);
+  ramvideo_close(&video);
+  return ret;
+}
+
+size_t ramvideo_show_frame(const char* path, bool byTime, uint64_t frame, double time,
+                           const hexdump_options_t* options, FILE* out)
+{
+  ramvideo_t video;
+  uint8_t* previous = NULL;
+  size_t ret = ramvideo_open(&video, path);
+  if (ret)
+    return ret;
+
+  uint64_t n = byTime ? ramvideo_find(&video, (uint64_t)(time * 1e6)) : frame;
+  if (n >= video.frames) {
+    LOGE(TAG, "%s has %llu frames", path, (unsigned long long)video.frames);
+    ramvideo_close(&video);
+    return ERANGE;
+  }
+  if (n > 0) {
+    previous = (uint8_t*)malloc(video.header.length);
+    ret = previous ? ramvideo_seek(&video, n - 1) : ENOMEM;
+    if (!ret)
+      memcpy(previous, video.frame, video.header.length);
+  }
+  if (!ret)
+    ret = ramvideo_seek(&video, n);
+  if (!ret) {
+    hexdump_options_t against = *options;
+    against.address  = video.header.address;
+    against.compare  = previous;
+    against.diffOnly = options->diffOnly && previous;
+    LOGI(TAG, "Frame %llu at %.6fs", (unsigned long long)n, (double)video.index[n].timestampUs / 1e6);
+    ret = hexdump_write(out, video.frame, video.header.length, &against);
+  } else {
+    LOGE(TAG, "%s is damaged at frame %llu", path, (unsigned long long)n);
+  }
+  free(previous);
+  ramvideo_close(&video);
+  return ret;
+}
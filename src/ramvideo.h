@@ -0,0 +1,146 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "mapfile.h"
+#include "hexdump.h"
+
+class RX8;
+
+/* RAM video.
+ *
+ * A window of RAM read over and over in one unlocked session, every pass a frame.
+ * A frame is stored as its XOR against the previous frame: runs of unchanged bytes
+ * are skipped, the changed ones are kept as XOR bytes. Most of RAM doesn't change
+ * from one frame to the next, so a frame costs about as much as what changed in it.
+ * Every RAMVIDEO_KEYFRAME_INTERVAL-th frame is encoded against zeros, so getting to
+ * any frame decodes at most that many frames.
+ *
+ * File layout:
+ *   ramvideo_header_t
+ *   ramvideo_frame_t, each followed by `length` bytes of encoded frame
+ *   ramvideo_index_t for every frame, written when the recording is closed
+ * A recording that was cut short has no index, it is rebuilt by walking the frames.
+ *
+ * Encoded frame: pairs of LEB128 varints (unchanged bytes, changed bytes), each
+ * followed by that many XOR bytes. Unchanged bytes after the last pair are implied.
+ * Unchanged runs shorter than RAMVIDEO_MIN_RUN stay inside the XOR bytes, a pair
+ * would cost more than they save.
+ */
+
+#define RAMVIDEO_MAGIC "RX8RAMV"
+static const uint32_t RAMVIDEO_VERSION           = 1;
+static const uint32_t RAMVIDEO_KEYFRAME_INTERVAL = 64;
+static const size_t   RAMVIDEO_MIN_RUN           = 4;
+static const uint32_t RAMVIDEO_KEYFRAME          = 1;
+
+typedef struct Ramvideo_Header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t address;      // of the window
+  uint32_t length;       // bytes per frame
+  uint32_t keyframeInterval;
+  uint64_t frames;       // 0 until the recording is closed
+  uint64_t indexOffset;  // 0 until the recording is closed
+  uint64_t startTime;    // seconds since the epoch
+} ramvideo_header_t;
+
+typedef struct Ramvideo_Frame {
+  uint32_t length;       // encoded bytes after this header
+  uint32_t flags;        // RAMVIDEO_KEYFRAME
+  uint64_t timestampUs;  // start of the frame's first read, since the first frame
+} ramvideo_frame_t;
+
+typedef struct Ramvideo_Index {
+  uint64_t offset;       // of the ramvideo_frame_t
+  uint64_t timestampUs;
+} ramvideo_index_t;
+
+typedef struct Ramvideo {
+  ramvideo_header_t header;
+  uint8_t*  frame;       // last frame written, or the frame ramvideo_seek() decoded
+  uint64_t  frames;
+  size_t    indexCapacity;
+  ramvideo_index_t* index;
+  // writer
+  FILE*     file;
+  uint8_t*  zeros;       // what keyframes are encoded against
+  uint8_t*  encoded;
+  uint64_t  offset;      // where the next frame goes
+  uint64_t  encodedBytes;  // frame headers included
+  // reader
+  bool      reader;      // `map` is open
+  mapfile_t map;
+  uint64_t  position;    // frame in `frame`, UINT64_MAX for none
+} ramvideo_t;
+
+/** Worst case encoded length of a `length` byte frame */
+size_t ramvideo_encoded_bound(size_t length);
+
+/**
+ * Encode `current` against `previous` (all zeros for a keyframe) into `out`, which holds
+ * ramvideo_encoded_bound() bytes. Returns the encoded length, 0 if nothing changed
+ */
+size_t ramvideo_encode(const uint8_t* previous, const uint8_t* current, size_t length, uint8_t* out);
+
+/** Apply an encoded frame to `frame`, which holds the previous one. Returns 0 or EINVAL */
+size_t ramvideo_decode(uint8_t* frame, size_t length, const uint8_t* in, size_t inLength);
+
+/** Start a recording of `length` bytes at `address`. Returns 0 or errno */
+size_t ramvideo_create(ramvideo_t* video, const char* path, uint32_t address, uint32_t length);
+
+/** Append a frame. Returns 0 or errno */
+size_t ramvideo_append(ramvideo_t* video, const uint8_t* frame, uint64_t timestampUs);
+
+/** Open a recording for reading, rebuilding its index if it has none. Returns 0 or errno */
+size_t ramvideo_open(ramvideo_t* video, const char* path);
+
+/** Decode frame `n` into video->frame. Returns 0, ERANGE past the last frame, or EINVAL */
+size_t ramvideo_seek(ramvideo_t* video, uint64_t n);
+
+/** Last frame that started at or before `timestampUs` */
+uint64_t ramvideo_find(const ramvideo_t* video, uint64_t timestampUs);
+
+/** Finish a recording (index and header) or close a reader. Returns 0 or errno */
+size_t ramvideo_close(ramvideo_t* video);
+
+/** One line per frame: number, time, encoded bytes and bytes changed. Returns 0 or errno */
+size_t ramvideo_print(ramvideo_t* video, FILE* out);
+
+/**
+ * --ram-video: read `length` bytes at `address` of an unlocked `ecu` back to back, `chunkSize`
+ * bytes per request, into a new recording at `path` until `samples` frames, forever if 0, or
+ * Ctrl+C. Returns 0 or the first error
+ */
+size_t ramvideo_record(RX8* ecu, const char* path, uint32_t address, uint32_t length, size_t chunkSize,
+                       uint64_t samples);
+
+/** ramvideo_print() of the recording at `path`. Returns 0 or errno */
+size_t ramvideo_list(const char* path, FILE* out);
+
+/**
+ * Hexdump frame `frame` of the recording at `path`, or the one at `time` seconds if `byTime`,
+ * against the frame before it. `options` set everything but the address and the compared
+ * frame. Returns 0 or errno
+ */
+size_t ramvideo_show_frame(const char* path, bool byTime, uint64_t frame, double time,
+                           const hexdump_options_t* options, FILE* out);
@@ -0,0 +1,606 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+
+#include "romedit.h"
+#include "defresolve.h"
+#include "util.h"
+
+static const char* TAG = "Romedit";
+
+// widest table row a patch can set
+static const size_t ROMEDIT_MAX_COLUMNS = 1024;
+
+static uint32_t romedit_be32(const uint8_t* p)
+{
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void romedit_put_be32(uint8_t* p, uint32_t value)
+{
+  p[0] = (uint8_t)(value >> 24);
+  p[1] = (uint8_t)(value >> 16);
+  p[2] = (uint8_t)(value >> 8);
+  p[3] = (uint8_t)value;
+}
+
+// sum of the big endian words in [from, to), both word aligned
+static uint32_t romedit_sum(const uint8_t* rom, uint32_t from, uint32_t to)
+{
+  uint32_t sum = 0;
+  for (uint32_t a = from; a < to; a += 4)
+    sum += romedit_be32(rom + a);
+  return sum;
+}
+
+// the subarudbw table, left empty if what is there doesn't look like one
+static void romedit_find_checksums(romedit_t* edit)
+{
+  size_t length = edit->map.length;
+  edit->numChecksums = 0;
+  edit->checksumTable = 0;
+  edit->checksumTableLength = 0;
+  if (length < ROMEDIT_CHECKSUM_TABLE || length % 4) return;
+
+  uint32_t table = (uint32_t)(length - ROMEDIT_CHECKSUM_TABLE);
+  for (size_t i = 0; i < ROMEDIT_MAX_CHECKSUMS; i++) {
+    const uint8_t* entry = edit->map.data + table + i * 12;
+    uint32_t start = romedit_be32(entry), end = romedit_be32(entry + 4);
+    if (!start && !end) break;
+    if (start >= end || end > table || start % 4 || end % 4) {
+      edit->numChecksums = 0;
+      return;
+    }
+    edit->checksums[i] = romedit_checksum_t{ start, end, table + (uint32_t)i * 12 + 8 };
+    edit->numChecksums++;
+  }
+  if (!edit->numChecksums) return;
+  edit->checksumTable = table;
+  edit->checksumTableLength = (uint32_t)edit->numChecksums * 12;
+}
+
+// what the checksum table looks like before the pending revision
+static void romedit_snapshot(romedit_t* edit)
+{
+  if (edit->checksumTableLength)
+    memcpy(edit->checksumsBefore, edit->map.data + edit->checksumTable, edit->checksumTableLength);
+}
+
+static void romedit_mark(romedit_t* edit, uint32_t address, size_t length)
+{
+  for (size_t b = address / ROMEDIT_BLOCK; b <= (address + length - 1) / ROMEDIT_BLOCK; b++)
+    edit->dirty[b] = 1;
+}
+
+static void romedit_reset(romedit_t* edit)
+{
+  edit->numRanges   = 0;
+  edit->bytesLength = 0;
+  romedit_snapshot(edit);
+}
+
+size_t romedit_open(romedit_t* edit, const char* path)
+{
+  size_t ret;
+  memset(edit, 0, sizeof(romedit_t));
+  if ((ret = mapfile_open_private(&edit->map, path))) return ret;
+  if (!edit->map.length) {
+    LOGE(TAG, "%s is empty", path);
+    mapfile_close(&edit->map);
+    return EINVAL;
+  }
+  snprintf(edit->path, sizeof(edit->path), "%s", path);
+  snprintf(edit->journalPath, sizeof(edit->journalPath), "%s.journal", path);
+
+  edit->numBlocks = (edit->map.length + ROMEDIT_BLOCK - 1) / ROMEDIT_BLOCK;
+  edit->dirty = (uint8_t*)calloc(edit->numBlocks, 1);
+  if (!edit->dirty) {
+    mapfile_close(&edit->map);
+    return ENOMEM;
+  }
+  romedit_find_checksums(edit);
+  romedit_reset(edit);
+  return 0;
+}
+
+void romedit_close(romedit_t* edit)
+{
+  mapfile_close(&edit->map);
+  free(edit->ranges);
+  free(edit->before);
+  free(edit->after);
+  free(edit->dirty);
+  memset(edit, 0, sizeof(romedit_t));
+}
+
+// room for one more range of `length` bytes in the pending revision
+static size_t romedit_reserve(romedit_t* edit, size_t length)
+{
+  if (edit->numRanges == edit->rangeCapacity) {
+    size_t capacity = edit->rangeCapacity ? edit->rangeCapacity * 2 : 64;
+    romedit_range_t* ranges = (romedit_range_t*)realloc(edit->ranges, capacity * sizeof(romedit_range_t));
+    if (!ranges) return ENOMEM;
+    edit->ranges = ranges;
+    edit->rangeCapacity = capacity;
+  }
+  if (edit->bytesLength + length > edit->bytesCapacity) {
+    size_t capacity = edit->bytesCapacity ? edit->bytesCapacity : 4096;
+    while (capacity < edit->bytesLength + length) capacity *= 2;
+    uint8_t* before = (uint8_t*)realloc(edit->before, capacity);
+    if (before) edit->before = before;
+    uint8_t* after = (uint8_t*)realloc(edit->after, capacity);
+    if (after) edit->after = after;
+    if (!before || !after) return ENOMEM;
+    edit->bytesCapacity = capacity;
+  }
+  return 0;
+}
+
+size_t romedit_write(romedit_t* edit, uint32_t address, const uint8_t* data, size_t length)
+{
+  uint8_t* rom = edit->map.data;
+  uint32_t sums[ROMEDIT_MAX_CHECKSUMS];
+  size_t ret;
+
+  if (!length) return 0;
+  if (address > edit->map.length || length > edit->map.length - address) return ERANGE;
+  if (memcmp(rom + address, data, length) == 0) return 0;
+  if ((ret = romedit_reserve(edit, length))) return ret;
+
+  // sums of the words this write touches, per checksum range. Ranges all end before the table, so
+  // only the part of a write outside of it is summed, even when it straddles the start of the table
+  uint32_t end = address + (uint32_t)length;
+  uint32_t from = address & ~3u, to = (end + 3) & ~3u;
+  for (size_t c = 0; c < edit->numChecksums; c++) {
+    const romedit_checksum_t* checksum = &edit->checksums[c];
+    uint32_t lo = from > checksum->start ? from : checksum->start, hi = to < checksum->end ? to : checksum->end;
+    sums[c] = lo < hi ? romedit_sum(rom, lo, hi) : 0;
+  }
+
+  // a write right after the previous one extends its range, a table row is one range
+  romedit_range_t* last = edit->numRanges ? &edit->ranges[edit->numRanges - 1] : NULL;
+  if (last && last->address + last->length == address) {
+    last->length += (uint32_t)length;
+  } else {
+    edit->ranges[edit->numRanges++] = romedit_range_t{ address, (uint32_t)length };
+  }
+  memcpy(edit->before + edit->bytesLength, rom + address, length);
+  memcpy(edit->after + edit->bytesLength, data, length);
+  edit->bytesLength += length;
+  memcpy(rom + address, data, length);
+  romedit_mark(edit, address, length);
+
+  for (size_t c = 0; c < edit->numChecksums; c++) {
+    const romedit_checksum_t* checksum = &edit->checksums[c];
+    uint32_t lo = from > checksum->start ? from : checksum->start, hi = to < checksum->end ? to : checksum->end;
+    if (lo >= hi) continue;
+    uint32_t delta = romedit_sum(rom, lo, hi) - sums[c];
+    romedit_put_be32(rom + checksum->address, romedit_be32(rom + checksum->address) - delta);
+    romedit_mark(edit, checksum->address, 4);
+  }
+  return 0;
+}
+
+size_t romedit_set_cells(romedit_t* edit, const definition_table_t* table, uint16_t row, uint16_t column,
+                         const float* values, size_t count)
+{
+  uint8_t buffer[ROMEDIT_MAX_COLUMNS * 4];
+  size_t size = definition_storage_size(table->storage), ret;
+
+  if (!size || row >= table->sizeY || column > table->sizeX || count > (size_t)(table->sizeX - column)) return ERANGE;
+  // rows are contiguous unless the table is stored column by column
+  size_t run = table->swapXY ? 1 : ROMEDIT_MAX_COLUMNS;
+  for (size_t i = 0; i < count; i += run) {
+    size_t n = count - i < run ? count - i : run;
+    if ((ret = definition_encode(buffer, sizeof(buffer), 0, n, table->storage, table->bigEndian, &table->scaling, values + i)))
+      return ret;
+    if ((ret = romedit_write(edit, definition_cell_address(table, row, (uint16_t)(column + i)), buffer, n * size)))
+      return ret;
+  }
+  return 0;
+}
+
+// strip spaces, quotes, a UTF-8 BOM and the line break
+static char* romedit_trim(char* s)
+{
+  if ((uint8_t)s[0] == 0xef && (uint8_t)s[1] == 0xbb && (uint8_t)s[2] == 0xbf) s += 3;
+  while (isspace((unsigned char)*s) || *s == '"') s++;
+  char* end = s + strlen(s);
+  while (end > s && (isspace((unsigned char)end[-1]) || end[-1] == '"')) end--;
+  *end = 0;
+  return s;
+}
+
+// one row of a patch, runs of non empty cells are set together
+static size_t romedit_patch_row(romedit_t* edit, const definition_table_t* table, uint16_t row, char* line,
+                                const char* path, unsigned lineNumber, size_t* cells)
+{
+  float values[ROMEDIT_MAX_COLUMNS];
+  char* field = strchr(line, ',');   // the breakpoint before it is ignored
+  size_t ret;
+
+  for (uint16_t column = 0; field; ) {
+    uint16_t start = column;
+    size_t n = 0;
+    while (field) {
+      char* value = field + 1;
+      field = strchr(value, ',');
+      if (field) *field = 0;
+      value = romedit_trim(value);
+      if (!*value) {
+        column++;
+        break;
+      }
+      char* end;
+      values[n] = strtof(value, &end);
+      if (*end || column >= table->sizeX || n == ROMEDIT_MAX_COLUMNS) {
+        LOGE(TAG, "%s:%u: bad cell %s, %s has %u columns", path, lineNumber, value, table->name, table->sizeX);
+        return EINVAL;
+      }
+      n++;
+      column++;
+    }
+    if (n && (ret = romedit_set_cells(edit, table, row, start, values, n))) {
+      LOGE(TAG, "%s:%u: can't set %s, %s", path, lineNumber, table->name,
+        ret == EINVAL ? "its to_byte scaling gives no number" : "it is outside the ROM");
+      return ret;
+    }
+    *cells += n;
+  }
+  return 0;
+}
+
+size_t romedit_apply_patch(romedit_t* edit, const definition_t* definition, const char* path, size_t* cells)
+{
+  FILE* file = fopen(path, "r");
+  const definition_table_t* table = NULL;
+  char line[16384];
+  unsigned lineNumber = 0;
+  uint16_t row = 0;
+  size_t ret = 0;
+
+  *cells = 0;
+  if (!file) {
+    LOGE(TAG, "failed to open %s %s", path, strerror(errno));
+    return errno;
+  }
+  while (!ret && fgets(line, sizeof(line), file)) {
+    char* text = romedit_trim(line);
+    lineNumber++;
+    if (!*text) {
+      table = NULL;
+      continue;
+    }
+    if (!table) {
+      if (!(table = definition_find(definition, text))) {
+        LOGE(TAG, "%s:%u: no table named %s", path, lineNumber, text);
+        ret = ENOENT;
+      }
+      row = 0;
+      continue;
+    }
+    // x breakpoints of a 3D table
+    if (table->dimensions == 3 && row == 0 && line[0] == ',') continue;
+    if (row >= table->sizeY) {
+      LOGE(TAG, "%s:%u: %s has %u rows", path, lineNumber, table->name, table->sizeY);
+      ret = EINVAL;
+      break;
+    }
+    ret = romedit_patch_row(edit, table, row++, line, path, lineNumber, cells);
+  }
+  fclose(file);
+  return ret;
+}
+
+void romedit_discard(romedit_t* edit)
+{
+  size_t offset = edit->bytesLength;
+  for (size_t r = edit->numRanges; r-- > 0;) {
+    const romedit_range_t* range = &edit->ranges[r];
+    offset -= range->length;
+    memcpy(edit->map.data + range->address, edit->before + offset, range->length);
+  }
+  if (edit->checksumTableLength)
+    memcpy(edit->map.data + edit->checksumTable, edit->checksumsBefore, edit->checksumTableLength);
+  romedit_reset(edit);
+}
+
+// dirty blocks back into the image file
+static size_t romedit_flush(romedit_t* edit)
+{
+  FILE* file = fopen(edit->path, "r+b");
+  if (!file) {
+    LOGE(TAG, "failed to open %s %s", edit->path, strerror(errno));
+    return errno;
+  }
+  for (size_t b = 0; b < edit->numBlocks; b++) {
+    if (!edit->dirty[b]) continue;
+    size_t address = b * ROMEDIT_BLOCK;
+    size_t length = edit->map.length - address < ROMEDIT_BLOCK ? edit->map.length - address : ROMEDIT_BLOCK;
+    if (fseek(file, (long)address, SEEK_SET) || fwrite(edit->map.data + address, 1, length, file) != length) {
+      LOGE(TAG, "failed to write %s %s", edit->path, strerror(errno));
+      fclose(file);
+      return EIO;
+    }
+  }
+  return fclose(file) ? EIO : 0;
+}
+
+// the journal with its header read, or a new one. NULL if it can't be used with this image
+static FILE* romedit_journal(romedit_t* edit, romedit_journal_header_t* header, bool create)
+{
+  FILE* file = fopen(edit->journalPath, "r+b");
+  if (!file) {
+    if (!create) return NULL;
+    file = fopen(edit->journalPath, "w+b");
+    if (!file) {
+      LOGE(TAG, "failed to create %s %s", edit->journalPath, strerror(errno));
+      return NULL;
+    }
+    memset(header, 0, sizeof(romedit_journal_header_t));
+    memcpy(header->magic, ROMEDIT_JOURNAL_MAGIC, sizeof(header->magic));
+    header->version   = ROMEDIT_JOURNAL_VERSION;
+    header->romLength = (uint32_t)edit->map.length;
+    return file;
+  }
+  if (fread(header, sizeof(romedit_journal_header_t), 1, file) != 1 ||
+      memcmp(header->magic, ROMEDIT_JOURNAL_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != ROMEDIT_JOURNAL_VERSION || header->romLength != edit->map.length) {
+    LOGE(TAG, "%s is not a journal of %s", edit->journalPath, edit->path);
+    fclose(file);
+    return NULL;
+  }
+  return file;
+}
+
+// file offset of revision `index`, -1 if the journal is cut short
+static long romedit_journal_seek(FILE* file, uint32_t index)
+{
+  long offset = (long)sizeof(romedit_journal_header_t);
+  romedit_revision_t revision;
+  for (uint32_t i = 0; i < index; i++) {
+    if (fseek(file, offset, SEEK_SET) || fread(&revision, sizeof(revision), 1, file) != 1 ||
+        revision.length < sizeof(revision))
+      return -1;
+    offset += (long)revision.length;
+  }
+  return fseek(file, offset, SEEK_SET) ? -1 : offset;
+}
+
+size_t romedit_commit(romedit_t* edit, const char* name)
+{
+  romedit_journal_header_t header;
+  romedit_revision_t revision;
+  size_t ret;
+
+  // the checksum words changed by this revision are one more range
+  if (edit->checksumTableLength &&
+      memcmp(edit->checksumsBefore, edit->map.data + edit->checksumTable, edit->checksumTableLength) != 0) {
+    if ((ret = romedit_reserve(edit, edit->checksumTableLength))) return ret;
+    edit->ranges[edit->numRanges++] = romedit_range_t{ edit->checksumTable, edit->checksumTableLength };
+    memcpy(edit->before + edit->bytesLength, edit->checksumsBefore, edit->checksumTableLength);
+    memcpy(edit->after + edit->bytesLength, edit->map.data + edit->checksumTable, edit->checksumTableLength);
+    edit->bytesLength += edit->checksumTableLength;
+  }
+  if (!edit->numRanges) return 0;
+
+  FILE* file = romedit_journal(edit, &header, true);
+  if (!file) return EIO;
+  // a new revision after an undo replaces the ones that could have been redone
+  long offset = romedit_journal_seek(file, header.current);
+  if (offset < 0) {
+    LOGE(TAG, "%s is cut short", edit->journalPath);
+    fclose(file);
+    return EIO;
+  }
+
+  memset(&revision, 0, sizeof(revision));
+  revision.length = (uint32_t)(sizeof(revision) + edit->numRanges * sizeof(romedit_range_t) + edit->bytesLength * 2);
+  revision.ranges = (uint32_t)edit->numRanges;
+  revision.time   = (uint64_t)time(NULL);
+  snprintf(revision.name, sizeof(revision.name), "%s", name ? name : "");
+  bool written = fwrite(&revision, sizeof(revision), 1, file) == 1;
+  for (size_t r = 0, bytes = 0; written && r < edit->numRanges; bytes += edit->ranges[r++].length) {
+    const romedit_range_t* range = &edit->ranges[r];
+    written = fwrite(range, sizeof(*range), 1, file) == 1 &&
+              fwrite(edit->before + bytes, 1, range->length, file) == range->length &&
+              fwrite(edit->after + bytes, 1, range->length, file) == range->length;
+  }
+  header.current++;
+  header.revisions = header.current;
+  written = written && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+  if (fclose(file) || !written) {
+    LOGE(TAG, "failed to write %s", edit->journalPath);
+    return EIO;
+  }
+
+  // the image only changes once the journal can take it back
+  if ((ret = romedit_flush(edit))) return ret;
+  romedit_reset(edit);
+  return 0;
+}
+
+// undo or redo one revision of the journal
+static size_t romedit_replay(romedit_t* edit, bool undo, char* name, size_t nameLength)
+{
+  romedit_journal_header_t header;
+  romedit_revision_t revision;
+  uint8_t* record = NULL;
+  size_t ret = 0;
+
+  if (edit->numRanges) return EBUSY;
+  FILE* file = romedit_journal(edit, &header, false);
+  if (!file) return ENOENT;
+  if (undo ? header.current == 0 : header.current >= header.revisions) {
+    fclose(file);
+    return ENOENT;
+  }
+  uint32_t index = undo ? header.current - 1 : header.current;
+  if (romedit_journal_seek(file, index) < 0 || fread(&revision, sizeof(revision), 1, file) != 1 ||
+      revision.length <= sizeof(revision) || !(record = (uint8_t*)malloc(revision.length - sizeof(revision))) ||
+      fread(record, 1, revision.length - sizeof(revision), file) != revision.length - sizeof(revision)) {
+    LOGE(TAG, "%s is cut short", edit->journalPath);
+    free(record);
+    fclose(file);
+    return EIO;
+  }
+
+  // find every range first, the image must hold what the other side of the revision left
+  size_t length = revision.length - sizeof(revision);
+  romedit_range_t* ranges = (romedit_range_t*)malloc((revision.ranges ? revision.ranges : 1) * sizeof(romedit_range_t));
+  size_t* offsets = (size_t*)malloc((revision.ranges ? revision.ranges : 1) * sizeof(size_t));
+  size_t offset = 0;
+  if (!ranges || !offsets) ret = ENOMEM;
+  for (uint32_t r = 0; !ret && r < revision.ranges; r++) {
+    if (offset + sizeof(romedit_range_t) > length) {
+      ret = EIO;
+      break;
+    }
+    memcpy(&ranges[r], record + offset, sizeof(romedit_range_t));
+    offsets[r] = offset + sizeof(romedit_range_t);
+    offset = offsets[r] + (size_t)ranges[r].length * 2;
+    if (offset > length || ranges[r].address > edit->map.length || ranges[r].length > edit->map.length - ranges[r].address)
+      ret = EIO;
+  }
+  if (!ret) {
+    const uint8_t* expected = NULL;
+    for (uint32_t r = 0; r < revision.ranges; r++) {
+      expected = record + offsets[r] + (undo ? ranges[r].length : 0);
+      if (memcmp(edit->map.data + ranges[r].address, expected, ranges[r].length) != 0) {
+        LOGE(TAG, "%s changed since revision %u \"%s\" was journaled", edit->path, index + 1, revision.name);
+        ret = EINVAL;
+        break;
+      }
+    }
+  }
+  if (!ret) {
+    // undo goes backwards, a range written twice in one revision ends up with its first before
+    for (uint32_t i = 0; i < revision.ranges; i++) {
+      uint32_t r = undo ? revision.ranges - 1 - i : i;
+      const uint8_t* bytes = record + offsets[r] + (undo ? 0 : ranges[r].length);
+      memcpy(edit->map.data + ranges[r].address, bytes, ranges[r].length);
+      romedit_mark(edit, ranges[r].address, ranges[r].length);
+    }
+    header.current = undo ? header.current - 1 : header.current + 1;
+    if (fseek(file, 0, SEEK_SET) || fwrite(&header, sizeof(header), 1, file) != 1) ret = EIO;
+  }
+  if (name) snprintf(name, nameLength, "%s", revision.name);
+  free(ranges);
+  free(offsets);
+  free(record);
+  if (fclose(file) && !ret) ret = EIO;
+  if (!ret) ret = romedit_flush(edit);
+  romedit_reset(edit);
+  return ret;
+}
+
+size_t romedit_undo(romedit_t* edit, char* name, size_t nameLength)
+{
+  return romedit_replay(edit, true, name, nameLength);
+}
+
+size_t romedit_redo(romedit_t* edit, char* name, size_t nameLength)
+{
+  return romedit_replay(edit, false, name, nameLength);
+}
+
+size_t romedit_dirty_blocks(const romedit_t* edit, uint32_t* blocks, size_t max)
+{
+  size_t count = 0;
+  for (size_t b = 0; b < edit->numBlocks; b++) {
+    if (!edit->dirty[b]) continue;
+    if (count < max) blocks[count] = (uint32_t)(b * ROMEDIT_BLOCK);
+    count++;
+  }
+  return count;
+}
+
+bool romedit_verify_checksums(const romedit_t* edit)
+{
+  for (size_t c = 0; c < edit->numChecksums; c++) {
+    const romedit_checksum_t* checksum = &edit->checksums[c];
+    uint32_t sum = romedit_sum(edit->map.data, checksum->start, checksum->end);
+    if (sum + romedit_be32(edit->map.data + checksum->address) != ROMEDIT_CHECKSUM_MAGIC) return false;
+  }
+  return true;
+}
+
+size_t romedit_edit_file(const char* path, const char* definitionPath, const char* patchPath, bool undo, bool verbose)
+{
+  uint64_t start = monotonic_us();
+  romedit_t edit;
+  char name[64] = { 0 };
+  size_t ret, cells = 0;
+
+  if ((ret = romedit_open(&edit, path)))
+    return ret;
+  if (!edit.numChecksums)
+    LOGI(TAG, "%s has no checksum table, checksums are left alone", path);
+
+  if (patchPath[0]) {
+    definition_t definition;
+    if ((ret = defresolve_load_path(&definition, definitionPath, edit.map.data, edit.map.length))) {
+      romedit_close(&edit);
+      return ret;
+    }
+    const char* base = strrchr(patchPath, '/');
+    const char* baseWindows = strrchr(patchPath, '\\');
+    if (baseWindows > base) base = baseWindows;
+    snprintf(name, sizeof(name), "%s", base ? base + 1 : patchPath);
+
+    ret = romedit_apply_patch(&edit, &definition, patchPath, &cells);
+    size_t ranges = edit.numRanges;
+    size_t bytes  = edit.bytesLength;
+    if (ret)
+      romedit_discard(&edit);
+    else
+      ret = romedit_commit(&edit, name);
+    definition_free(&definition);
+    if (!ret)
+      LOGI(TAG, "%s: %zu cells, %zu bytes in %zu ranges", name, cells, bytes, ranges);
+  } else {
+    ret = undo ? romedit_undo(&edit, name, sizeof(name)) : romedit_redo(&edit, name, sizeof(name));
+    if (ret == ENOENT)
+      LOGE(TAG, "Nothing to %s in %s", undo ? "undo" : "redo", edit.journalPath);
+    else if (!ret)
+      LOGI(TAG, "%s %s", undo ? "Undid" : "Redid", name);
+  }
+
+  if (!ret) {
+    // what a flash of this revision has to write
+    uint32_t blocks[128];
+    size_t maxBlocks = sizeof(blocks) / sizeof(blocks[0]);
+    size_t numBlocks = romedit_dirty_blocks(&edit, blocks, maxBlocks);
+    char list[128 * 11 + 8] = { 0 };
+    size_t length = 0;
+    for (size_t b = 0; b < numBlocks && b < maxBlocks; b++)
+      length += (size_t)snprintf(list + length, sizeof(list) - length, " 0x%05x", blocks[b]);
+    if (numBlocks > maxBlocks)
+      snprintf(list + length, sizeof(list) - length, " ...");
+    LOGI(TAG, "%zu dirty %u byte blocks:%s", numBlocks, ROMEDIT_BLOCK, numBlocks ? list : " none");
+    if (verbose && edit.numChecksums)
+      LOGI(TAG, "%zu checksums %s", edit.numChecksums, romedit_verify_checksums(&edit) ? "match" : "DO NOT match");
+    LOGI(TAG, "Wrote %s in %.3f ms", path, (double)(monotonic_us() - start) / 1000.0);
+  }
+  romedit_close(&edit);
+  return ret;
+}
@@ -0,0 +1,144 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "definition.h"
+#include "mapfile.h"
+
+/* ROM editing.
+ *
+ * Edits are applied to a copy-on-write mapping of a ROM image, so nothing reaches the
+ * file until a whole batch went through. Every write is recorded in the pending
+ * revision as the bytes before and after it. romedit_commit() appends the revision
+ * to a journal next to the image (<rom>.journal) and writes back only the blocks
+ * that changed. Undo and redo replay a revision from the journal the same way, after
+ * checking the image still holds what the journal expects.
+ *
+ * Checksums follow EcuFlash's "subarudbw" model, the one definitions/EcuFlash lists
+ * for this ROM: a table of { start, end, checksum } entries 0x480 bytes before the end
+ * of the image, checksum = 0x5AA5A55A - the sum of the big endian words in
+ * [start, end). Every write adjusts the checksums of the ranges it falls in by how
+ * much it changed the sum, so fixing them costs as much as the edit itself.
+ *
+ * Patch file, the grid layout of the --cells CSV and definitions/table.csv:
+ *   <table name>
+ *   ,<x breakpoints>                  3D tables only, ignored
+ *   <y breakpoint>,<value>,<value>... one line per row, the breakpoint is ignored
+ *   <blank line>
+ * Empty cells are left alone, so a patch can change a single cell.
+ */
+
+#define ROMEDIT_JOURNAL_MAGIC "RX8EDIT"
+static const uint32_t ROMEDIT_JOURNAL_VERSION = 1;
+// unit of the dirty block list, the smallest erase block of the SH7055 flash
+static const uint32_t ROMEDIT_BLOCK           = 0x1000;
+static const uint32_t ROMEDIT_CHECKSUM_TABLE  = 0x480;   // bytes before the end of the image
+static const uint32_t ROMEDIT_CHECKSUM_MAGIC  = 0x5AA5A55A;
+static const size_t   ROMEDIT_MAX_CHECKSUMS   = 0x480 / 12;
+
+typedef struct Romedit_Journal_Header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t romLength;
+  uint32_t revisions;  // in the file
+  uint32_t current;    // applied to the image, less than `revisions` after an undo
+} romedit_journal_header_t;
+
+// followed by `ranges` romedit_range_t, each followed by its bytes before and after
+typedef struct Romedit_Revision {
+  uint32_t length;     // whole record, this header included
+  uint32_t ranges;
+  uint64_t time;       // seconds since the epoch
+  char     name[64];
+} romedit_revision_t;
+
+typedef struct Romedit_Range {
+  uint32_t address;
+  uint32_t length;
+} romedit_range_t;
+
+typedef struct Romedit_Checksum {
+  uint32_t start;
+  uint32_t end;
+  uint32_t address;    // of the checksum word
+} romedit_checksum_t;
+
+typedef struct Romedit {
+  mapfile_t map;
+  char path[256];
+  char journalPath[264];
+  // pending revision, `before` and `after` hold the bytes of every range back to back
+  size_t numRanges;
+  size_t rangeCapacity;
+  romedit_range_t* ranges;
+  size_t bytesLength;
+  size_t bytesCapacity;
+  uint8_t* before;
+  uint8_t* after;
+  // checksum table, none if the image doesn't have one
+  size_t numChecksums;
+  romedit_checksum_t checksums[ROMEDIT_MAX_CHECKSUMS];
+  uint32_t checksumTable;
+  uint32_t checksumTableLength;
+  uint8_t checksumsBefore[ROMEDIT_CHECKSUM_TABLE];
+  // one byte per ROMEDIT_BLOCK, set for blocks written since the image was opened
+  uint8_t* dirty;
+  size_t numBlocks;
+} romedit_t;
+
+/** Map `path` copy-on-write and find its checksum table. Returns 0 or errno */
+size_t romedit_open(romedit_t* edit, const char* path);
+
+/** Unmap, dropping anything not committed */
+void romedit_close(romedit_t* edit);
+
+/** Write `length` bytes into the pending revision and adjust checksums. Returns 0 or errno */
+size_t romedit_write(romedit_t* edit, uint32_t address, const uint8_t* data, size_t length);
+
+/** Set `count` cells along `row` of `table` from `column` on, in display units. Returns 0 or errno */
+size_t romedit_set_cells(romedit_t* edit, const definition_table_t* table, uint16_t row, uint16_t column,
+                         const float* values, size_t count);
+
+/** Apply a patch file to the pending revision, `cells` counts what it set. Returns 0 or errno */
+size_t romedit_apply_patch(romedit_t* edit, const definition_t* definition, const char* path, size_t* cells);
+
+/** Journal the pending revision and write the dirty blocks back to the image. Returns 0 or errno */
+size_t romedit_commit(romedit_t* edit, const char* name);
+
+/** Put the pending revision back the way it was */
+void romedit_discard(romedit_t* edit);
+
+/** Revert the last applied revision of the journal, or apply the next one again. Returns 0, ENOENT if there is none, or errno */
+size_t romedit_undo(romedit_t* edit, char* name, size_t nameLength);
+size_t romedit_redo(romedit_t* edit, char* name, size_t nameLength);
+
+/** Addresses of the blocks written since the image was opened, ascending. Returns how many there are */
+size_t romedit_dirty_blocks(const romedit_t* edit, uint32_t* blocks, size_t max);
+
+/** Recompute every checksum, true if they all match. Reads the whole image */
+bool romedit_verify_checksums(const romedit_t* edit);
+
+/**
+ * --edit: apply the patch in `patchPath` to the ROM in `path` with the definition from
+ * `definitionPath`, or undo or redo a revision if `patchPath` is empty, then log the blocks
+ * a flash has to write. Returns 0 or errno
+ */
+size_t romedit_edit_file(const char* path, const char* definitionPath, const char* patchPath, bool undo, bool verbose);
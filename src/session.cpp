@@ -0,0 +1,148 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <assert.h>
+#include <string.h>
+
+#include "session.h"
+#include "UDS.h"
+#include "util.h"
+
+static const char* TAG = "Session";
+
+// sessions that fall back to default after S3 expires (MAZDA_SBF_SESSION_81/85/87)
+static bool uds_session_times_out(uint8_t sessionID)
+{
+  return sessionID == 0x81 || sessionID == 0x85 || sessionID == 0x87;
+}
+
+static size_t uds_session_keepalive_start(uds_session_t* session)
+{
+  if (session->keepaliveRunning) return 0;
+  if (session->pauseDepth)       return 0;
+  if (session->state == UDS_SESSION_STATE_DEFAULT) return 0;
+
+  long ret = session->j2534->PassThruStartPeriodicMsg(
+    session->chanID,
+    &session->testerPresent,
+    &session->periodicID,
+    UDS_TESTER_PRESENT_INTERVAL
+  );
+  if (ret) {
+    LOGE(TAG, "failed to start TesterPresent keepalive (%ld)", ret);
+    return ret;
+  }
+  session->keepaliveRunning = true;
+  return 0;
+}
+
+static size_t uds_session_keepalive_stop(uds_session_t* session)
+{
+  if (!session->keepaliveRunning) return 0;
+
+  long ret = session->j2534->PassThruStopPeriodicMsg(session->chanID, session->periodicID);
+  // the message is gone either way, a failure here usually means the channel is already closed
+  session->keepaliveRunning = false;
+  session->periodicID = 0;
+  if (ret) {
+    LOGE(TAG, "failed to stop TesterPresent keepalive (%ld)", ret);
+    return ret;
+  }
+  return 0;
+}
+
+size_t uds_session_init(uds_session_t* session, J2534* j2534, unsigned long chanID)
+{
+  assert(session != NULL);
+  memset(session, 0, sizeof(uds_session_t));
+  session->j2534  = j2534;
+  session->chanID = chanID;
+  session->state  = UDS_SESSION_STATE_DEFAULT;
+
+  // single frame 0x7E0 3E 80, the passthru device pads it out to 8 bytes
+  session->testerPresent.ProtocolID = ISO15765;
+  session->testerPresent.TxFlags    = ISO15765_FRAME_PAD;
+  session->testerPresent.Data[0]    = 0x0;
+  session->testerPresent.Data[1]    = 0x0;
+  session->testerPresent.Data[2]    = UDS_REQUEST_CANID_MSB;
+  session->testerPresent.Data[3]    = UDS_REQUEST_CANID_LSB;
+  session->testerPresent.Data[4]    = UDS_SID_TESTER_PRESENT;
+  session->testerPresent.Data[5]    = UDS_TESTER_PRESENT_SUPPRESS_RESPONSE;
+  session->testerPresent.DataSize   = 6;
+  return 0;
+}
+
+size_t uds_session_deinit(uds_session_t* session)
+{
+  return uds_session_keepalive_stop(session);
+}
+
+size_t uds_session_enter(uds_session_t* session, uint8_t sessionID)
+{
+  session->session = sessionID;
+  if (!uds_session_times_out(sessionID)) {
+    session->state = UDS_SESSION_STATE_DEFAULT;
+    return uds_session_keepalive_stop(session);
+  }
+
+  // changing session always drops security access
+  session->state = UDS_SESSION_STATE_ACTIVE;
+  return uds_session_keepalive_start(session);
+}
+
+size_t uds_session_unlocked(uds_session_t* session)
+{
+  if (session->state == UDS_SESSION_STATE_DEFAULT) {
+    LOGE(TAG, "security access granted outside of a diag session");
+    return 1;
+  }
+  session->state = UDS_SESSION_STATE_UNLOCKED;
+  return 0;
+}
+
+size_t uds_session_reset(uds_session_t* session)
+{
+  session->state   = UDS_SESSION_STATE_DEFAULT;
+  session->session = 0;
+  return uds_session_keepalive_stop(session);
+}
+
+size_t uds_session_pause(uds_session_t* session)
+{
+  if (session->pauseDepth++ == 0)
+    return uds_session_keepalive_stop(session);
+  return 0;
+}
+
+size_t uds_session_resume(uds_session_t* session)
+{
+  assert(session->pauseDepth > 0);
+  if (session->pauseDepth == 0) return 0;
+
+  if (--session->pauseDepth == 0)
+    return uds_session_keepalive_start(session);
+  return 0;
+}
+
+const char* uds_session_state_string(uds_session_state_t state)
+{
+  switch (state) {
+  case UDS_SESSION_STATE_DEFAULT:  return "default";
+  case UDS_SESSION_STATE_ACTIVE:   return "active";
+  case UDS_SESSION_STATE_UNLOCKED: return "unlocked";
+  default:                         return "unknown";
+  }
+}
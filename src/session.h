@@ -0,0 +1,79 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "J2534.h"
+
+// how often the passthru device should send TesterPresent while a session is open.
+// the ECU drops back to the default session after ~5 seconds of silence.
+static const unsigned long UDS_TESTER_PRESENT_INTERVAL = 2000;
+
+// TesterPresent with the suppressPosRspMsgIndicationBit set, the ECU should not answer
+static const uint8_t UDS_TESTER_PRESENT_SUPPRESS_RESPONSE = 0x80;
+
+/* The session state machine. Transitions:
+ *
+ *   DEFAULT  --enter(0x81/0x85/0x87)--> ACTIVE
+ *   ACTIVE   --unlocked()------------> UNLOCKED
+ *   ANY      --reset()---------------> DEFAULT
+ *
+ * The keepalive runs in every state except DEFAULT, unless it is paused.
+ */
+typedef enum uds_session_state {
+  UDS_SESSION_STATE_DEFAULT  = 0,
+  UDS_SESSION_STATE_ACTIVE   = 1,
+  UDS_SESSION_STATE_UNLOCKED = 2,
+} uds_session_state_t;
+
+typedef struct UDS_Session {
+  J2534*              j2534;
+  unsigned long       chanID;
+
+  uds_session_state_t state;
+
+  /* diag session id reported by the ECU, 0 when in the default session */
+  uint8_t             session;
+
+  /* pause()/resume() nest, the keepalive only restarts when this drops to 0 */
+  uint32_t            pauseDepth;
+
+  /* handle returned by PassThruStartPeriodicMsg */
+  bool                keepaliveRunning;
+  unsigned long       periodicID;
+  PASSTHRU_MSG        testerPresent;
+} uds_session_t;
+
+size_t uds_session_init(uds_session_t* session, J2534* j2534, unsigned long chanID);
+size_t uds_session_deinit(uds_session_t* session);
+
+/** Record a positive session control response. Starts the keepalive for sessions that time out */
+size_t uds_session_enter(uds_session_t* session, uint8_t sessionID);
+
+/** Record a successful security access */
+size_t uds_session_unlocked(uds_session_t* session);
+
+/** Record an ECU reset (or anything else that drops the ECU back to the default session) */
+size_t uds_session_reset(uds_session_t* session);
+
+/** Stop the keepalive while a transfer burst keeps the ECU busy. Must be paired with resume() */
+size_t uds_session_pause(uds_session_t* session);
+size_t uds_session_resume(uds_session_t* session);
+
+const char* uds_session_state_string(uds_session_state_t state);
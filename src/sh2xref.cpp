@@ -0,0 +1,615 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#include <io.h>
+#include <direct.h>
+#define F_OK 0
+#define access _access
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "sh2xref.h"
+#include "crc32c.h"
+#include "defresolve.h"
+#include "mapfile.h"
+#include "util.h"
+
+static const char* TAG = "Sh2xref";
+
+typedef struct Sh2xref_Call {
+  uint32_t target;
+  uint32_t from;
+} sh2xref_call_t;
+
+typedef struct Sh2xref_Job {
+  const uint8_t* rom;
+  size_t   length;
+  size_t   start;     // first instruction, after the vectors
+  size_t   numSegments;
+  std::atomic<size_t> next;
+} sh2xref_job_t;
+
+typedef struct Sh2xref_Worker {
+  std::vector<sh2xref_ref_t>  refs;
+  std::vector<sh2xref_call_t> calls;
+  uint64_t instructions;
+} sh2xref_worker_t;
+
+// what a register was last loaded with from a literal pool
+typedef struct Sh2xref_Register {
+  uint32_t value;
+  uint32_t at;
+  bool     valid;
+} sh2xref_register_t;
+
+static inline uint32_t sh2xref_be16(const uint8_t* p)
+{
+  return ((uint32_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t sh2xref_be32(const uint8_t* p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void sh2xref_add_ref(sh2xref_worker_t* worker, uint32_t target, uint32_t from, uint32_t literal, enum sh2xref_kind kind)
+{
+  sh2xref_ref_t ref;
+  ref.target   = target;
+  ref.from     = from;
+  ref.literal  = literal;
+  ref.function = SH2XREF_NO_FUNCTION;
+  ref.kind     = kind;
+  worker->refs.push_back(ref);
+}
+
+static void sh2xref_add_call(sh2xref_worker_t* worker, size_t length, uint32_t target, uint32_t from)
+{
+  if (target >= length || (target & 1)) return;
+  sh2xref_call_t call = { target, from };
+  worker->calls.push_back(call);
+}
+
+/*
+ * Decode [start, end). Registers are followed from SH2XREF_CALL_REACH bytes before it,
+ * only what is inside is recorded. Anything that may write Rn forgets what it was loaded
+ * with, it is no use knowing exactly which instructions do.
+ */
+static void sh2xref_segment(const sh2xref_job_t* job, size_t start, size_t end, sh2xref_worker_t* worker)
+{
+  const uint8_t* rom = job->rom;
+  size_t length = job->length;
+  sh2xref_register_t registers[16];
+  memset(registers, 0, sizeof(registers));
+
+  size_t pc = start >= job->start + SH2XREF_CALL_REACH ? start - SH2XREF_CALL_REACH : job->start;
+  for (; pc < end && pc + 2 <= length; pc += 2) {
+    uint32_t op = sh2xref_be16(rom + pc);
+    unsigned n = (op >> 8) & 15;
+    bool record = pc >= start;
+    switch (op >> 12) {
+      case 0xD: {   // mov.l @(disp,PC),Rn
+        uint32_t literal = (uint32_t)((pc & ~(size_t)3) + 4 + (op & 0xff) * 4);
+        registers[n].valid = literal + 4 <= length;
+        if (!registers[n].valid) break;
+        registers[n].value = sh2xref_be32(rom + literal);
+        registers[n].at    = (uint32_t)pc;
+        if (record) sh2xref_add_ref(worker, registers[n].value, (uint32_t)pc, literal, SH2XREF_MOV_L);
+        break;
+      }
+      case 0x9: {   // mov.w @(disp,PC),Rn
+        uint32_t literal = (uint32_t)(pc + 4 + (op & 0xff) * 2);
+        registers[n].valid = literal + 2 <= length;
+        if (!registers[n].valid) break;
+        registers[n].value = (uint32_t)(int32_t)(int16_t)sh2xref_be16(rom + literal);
+        registers[n].at    = (uint32_t)pc;
+        if (record) sh2xref_add_ref(worker, registers[n].value, (uint32_t)pc, literal, SH2XREF_MOV_W);
+        break;
+      }
+      case 0xC:
+        if (n == 7 && record) {   // mova @(disp,PC),R0
+          uint32_t address = (uint32_t)((pc & ~(size_t)3) + 4 + (op & 0xff) * 4);
+          sh2xref_add_ref(worker, address, (uint32_t)pc, address, SH2XREF_MOVA);
+        }
+        if (n >= 4) registers[0].valid = false;
+        break;
+      case 0xB: {   // bsr
+        int32_t disp = (int32_t)(op & 0xfff);
+        if (disp & 0x800) disp -= 0x1000;
+        if (record) sh2xref_add_call(worker, length, (uint32_t)((int64_t)pc + 4 + disp * 2), (uint32_t)pc);
+        for (int r = 0; r < 8; r++) registers[r].valid = false;
+        break;
+      }
+      case 0x4:
+        if ((op & 0xff) == 0x0B) {   // jsr @Rn
+          if (record && registers[n].valid && pc - registers[n].at <= SH2XREF_CALL_REACH)
+            sh2xref_add_call(worker, length, registers[n].value, (uint32_t)pc);
+          // r0-r7 don't survive a call, the delay slot still sees them but loads nothing new
+          for (int r = 0; r < 8; r++) registers[r].valid = false;
+        } else {
+          registers[n].valid = false;
+        }
+        break;
+      case 0x8:
+        if (n == 4 || n == 5) registers[0].valid = false;   // mov.b/w @(disp,Rm),R0
+        break;
+      case 0xF:     // FPU, fmov.s @Rm+ and @-Rn move an address register
+        registers[n].valid = false;
+        registers[(op >> 4) & 15].valid = false;
+        break;
+      case 0x0:
+        if (op == 0x000B) {   // rts
+          memset(registers, 0, sizeof(registers));
+          break;
+        }
+        registers[n].valid = false;
+        break;
+      case 0xA:     // bra
+        break;
+      default:      // 2 (pre-decrement stores), 3, 5, 6, 7, E write Rn
+        registers[n].valid = false;
+        break;
+    }
+    if (record) worker->instructions++;
+  }
+}
+
+static void sh2xref_worker(sh2xref_job_t* job, sh2xref_worker_t* worker)
+{
+  for (;;) {
+    size_t segment = job->next.fetch_add(1);
+    if (segment >= job->numSegments) break;
+    size_t start = job->start + segment * SH2XREF_SEGMENT;
+    size_t end = std::min(start + SH2XREF_SEGMENT, job->length);
+    sh2xref_segment(job, start, end, worker);
+  }
+}
+
+// one bit per halfword of the ROM
+static inline bool sh2xref_test(const std::vector<uint64_t>& bits, uint32_t address)
+{
+  size_t half = address >> 1;
+  return half / 64 < bits.size() && ((bits[half / 64] >> (half % 64)) & 1);
+}
+
+static inline void sh2xref_set(std::vector<uint64_t>& bits, uint32_t address)
+{
+  size_t half = address >> 1;
+  if (half / 64 < bits.size()) bits[half / 64] |= (uint64_t)1 << (half % 64);
+}
+
+// pool words, both halves of a long, except those loaded by instructions in `skip`
+static void sh2xref_literals(const std::vector<sh2xref_ref_t>& refs, const std::vector<uint64_t>* skip,
+                             std::vector<uint64_t>& literals)
+{
+  std::fill(literals.begin(), literals.end(), 0);
+  for (size_t r = 0; r < refs.size(); r++) {
+    const sh2xref_ref_t* ref = &refs[r];
+    if (ref->kind == SH2XREF_MOVA) continue;
+    if (skip && sh2xref_test(*skip, ref->from)) continue;
+    sh2xref_set(literals, ref->literal);
+    if (ref->kind == SH2XREF_MOV_L) sh2xref_set(literals, ref->literal + 2);
+  }
+}
+
+static size_t sh2xref_assemble(sh2xref_t* index, const std::vector<sh2xref_ref_t>& refs,
+                               const std::vector<uint32_t>& functions, uint32_t romLength, uint32_t romCrc)
+{
+  size_t refBytes = refs.size() * sizeof(sh2xref_ref_t);
+  size_t functionBytes = functions.size() * sizeof(uint32_t);
+  memset(index, 0, sizeof(sh2xref_t));
+  index->data = (uint8_t*)malloc(sizeof(sh2xref_header_t) + refBytes + functionBytes);
+  if (!index->data) return ENOMEM;
+
+  sh2xref_header_t* header = (sh2xref_header_t*)index->data;
+  memset(header, 0, sizeof(sh2xref_header_t));
+  memcpy(header->magic, SH2XREF_MAGIC, sizeof(SH2XREF_MAGIC));
+  header->version      = SH2XREF_VERSION;
+  header->refSize      = sizeof(sh2xref_ref_t);
+  header->romLength    = romLength;
+  header->romCrc       = romCrc;
+  header->numRefs      = (uint32_t)refs.size();
+  header->numFunctions = (uint32_t)functions.size();
+  if (refBytes) memcpy(index->data + sizeof(sh2xref_header_t), refs.data(), refBytes);
+  if (functionBytes) memcpy(index->data + sizeof(sh2xref_header_t) + refBytes, functions.data(), functionBytes);
+  header->crc = crc32c(0, index->data + sizeof(sh2xref_header_t), refBytes + functionBytes);
+
+  index->header       = header;
+  index->numRefs      = refs.size();
+  index->refs         = (const sh2xref_ref_t*)(index->data + sizeof(sh2xref_header_t));
+  index->numFunctions = functions.size();
+  index->functions    = (const uint32_t*)(index->data + sizeof(sh2xref_header_t) + refBytes);
+  return 0;
+}
+
+size_t sh2xref_build(sh2xref_t* index, const uint8_t* rom, size_t length, unsigned threads, sh2xref_stats_t* stats)
+{
+  uint64_t begin = monotonic_us();
+  std::vector<sh2xref_ref_t> refs;
+  std::vector<sh2xref_call_t> calls;
+  std::vector<uint32_t> functions;
+  sh2xref_job_t job;
+
+  memset(index, 0, sizeof(sh2xref_t));
+  memset(stats, 0, sizeof(sh2xref_stats_t));
+  if (length > 0xffffffffu) {
+    LOGE(TAG, "A ROM of %zu bytes is beyond the SH-2's address space", length);
+    return EINVAL;
+  }
+
+  job.rom         = rom;
+  job.length      = length;
+  job.start       = std::min(SH2XREF_VECTORS, length & ~(size_t)1);
+  job.numSegments = (length - job.start + SH2XREF_SEGMENT - 1) / SH2XREF_SEGMENT;
+  job.next        = 0;
+  if (!threads) threads = std::thread::hardware_concurrency();
+  if (!threads) threads = 1;
+  if (threads > job.numSegments) threads = job.numSegments ? (unsigned)job.numSegments : 1;
+  stats->segments = job.numSegments;
+  stats->threads  = threads;
+
+  sh2xref_worker_t* workers = new sh2xref_worker_t[threads]();
+  {
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++)
+      pool.push_back(std::thread(sh2xref_worker, &job, &workers[t]));
+    sh2xref_worker(&job, &workers[0]);
+    for (size_t t = 0; t < pool.size(); t++)
+      pool[t].join();
+  }
+  for (unsigned t = 0; t < threads; t++) {
+    refs.insert(refs.end(), workers[t].refs.begin(), workers[t].refs.end());
+    calls.insert(calls.end(), workers[t].calls.begin(), workers[t].calls.end());
+    stats->instructions += workers[t].instructions;
+  }
+  delete[] workers;
+
+  // pool words decoded as code load from "pools" of their own, those don't count
+  std::vector<uint64_t> pools((length / 2 + 63) / 64), literals(pools.size());
+  sh2xref_literals(refs, NULL, pools);
+  sh2xref_literals(refs, &pools, literals);
+  for (size_t w = 0; w < literals.size(); w++) {
+    for (uint64_t bits = literals[w]; bits; bits &= bits - 1)
+      stats->literals++;
+  }
+  size_t decoded = refs.size() + calls.size();
+  refs.erase(std::remove_if(refs.begin(), refs.end(), [&literals](const sh2xref_ref_t& ref) {
+    return sh2xref_test(literals, ref.from);
+  }), refs.end());
+  calls.erase(std::remove_if(calls.begin(), calls.end(), [&literals](const sh2xref_call_t& call) {
+    return sh2xref_test(literals, call.from);
+  }), calls.end());
+  stats->dropped = decoded - refs.size() - calls.size();
+
+  for (size_t v = 0; v + 4 <= job.start; v += 4) {
+    uint32_t vector = sh2xref_be32(rom + v);
+    if (vector >= job.start && vector < length && !(vector & 1)) functions.push_back(vector);
+  }
+  for (size_t c = 0; c < calls.size(); c++)
+    functions.push_back(calls[c].target);
+  std::sort(functions.begin(), functions.end());
+  functions.erase(std::unique(functions.begin(), functions.end()), functions.end());
+
+  for (size_t r = 0; r < refs.size(); r++) {
+    std::vector<uint32_t>::const_iterator it = std::upper_bound(functions.begin(), functions.end(), refs[r].from);
+    if (it != functions.begin()) refs[r].function = *(it - 1);
+  }
+  std::sort(refs.begin(), refs.end(), [](const sh2xref_ref_t& a, const sh2xref_ref_t& b) {
+    return a.target != b.target ? a.target < b.target : a.from < b.from;
+  });
+
+  size_t ret = sh2xref_assemble(index, refs, functions, (uint32_t)length, crc32c(0, rom, length));
+  stats->elapsedUs = monotonic_us() - begin;
+  return ret;
+}
+
+size_t sh2xref_save(const sh2xref_t* index, const char* path)
+{
+  char temporary[512];
+  size_t size = sizeof(sh2xref_header_t) + index->numRefs * sizeof(sh2xref_ref_t) + index->numFunctions * sizeof(uint32_t);
+
+  // written next to it and renamed over it, a reader never sees half an index
+  if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= (int)sizeof(temporary))
+    return ENAMETOOLONG;
+  FILE* file = fopen(temporary, "wb");
+  if (!file) {
+    size_t ret = errno;
+    LOGE(TAG, "Failed to create %s %s", temporary, strerror(errno));
+    return ret;
+  }
+  bool written = fwrite(index->data, 1, size, file) == size;
+  if (fclose(file) || !written) {
+    LOGE(TAG, "Failed to write %s", temporary);
+    remove(temporary);
+    return EIO;
+  }
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  if (!MoveFileExA(temporary, path, MOVEFILE_REPLACE_EXISTING)) {
+    LOGE(TAG, "Failed to replace %s (%lu)", path, GetLastError());
+    remove(temporary);
+    return EIO;
+  }
+#else
+  if (rename(temporary, path)) {
+    size_t ret = errno;
+    LOGE(TAG, "Failed to replace %s %s", path, strerror(errno));
+    remove(temporary);
+    return ret;
+  }
+#endif
+  return 0;
+}
+
+size_t sh2xref_open(sh2xref_t* index, const char* path)
+{
+  size_t length = 0;
+  memset(index, 0, sizeof(sh2xref_t));
+  uint8_t* data = load_file(path, &length);
+  if (!data) return errno ? errno : ENOENT;
+
+  const sh2xref_header_t* header = (const sh2xref_header_t*)data;
+  size_t body = length - sizeof(sh2xref_header_t);
+  if (length < sizeof(sh2xref_header_t) || memcmp(header->magic, SH2XREF_MAGIC, sizeof(SH2XREF_MAGIC)) ||
+      header->version != SH2XREF_VERSION || header->refSize != sizeof(sh2xref_ref_t) ||
+      body != (size_t)header->numRefs * sizeof(sh2xref_ref_t) + (size_t)header->numFunctions * sizeof(uint32_t) ||
+      crc32c(0, data + sizeof(sh2xref_header_t), body) != header->crc) {
+    LOGE(TAG, "%s is no cross reference index of this version", path);
+    free(data);
+    return EINVAL;
+  }
+  index->data         = data;
+  index->header       = header;
+  index->numRefs      = header->numRefs;
+  index->refs         = (const sh2xref_ref_t*)(data + sizeof(sh2xref_header_t));
+  index->numFunctions = header->numFunctions;
+  index->functions    = (const uint32_t*)(index->refs + index->numRefs);
+  return 0;
+}
+
+void sh2xref_free(sh2xref_t* index)
+{
+  free(index->data);
+  memset(index, 0, sizeof(sh2xref_t));
+}
+
+static size_t sh2xref_path(char* path, size_t size, const char* directory, uint32_t crc, size_t length)
+{
+  if (snprintf(path, size, "%s/%08x-%zx.xref", directory, crc, length) >= (int)size)
+    return ENAMETOOLONG;
+  return 0;
+}
+
+size_t sh2xref_cache_path(char* path, size_t size, const char* directory, const uint8_t* rom, size_t length)
+{
+  return sh2xref_path(path, size, directory, crc32c(0, rom, length), length);
+}
+
+size_t sh2xref_load(sh2xref_t* index, const uint8_t* rom, size_t length, const char* cacheDirectory,
+                    unsigned threads, sh2xref_stats_t* stats)
+{
+  uint64_t begin = monotonic_us();
+  uint32_t crc = crc32c(0, rom, length);
+  char path[512];
+
+  memset(stats, 0, sizeof(sh2xref_stats_t));
+  size_t ret = sh2xref_path(path, sizeof(path), cacheDirectory, crc, length);
+  if (ret) return ret;
+  if (!access(path, F_OK) && !sh2xref_open(index, path)) {
+    if (index->header->romLength == length && index->header->romCrc == crc) {
+      stats->cached    = true;
+      stats->elapsedUs = monotonic_us() - begin;
+      return 0;
+    }
+    sh2xref_free(index);
+  }
+
+  ret = sh2xref_build(index, rom, length, threads, stats);
+  if (ret) return ret;
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  if (_mkdir(cacheDirectory) && errno != EEXIST)
+#else
+  if (mkdir(cacheDirectory, 0755) && errno != EEXIST)
+#endif
+    LOGW(TAG, "Failed to create %s %s, the index isn't kept", cacheDirectory, strerror(errno));
+  else if (sh2xref_save(index, path))
+    LOGW(TAG, "The index isn't kept");
+  return 0;
+}
+
+size_t sh2xref_find(const sh2xref_t* index, uint32_t low, uint32_t high, const sh2xref_ref_t** first)
+{
+  const sh2xref_ref_t* begin = index->refs;
+  const sh2xref_ref_t* end = index->refs + index->numRefs;
+  const sh2xref_ref_t* from = std::lower_bound(begin, end, low, [](const sh2xref_ref_t& ref, uint32_t address) {
+    return ref.target < address;
+  });
+  const sh2xref_ref_t* to = std::lower_bound(from, end, high, [](const sh2xref_ref_t& ref, uint32_t address) {
+    return ref.target < address;
+  });
+  *first = from;
+  return low < high ? (size_t)(to - from) : 0;
+}
+
+uint32_t sh2xref_function(const sh2xref_t* index, uint32_t address)
+{
+  const uint32_t* it = std::upper_bound(index->functions, index->functions + index->numFunctions, address);
+  return it == index->functions ? SH2XREF_NO_FUNCTION : *(it - 1);
+}
+
+const char* sh2xref_kind_name(uint32_t kind)
+{
+  switch (kind) {
+    case SH2XREF_MOV_L: return "mov.l";
+    case SH2XREF_MOV_W: return "mov.w";
+    case SH2XREF_MOVA:  return "mova";
+    default:            return "?";
+  }
+}
+
+static void sh2xref_write_refs(FILE* file, const char* table, const char* part, uint32_t address, const char* record,
+                               const sh2xref_ref_t* refs, size_t count)
+{
+  char function[16];
+  for (size_t r = 0; r < count; r++) {
+    if (refs[r].function == SH2XREF_NO_FUNCTION) function[0] = 0;
+    else snprintf(function, sizeof(function), "0x%x", refs[r].function);
+    fprintf(file, "\"%s\",%s,0x%x,%s,0x%x,%s,%s\n", table, part, address, record, refs[r].from,
+            sh2xref_kind_name(refs[r].kind), function);
+  }
+}
+
+size_t sh2xref_write_csv(const sh2xref_t* index, const definition_t* definition, const uint8_t* rom, size_t length,
+                         FILE* file)
+{
+  std::vector<uint32_t> wanted;
+  std::vector<sh2xref_call_t> pointers;   // `target` is stored at `from`
+
+  // the addresses no code refers to, then every long of the ROM holding one of them
+  for (size_t t = 0; t < definition->numTables; t++) {
+    const definition_table_t* table = &definition->tables[t];
+    const definition_axis_t* axes[3] = { NULL, &table->x, &table->y };
+    for (int a = 0; a < 3; a++) {
+      if (axes[a] && (!axes[a]->length || axes[a]->storage == DEFINITION_STORAGE_NONE)) continue;
+      uint32_t address = axes[a] ? axes[a]->address : table->address;
+      const sh2xref_ref_t* first;
+      if (!sh2xref_find(index, address, address + 1, &first)) wanted.push_back(address);
+    }
+  }
+  std::sort(wanted.begin(), wanted.end());
+  wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+  for (size_t p = 0; !wanted.empty() && p + 4 <= length; p += 4) {
+    uint32_t value = sh2xref_be32(rom + p);
+    if (std::binary_search(wanted.begin(), wanted.end(), value)) {
+      sh2xref_call_t pointer = { value, (uint32_t)p };
+      pointers.push_back(pointer);
+    }
+  }
+  std::sort(pointers.begin(), pointers.end(), [](const sh2xref_call_t& a, const sh2xref_call_t& b) {
+    return a.target != b.target ? a.target < b.target : a.from < b.from;
+  });
+
+  fprintf(file, "table,part,address,record,from,instruction,function\n");
+  for (size_t t = 0; t < definition->numTables; t++) {
+    const definition_table_t* table = &definition->tables[t];
+    const definition_axis_t* axes[3] = { NULL, &table->x, &table->y };
+    static const char* parts[3] = { "data", "x", "y" };
+    for (int a = 0; a < 3; a++) {
+      if (axes[a] && (!axes[a]->length || axes[a]->storage == DEFINITION_STORAGE_NONE)) continue;
+      uint32_t address = axes[a] ? axes[a]->address : table->address;
+      const sh2xref_ref_t* refs;
+      size_t count = sh2xref_find(index, address, address + 1, &refs);
+      if (count) {
+        sh2xref_write_refs(file, table->name, parts[a], address, "", refs, count);
+        continue;
+      }
+      // the closest referenced address at or below each long pointing here is its record
+      size_t written = 0;
+      sh2xref_call_t key = { address, 0 };
+      std::vector<sh2xref_call_t>::const_iterator it = std::lower_bound(pointers.begin(), pointers.end(), key,
+        [](const sh2xref_call_t& a, const sh2xref_call_t& b) { return a.target < b.target; });
+      for (; it != pointers.end() && it->target == address; ++it) {
+        uint32_t low = it->from >= SH2XREF_RECORD_REACH ? it->from - SH2XREF_RECORD_REACH : 0;
+        count = sh2xref_find(index, low, it->from + 1, &refs);
+        if (!count) continue;
+        uint32_t recordAddress = refs[count - 1].target;
+        while (count && refs[0].target != recordAddress) {
+          refs++;
+          count--;
+        }
+        char record[16];
+        snprintf(record, sizeof(record), "0x%x", recordAddress);
+        sh2xref_write_refs(file, table->name, parts[a], address, record, refs, count);
+        written += count;
+      }
+      if (!written)
+        fprintf(file, "\"%s\",%s,0x%x,,,,\n", table->name, parts[a], address);
+    }
+  }
+  if (ferror(file)) return EIO;
+  return 0;
+}
+
+size_t sh2xref_report(const char* romPath, const char* cacheDirectory, uint32_t low, uint32_t size,
+                      const char* definitionPath, const char* csvPath, unsigned threads, FILE* out)
+{
+  sh2xref_t index;
+  sh2xref_stats_t stats;
+  mapfile_t rom;
+  size_t ret;
+
+  if ((ret = mapfile_open(&rom, romPath)))
+    return ret;
+  if ((ret = sh2xref_load(&index, rom.data, rom.length, cacheDirectory, threads, &stats))) {
+    mapfile_close(&rom);
+    return ret;
+  }
+  if (stats.cached)
+    LOGI(TAG, "Read the index of %s from %s in %.1f ms", romPath, cacheDirectory, (double)stats.elapsedUs / 1000.0);
+  else
+    LOGI(TAG, "Indexed %s in %.1f ms, %zu segments with %u threads: %llu instructions, %zu literal pool words, %zu loads decoded out of them dropped",
+         romPath, (double)stats.elapsedUs / 1000.0, stats.segments, stats.threads,
+         (unsigned long long)stats.instructions, stats.literals, stats.dropped);
+  LOGI(TAG, "%zu references in %zu functions", index.numRefs, index.numFunctions);
+
+  if (low || size) {
+    const sh2xref_ref_t* refs;
+    uint32_t high = size ? (size > 0xffffffffu - low ? 0xffffffffu : low + size) : low + 1;
+    size_t count = sh2xref_find(&index, low, high, &refs);
+    LOGI(TAG, "%zu references to 0x%08x-0x%08x", count, low, high - 1);
+    for (size_t r = 0; r < count; r++) {
+      if (refs[r].function == SH2XREF_NO_FUNCTION)
+        fprintf(out, "0x%08x  %-5s at 0x%08x\n", refs[r].target, sh2xref_kind_name(refs[r].kind), refs[r].from);
+      else
+        fprintf(out, "0x%08x  %-5s at 0x%08x in 0x%08x\n", refs[r].target, sh2xref_kind_name(refs[r].kind),
+                refs[r].from, refs[r].function);
+    }
+  }
+
+  if (definitionPath[0]) {
+    definition_t definition;
+    if (!(ret = defresolve_load_path(&definition, definitionPath, rom.data, rom.length))) {
+      FILE* file = fopen(csvPath, "w");
+      if (!file) {
+        ret = errno;
+        LOGE(TAG, "Failed to write %s %s", csvPath, strerror(errno));
+      } else {
+        ret = sh2xref_write_csv(&index, &definition, rom.data, rom.length, file);
+        if (fclose(file) && !ret)
+          ret = errno ? errno : EIO;
+        if (ret)
+          LOGE(TAG, "Failed to write %s", csvPath);
+        else
+          LOGI(TAG, "Wrote the references to %zu tables to %s", definition.numTables, csvPath);
+      }
+      definition_free(&definition);
+    }
+  }
+  sh2xref_free(&index);
+  mapfile_close(&rom);
+  return ret;
+}
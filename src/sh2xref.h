@@ -0,0 +1,155 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "definition.h"
+
+/* SH-2 cross references.
+ *
+ * Which code refers to which address of a ROM image, without a Ghidra analysis of
+ * disassembly/RX8.gpr. SH-2 instructions have no room for an address, code loads them
+ * from literal pools next to it (see disassembly/src/main-init.asm):
+ *   mov.l @(disp,PC),Rn   Dndd  the long at (PC & ~3) + 4 + disp * 4
+ *   mov.w @(disp,PC),Rn   9ndd  the word at PC + 4 + disp * 2, sign extended (DFA8h is 0xffffdfa8)
+ *   mova  @(disp,PC),R0   C7dd  the address (PC & ~3) + 4 + disp * 4 itself
+ * Every one of those is a reference to the value it loads. Function starts are the
+ * targets of bsr, of jsr @Rn when Rn was just loaded from a literal pool, and the
+ * vectors at the start of the ROM; a reference belongs to the closest start before it.
+ *
+ * The ROM is decoded in one linear sweep, cut into segments of SH2XREF_SEGMENT bytes
+ * that worker threads take in turn, each starting a few instructions early to know what
+ * the registers were loaded with. Literal pools get decoded as if they were code too:
+ * the words that some load reads are known to be data once every segment is done, the
+ * references and calls found in them are dropped then. Code only reached through
+ * pointer tables gets no start of its own and counts toward the function before it.
+ *
+ * An index is kept per ROM in a cache directory, named by the CRC32C and length of the
+ * image, so the next lookup for the same ROM is a file read. File layout:
+ *   sh2xref_header_t
+ *   sh2xref_ref_t refs[numRefs]            sorted by target, then instruction
+ *   uint32_t      functions[numFunctions]  ascending
+ */
+
+#define SH2XREF_MAGIC "RX8XREF"
+static const uint32_t SH2XREF_VERSION = 1;
+
+static const size_t   SH2XREF_SEGMENT  = 64 * 1024;
+// the exception vector table of the SH7058, 256 longs
+static const size_t   SH2XREF_VECTORS  = 0x400;
+// a jsr @Rn only calls what Rn was loaded with this many bytes before it
+static const uint32_t SH2XREF_CALL_REACH = 32;
+// how far a table's address may be into the record that points at it
+static const uint32_t SH2XREF_RECORD_REACH = 16;
+static const uint32_t SH2XREF_NO_FUNCTION = 0xffffffffu;
+
+enum sh2xref_kind {
+  SH2XREF_MOV_L = 0,
+  SH2XREF_MOV_W,
+  SH2XREF_MOVA,
+};
+
+typedef struct Sh2xref_Ref {
+  uint32_t target;     // the value loaded
+  uint32_t from;       // the instruction
+  uint32_t literal;    // where the value is, `target` itself for mova
+  uint32_t function;   // start of the function `from` is in, SH2XREF_NO_FUNCTION if none is before it
+  uint32_t kind;       // enum sh2xref_kind
+} sh2xref_ref_t;
+
+typedef struct Sh2xref_Header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t refSize;
+  uint32_t romLength;
+  uint32_t romCrc;     // CRC32C of the image
+  uint32_t numRefs;
+  uint32_t numFunctions;
+  uint32_t crc;        // CRC32C of the refs and functions
+  uint32_t reserved;
+} sh2xref_header_t;
+
+typedef struct Sh2xref {
+  uint8_t* data;       // header, refs and functions, as in the file
+  const sh2xref_header_t* header;
+  const sh2xref_ref_t* refs;
+  size_t   numRefs;
+  const uint32_t* functions;
+  size_t   numFunctions;
+} sh2xref_t;
+
+typedef struct Sh2xref_Stats {
+  bool     cached;     // read from the cache, nothing was decoded
+  size_t   segments;
+  unsigned threads;
+  uint64_t instructions;
+  size_t   literals;   // pool words, 2 bytes each
+  size_t   dropped;    // references and calls decoded out of literal pools
+  uint64_t elapsedUs;
+} sh2xref_stats_t;
+
+/** Index `rom` with `threads` workers, 0 for one per core. Returns 0 or errno */
+size_t sh2xref_build(sh2xref_t* index, const uint8_t* rom, size_t length, unsigned threads, sh2xref_stats_t* stats);
+
+/**
+ * The index of `rom` from `cacheDirectory`, or built and saved there if it has none.
+ * A cache that can't be written only logs a warning. Returns 0 or errno
+ */
+size_t sh2xref_load(sh2xref_t* index, const uint8_t* rom, size_t length, const char* cacheDirectory,
+                    unsigned threads, sh2xref_stats_t* stats);
+
+/** Write an index, replacing `path` only once it is complete. Returns 0 or errno */
+size_t sh2xref_save(const sh2xref_t* index, const char* path);
+
+/** Read an index. Returns 0, errno, or EINVAL if it isn't one */
+size_t sh2xref_open(sh2xref_t* index, const char* path);
+
+void sh2xref_free(sh2xref_t* index);
+
+/** `<directory>/<crc>-<length>.xref`, the cache file of a ROM. Returns 0 or ENAMETOOLONG */
+size_t sh2xref_cache_path(char* path, size_t size, const char* directory, const uint8_t* rom, size_t length);
+
+/** "mov.l", "mov.w" or "mova" */
+const char* sh2xref_kind_name(uint32_t kind);
+
+/** References to an address in [low, high), `*first` is the first of them. Returns how many */
+size_t sh2xref_find(const sh2xref_t* index, uint32_t low, uint32_t high, const sh2xref_ref_t** first);
+
+/** Start of the function `address` is in, SH2XREF_NO_FUNCTION if none is before it */
+uint32_t sh2xref_function(const sh2xref_t* index, uint32_t address);
+
+/**
+ * Who refers to the data and axes of every table of `definition`: one line per reference,
+ * with its function. Tables the code doesn't refer to directly are looked for in the
+ * records that point at them, ScoobyRom's "Record 0x68AEC": a long in the ROM holding the
+ * address, up to SH2XREF_RECORD_REACH bytes after a referenced address. Returns 0 or errno
+ */
+size_t sh2xref_write_csv(const sh2xref_t* index, const definition_t* definition, const uint8_t* rom, size_t length,
+                         FILE* file);
+
+/**
+ * --xref: index the ROM at `romPath`, cached in `cacheDirectory`, and print the references
+ * to [low, low + size), to `low` alone if `size` is 0, to nothing if both are 0. With a
+ * `definitionPath`, also sh2xref_write_csv() of its definition for the ROM to `csvPath`.
+ * Returns 0 or errno
+ */
+size_t sh2xref_report(const char* romPath, const char* cacheDirectory, uint32_t low, uint32_t size,
+                      const char* definitionPath, const char* csvPath, unsigned threads, FILE* out);
@@ -0,0 +1,702 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "simecu.h"
+#include "librx8.h"
+#include "UDS.h"
+#include "OBD2.h"
+#include "util.h"
+
+static const char* TAG = "SimECU";
+
+static const uint8_t SIMECU_NRC_SECURITY_ACCESS_DENIED = 0x33;
+
+// ReadMemoryByAddress only carries 24 bits of address, RAM shows up at 0xff6000
+static const uint32_t SIMECU_RAM_ALIAS = SIMECU_RAM_START & 0xffffff;
+
+static const char* SIMECU_CALIBRATION_ID = "N3M5EF00013H6020";
+
+// mode 01 PIDs 01-20 the PCM claims, a typical gasoline engine
+static const uint32_t SIMECU_PCM_PIDS = 0xBE3EB811;
+
+typedef struct SimECU_Module {
+  const char* calibrationID;  // NULL if the module doesn't report one
+  bool        vin;            // answers mode 09 PID 02
+  uint32_t    pids;           // mode 01 PIDs 01-20
+} simecu_module_t;
+
+// modules after the PCM, 0x7E1 onwards. The last entry is used for any further ones
+static const simecu_module_t simecu_modules[] = {
+  { "N3M6TC00001A0000", true,  0x80018001 },  // TCM
+  { NULL,               false, 0x80000000 },  // ABS
+  { NULL,               false, 0x80000000 },
+};
+
+typedef struct SimECU_Frame {
+  uint64_t     due;  // us, when the frame shows up on the receive queue
+  PASSTHRU_MSG msg;
+} simecu_frame_t;
+
+typedef struct SimECU_Device {
+  unsigned long id;
+  simecu_latency_t latency;
+  unsigned int modules;
+
+  std::mutex lock;
+  std::condition_variable queued;
+  std::deque<simecu_frame_t> rx;
+  // us, when the bus is done with the last queued frame. Requests and responses interleave frame
+  // by frame on a real bus, so each direction keeps its own timeline
+  uint64_t busFree;   // responses
+  uint64_t txFree;    // requests
+
+  // flow control filters as (filter ID, flow control CAN ID), the channel only transmits to those
+  std::vector<std::pair<unsigned long, uint32_t>> flowControl;
+
+  std::vector<uint8_t> rom;
+  std::vector<uint8_t> ram;
+  uint64_t openedUs;
+
+  char     vin[VIN_LENGTH];
+  uint8_t  session;
+  bool     unlocked;
+  rx8_seed_t seed;
+  uint32_t seedCounter;
+
+  bool     downloading;
+  uint32_t downloadSize;
+  uint32_t downloadReceived;
+
+  uint8_t  response[PM_DATA_LEN];
+} simecu_device_t;
+
+static struct {
+  std::mutex lock;
+  std::vector<simecu_device_t*> devices;
+  std::vector<uint8_t> rom;   // image new devices start with
+  simecu_latency_t latency = SIMECU_LATENCY_DEFAULT;
+  unsigned int modules = SIMECU_DEFAULT_MODULES;
+  unsigned long nextID = 1;
+  unsigned long nextMsgID = 1;
+} sim;
+
+void simecu_set_latency(const simecu_latency_t* latency)
+{
+  std::lock_guard<std::mutex> guard(sim.lock);
+  sim.latency = *latency;
+}
+
+void simecu_set_modules(unsigned int count)
+{
+  std::lock_guard<std::mutex> guard(sim.lock);
+  sim.modules = count < 1 ? 1 : count > SIMECU_MAX_MODULES ? SIMECU_MAX_MODULES : count;
+}
+
+size_t simecu_load_rom(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    LOGE(TAG, "failed to open %s %s", path, strerror(errno));
+    return errno;
+  }
+  std::vector<uint8_t> rom(MAZDA_ROM_LENGTH, 0xff);
+  size_t length = fread(rom.data(), 1, rom.size(), file);
+  fclose(file);
+  if (length != MAZDA_ROM_LENGTH) {
+    LOGE(TAG, "%s is 0x%zx bytes, expecting 0x%x", path, length, MAZDA_ROM_LENGTH);
+    return 1;
+  }
+
+  std::lock_guard<std::mutex> guard(sim.lock);
+  sim.rom.swap(rom);
+  return 0;
+}
+
+// deterministic filler so dumps of the same simulated ECU compare equal
+static void simecu_generate_rom(std::vector<uint8_t>& rom)
+{
+  uint32_t state = 0x52583845; // RX8E
+  rom.resize(MAZDA_ROM_LENGTH);
+  for (size_t i = 0; i < rom.size(); i++) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    rom[i] = (uint8_t)state;
+  }
+  memcpy(&rom[MAZDA_ROM_START_OFFSET], SIMECU_CALIBRATION_ID, strlen(SIMECU_CALIBRATION_ID));
+}
+
+static simecu_device_t* simecu_device(unsigned long id)
+{
+  std::lock_guard<std::mutex> guard(sim.lock);
+  for (simecu_device_t* device : sim.devices)
+    if (device->id == id)
+      return device;
+  return NULL;
+}
+
+// ISO15765 frames needed to move `length` bytes (CAN ID excluded), including the flow control frame
+static uint32_t simecu_frames(uint32_t length)
+{
+  if (length <= 7) return 1;
+  return 2 + (length - 6 + 6) / 7;
+}
+
+static void simecu_sleep_until(uint64_t due)
+{
+  uint64_t now = monotonic_us();
+  if (due > now)
+    std::this_thread::sleep_for(std::chrono::microseconds(due - now));
+}
+
+static void simecu_frame_header(PASSTHRU_MSG* msg, uint8_t canLSB)
+{
+  memset(msg, 0, sizeof(PASSTHRU_MSG) - PM_DATA_LEN);
+  msg->ProtocolID = ISO15765;
+  msg->Data[0] = 0x00;
+  msg->Data[1] = 0x00;
+  msg->Data[2] = UDS_RESPONSE_CANID_MSB;
+  msg->Data[3] = canLSB;
+}
+
+/** queue a response from `canLSB`, `ready` is when the ECU starts transmitting. caller holds device->lock */
+static void simecu_respond(simecu_device_t* device, uint8_t canLSB, uint64_t ready, const uint8_t* data, uint32_t length)
+{
+  uint32_t frames = simecu_frames(length);
+  uint64_t start = ready > device->busFree ? ready : device->busFree;
+
+  if (frames > 1) {
+    // first frame indication, like a real interface sends
+    device->rx.emplace_back();
+    simecu_frame_t& indication = device->rx.back();
+    simecu_frame_header(&indication.msg, canLSB);
+    indication.msg.RxStatus = START_OF_MESSAGE;
+    indication.msg.DataSize = 4;
+    indication.due = start + device->latency.frameUs;
+  }
+
+  // frames are built in place, a PASSTHRU_MSG is over 4KB
+  device->rx.emplace_back();
+  simecu_frame_t& frame = device->rx.back();
+  simecu_frame_header(&frame.msg, canLSB);
+  memcpy(&frame.msg.Data[4], data, length);
+  frame.msg.DataSize = 4 + length;
+  frame.due = start + (uint64_t)frames * device->latency.frameUs;
+
+  device->busFree = frame.due;
+  device->queued.notify_all();
+}
+
+static void simecu_negative(simecu_device_t* device, uint64_t ready, uint8_t sid, uint8_t nrc)
+{
+  uint8_t response[3] = { UDS_NEGATIVE_RESPONSE, sid, nrc };
+  simecu_respond(device, UDS_RESPONSE_CANID_LSB, ready, response, sizeof(response));
+}
+
+static void simecu_update_ram(simecu_device_t* device)
+{
+  // free running millisecond counter at the start of RAM so consecutive reads differ
+  uint32_t ms = (uint32_t)((monotonic_us() - device->openedUs) / 1000);
+  device->ram[0] = ms >> 24;
+  device->ram[1] = ms >> 16;
+  device->ram[2] = ms >> 8;
+  device->ram[3] = ms;
+
+  // engine: slow RPM sweep with some ripple, load on its own period, warming up over minutes
+  double t = ms / 1000.0, twoPi = 6.283185307179586;
+  double rpm  = 800 + 6000 * (0.5 - 0.5 * cos(twoPi * t / 20)) + 300 * sin(twoPi * t / 3.7);
+  double load = 0.15 + 0.85 * (0.5 - 0.5 * cos(twoPi * t / 7.3));
+  double ect  = 20 + 70 * (1 - exp(-t / 60));
+  uint8_t* engine = &device->ram[SIMECU_RAM_ENGINE - SIMECU_RAM_START];
+  uint16_t rpmRaw  = (uint16_t)(rpm < 700 ? 700 : rpm);
+  uint16_t loadRaw = (uint16_t)(load * 1000);
+  engine[0] = rpmRaw >> 8;
+  engine[1] = (uint8_t)rpmRaw;
+  engine[2] = loadRaw >> 8;
+  engine[3] = (uint8_t)loadRaw;
+  engine[4] = (uint8_t)(ect + 40);
+  engine[5] = (uint8_t)(1 + (ms / 5000) % 6);
+  engine[6] = (uint8_t)((14.7 - 2.5 * load) * 10);
+}
+
+static void simecu_read_memory(simecu_device_t* device, uint32_t address, uint32_t length, uint8_t* out)
+{
+  for (uint32_t i = 0; i < length; i++, address++) {
+    if (address < device->rom.size())
+      out[i] = device->rom[address];
+    else if (address >= SIMECU_RAM_ALIAS && address - SIMECU_RAM_ALIAS < device->ram.size())
+      out[i] = device->ram[address - SIMECU_RAM_ALIAS];
+    else
+      out[i] = 0xff;
+  }
+}
+
+/** handle one physically addressed request. caller holds device->lock */
+static void simecu_request(simecu_device_t* device, const uint8_t* data, uint32_t length, uint64_t received)
+{
+  uint8_t* response = device->response;
+  uint64_t ready = received + device->latency.responseUs;
+  if (length == 0) return;
+  uint8_t sid = data[0];
+
+  switch (sid) {
+  case OBD2_SID_REQUEST_VEHICLE_INFORMATION: {
+    if (length < 2) break;
+    const char* value;
+    size_t valueLength;
+    if (data[1] == OBD2_PID_REQUEST_VIN) {
+      value = device->vin;
+      valueLength = VIN_LENGTH - 1;
+    } else if (data[1] == OBD2_PID_REQUEST_CALID) {
+      value = SIMECU_CALIBRATION_ID;
+      valueLength = CALIBRATION_ID_LENGTH - 1;
+    } else {
+      simecu_negative(device, ready, sid, UDS_NEGATIVE_RESPONSE_REQUEST_OUT_OF_RANGE);
+      return;
+    }
+    uint8_t reply[3 + VIN_LENGTH] = { OBD2_SID_REQUEST_VEHICLE_INFORMATION_ACK, data[1], 0x01 };
+    memcpy(&reply[3], value, valueLength);
+    simecu_respond(device, UDS_RESPONSE_CANID_LSB, ready, reply, (uint32_t)(3 + valueLength));
+    return;
+  }
+
+  case OBD2_SID_REQUEST_CURRENT_DATA: {
+    if (length < 2) break;
+    if (data[1] != OBD2_PID_SUPPORTED_PIDS_01_20) {
+      simecu_negative(device, ready, sid, UDS_NEGATIVE_RESPONSE_REQUEST_OUT_OF_RANGE);
+      return;
+    }
+    uint8_t reply[6] = { OBD2_SID_REQUEST_CURRENT_DATA_ACK, data[1],
+      (uint8_t)(SIMECU_PCM_PIDS >> 24), (uint8_t)(SIMECU_PCM_PIDS >> 16), (uint8_t)(SIMECU_PCM_PIDS >> 8), (uint8_t)SIMECU_PCM_PIDS };
+    simecu_respond(device, UDS_RESPONSE_CANID_LSB, ready, reply, sizeof(reply));
+    return;
+  }
+
+  case UDS_SID_SESSION: {
+    if (length < 2) break;
+    if (data[1] != MAZDA_SBF_SESSION_81 && data[1] != MAZDA_SBF_SESSION_85 && data[1] != MAZDA_SBF_SESSION_87) {
+      simecu_negative(device, ready, sid, UDS_NEGATIVE_RESPONSE_SUBFUNCTION_NOT_SUPPORTED);
+      return;
+    }
+    device->session = data[1];
+    uint8_t reply[2] = { UDS_SID_SESSION_ACK, data[1] };
+    simecu_respond(device, UDS_RESPONSE_CANID_LSB, ready, reply, sizeof(reply));
+    return;
+  }
+
+  case UDS_SID_SECURITY: {
+    if (length < 2) break;
+    if (data[1] == MAZDA_SBF_REQUEST_SEED) {
+      device->seedCounter = device->seedCounter * 1103515245 + 12345;
+      device->seed[0] = device->seedCounter >> 16;
+      device->seed[1] = device->seedCounter >> 8;
+      device->seed[2] = device->seedCounter;
+      uint8_t reply[2 + SEED_LENGTH] = { UDS_SID_SECURITY_ACK, MAZDA_SBF_REQUEST_SEED, device->seed[0], device->seed[1], device->seed[2] };
+      simecu_respond(device, UDS_RESPONSE_CANID_LSB, ready, reply, sizeof(reply));
+      return;
+    }
+    if (data[1] == MAZDA_SBF_CHECK_KEY && length >= 2 + SEED_LENGTH) {
+      rx8_key_t key = RX8::calculateKey(device->seed);
+      if (memcmp(key.data(), &data[2], SEED_LENGTH) != 0) {
+        simecu_negative(device, ready, sid, UDS_NEGATIVE_RESPONSE_INVALID_KEY);
+        return;
+      }
+      device->unlocked = true;
+      uint8_t reply[2] = { UDS_SID_SECURITY_ACK, MAZDA_SBF_CHECK_KEY };
+      simecu_respond(device, UDS_RESPONSE_CANID_LSB, ready, reply, sizeof(reply));
+      return;
+    }
+    simecu_negative(device, ready, sid, UDS_NEGATIVE_RESPONSE_SUBFUNCTION_NOT_SUPPORTED);
+    return;
+  }
+
+  case UDS_SID_READ_MEMORY_BY_ADDRESS: {
+    if (length < 7) break;
+    if (!device->unlocked) {
+      simecu_negative(device, ready, sid, SIMECU_NRC_SECURITY_ACCESS_DENIED);
+      return;
+    }
+    uint32_t address = (data[2] << 16) | (data[3] << 8) | data[4];
+    uint32_t size    = (data[5] << 8) | data[6];
+    if (size == 0 || size + 1 > PM_DATA_LEN - 4) {
+      simecu_negative(device, ready, sid, UDS_NEGATIVE_RESPONSE_REQUEST_OUT_OF_RANGE);
+      return;
+    }
+    simecu_update_ram(device);
+    response[0] = UDS_SID_READ_MEMORY_BY_ADDRESS_ACK;
+    simecu_read_memory(device, address, size, &response[1]);
+    simecu_respond(device, UDS_RESPONSE_CANID_LSB, ready, response, size + 1);
+    return;
+  }
+
+  case 0xB1: {
+    uint8_t reply[4] = { 0xF1, 0x00, 0xB2, 0x00 };
+    simecu_respond(device, UDS_RESPONSE_CANID_LSB, ready, reply, sizeof(reply));
+    return;
+  }
+
+  case UDS_SID_REQUEST_DOWNLOAD: {
+    if (length < 9) break;
+    if (!device->unlocked) {
+      simecu_negative(device, ready, sid, SIMECU_NRC_SECURITY_ACCESS_DENIED);
+      return;
+    }
+    device->downloading      = true;
+    device->downloadSize     = (data[6] << 16) | (data[7] << 8) | data[8];
+    device->downloadReceived = 0;
+    uint8_t reply[3] = { UDS_SID_REQUEST_DOWNLOAD_ACK, 0x00, 0x00 };
+    simecu_respond(device, UDS_RESPONSE_CANID_LSB, ready, reply, sizeof(reply));
+    return;
+  }
+
+  case UDS_SID_TRANSFER_DATA: {
+    if (!device->downloading) {
+      simecu_negative(device, ready, sid, UDS_NEGATIVE_RESPONSE_REQUEST_SEQUENCE_ERROR);
+      return;
+    }
+    // the payload is the SBL followed by the ROM from MAZDA_ROM_START_OFFSET, only the ROM part is kept
+    for (uint32_t i = 1; i < length && device->downloadReceived < device->downloadSize; i++, device->downloadReceived++) {
+      if (device->downloadReceived < MAZDA_SBL_LENGTH) continue;
+      uint32_t address = MAZDA_ROM_START_OFFSET + device->downloadReceived - MAZDA_SBL_LENGTH;
+      if (address < device->rom.size())
+        device->rom[address] = data[i];
+    }
+    uint8_t reply[1] = { UDS_SID_TRANSFER_DATA_ACK };
+    simecu_respond(device, UDS_RESPONSE_CANID_LSB, ready + device->latency.programUs, reply, sizeof(reply));
+    return;
+  }
+
+  case UDS_SID_REQUEST_TRANSFER_EXIT: {
+    device->downloading = false;
+    uint8_t reply[1] = { UDS_SID_REQUEST_TRANSFER_EXIT_ACK };
+    simecu_respond(device, UDS_RESPONSE_CANID_LSB, ready, reply, sizeof(reply));
+    return;
+  }
+
+  case UDS_SID_RESET: {
+    device->session     = 0;
+    device->unlocked    = false;
+    device->downloading = false;
+    uint8_t reply[2] = { UDS_SID_RESET_ACK, length > 1 ? data[1] : (uint8_t)0 };
+    simecu_respond(device, UDS_RESPONSE_CANID_LSB, ready, reply, sizeof(reply));
+    return;
+  }
+
+  case UDS_SID_TESTER_PRESENT: {
+    // 0x80 suppresses the positive response
+    if (length > 1 && (data[1] & 0x80)) return;
+    uint8_t reply[2] = { UDS_SID_TESTER_PRESENT_ACK, 0x00 };
+    simecu_respond(device, UDS_RESPONSE_CANID_LSB, ready, reply, sizeof(reply));
+    return;
+  }
+
+  default:
+    simecu_negative(device, ready, sid, UDS_NEGATIVE_RESPONSE_SERVICE_NOT_SUPPORTED);
+    return;
+  }
+
+  simecu_negative(device, ready, sid, UDS_NEGATIVE_RESPONSE_INCORRECT_MESSAGE_LENGTH_OR_INVALID_FORMAT);
+}
+
+/**
+ * handle a request to one of the modules after the PCM, they only know OBD services.
+ * Functionally addressed requests they can't answer are ignored instead of rejected. caller holds device->lock
+ */
+static void simecu_module_request(simecu_device_t* device, unsigned int index, const uint8_t* data, uint32_t length,
+                                  uint64_t received, bool functional)
+{
+  const size_t known = sizeof(simecu_modules) / sizeof(simecu_modules[0]);
+  const simecu_module_t* module = &simecu_modules[(index - 1) < known ? index - 1 : known - 1];
+  uint8_t canLSB = (uint8_t)(UDS_RESPONSE_CANID_LSB + index);
+  // modules don't all answer at the same time
+  uint64_t ready = received + device->latency.responseUs + index * device->latency.responseUs / 4;
+  uint8_t* response = device->response;
+  if (length < 2) return;
+
+  if (data[0] == OBD2_SID_REQUEST_CURRENT_DATA && data[1] == OBD2_PID_SUPPORTED_PIDS_01_20) {
+    uint8_t reply[6] = { OBD2_SID_REQUEST_CURRENT_DATA_ACK, data[1],
+      (uint8_t)(module->pids >> 24), (uint8_t)(module->pids >> 16), (uint8_t)(module->pids >> 8), (uint8_t)module->pids };
+    simecu_respond(device, canLSB, ready, reply, sizeof(reply));
+    return;
+  }
+  if (data[0] == OBD2_SID_REQUEST_VEHICLE_INFORMATION &&
+      ((data[1] == OBD2_PID_REQUEST_VIN && module->vin) || (data[1] == OBD2_PID_REQUEST_CALID && module->calibrationID))) {
+    const char* value = data[1] == OBD2_PID_REQUEST_VIN ? device->vin : module->calibrationID;
+    size_t valueLength = data[1] == OBD2_PID_REQUEST_VIN ? VIN_LENGTH - 1 : CALIBRATION_ID_LENGTH - 1;
+    response[0] = OBD2_SID_REQUEST_VEHICLE_INFORMATION_ACK;
+    response[1] = data[1];
+    response[2] = 0x01;
+    memcpy(&response[3], value, valueLength);
+    simecu_respond(device, canLSB, ready, response, (uint32_t)(3 + valueLength));
+    return;
+  }
+  if (functional) return;
+
+  uint8_t reply[3] = { UDS_NEGATIVE_RESPONSE, data[0],
+    data[0] == OBD2_SID_REQUEST_CURRENT_DATA || data[0] == OBD2_SID_REQUEST_VEHICLE_INFORMATION ?
+      UDS_NEGATIVE_RESPONSE_REQUEST_OUT_OF_RANGE : UDS_NEGATIVE_RESPONSE_SERVICE_NOT_SUPPORTED };
+  simecu_respond(device, canLSB, ready, reply, sizeof(reply));
+}
+
+static long PT_CALL simOpen(const void*, unsigned long* pDeviceID)
+{
+  simecu_device_t* device = new simecu_device_t();
+
+  std::lock_guard<std::mutex> guard(sim.lock);
+  if (sim.rom.empty()) simecu_generate_rom(sim.rom);
+
+  device->id       = sim.nextID++;
+  device->latency  = sim.latency;
+  device->modules  = sim.modules;
+  device->rom      = sim.rom;
+  device->ram.assign(SIMECU_RAM_LENGTH, 0);
+  device->openedUs = monotonic_us();
+  device->busFree  = 0;
+  device->txFree   = 0;
+  device->session  = 0;
+  device->unlocked = false;
+  device->downloading = false;
+  device->seedCounter = (uint32_t)device->id * 0x9e3779b9;
+  // example: JM1FE17N0Z0000001, every device gets its own VIN
+  snprintf(device->vin, sizeof(device->vin), "JM1FE17N0Z%07lu", device->id % 10000000);
+
+  sim.devices.push_back(device);
+  *pDeviceID = device->id;
+  return STATUS_NOERROR;
+}
+
+static long PT_CALL simClose(unsigned long DeviceID)
+{
+  std::lock_guard<std::mutex> guard(sim.lock);
+  for (size_t i = 0; i < sim.devices.size(); i++) {
+    if (sim.devices[i]->id == DeviceID) {
+      delete sim.devices[i];
+      sim.devices.erase(sim.devices.begin() + i);
+      return STATUS_NOERROR;
+    }
+  }
+  return ERR_INVALID_DEVICE_ID;
+}
+
+// one channel per device, the channel ID is the device ID
+static long PT_CALL simConnect(unsigned long DeviceID, unsigned long, unsigned long, unsigned long, unsigned long* pChannelID)
+{
+  if (!simecu_device(DeviceID)) return ERR_INVALID_DEVICE_ID;
+  *pChannelID = DeviceID;
+  return STATUS_NOERROR;
+}
+
+static long PT_CALL simDisconnect(unsigned long ChannelID)
+{
+  return simecu_device(ChannelID) ? STATUS_NOERROR : ERR_INVALID_CHANNEL_ID;
+}
+
+static long PT_CALL simReadMsgs(unsigned long ChannelID, void* pMsg, unsigned long* pNumMsgs, unsigned long Timeout)
+{
+  simecu_device_t* device = simecu_device(ChannelID);
+  PASSTHRU_MSG* msg = (PASSTHRU_MSG*)pMsg;
+  unsigned long wanted = *pNumMsgs;
+  uint64_t deadline = monotonic_us() + (uint64_t)Timeout * 1000;
+
+  *pNumMsgs = 0;
+  if (!device) return ERR_INVALID_CHANNEL_ID;
+
+  std::unique_lock<std::mutex> guard(device->lock);
+  for (;;) {
+    uint64_t now = monotonic_us();
+    while (*pNumMsgs < wanted && !device->rx.empty() && device->rx.front().due <= now) {
+      simecu_frame_t& frame = device->rx.front();
+      memcpy(&msg[*pNumMsgs], &frame.msg, sizeof(PASSTHRU_MSG) - PM_DATA_LEN + frame.msg.DataSize);
+      msg[*pNumMsgs].Timestamp = (unsigned long)(frame.due - device->openedUs);
+      device->rx.pop_front();
+      (*pNumMsgs)++;
+    }
+    if (*pNumMsgs) return STATUS_NOERROR;
+    if (now >= deadline) return ERR_BUFFER_EMPTY;
+
+    uint64_t wake = deadline;
+    if (!device->rx.empty() && device->rx.front().due < wake)
+      wake = device->rx.front().due;
+    device->queued.wait_for(guard, std::chrono::microseconds(wake - now));
+  }
+}
+
+static long PT_CALL simWriteMsgs(unsigned long ChannelID, const void* pMsg, unsigned long* pNumMsgs, unsigned long)
+{
+  simecu_device_t* device = simecu_device(ChannelID);
+  const PASSTHRU_MSG* msg = (const PASSTHRU_MSG*)pMsg;
+  if (!device) return ERR_INVALID_CHANNEL_ID;
+
+  for (unsigned long i = 0; i < *pNumMsgs; i++) {
+    if (msg[i].DataSize < 4) return ERR_INVALID_MSG;
+    uint32_t length = msg[i].DataSize - 4;
+    uint32_t canID = ((uint32_t)msg[i].Data[0] << 24) | ((uint32_t)msg[i].Data[1] << 16) |
+                     ((uint32_t)msg[i].Data[2] << 8) | msg[i].Data[3];
+    uint64_t done;
+
+    {
+      std::lock_guard<std::mutex> guard(device->lock);
+      bool flowControl = false;
+      for (const auto& filter : device->flowControl)
+        flowControl |= filter.second == canID;
+      if (!flowControl) return ERR_NO_FLOW_CONTROL;
+      uint64_t now = monotonic_us();
+      uint64_t start = now > device->txFree ? now : device->txFree;
+      done = start + (uint64_t)simecu_frames(length) * device->latency.frameUs;
+      device->txFree = done;
+    }
+    // writes block until the last frame is on the bus
+    simecu_sleep_until(done);
+
+    std::lock_guard<std::mutex> guard(device->lock);
+    if (msg[i].Data[2] != UDS_REQUEST_CANID_MSB || length == 0) continue;
+    uint8_t target = msg[i].Data[3];
+    if (target == OBD2_FUNCTIONAL_CANID_LSB) {
+      // every module sees it, the PCM only answers the OBD services when addressed this way
+      if (msg[i].Data[4] == OBD2_SID_REQUEST_CURRENT_DATA || msg[i].Data[4] == OBD2_SID_REQUEST_VEHICLE_INFORMATION)
+        simecu_request(device, &msg[i].Data[4], length, done);
+      for (unsigned int module = 1; module < device->modules; module++)
+        simecu_module_request(device, module, &msg[i].Data[4], length, done, true);
+    } else if (target == UDS_REQUEST_CANID_LSB) {
+      simecu_request(device, &msg[i].Data[4], length, done);
+    } else if (target > UDS_REQUEST_CANID_LSB && target < UDS_REQUEST_CANID_LSB + device->modules) {
+      simecu_module_request(device, target - UDS_REQUEST_CANID_LSB, &msg[i].Data[4], length, done, false);
+    }
+  }
+  return STATUS_NOERROR;
+}
+
+// the device sends periodic messages itself, and TesterPresent with 0x80 never gets a reply
+static long PT_CALL simStartPeriodicMsg(unsigned long ChannelID, const void*, unsigned long* pMsgID, unsigned long)
+{
+  if (!simecu_device(ChannelID)) return ERR_INVALID_CHANNEL_ID;
+  std::lock_guard<std::mutex> guard(sim.lock);
+  *pMsgID = sim.nextMsgID++;
+  return STATUS_NOERROR;
+}
+
+static long PT_CALL simStopPeriodicMsg(unsigned long, unsigned long)
+{
+  return STATUS_NOERROR;
+}
+
+static long PT_CALL simStartMsgFilter(unsigned long ChannelID, unsigned long FilterType, const void*, const void*,
+                                      const void* pFlowControlMsg, unsigned long* pMsgID)
+{
+  simecu_device_t* device = simecu_device(ChannelID);
+  const PASSTHRU_MSG* flowControl = (const PASSTHRU_MSG*)pFlowControlMsg;
+  if (!device) return ERR_INVALID_CHANNEL_ID;
+  if (FilterType == FLOW_CONTROL_FILTER && (!flowControl || flowControl->DataSize != 4)) return ERR_INVALID_MSG;
+  {
+    std::lock_guard<std::mutex> guard(sim.lock);
+    *pMsgID = sim.nextMsgID++;
+  }
+  if (FilterType == FLOW_CONTROL_FILTER) {
+    const uint8_t* id = flowControl->Data;
+    std::lock_guard<std::mutex> guard(device->lock);
+    device->flowControl.push_back(std::make_pair(*pMsgID,
+      ((uint32_t)id[0] << 24) | ((uint32_t)id[1] << 16) | ((uint32_t)id[2] << 8) | id[3]));
+  }
+  return STATUS_NOERROR;
+}
+
+static long PT_CALL simStopMsgFilter(unsigned long ChannelID, unsigned long MsgID)
+{
+  simecu_device_t* device = simecu_device(ChannelID);
+  if (!device) return ERR_INVALID_CHANNEL_ID;
+  std::lock_guard<std::mutex> guard(device->lock);
+  for (auto filter = device->flowControl.begin(); filter != device->flowControl.end(); ++filter) {
+    if (filter->first == MsgID) {
+      device->flowControl.erase(filter);
+      break;
+    }
+  }
+  return STATUS_NOERROR;
+}
+
+static long PT_CALL simSetProgrammingVoltage(unsigned long, unsigned long, unsigned long)
+{
+  return STATUS_NOERROR;
+}
+
+static long PT_CALL simReadVersion(unsigned long, char* pFirmwareVersion, char* pDllVersion, char* pApiVersion)
+{
+  strcpy(pFirmwareVersion, "simecu");
+  strcpy(pDllVersion, "simecu");
+  strcpy(pApiVersion, "04.04");
+  return STATUS_NOERROR;
+}
+
+static long PT_CALL simGetLastError(char* pErrorDescription)
+{
+  strcpy(pErrorDescription, "simulated ECU");
+  return STATUS_NOERROR;
+}
+
+static long PT_CALL simIoctl(unsigned long ChannelID, unsigned long IoctlID, const void*, void* pOutput)
+{
+  if (IoctlID == READ_VBATT) {
+    *(unsigned long*)pOutput = 13800;
+    return STATUS_NOERROR;
+  }
+
+  simecu_device_t* device = simecu_device(ChannelID);
+  if (!device) return STATUS_NOERROR;
+  if (IoctlID == CLEAR_RX_BUFFER) {
+    std::lock_guard<std::mutex> guard(device->lock);
+    device->rx.clear();
+  } else if (IoctlID == CLEAR_MSG_FILTERS) {
+    std::lock_guard<std::mutex> guard(device->lock);
+    device->flowControl.clear();
+  }
+  return STATUS_NOERROR;
+}
+
+static const PASSTHRU_API simApi = {
+  simOpen,
+  simClose,
+  simConnect,
+  simDisconnect,
+  simReadMsgs,
+  simWriteMsgs,
+  simStartPeriodicMsg,
+  simStopPeriodicMsg,
+  simStartMsgFilter,
+  simStopMsgFilter,
+  simSetProgrammingVoltage,
+  simReadVersion,
+  simGetLastError,
+  simIoctl,
+};
+
+const PASSTHRU_API* simecu_api()
+{
+  return &simApi;
+}
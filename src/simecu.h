@@ -0,0 +1,71 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "J2534.h"
+
+/* Simulated ECU.
+ *
+ * An in-process passthru API with an RX8 PCM behind every device it opens. It
+ * answers the services librx8 uses (VIN, CALID, session, seed/key, ReadMemoryByAddress,
+ * RequestDownload/TransferData/RequestTransferExit, ECUReset) and models the bus and
+ * the ECU with a configurable latency, so dumps and flashes can be exercised and
+ * benchmarked without a car. Every device is independent and thread safe, any number
+ * of them can run at once. Functionally addressed OBD requests (0x7DF) reach every
+ * module on the simulated bus.
+ */
+
+typedef struct SimECU_Latency {
+  uint32_t responseUs;  // ECU processing time before the first frame of a response
+  uint32_t frameUs;     // bus time per CAN frame, ~250us at 500kbit
+  uint32_t programUs;   // extra processing time for every TransferData
+} simecu_latency_t;
+
+static const simecu_latency_t SIMECU_LATENCY_DEFAULT = { 2000, 250, 5000 };
+static const simecu_latency_t SIMECU_LATENCY_NONE    = { 0, 0, 0 };
+
+// modules on the simulated bus: the PCM at 0x7E0, a TCM at 0x7E1 and ABS at 0x7E2.
+// Everything after the PCM only answers OBD requests (supported PIDs, VIN, CALID)
+static const unsigned int SIMECU_DEFAULT_MODULES = 3;
+static const unsigned int SIMECU_MAX_MODULES     = 8;
+
+// address of the RAM window readable through ReadMemoryByAddress
+static const uint32_t SIMECU_RAM_START  = 0xffff6000;
+static const uint32_t SIMECU_RAM_LENGTH = 0xa000;
+
+// a simulated engine that sweeps through its operating range, so logging RAM sees values
+// change. Big endian like the real ECU:
+//   +0 RPM  uint16
+//   +2 load uint16, 1/1000
+//   +4 ECT  uint8, degrees C + 40
+//   +5 gear uint8
+//   +6 AFR  uint8, 1/10
+static const uint32_t SIMECU_RAM_ENGINE = SIMECU_RAM_START + 0x2000;
+
+/** Set the latency model for devices opened after this call */
+void simecu_set_latency(const simecu_latency_t* latency);
+
+/** Set how many modules devices opened after this call have, 1 (only the PCM) to SIMECU_MAX_MODULES */
+void simecu_set_modules(unsigned int count);
+
+/** Load the ROM image new devices start with. By default a synthetic image is generated */
+size_t simecu_load_rom(const char* path);
+
+const PASSTHRU_API* simecu_api();
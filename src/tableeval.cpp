@@ -0,0 +1,561 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TABLEEVAL_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <vector>
+
+#include "tableeval.h"
+#include "util.h"
+
+static const char* TAG = "Tableeval";
+
+// axes up to this long are scanned breakpoint by breakpoint, longer ones binary searched
+static const uint16_t TABLEEVAL_MAX_SCAN = 32;
+// longer axes than this aren't something an ECU interpolates over
+static const uint16_t TABLEEVAL_MAX_AXIS = 1024;
+
+void tableeval_init(tableeval_t* eval)
+{
+  memset(eval, 0, sizeof(*eval));
+  for (size_t c = 0; c < CELLTRACE_MAX_CHANNELS; c++)
+    eval->minuends[c] = eval->subtrahends[c] = -1;
+}
+
+void tableeval_free(tableeval_t* eval)
+{
+  for (size_t a = 0; a < eval->numAxes; a++) {
+    free(eval->axes[a].values);
+    free(eval->axes[a].inverseSpans);
+  }
+  for (size_t t = 0; t < eval->numTables; t++)
+    free(eval->tables[t].cells);
+  free(eval->axes);
+  free(eval->tables);
+  tableeval_init(eval);
+}
+
+static bool tableeval_ascending(const float* values, uint16_t length)
+{
+  for (uint16_t i = 0; i < length; i++) {
+    if (!isfinite(values[i])) return false;
+    if (i && values[i] < values[i - 1]) return false;
+  }
+  return true;
+}
+
+// index of an axis with these breakpoints, added if there is none yet. -1 if out of memory
+static int tableeval_axis(tableeval_t* eval, const float* values, uint16_t length, int channel)
+{
+  for (size_t a = 0; a < eval->numAxes; a++) {
+    const tableeval_axis_t* axis = &eval->axes[a];
+    if (axis->channel == channel && axis->length == length && !memcmp(axis->values, values, length * sizeof(float)))
+      return (int)a;
+  }
+
+  tableeval_axis_t* axes = (tableeval_axis_t*)realloc(eval->axes, (eval->numAxes + 1) * sizeof(tableeval_axis_t));
+  if (!axes) return -1;
+  eval->axes = axes;
+  tableeval_axis_t* axis = &axes[eval->numAxes];
+  axis->values       = (float*)malloc(length * sizeof(float));
+  axis->inverseSpans = (float*)malloc(length * sizeof(float));
+  if (!axis->values || !axis->inverseSpans) {
+    free(axis->values);
+    free(axis->inverseSpans);
+    return -1;
+  }
+  memcpy(axis->values, values, length * sizeof(float));
+  for (uint16_t i = 0; i < length; i++) {
+    float span = i + 1 < length ? values[i + 1] - values[i] : 0;
+    axis->inverseSpans[i] = span > 0 ? 1 / span : 0;
+  }
+  axis->length  = length;
+  axis->channel = channel;
+  return (int)eval->numAxes++;
+}
+
+/*
+ * Interval of every sample, the number of breakpoints after the first it is at or past,
+ * and its position inside it. Clamped at the ends of the axis like the ECU does
+ */
+static void tableeval_locate(const tableeval_axis_t* axis, const float* in, uint32_t* index, float* fraction, size_t count)
+{
+  const float* values = axis->values;
+  uint32_t last = axis->length > 1 ? (uint32_t)axis->length - 2 : 0;
+  size_t i = 0;
+
+  if (!in) {
+    for (; i < count; i++) {
+      index[i]    = 0;
+      fraction[i] = NAN;
+    }
+    return;
+  }
+  if (axis->length > TABLEEVAL_MAX_SCAN) {
+    for (; i < count; i++) {
+      size_t n = (size_t)(std::upper_bound(values + 1, values + last + 1, in[i]) - (values + 1));
+      index[i] = (uint32_t)n;
+    }
+  } else {
+#if defined(TABLEEVAL_SSE2)
+    for (; i + 4 <= count; i += 4) {
+      __m128  v = _mm_loadu_ps(in + i);
+      __m128i n = _mm_setzero_si128();
+      // a true compare is -1
+      for (uint32_t k = 1; k <= last; k++)
+        n = _mm_sub_epi32(n, _mm_castps_si128(_mm_cmpge_ps(v, _mm_set1_ps(values[k]))));
+      _mm_storeu_si128((__m128i*)(index + i), n);
+    }
+#endif
+    for (; i < count; i++) {
+      uint32_t n = 0;
+      for (uint32_t k = 1; k <= last; k++) n += in[i] >= values[k];
+      index[i] = n;
+    }
+  }
+  // NaN stays NaN
+  for (i = 0; i < count; i++) {
+    float f = (in[i] - values[index[i]]) * axis->inverseSpans[index[i]];
+    fraction[i] = f < 0 ? 0 : (f > 1 ? 1 : f);
+  }
+}
+
+/*
+ * Interpolation per cell type and layout. A 2D table steps through its cells one by one,
+ * a 3D table one by one along x when stored row by row, along y when `swapxy`. The
+ * other step is the table's. Cells past the last row and column are padding, so the
+ * neighbours of an edge cell can be read, they are weighted 0
+ */
+template <typename Cell>
+static void tableeval_2d(const tableeval_table_t* table, const uint32_t*, const float*, const uint32_t* yIndex, const float* yFraction, float* out, size_t count)
+{
+  const Cell* cells = (const Cell*)table->cells;
+  size_t i = 0;
+#if defined(TABLEEVAL_SSE2)
+  const __m128 scale  = _mm_set1_ps(table->scale);
+  const __m128 offset = _mm_set1_ps(table->offset);
+  alignas(16) float low[4], high[4];
+  for (; i + 4 <= count; i += 4) {
+    for (size_t lane = 0; lane < 4; lane++) {
+      const Cell* cell = cells + yIndex[i + lane];
+      low[lane]  = (float)cell[0];
+      high[lane] = (float)cell[1];
+    }
+    __m128 a = _mm_load_ps(low);
+    __m128 v = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(high), a), _mm_loadu_ps(yFraction + i)));
+    _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(v, scale), offset));
+  }
+#endif
+  for (; i < count; i++) {
+    const Cell* cell = cells + yIndex[i];
+    float a = (float)cell[0];
+    out[i] = (a + ((float)cell[1] - a) * yFraction[i]) * table->scale + table->offset;
+  }
+}
+
+template <typename Cell, bool Columns>
+static void tableeval_3d(const tableeval_table_t* table, const uint32_t* xIndex, const float* xFraction,
+                         const uint32_t* yIndex, const float* yFraction, float* out, size_t count)
+{
+  const Cell* cells = (const Cell*)table->cells;
+  const size_t stepX = Columns ? table->stepX : 1;
+  const size_t stepY = Columns ? 1 : table->stepY;
+  size_t i = 0;
+#if defined(TABLEEVAL_SSE2)
+  const __m128 scale  = _mm_set1_ps(table->scale);
+  const __m128 offset = _mm_set1_ps(table->offset);
+  alignas(16) float c00[4], c01[4], c10[4], c11[4];
+  for (; i + 4 <= count; i += 4) {
+    for (size_t lane = 0; lane < 4; lane++) {
+      const Cell* cell = cells + xIndex[i + lane] * stepX + yIndex[i + lane] * stepY;
+      c00[lane] = (float)cell[0];
+      c01[lane] = (float)cell[stepX];
+      c10[lane] = (float)cell[stepY];
+      c11[lane] = (float)cell[stepX + stepY];
+    }
+    __m128 fx  = _mm_loadu_ps(xFraction + i);
+    __m128 fy  = _mm_loadu_ps(yFraction + i);
+    __m128 a   = _mm_load_ps(c00);
+    __m128 b   = _mm_load_ps(c10);
+    __m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(c01), a), fx));
+    __m128 bottom = _mm_add_ps(b, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(c11), b), fx));
+    __m128 v   = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+    _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(v, scale), offset));
+  }
+#endif
+  for (; i < count; i++) {
+    const Cell* cell = cells + xIndex[i] * stepX + yIndex[i] * stepY;
+    float fx = xFraction[i];
+    float top = (float)cell[0] + ((float)cell[stepX] - (float)cell[0]) * fx;
+    float bottom = (float)cell[stepY] + ((float)cell[stepX + stepY] - (float)cell[stepY]) * fx;
+    out[i] = (top + (bottom - top) * yFraction[i]) * table->scale + table->offset;
+  }
+}
+
+template <typename Cell>
+static tableeval_fn tableeval_pick(uint8_t dimensions, bool swapXY)
+{
+  if (dimensions != 3) return tableeval_2d<Cell>;
+  return swapXY ? tableeval_3d<Cell, true> : tableeval_3d<Cell, false>;
+}
+
+// the raw values of `cells` as `Cell`, with `padding` zeroes after them
+template <typename Cell>
+static void* tableeval_cells(const float* raw, size_t count, size_t padding)
+{
+  Cell* cells = (Cell*)calloc(count + padding, sizeof(Cell));
+  if (!cells) return NULL;
+  for (size_t i = 0; i < count; i++) cells[i] = (Cell)raw[i];
+  return cells;
+}
+
+size_t tableeval_add_table(tableeval_t* eval, const definition_table_t* table, const uint8_t* rom, size_t romLength,
+                           int xChannel, int yChannel)
+{
+  float x[TABLEEVAL_MAX_AXIS], y[TABLEEVAL_MAX_AXIS];
+  bool hasX = table->dimensions == 3;
+  uint16_t columns = hasX ? table->x.length : 1, rows = table->y.length;
+
+  if (table->dimensions < 2 || !rows || !columns || rows > TABLEEVAL_MAX_AXIS || columns > TABLEEVAL_MAX_AXIS)
+    return EINVAL;
+  if ((size_t)columns * rows != (size_t)table->sizeX * table->sizeY) return EINVAL;
+  if ((hasX && (xChannel < 0 || (size_t)xChannel >= eval->numChannels)) || yChannel < 0 || (size_t)yChannel >= eval->numChannels)
+    return EINVAL;
+  if ((hasX && definition_decode_axis(&table->x, rom, romLength, x)) || definition_decode_axis(&table->y, rom, romLength, y))
+    return ERANGE;
+  if ((hasX && !tableeval_ascending(x, columns)) || !tableeval_ascending(y, rows)) {
+    LOGE(TAG, "%s: axis breakpoints are not ascending", table->name);
+    return EINVAL;
+  }
+
+  size_t count = (size_t)columns * rows;
+  float* raw = (float*)malloc(count * sizeof(float));
+  if (!raw) return ENOMEM;
+  // interpolating raw values and scaling the result only works for a linear scaling
+  bool scaled = !table->scaling.linear || definition_storage_size(table->storage) == 4;
+  if (definition_decode(rom, romLength, table->address, count, table->storage, table->bigEndian,
+                        scaled ? &table->scaling : NULL, raw)) {
+    free(raw);
+    return ERANGE;
+  }
+
+  tableeval_table_t* tables = (tableeval_table_t*)realloc(eval->tables, (eval->numTables + 1) * sizeof(tableeval_table_t));
+  if (!tables) {
+    free(raw);
+    return ENOMEM;
+  }
+  eval->tables = tables;
+  tableeval_table_t* t = &tables[eval->numTables];
+  memset(t, 0, sizeof(*t));
+  snprintf(t->name, sizeof(t->name), "%s", table->name);
+  t->columns = columns;
+  t->rows    = rows;
+  t->x       = hasX ? tableeval_axis(eval, x, columns, xChannel) : -1;
+  t->y       = tableeval_axis(eval, y, rows, yChannel);
+  t->stepX   = hasX && table->swapXY ? rows : 1;
+  t->stepY   = hasX && !table->swapXY ? columns : 1;
+  t->scale   = scaled ? 1 : table->scaling.scale;
+  t->offset  = scaled ? 0 : table->scaling.offset;
+  t->storage = scaled ? DEFINITION_STORAGE_FLOAT : table->storage;
+
+  // enough that reading one step past the last cell either way stays inside
+  size_t padding = (size_t)columns + rows + 1;
+  switch (t->storage) {
+    case DEFINITION_STORAGE_UINT8:
+      t->cells    = tableeval_cells<uint8_t>(raw, count, padding);
+      t->evaluate = tableeval_pick<uint8_t>(table->dimensions, table->swapXY);
+      break;
+    case DEFINITION_STORAGE_INT8:
+      t->cells    = tableeval_cells<int8_t>(raw, count, padding);
+      t->evaluate = tableeval_pick<int8_t>(table->dimensions, table->swapXY);
+      break;
+    case DEFINITION_STORAGE_UINT16:
+      t->cells    = tableeval_cells<uint16_t>(raw, count, padding);
+      t->evaluate = tableeval_pick<uint16_t>(table->dimensions, table->swapXY);
+      break;
+    case DEFINITION_STORAGE_INT16:
+      t->cells    = tableeval_cells<int16_t>(raw, count, padding);
+      t->evaluate = tableeval_pick<int16_t>(table->dimensions, table->swapXY);
+      break;
+    default:
+      t->cells    = tableeval_cells<float>(raw, count, padding);
+      t->evaluate = tableeval_pick<float>(table->dimensions, table->swapXY);
+      break;
+  }
+  free(raw);
+  if (!t->cells || (hasX && t->x < 0) || t->y < 0) {
+    free(t->cells);
+    return ENOMEM;
+  }
+  eval->numTables++;
+  return 0;
+}
+
+size_t tableeval_bind(tableeval_t* eval, const celltrace_t* trace, const definition_t* definition,
+                      const uint8_t* rom, size_t romLength)
+{
+  eval->numChannels = trace->numChannels;
+  for (size_t c = 0; c < trace->numChannels; c++) {
+    bool difference = trace->channels[c].source == CELLTRACE_SOURCE_DIFFERENCE;
+    eval->minuends[c]    = difference ? trace->channels[c].minuend : -1;
+    eval->subtrahends[c] = difference ? trace->channels[c].subtrahend : -1;
+  }
+  for (size_t t = 0; t < trace->numTables; t++) {
+    const celltrace_table_t* traced = &trace->tables[t];
+    const definition_table_t* table = definition_find(definition, traced->name);
+    if (!table) {
+      LOGE(TAG, "no table named %s", traced->name);
+      return ENOENT;
+    }
+    int xChannel = traced->x >= 0 ? trace->axes[traced->x].channel : -1;
+    size_t ret = tableeval_add_table(eval, table, rom, romLength, xChannel, trace->axes[traced->y].channel);
+    if (ret) {
+      LOGE(TAG, "can't evaluate %s, its cells or axes are outside the ROM or don't match", traced->name);
+      return ret;
+    }
+  }
+  return 0;
+}
+
+size_t tableeval_scratch_init(tableeval_scratch_t* scratch, const tableeval_t* eval)
+{
+  size_t axes = eval->numAxes ? eval->numAxes : 1, channels = eval->numChannels ? eval->numChannels : 1;
+  scratch->index       = (uint32_t*)malloc(axes * CELLTRACE_BATCH * sizeof(uint32_t));
+  scratch->fraction    = (float*)malloc(axes * CELLTRACE_BATCH * sizeof(float));
+  scratch->differences = (float*)malloc(channels * CELLTRACE_BATCH * sizeof(float));
+  if (scratch->index && scratch->fraction && scratch->differences) return 0;
+  tableeval_scratch_free(scratch);
+  return ENOMEM;
+}
+
+void tableeval_scratch_free(tableeval_scratch_t* scratch)
+{
+  free(scratch->index);
+  free(scratch->fraction);
+  free(scratch->differences);
+  memset(scratch, 0, sizeof(*scratch));
+}
+
+void tableeval_run(const tableeval_t* eval, tableeval_scratch_t* scratch, const float* const* columns, size_t count,
+                   float* const* outputs)
+{
+  const float* batch[CELLTRACE_MAX_CHANNELS];
+  for (size_t offset = 0; offset < count; offset += CELLTRACE_BATCH) {
+    size_t n = count - offset < CELLTRACE_BATCH ? count - offset : CELLTRACE_BATCH;
+    for (size_t c = 0; c < eval->numChannels; c++) {
+      if (eval->minuends[c] < 0) {
+        batch[c] = columns[c] ? columns[c] + offset : NULL;
+        continue;
+      }
+      const float* a = batch[eval->minuends[c]];
+      const float* b = batch[eval->subtrahends[c]];
+      float* out = scratch->differences + c * CELLTRACE_BATCH;
+      if (!a || !b) {
+        batch[c] = NULL;
+        continue;
+      }
+      for (size_t i = 0; i < n; i++) out[i] = a[i] - b[i];
+      batch[c] = out;
+    }
+    for (size_t a = 0; a < eval->numAxes; a++) {
+      const tableeval_axis_t* axis = &eval->axes[a];
+      tableeval_locate(axis, batch[axis->channel], scratch->index + a * CELLTRACE_BATCH,
+                       scratch->fraction + a * CELLTRACE_BATCH, n);
+    }
+    for (size_t t = 0; t < eval->numTables; t++) {
+      const tableeval_table_t* table = &eval->tables[t];
+      size_t x = table->x >= 0 ? (size_t)table->x : 0, y = (size_t)table->y;
+      table->evaluate(table, scratch->index + x * CELLTRACE_BATCH, scratch->fraction + x * CELLTRACE_BATCH,
+                      scratch->index + y * CELLTRACE_BATCH, scratch->fraction + y * CELLTRACE_BATCH, outputs[t] + offset, n);
+    }
+  }
+}
+
+void tableeval_compare(tableeval_diff_t* diff, const float* from, const float* to, size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    float a = from[i], b = to[i];
+    if (isnan(a) || isnan(b)) continue;
+    float d = fabsf(b - a);
+    diff->samples++;
+    diff->changed += d > 0;
+    diff->sumOld  += a;
+    diff->sumNew  += b;
+    diff->sumAbs  += d;
+    if (d > diff->maxAbs) {
+      diff->maxAbs = d;
+      diff->maxOld = a;
+      diff->maxNew = b;
+    }
+  }
+}
+
+void tableeval_merge(tableeval_diff_t* diff, const tableeval_diff_t* from)
+{
+  diff->samples += from->samples;
+  diff->changed += from->changed;
+  diff->sumOld  += from->sumOld;
+  diff->sumNew  += from->sumNew;
+  diff->sumAbs  += from->sumAbs;
+  if (from->maxAbs > diff->maxAbs) {
+    diff->maxAbs = from->maxAbs;
+    diff->maxOld = from->maxOld;
+    diff->maxNew = from->maxNew;
+  }
+}
+
+// what every log worker evaluates its batches with
+typedef struct Tableeval_Worker {
+  tableeval_scratch_t scratch;
+  float*  values;           // CELLTRACE_BATCH per table
+  float** outputs;          // into `values`, one per table
+} tableeval_worker_t;
+
+typedef struct Tableeval_Replay {
+  const tableeval_t* eval;
+  size_t pairs;
+  std::vector<tableeval_worker_t*> workers;
+  std::vector<tableeval_diff_t> diffs;    // `pairs` per worker
+} tableeval_replay_t;
+
+static void tableeval_replay_batch(void* ctx, unsigned w, const float* const* columns, size_t count)
+{
+  tableeval_replay_t* replay = (tableeval_replay_t*)ctx;
+  tableeval_worker_t* worker = replay->workers[w];
+  tableeval_run(replay->eval, &worker->scratch, columns, count, worker->outputs);
+  tableeval_diff_t* diffs = &replay->diffs[w * replay->pairs];
+  for (size_t p = 0; p < replay->pairs; p++)
+    tableeval_compare(&diffs[p], worker->outputs[p], worker->outputs[p + replay->pairs], count);
+}
+
+size_t tableeval_replay(const tableeval_t* eval, celltrace_t* trace, char* const* paths, size_t numPaths,
+                        unsigned threads, tableeval_diff_t* diffs, loganalyze_stats_t* stats)
+{
+  tableeval_replay_t replay;
+  unsigned workers = loganalyze_threads(threads);
+  size_t tables = eval->numTables ? eval->numTables : 1, ret = 0;
+
+  replay.eval  = eval;
+  replay.pairs = eval->numTables / 2;
+  replay.diffs.assign(workers * replay.pairs, tableeval_diff_t());
+  for (unsigned w = 0; w < workers && !ret; w++) {
+    tableeval_worker_t* worker = (tableeval_worker_t*)calloc(1, sizeof(tableeval_worker_t));
+    if (!worker) {
+      ret = ENOMEM;
+      break;
+    }
+    replay.workers.push_back(worker);
+    worker->values  = (float*)malloc(tables * CELLTRACE_BATCH * sizeof(float));
+    worker->outputs = (float**)malloc(tables * sizeof(float*));
+    if (!worker->values || !worker->outputs || tableeval_scratch_init(&worker->scratch, eval)) {
+      ret = ENOMEM;
+      break;
+    }
+    for (size_t t = 0; t < eval->numTables; t++)
+      worker->outputs[t] = worker->values + t * CELLTRACE_BATCH;
+  }
+
+  if (!ret) ret = loganalyze_replay(trace, paths, numPaths, threads, tableeval_replay_batch, &replay, stats);
+  memset(diffs, 0, replay.pairs * sizeof(tableeval_diff_t));
+  for (unsigned w = 0; w < workers && !ret; w++)
+    for (size_t p = 0; p < replay.pairs; p++)
+      tableeval_merge(&diffs[p], &replay.diffs[w * replay.pairs + p]);
+
+  for (size_t w = 0; w < replay.workers.size(); w++) {
+    tableeval_scratch_free(&replay.workers[w]->scratch);
+    free(replay.workers[w]->values);
+    free(replay.workers[w]->outputs);
+    free(replay.workers[w]);
+  }
+  return ret;
+}
+
+size_t tableeval_write_csv(const tableeval_t* eval, const tableeval_diff_t* diffs, FILE* file)
+{
+  fprintf(file, "table,samples,changed,old mean,new mean,mean difference,max difference,old at max,new at max\n");
+  for (size_t p = 0; p < eval->numTables / 2; p++) {
+    const tableeval_diff_t* diff = &diffs[p];
+    double samples = diff->samples ? (double)diff->samples : 1;
+    fprintf(file, "\"%s\",%llu,%llu,%g,%g,%g,%g,%g,%g\n", eval->tables[p].name, (unsigned long long)diff->samples,
+            (unsigned long long)diff->changed, diff->sumOld / samples, diff->sumNew / samples, diff->sumAbs / samples,
+            diff->maxAbs, diff->maxOld, diff->maxNew);
+  }
+  return ferror(file) ? EIO : 0;
+}
+
+size_t tableeval_predict(celltrace_t* trace, const definition_t* definition, const char* logs, const char* romPath,
+                         const char* predictPath, const char* csvPath, const char* cellsCsvPath, unsigned threads)
+{
+  const char* fileNames[2] = { romPath, predictPath };
+  loganalyze_stats_t stats;
+  tableeval_t eval;
+  tableeval_diff_t* diffs = NULL;
+  char** paths = NULL;
+  size_t numPaths = 0;
+  size_t ret = 0;
+
+  if (loganalyze_paths(logs, &paths, &numPaths)) {
+    LOGE(TAG, "No logs in %s", logs);
+    return ENOENT;
+  }
+  tableeval_init(&eval);
+  for (int r = 0; r < 2 && !ret; r++) {
+    size_t romLength = 0;
+    uint8_t* rom = load_file(fileNames[r], &romLength);
+    if (!rom) {
+      LOGE(TAG, "Failed to read ROM %s %s", fileNames[r], strerror(errno));
+      ret = errno ? errno : EIO;
+      break;
+    }
+    ret = tableeval_bind(&eval, trace, definition, rom, romLength);
+    free(rom);
+  }
+  size_t pairs = eval.numTables / 2;
+  if (!ret && !(diffs = (tableeval_diff_t*)calloc(pairs ? pairs : 1, sizeof(tableeval_diff_t))))
+    ret = ENOMEM;
+  if (!ret)
+    ret = tableeval_replay(&eval, trace, paths, numPaths, threads, diffs, &stats);
+  if (ret) {
+    LOGE(TAG, "Analyzing logs failed %s", strerror((int)ret));
+  } else {
+    size_t changed = 0;
+    for (size_t p = 0; p < pairs; p++)
+      changed += diffs[p].changed != 0;
+    LOGI(TAG, "%zu of %zu tables (%zu distinct axes) predict different values with %s", changed, pairs, eval.numAxes,
+         predictPath);
+    FILE* file = fopen(csvPath, "w");
+    if (!file || tableeval_write_csv(&eval, diffs, file)) {
+      LOGE(TAG, "Failed to write %s %s", csvPath, strerror(errno));
+      ret = EIO;
+    } else {
+      LOGI(TAG, "Wrote %s", csvPath);
+    }
+    if (file) fclose(file);
+  }
+  free(diffs);
+  tableeval_free(&eval);
+  free_list(paths, numPaths);
+  return ret ? ret : loganalyze_report(trace, &stats, cellsCsvPath);
+}
@@ -0,0 +1,156 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "definition.h"
+#include "celltrace.h"
+#include "loganalyze.h"
+
+/* Table evaluation, the ECU's table math over logged samples.
+ *
+ * Predicts what the ECU reads out of its tables (ignition, fuel, idle target, ...)
+ * for every sample of a log, to see what a change does before it is flashed. Like
+ * the ECU, an input is clamped to the ends of its axis and placed between two
+ * breakpoints, then the cells around it are interpolated: linearly along the only
+ * axis of a 2D table, bilinearly on a 3D one. Cells stay in their storage type and
+ * are interpolated as raw values, the linear scaling is applied to the result. Cells
+ * of a table with any other scaling, or stored as 32 bit integers, are scaled to
+ * floats first.
+ *
+ * Samples are evaluated CELLTRACE_BATCH at a time. Every axis places the whole batch
+ * first, counting the breakpoints each sample is at or past four samples at a time
+ * with SSE2, and tables with the same breakpoints on the same channel share that.
+ * Then every table interpolates the batch through a function specialized for its
+ * cell type (uint8, int8, uint16, int16, float) and layout (2D, 3D rows, 3D columns
+ * for swapxy), four samples per step with SSE2. Sample columns and channels are those
+ * of the celltrace the tables are bound with (see celltrace.h), NaN where a channel
+ * wasn't logged gives NaN.
+ *
+ * Binding the same celltrace twice, with the tables of a ROM and of its changed
+ * version, compares them: table t against table t + numTables / 2, sample by sample.
+ */
+
+typedef struct Tableeval_Axis {
+  float*   values;        // ascending breakpoints
+  float*   inverseSpans;  // 1 / (values[i + 1] - values[i]), 0 for an interval of no width
+  uint16_t length;
+  int      channel;
+} tableeval_axis_t;
+
+struct Tableeval_Table;
+
+/** Interpolate `count` samples placed on the table's axes: interval and position inside it, 0-1 */
+typedef void (*tableeval_fn)(const struct Tableeval_Table* table, const uint32_t* xIndex, const float* xFraction,
+                             const uint32_t* yIndex, const float* yFraction, float* out, size_t count);
+
+typedef struct Tableeval_Table {
+  char     name[128];
+  int      x;             // axis, -1 for 2D tables
+  int      y;
+  uint16_t columns;       // x axis length, 1 for 2D tables
+  uint16_t rows;
+  definition_storage_t storage;   // of `cells`, DEFINITION_STORAGE_FLOAT once scaled
+  void*    cells;         // native byte order, as laid out in the ROM
+  uint32_t stepX;         // elements from a cell to the next along x
+  uint32_t stepY;
+  float    scale;         // display = interpolated * scale + offset
+  float    offset;
+  tableeval_fn evaluate;
+} tableeval_table_t;
+
+typedef struct Tableeval {
+  size_t numChannels;
+  int    minuends[CELLTRACE_MAX_CHANNELS];     // of difference channels, -1 for the others
+  int    subtrahends[CELLTRACE_MAX_CHANNELS];
+  size_t numAxes;
+  tableeval_axis_t* axes;
+  size_t numTables;
+  tableeval_table_t* tables;
+} tableeval_t;
+
+// a batch being evaluated, one per thread
+typedef struct Tableeval_Scratch {
+  uint32_t* index;        // CELLTRACE_BATCH per axis
+  float*    fraction;
+  float*    differences;  // CELLTRACE_BATCH per channel
+} tableeval_scratch_t;
+
+// one table of a ROM against the same table of another
+typedef struct Tableeval_Diff {
+  uint64_t samples;       // both have a value
+  uint64_t changed;       // and those differ
+  double   sumOld;
+  double   sumNew;
+  double   sumAbs;        // of new - old
+  float    maxAbs;
+  float    maxOld;        // at the largest difference
+  float    maxNew;
+} tableeval_diff_t;
+
+void tableeval_init(tableeval_t* eval);
+void tableeval_free(tableeval_t* eval);
+
+/**
+ * Add a table of the definition with its cells and axes from `rom`, evaluated at
+ * channels `xChannel` (-1 for 2D tables) and `yChannel`. Returns 0 or errno
+ */
+size_t tableeval_add_table(tableeval_t* eval, const definition_table_t* table, const uint8_t* rom, size_t romLength,
+                           int xChannel, int yChannel);
+
+/** Add every table `trace` traces, from `rom`, on the same channels. Returns 0 or errno */
+size_t tableeval_bind(tableeval_t* eval, const celltrace_t* trace, const definition_t* definition,
+                      const uint8_t* rom, size_t romLength);
+
+size_t tableeval_scratch_init(tableeval_scratch_t* scratch, const tableeval_t* eval);
+void tableeval_scratch_free(tableeval_scratch_t* scratch);
+
+/**
+ * Evaluate every table at `count` samples, up to CELLTRACE_BATCH. `columns` as for
+ * celltrace_add(), `outputs[t]` gets `count` values of table t
+ */
+void tableeval_run(const tableeval_t* eval, tableeval_scratch_t* scratch, const float* const* columns, size_t count,
+                   float* const* outputs);
+
+/** Add `count` samples of `from` and `to` to `diff` */
+void tableeval_compare(tableeval_diff_t* diff, const float* from, const float* to, size_t count);
+
+/** Add the samples of `from` to `diff` */
+void tableeval_merge(tableeval_diff_t* diff, const tableeval_diff_t* from);
+
+/**
+ * Replay logs through tables 0 to n / 2 - 1 and n / 2 to n - 1 of `eval` (see loganalyze.h),
+ * one diff per pair into `diffs`, while also adding them to `trace`. Returns 0 or errno
+ */
+size_t tableeval_replay(const tableeval_t* eval, celltrace_t* trace, char* const* paths, size_t numPaths,
+                        unsigned threads, tableeval_diff_t* diffs, loganalyze_stats_t* stats);
+
+/** One row per pair of tables: name, samples, changed, mean old, mean new, mean and max difference */
+size_t tableeval_write_csv(const tableeval_t* eval, const tableeval_diff_t* diffs, FILE* file);
+
+/**
+ * --predict: the tables `trace` binds in the ROMs at `romPath` and `predictPath` evaluated at
+ * every sample of the comma separated files and directories in `logs`, the differences
+ * written to `csvPath`, then loganalyze_report() with the cells to `cellsCsvPath`.
+ * Returns 0 or errno
+ */
+size_t tableeval_predict(celltrace_t* trace, const definition_t* definition, const char* logs, const char* romPath,
+                         const char* predictPath, const char* csvPath, const char* cellsCsvPath, unsigned threads);
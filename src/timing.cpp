@@ -0,0 +1,93 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <assert.h>
+#include <string.h>
+
+#include "timing.h"
+#include "UDS.h"
+#include "OBD2.h"
+
+// slack on top of the computed bus time once the first frame arrived
+static const uint32_t UDS_TIMING_TRANSFER_SLACK_MS = 50;
+
+// the last entry is the fallback for anything not listed
+static const uds_timing_service_t uds_timing_services[] = {
+  { UDS_SID_READ_MEMORY_BY_ADDRESS,     100,  2000 },
+  { UDS_SID_REQUEST_DOWNLOAD,           150, 10000 },
+  { UDS_SID_TRANSFER_DATA,              150,  5000 },
+  { UDS_SID_REQUEST_TRANSFER_EXIT,      150, 10000 },
+  { UDS_SID_RESET,                      150,  5000 },
+  { UDS_SID_SECURITY,                   150,  5000 },
+  { UDS_SID_SESSION,                    150,  5000 },
+  { OBD2_SID_REQUEST_VEHICLE_INFORMATION, 150, 5000 },
+  // ISO 15765-4 P2CAN, this is also the window for functional discovery
+  { OBD2_SID_REQUEST_CURRENT_DATA,       50,  5000 },
+  { 0,                                  150,  5000 },
+};
+
+const uds_timing_service_t* uds_timing_service(uint8_t sid)
+{
+  size_t i;
+  size_t count = sizeof(uds_timing_services) / sizeof(uds_timing_services[0]);
+  for (i = 0; i < count - 1; i++)
+    if (uds_timing_services[i].sid == sid)
+      return &uds_timing_services[i];
+  return &uds_timing_services[count - 1];
+}
+
+static uint64_t uds_deadline_transfer_us(uint32_t length)
+{
+  uint32_t frames = (length + UDS_TIMING_FRAME_PAYLOAD - 1) / UDS_TIMING_FRAME_PAYLOAD;
+  return (uint64_t)frames * UDS_TIMING_FRAME_US + (uint64_t)UDS_TIMING_TRANSFER_SLACK_MS * 1000;
+}
+
+void uds_deadline_start(uds_deadline_t* deadline, uint8_t sid, uint32_t expectedLength, uint64_t now)
+{
+  deadline->sid            = sid;
+  deadline->service        = uds_timing_service(sid);
+  deadline->expectedLength = expectedLength;
+  deadline->pending        = 0;
+  deadline->receiving      = false;
+  deadline->start          = now;
+  deadline->deadline       = deadline->start + (uint64_t)deadline->service->p2 * 1000;
+}
+
+void uds_deadline_pending(uds_deadline_t* deadline, uint64_t now)
+{
+  deadline->pending++;
+  deadline->receiving = false;
+  deadline->deadline  = now + (uint64_t)deadline->service->p2star * 1000;
+}
+
+void uds_deadline_first_frame(uds_deadline_t* deadline, uint64_t now)
+{
+  // the indication does not say how long the message is, assume the worst if the caller didn't either
+  uint32_t length = deadline->expectedLength ? deadline->expectedLength : PM_DATA_LEN;
+  deadline->receiving = true;
+  deadline->deadline  = now + uds_deadline_transfer_us(length);
+}
+
+bool uds_deadline_expired(const uds_deadline_t* deadline, uint64_t now)
+{
+  return now >= deadline->deadline;
+}
+
+unsigned long uds_deadline_remaining_ms(const uds_deadline_t* deadline, uint64_t now)
+{
+  if (now >= deadline->deadline) return 0;
+  return (unsigned long)((deadline->deadline - now + 999) / 1000);
+}
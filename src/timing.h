@@ -0,0 +1,66 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Response timing per service.
+ *
+ * P2  - time the ECU has to start answering a request
+ * P2* - time the ECU gets after every 0x78 (response pending) it sends
+ *
+ * Multi frame responses additionally get time to move the frames across the bus,
+ * counted from the first frame indication.
+ */
+typedef struct UDS_Timing_Service {
+  uint8_t  sid;
+  uint32_t p2;      // ms
+  uint32_t p2star;  // ms
+} uds_timing_service_t;
+
+// bus time per ISO15765 consecutive frame, padded for the ECU's STmin and passthru overhead
+static const uint32_t UDS_TIMING_FRAME_US = 1000;
+static const uint32_t UDS_TIMING_FRAME_PAYLOAD = 7;
+
+typedef struct UDS_Deadline {
+  uint8_t  sid;
+  const uds_timing_service_t* service;
+  uint32_t expectedLength;
+  uint64_t start;     // us, when the request finished transmitting
+  uint64_t deadline;  // us
+  uint32_t pending;
+  bool     receiving; // first frame of a multi frame response has arrived
+} uds_deadline_t;
+
+const uds_timing_service_t* uds_timing_service(uint8_t sid);
+
+/* Every call takes the current monotonic_us() from the caller, which already has it
+ * for the latency metrics, so the transfer loop reads the clock once per event. */
+void uds_deadline_start(uds_deadline_t* deadline, uint8_t sid, uint32_t expectedLength, uint64_t now);
+
+/** ECU sent 0x78, push the deadline out by P2* */
+void uds_deadline_pending(uds_deadline_t* deadline, uint64_t now);
+
+/** First frame of a multi frame response arrived, allow time for the rest of the frames */
+void uds_deadline_first_frame(uds_deadline_t* deadline, uint64_t now);
+
+bool uds_deadline_expired(const uds_deadline_t* deadline, uint64_t now);
+
+/** milliseconds left until the deadline, rounded up, for use as a PassThruReadMsgs timeout */
+unsigned long uds_deadline_remaining_ms(const uds_deadline_t* deadline, uint64_t now);
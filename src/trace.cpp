@@ -0,0 +1,645 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "hexdump.h"
+#include "trace.h"
+#include "util.h"
+
+static const char* TAG = "Trace";
+
+// keeps the ring 8 byte aligned
+static const uint32_t TRACE_HEADER_SIZE = 128;
+
+static uint32_t trace_align(uint32_t length)
+{
+  return (length + 7) & ~7u;
+}
+
+size_t trace_open(trace_t* trace, const char* path, uint64_t capacity)
+{
+  assert(trace != NULL);
+  memset(trace, 0, sizeof(trace_t));
+  capacity = capacity & ~(uint64_t)7;
+  trace->mapLength = (size_t)(TRACE_HEADER_SIZE + capacity);
+
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  trace->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (trace->file == INVALID_HANDLE_VALUE) {
+    LOGE(TAG, "failed to create %s (%lu)", path, GetLastError());
+    return 1;
+  }
+  trace->mapping = CreateFileMappingA(trace->file, NULL, PAGE_READWRITE,
+    (DWORD)((uint64_t)trace->mapLength >> 32), (DWORD)trace->mapLength, NULL);
+  if (!trace->mapping) {
+    LOGE(TAG, "failed to map %s (%lu)", path, GetLastError());
+    CloseHandle(trace->file);
+    return 1;
+  }
+  void* map = MapViewOfFile(trace->mapping, FILE_MAP_ALL_ACCESS, 0, 0, trace->mapLength);
+  if (!map) {
+    LOGE(TAG, "failed to map %s (%lu)", path, GetLastError());
+    CloseHandle(trace->mapping);
+    CloseHandle(trace->file);
+    return 1;
+  }
+#else
+  trace->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (trace->fd < 0) {
+    LOGE(TAG, "failed to create %s %s", path, strerror(errno));
+    return errno;
+  }
+  if (ftruncate(trace->fd, (off_t)trace->mapLength)) {
+    LOGE(TAG, "failed to size %s %s", path, strerror(errno));
+    close(trace->fd);
+    return errno;
+  }
+  void* map = mmap(NULL, trace->mapLength, PROT_READ | PROT_WRITE, MAP_SHARED, trace->fd, 0);
+  if (map == MAP_FAILED) {
+    LOGE(TAG, "failed to map %s %s", path, strerror(errno));
+    close(trace->fd);
+    return errno;
+  }
+#endif
+
+  trace->header = (trace_header_t*)map;
+  trace->ring   = (uint8_t*)map + TRACE_HEADER_SIZE;
+
+  memset(trace->header, 0, sizeof(trace_header_t));
+  memcpy(trace->header->magic, TRACE_MAGIC, sizeof(trace->header->magic));
+  trace->header->version    = TRACE_VERSION;
+  trace->header->headerSize = TRACE_HEADER_SIZE;
+  trace->header->capacity   = capacity;
+  trace->header->startUs    = monotonic_us();
+  return 0;
+}
+
+size_t trace_close(trace_t* trace)
+{
+  if (!trace->header) return 0;
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  FlushViewOfFile(trace->header, 0);
+  UnmapViewOfFile(trace->header);
+  CloseHandle(trace->mapping);
+  CloseHandle(trace->file);
+#else
+  msync(trace->header, trace->mapLength, MS_ASYNC);
+  munmap(trace->header, trace->mapLength);
+  close(trace->fd);
+#endif
+  trace->header = NULL;
+  trace->ring = NULL;
+  return 0;
+}
+
+// drop the oldest records until `length` contiguous bytes are free at head
+static void trace_reserve(trace_header_t* header, uint8_t* ring, uint64_t length)
+{
+  while (header->used + length > header->capacity) {
+    trace_record_t* oldest = (trace_record_t*)(ring + header->tail);
+    header->used -= oldest->length;
+    header->tail += oldest->length;
+    if (header->tail == header->capacity) header->tail = 0;
+    if (oldest->kind != TRACE_RECORD_PAD) header->dropped++;
+  }
+}
+
+// room for a record of `length` bytes at head, NULL if it can't ever fit
+static trace_record_t* trace_allocate(trace_t* trace, uint8_t kind, long result, uint32_t length)
+{
+  trace_header_t* header = trace->header;
+  if (length > header->capacity / 2) return NULL;
+
+  // records never straddle the end of the ring, pad it out and start over at 0
+  if (header->head + length > header->capacity) {
+    uint32_t padLength = (uint32_t)(header->capacity - header->head);
+    trace_reserve(header, trace->ring, padLength);
+    trace_record_t* pad = (trace_record_t*)(trace->ring + header->head);
+    pad->length = padLength;
+    pad->kind   = TRACE_RECORD_PAD;
+    header->used += padLength;
+    header->head  = 0;
+  }
+
+  trace_reserve(header, trace->ring, length);
+  trace_record_t* record = (trace_record_t*)(trace->ring + header->head);
+  memset(record, 0, sizeof(trace_record_t));
+  record->length = length;
+  record->kind   = kind;
+  record->result = (int32_t)result;
+  record->hostUs = monotonic_us() - header->startUs;
+  return record;
+}
+
+static void trace_commit(trace_header_t* header, const trace_record_t* record)
+{
+  header->used += record->length;
+  header->head += record->length;
+  if (header->head == header->capacity) header->head = 0;
+  header->records++;
+}
+
+static void trace_append(trace_t* trace, uint8_t kind, long result, const PASSTHRU_MSG* msg)
+{
+  uint32_t dataSize = msg ? (uint32_t)msg->DataSize : 0;
+  if (dataSize > PASSTHRU_MSG_DATA_SIZE) dataSize = PASSTHRU_MSG_DATA_SIZE;
+  trace_record_t* record = trace_allocate(trace, kind, result, trace_align(sizeof(trace_record_t) + dataSize));
+  if (!record) return;
+  if (msg) {
+    record->deviceTimestamp = (uint32_t)msg->Timestamp;
+    record->protocolID      = (uint32_t)msg->ProtocolID;
+    record->rxStatus        = (uint32_t)msg->RxStatus;
+    record->txFlags         = (uint32_t)msg->TxFlags;
+    record->dataSize        = dataSize;
+    record->extraDataIndex  = (uint32_t)msg->ExtraDataIndex;
+    memcpy(record + 1, msg->Data, dataSize);
+  }
+  trace_commit(trace->header, record);
+}
+
+// largest data of a call record: the arguments, then a header and the bytes of each message
+static const size_t TRACE_CALL_DATA_MAX = CALL_MAX_ARGS * 4 + CALL_MAX_MSGS * (12 + PASSTHRU_MSG_DATA_SIZE);
+
+static void trace_put32(uint8_t* p, uint32_t value)
+{
+  memcpy(p, &value, sizeof(value));
+}
+
+// the data of a call record, returns its size
+static uint32_t trace_encode_call(uint8_t* out, const unsigned long* args, unsigned long numArgs,
+                                  const PASSTHRU_MSG* const* msgs, unsigned long numMsgs)
+{
+  uint32_t size = 0;
+  for (unsigned long a = 0; a < numArgs && a < CALL_MAX_ARGS; a++, size += 4)
+    trace_put32(out + size, (uint32_t)args[a]);
+  for (unsigned long m = 0; m < numMsgs && m < CALL_MAX_MSGS; m++) {
+    const PASSTHRU_MSG* msg = msgs[m];
+    uint32_t dataSize = msg ? (uint32_t)msg->DataSize : 0;
+    if (dataSize > PASSTHRU_MSG_DATA_SIZE) dataSize = PASSTHRU_MSG_DATA_SIZE;
+    trace_put32(out + size,     msg ? (uint32_t)msg->ProtocolID : 0);
+    trace_put32(out + size + 4, msg ? (uint32_t)msg->TxFlags : 0);
+    trace_put32(out + size + 8, dataSize);
+    size += 12;
+    if (dataSize) memcpy(out + size, msg->Data, dataSize);
+    size += (dataSize + 3) & ~3u;
+  }
+  return size;
+}
+
+void trace_call_hook(void* ctx, int call, long result, const unsigned long* args, unsigned long numArgs,
+                     unsigned long out, const PASSTHRU_MSG* const* msgs, unsigned long numMsgs)
+{
+  trace_t* trace = (trace_t*)ctx;
+  if (!trace->header) return;
+  uint8_t* data = (uint8_t*)malloc(TRACE_CALL_DATA_MAX);
+  if (!data) return;
+
+  uint32_t dataSize = trace_encode_call(data, args, numArgs, msgs, numMsgs);
+  trace_record_t* record = trace_allocate(trace, TRACE_RECORD_CALL, result, trace_align(sizeof(trace_record_t) + dataSize));
+  if (record) {
+    record->protocolID     = (uint32_t)call;
+    record->rxStatus       = (uint32_t)out;
+    record->txFlags        = (uint32_t)(numArgs < CALL_MAX_ARGS ? numArgs : CALL_MAX_ARGS);
+    record->extraDataIndex = (uint32_t)(numMsgs < CALL_MAX_MSGS ? numMsgs : CALL_MAX_MSGS);
+    record->dataSize       = dataSize;
+    memcpy(record + 1, data, dataSize);
+    trace_commit(trace->header, record);
+  }
+  free(data);
+}
+
+void trace_hook(void* ctx, int kind, long result, const PASSTHRU_MSG* pMsg, unsigned long numMsgs)
+{
+  trace_t* trace = (trace_t*)ctx;
+  unsigned long i;
+  if (!trace->header) return;
+
+  if (kind == MSG_READ && numMsgs == 0) {
+    trace_append(trace, TRACE_RECORD_READ_NONE, result, NULL);
+    return;
+  }
+  for (i = 0; i < numMsgs; i++)
+    trace_append(trace, kind == MSG_READ ? TRACE_RECORD_READ : TRACE_RECORD_WRITE, result, &pMsg[i]);
+}
+
+void trace_attach(trace_t* trace, J2534* j2534)
+{
+  j2534->setMessageHook(trace_hook, trace);
+  j2534->setCallHook(trace_call_hook, trace);
+}
+
+/* Replay */
+
+static struct {
+  uint8_t*  buffer;
+  size_t    length;
+  uint64_t* offsets;       // offsets of the replayable records in buffer
+  size_t    count;
+  size_t    cursor;
+  size_t    mismatches;
+  bool      calls;         // the setup calls were recorded, version 2 on
+  bool      realtime;
+  uint64_t  startUs;
+  uint64_t  firstRecordUs;
+} replay;
+
+// bytes of data that follow a record, 0 if its length can't even hold the record header
+static uint32_t trace_record_data_size(const trace_record_t* record)
+{
+  if (record->length < sizeof(trace_record_t)) return 0;
+  uint32_t room = record->length - (uint32_t)sizeof(trace_record_t);
+  return record->dataSize <= room ? record->dataSize : room;
+}
+
+static const trace_record_t* trace_replay_peek()
+{
+  if (replay.cursor >= replay.count) return NULL;
+  return (const trace_record_t*)(replay.buffer + replay.offsets[replay.cursor]);
+}
+
+static void trace_replay_pace(const trace_record_t* record)
+{
+  if (!replay.realtime) return;
+  uint64_t due = replay.startUs + (record->hostUs - replay.firstRecordUs);
+  uint64_t now = monotonic_us();
+  if (due > now) sleep_ms((int)((due - now) / 1000));
+}
+
+// read a trace into replay.buffer and index its records in replay.offsets
+static size_t trace_load(const char* path, trace_header_t* header)
+{
+  trace_replay_close();
+
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    LOGE(TAG, "failed to open %s %s", path, strerror(errno));
+    return errno;
+  }
+  if (fread(header, sizeof(*header), 1, file) != 1 ||
+      memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version < 1 || header->version > TRACE_VERSION ||
+      header->headerSize < sizeof(*header) || header->capacity == 0 || header->capacity % 8 ||
+      header->tail >= header->capacity || header->tail % 8 || header->used > header->capacity ||
+      header->capacity > SIZE_MAX) {
+    LOGE(TAG, "%s is not a trace file", path);
+    fclose(file);
+    return 1;
+  }
+
+  replay.length = (size_t)header->capacity;
+  replay.buffer = (uint8_t*)malloc(replay.length);
+  replay.offsets = (uint64_t*)malloc(sizeof(uint64_t) * (size_t)(header->used / sizeof(trace_record_t) + 1));
+  if (!replay.buffer || !replay.offsets) {
+    fclose(file);
+    trace_replay_close();
+    return ENOMEM;
+  }
+  if (fseek(file, (long)header->headerSize, SEEK_SET) || fread(replay.buffer, 1, replay.length, file) != replay.length) {
+    LOGE(TAG, "%s is truncated", path);
+    fclose(file);
+    trace_replay_close();
+    return 1;
+  }
+  fclose(file);
+  replay.calls = header->version >= 2;
+
+  // walk the ring from the oldest record, anything that doesn't fit the ring means the file is damaged
+  uint64_t position = header->tail;
+  uint64_t remaining = header->used;
+  while (remaining > 0) {
+    const trace_record_t* record = (const trace_record_t*)(replay.buffer + position);
+    bool valid = position + sizeof(uint32_t) * 2 <= header->capacity &&
+      record->length >= sizeof(uint32_t) * 2 && record->length % 8 == 0 &&
+      record->length <= remaining && position + record->length <= header->capacity;
+    if (valid && record->kind != TRACE_RECORD_PAD) {
+      uint32_t dataMax = record->length >= sizeof(trace_record_t) ? record->length - (uint32_t)sizeof(trace_record_t) : 0;
+      if (record->kind != TRACE_RECORD_CALL && dataMax > PASSTHRU_MSG_DATA_SIZE) dataMax = PASSTHRU_MSG_DATA_SIZE;
+      valid = record->length >= sizeof(trace_record_t) && record->dataSize <= dataMax &&
+        (record->kind == TRACE_RECORD_READ || record->kind == TRACE_RECORD_WRITE ||
+         record->kind == TRACE_RECORD_READ_NONE || (replay.calls && record->kind == TRACE_RECORD_CALL));
+    }
+    if (!valid) {
+      LOGE(TAG, "%s has a corrupt record at 0x%08llx", path, (unsigned long long)position);
+      trace_replay_close();
+      return 1;
+    }
+    if (record->kind != TRACE_RECORD_PAD)
+      replay.offsets[replay.count++] = position;
+    remaining -= record->length;
+    position  += record->length;
+    if (position >= header->capacity) position = 0;
+  }
+  return 0;
+}
+
+size_t trace_replay_open(const char* path, bool realtime)
+{
+  trace_header_t header;
+  size_t ret = trace_load(path, &header);
+  if (ret) return ret;
+
+  replay.realtime = realtime;
+  replay.startUs  = monotonic_us();
+  if (replay.count)
+    replay.firstRecordUs = ((const trace_record_t*)(replay.buffer + replay.offsets[0]))->hostUs;
+
+  LOGI(TAG, "replaying %zu records from %s (%llu dropped while recording)",
+    replay.count, path, (unsigned long long)header.dropped);
+  return 0;
+}
+
+size_t trace_print(const char* path, FILE* out)
+{
+  static const char* kinds[] = { "?", "R", "W", "-", "C" };
+  static const char* calls[] = { "?", "open", "close", "connect", "disconnect", "start-periodic", "stop-periodic",
+                                 "start-filter", "stop-filter", "ioctl" };
+  trace_header_t header;
+  size_t ret = trace_load(path, &header), i;
+  if (ret) return ret;
+
+  // a line is at most the prefix plus "XX " for every data byte
+  const size_t lineMax = 96 + sizeof(((PASSTHRU_MSG*)0)->Data) * 3;
+  char* buffer = (char*)malloc(HEXDUMP_BUFFER_LENGTH);
+  size_t used = 0;
+  if (!buffer) {
+    trace_replay_close();
+    return ENOMEM;
+  }
+
+  used += snprintf(buffer, lineMax, "# %zu records, %llu dropped while recording\n",
+    replay.count, (unsigned long long)header.dropped);
+  for (i = 0; i < replay.count; i++) {
+    const trace_record_t* record = (const trace_record_t*)(replay.buffer + replay.offsets[i]);
+    uint32_t dataSize = trace_record_data_size(record);
+
+    if (record->kind == TRACE_RECORD_CALL) {
+      // a call with its arguments is no longer than a message line, the messages follow on their own lines
+      const uint8_t* data = (const uint8_t*)(record + 1);
+      uint32_t offset = 0, a, m;
+      if (used + lineMax * (1 + CALL_MAX_MSGS) > HEXDUMP_BUFFER_LENGTH) {
+        fwrite(buffer, 1, used, out);
+        used = 0;
+      }
+      used += snprintf(buffer + used, lineMax, "%12.3fms C %3d %s -> %u (",
+        (double)record->hostUs / 1000.0, record->result,
+        calls[record->protocolID < CALL_IOCTL + 1 ? record->protocolID : 0], record->rxStatus);
+      for (a = 0; a < record->txFlags && offset + 4 <= dataSize; a++, offset += 4) {
+        uint32_t value;
+        memcpy(&value, data + offset, sizeof(value));
+        used += snprintf(buffer + used, lineMax, a ? " %u" : "%u", value);
+      }
+      used += snprintf(buffer + used, lineMax, ")\n");
+      for (m = 0; m < record->extraDataIndex && offset + 12 <= dataSize; m++) {
+        uint32_t header[3];
+        memcpy(header, data + offset, sizeof(header));
+        offset += sizeof(header);
+        if (header[2] > dataSize - offset) break;
+        used += snprintf(buffer + used, lineMax, "%16s protocol=%u tx=%08X [%4u] ", "", header[0], header[1], header[2]);
+        used += hexdump_hex(buffer + used, data + offset, header[2], true);
+        buffer[used++] = '\n';
+        offset += (header[2] + 3) & ~3u;
+      }
+      continue;
+    }
+
+    if (used + lineMax > HEXDUMP_BUFFER_LENGTH) {
+      fwrite(buffer, 1, used, out);
+      used = 0;
+    }
+    used += snprintf(buffer + used, lineMax, "%12.3fms %s %3d rx=%08X tx=%08X [%4u] ",
+      (double)record->hostUs / 1000.0, kinds[record->kind < 5 ? record->kind : 0], record->result,
+      record->rxStatus, record->txFlags, dataSize);
+    used += hexdump_hex(buffer + used, (const uint8_t*)(record + 1), dataSize, true);
+    buffer[used++] = '\n';
+  }
+  fwrite(buffer, 1, used, out);
+
+  free(buffer);
+  trace_replay_close();
+  return ferror(out) ? EIO : 0;
+}
+
+void trace_replay_close()
+{
+  free(replay.buffer);
+  free(replay.offsets);
+  memset(&replay, 0, sizeof(replay));
+}
+
+size_t trace_replay_mismatches()
+{
+  return replay.mismatches;
+}
+
+// consume the recorded call matching this one, `out` gets the ID it returned. Without one the call
+// succeeds with ID 1, as for traces recorded before calls were
+static long trace_replay_call(int call, unsigned long* out, const unsigned long* args, unsigned long numArgs,
+                              const PASSTHRU_MSG* const* msgs, unsigned long numMsgs)
+{
+  if (out) *out = 1;
+  if (!replay.calls) return STATUS_NOERROR;
+
+  // reads that came back empty don't have to line up with the calls around them
+  const trace_record_t* record;
+  size_t cursor = replay.cursor;
+  while (cursor < replay.count &&
+         ((const trace_record_t*)(replay.buffer + replay.offsets[cursor]))->kind == TRACE_RECORD_READ_NONE)
+    cursor++;
+  record = cursor < replay.count ? (const trace_record_t*)(replay.buffer + replay.offsets[cursor]) : NULL;
+  if (!record || record->kind != TRACE_RECORD_CALL || record->protocolID != (uint32_t)call) {
+    LOGE(TAG, "call %d at record %zu is not in the recording", call, replay.cursor);
+    replay.mismatches++;
+    return STATUS_NOERROR;
+  }
+  replay.cursor = cursor + 1;
+
+  uint8_t* data = (uint8_t*)malloc(TRACE_CALL_DATA_MAX);
+  if (!data || trace_encode_call(data, args, numArgs, msgs, numMsgs) != record->dataSize ||
+      memcmp(data, record + 1, record->dataSize) != 0) {
+    LOGE(TAG, "call %d at record %zu does not match the recording", call, cursor);
+    replay.mismatches++;
+  }
+  free(data);
+  if (out) *out = record->rxStatus;
+  return record->result;
+}
+
+static long PT_CALL replayOpen(const void*, unsigned long* pDeviceID)
+{
+  return trace_replay_call(CALL_OPEN, pDeviceID, NULL, 0, NULL, 0);
+}
+
+static long PT_CALL replayClose(unsigned long DeviceID)
+{
+  return trace_replay_call(CALL_CLOSE, NULL, &DeviceID, 1, NULL, 0);
+}
+
+static long PT_CALL replayConnect(unsigned long DeviceID, unsigned long ProtocolID, unsigned long Flags, unsigned long Baudrate, unsigned long* pChannelID)
+{
+  unsigned long args[] = { DeviceID, ProtocolID, Flags, Baudrate };
+  return trace_replay_call(CALL_CONNECT, pChannelID, args, 4, NULL, 0);
+}
+
+static long PT_CALL replayDisconnect(unsigned long ChannelID)
+{
+  return trace_replay_call(CALL_DISCONNECT, NULL, &ChannelID, 1, NULL, 0);
+}
+
+static long PT_CALL replayReadMsgs(unsigned long, void* pMsg, unsigned long* pNumMsgs, unsigned long Timeout)
+{
+  const trace_record_t* record = trace_replay_peek();
+  PASSTHRU_MSG* msg = (PASSTHRU_MSG*)pMsg;
+
+  // the original read came back empty, or the recording ran out
+  if (!record || record->kind != TRACE_RECORD_READ) {
+    long result = ERR_BUFFER_EMPTY;
+    if (record && record->kind == TRACE_RECORD_READ_NONE) {
+      result = record->result;
+      replay.cursor++;
+    }
+    sleep_ms((int)Timeout);
+    *pNumMsgs = 0;
+    return result;
+  }
+
+  trace_replay_pace(record);
+  msg->ProtocolID     = record->protocolID;
+  msg->RxStatus       = record->rxStatus;
+  msg->TxFlags        = record->txFlags;
+  msg->Timestamp      = record->deviceTimestamp;
+  msg->DataSize       = trace_record_data_size(record);
+  msg->ExtraDataIndex = record->extraDataIndex;
+  memcpy(msg->Data, record + 1, msg->DataSize);
+  *pNumMsgs = 1;
+  replay.cursor++;
+  return record->result;
+}
+
+static long PT_CALL replayWriteMsgs(unsigned long, const void* pMsg, unsigned long* pNumMsgs, unsigned long)
+{
+  const PASSTHRU_MSG* msg = (const PASSTHRU_MSG*)pMsg;
+  long result = STATUS_NOERROR;
+  unsigned long i;
+
+  for (i = 0; i < *pNumMsgs; i++) {
+    // anything still queued before the next write was never read by the original session either
+    const trace_record_t* record;
+    while ((record = trace_replay_peek()) && record->kind != TRACE_RECORD_WRITE) {
+      replay.mismatches++;
+      replay.cursor++;
+    }
+    if (!record) {
+      replay.mismatches++;
+      continue;
+    }
+
+    trace_replay_pace(record);
+    if (record->dataSize != msg[i].DataSize || memcmp(record + 1, msg[i].Data, record->dataSize) != 0) {
+      LOGE(TAG, "write %zu does not match the recording", replay.cursor);
+      replay.mismatches++;
+    }
+    result = record->result;
+    replay.cursor++;
+  }
+  return result;
+}
+
+static long PT_CALL replayStartPeriodicMsg(unsigned long ChannelID, const void* pMsg, unsigned long* pMsgID, unsigned long TimeInterval)
+{
+  unsigned long args[] = { ChannelID, TimeInterval };
+  const PASSTHRU_MSG* msgs[] = { (const PASSTHRU_MSG*)pMsg };
+  return trace_replay_call(CALL_START_PERIODIC, pMsgID, args, 2, msgs, 1);
+}
+
+static long PT_CALL replayStopPeriodicMsg(unsigned long ChannelID, unsigned long MsgID)
+{
+  unsigned long args[] = { ChannelID, MsgID };
+  return trace_replay_call(CALL_STOP_PERIODIC, NULL, args, 2, NULL, 0);
+}
+
+static long PT_CALL replayStartMsgFilter(unsigned long ChannelID, unsigned long FilterType, const void* pMaskMsg,
+                                         const void* pPatternMsg, const void* pFlowControlMsg, unsigned long* pMsgID)
+{
+  unsigned long args[] = { ChannelID, FilterType };
+  const PASSTHRU_MSG* msgs[] = { (const PASSTHRU_MSG*)pMaskMsg, (const PASSTHRU_MSG*)pPatternMsg, (const PASSTHRU_MSG*)pFlowControlMsg };
+  return trace_replay_call(CALL_START_FILTER, pMsgID, args, 2, msgs, 3);
+}
+
+static long PT_CALL replayStopMsgFilter(unsigned long ChannelID, unsigned long MsgID)
+{
+  unsigned long args[] = { ChannelID, MsgID };
+  return trace_replay_call(CALL_STOP_FILTER, NULL, args, 2, NULL, 0);
+}
+
+static long PT_CALL replaySetProgrammingVoltage(unsigned long, unsigned long, unsigned long)
+{
+  return STATUS_NOERROR;
+}
+
+static long PT_CALL replayReadVersion(unsigned long, char* pFirmwareVersion, char* pDllVersion, char* pApiVersion)
+{
+  strcpy(pFirmwareVersion, "replay");
+  strcpy(pDllVersion, "replay");
+  strcpy(pApiVersion, "04.04");
+  return STATUS_NOERROR;
+}
+
+static long PT_CALL replayGetLastError(char* pErrorDescription)
+{
+  sprintf(pErrorDescription, "replay: %zu of %zu records, %zu mismatches", replay.cursor, replay.count, replay.mismatches);
+  return STATUS_NOERROR;
+}
+
+static long PT_CALL replayIoctl(unsigned long ChannelID, unsigned long IoctlID, const void*, void*)
+{
+  unsigned long args[] = { ChannelID, IoctlID };
+  return trace_replay_call(CALL_IOCTL, NULL, args, 2, NULL, 0);
+}
+
+static const PASSTHRU_API replayApi = {
+  replayOpen,
+  replayClose,
+  replayConnect,
+  replayDisconnect,
+  replayReadMsgs,
+  replayWriteMsgs,
+  replayStartPeriodicMsg,
+  replayStopPeriodicMsg,
+  replayStartMsgFilter,
+  replayStopMsgFilter,
+  replaySetProgrammingVoltage,
+  replayReadVersion,
+  replayGetLastError,
+  replayIoctl,
+};
+
+const PASSTHRU_API* trace_replay_api()
+{
+  return &replayApi;
+}
@@ -0,0 +1,126 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "J2534.h"
+
+/* Binary bus trace.
+ *
+ * Every PASSTHRU_MSG that goes through J2534::PassThruReadMsgs/PassThruWriteMsgs is
+ * appended raw to a ring buffer in a memory mapped file. Once the ring is full the
+ * oldest records are dropped. Reads that returned nothing are recorded too, so a
+ * replay sees exactly the same sequence of driver results. So are the setup calls
+ * (open, connect, filters, periodic messages, Ioctl) with the IDs they returned, a
+ * replay checks the session sets the channel up the same way.
+ *
+ * File layout:
+ *   trace_header_t
+ *   ring of trace_record_t, each followed by DataSize bytes and padded to 8 bytes
+ * A call record has the call in `protocolID`, the ID it returned in `rxStatus`, the
+ * number of arguments in `txFlags` and of messages in `extraDataIndex`. Its data is
+ * the arguments as uint32_t, then per message its protocol, flags and size as
+ * uint32_t and its bytes padded to 4. Version 1 traces have no call records.
+ */
+
+#define TRACE_MAGIC   "RX8TRACE"
+static const uint32_t TRACE_VERSION = 2;
+
+// default ring size, about 100k request/response pairs of ROM reads
+static const uint64_t TRACE_DEFAULT_CAPACITY = 32 * 1024 * 1024;
+
+static const uint8_t TRACE_RECORD_WRITE     = MSG_WRITE;
+static const uint8_t TRACE_RECORD_READ      = MSG_READ;
+static const uint8_t TRACE_RECORD_READ_NONE = 3;
+static const uint8_t TRACE_RECORD_CALL      = 4;
+// filler at the end of the ring, records never wrap around
+static const uint8_t TRACE_RECORD_PAD       = 0xff;
+
+typedef struct Trace_Header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t capacity;  // size of the ring in bytes
+  uint64_t head;      // ring offset of the next record
+  uint64_t tail;      // ring offset of the oldest record
+  uint64_t used;      // bytes between tail and head
+  uint64_t records;   // records written, including dropped ones
+  uint64_t dropped;   // records overwritten after the ring filled
+  uint64_t startUs;   // host clock when the trace was created
+} trace_header_t;
+
+typedef struct Trace_Record {
+  uint32_t length;    // whole record including this header and padding
+  uint8_t  kind;
+  uint8_t  reserved[3];
+  int32_t  result;    // return value of the driver call
+  uint32_t deviceTimestamp;
+  uint64_t hostUs;    // monotonic_us() - startUs
+  uint32_t protocolID;
+  uint32_t rxStatus;
+  uint32_t txFlags;
+  uint32_t dataSize;
+  uint32_t extraDataIndex;
+  uint32_t reserved2;
+} trace_record_t;
+
+typedef struct Trace {
+  trace_header_t* header;
+  uint8_t*        ring;
+  size_t          mapLength;
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  HANDLE          file;
+  HANDLE          mapping;
+#else
+  int             fd;
+#endif
+} trace_t;
+
+/** Create (or truncate) a trace file with a ring of `capacity` bytes and map it */
+size_t trace_open(trace_t* trace, const char* path, uint64_t capacity);
+size_t trace_close(trace_t* trace);
+
+/** Record messages. Matches J2534_MSG_HOOK so it can be installed with J2534::setMessageHook */
+void trace_hook(void* ctx, int kind, long result, const PASSTHRU_MSG* pMsg, unsigned long numMsgs);
+
+/** Record setup calls. Matches J2534_CALL_HOOK */
+void trace_call_hook(void* ctx, int call, long result, const unsigned long* args, unsigned long numArgs,
+                     unsigned long out, const PASSTHRU_MSG* const* msgs, unsigned long numMsgs);
+
+/** Start recording everything that goes through `j2534`, before it is opened to have the setup too */
+void trace_attach(trace_t* trace, J2534* j2534);
+
+/* Replay.
+ *
+ * A recorded trace is loaded into memory and served through an in-process PASSTHRU_API.
+ * Writes consume the next recorded write, reads return the next recorded read. With
+ * `realtime` the recorded gaps between records are reproduced, otherwise the replay runs
+ * as fast as the host allows and only reads that returned nothing wait out their timeout.
+ */
+size_t trace_replay_open(const char* path, bool realtime);
+void   trace_replay_close();
+const PASSTHRU_API* trace_replay_api();
+
+/** Print every record of a trace as a line of text: time, kind, result, flags and data */
+size_t trace_print(const char* path, FILE* out);
+
+/** number of writes that did not match the recording */
+size_t trace_replay_mismatches();
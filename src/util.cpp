@@ -15,7 +15,12 @@ limitations under the License.
 */
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <signal.h>
 
 #if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
 #include <windows.h>
@@ -25,10 +30,19 @@ limitations under the License.
 #include <unistd.h> // for usleep
 #endif
 
+#if !defined(_WIN32) && !defined(WIN32) && !defined (_WIN64) && !defined (WIN64)
+#include <time.h>   // for clock_gettime
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
 #include "J2534.h"
+#include "hexdump.h"
 #include "util.h"
 
-void reportJ2534Error(J2534 j2534)
+static const char* TAG = "J2534";
+
+void reportJ2534Error(J2534& j2534)
 {
 	char err[512];
 	j2534.PassThruGetLastError(err);
@@ -40,33 +54,20 @@ void dump_msg(PASSTHRU_MSG* msg)
 	if (msg->RxStatus & START_OF_MESSAGE)
 		return;
 
-	printf("[%lu]", msg->Timestamp);
-	for (unsigned int i = 0; i < msg->DataSize; i++)
-		printf("%02X ", msg->Data[i]);
-	printf("\n");
+	// "[timestamp]" + "XX " per byte + newline, formatted in one go
+	char line[32 + sizeof(msg->Data) * 3 + 2];
+	size_t length = (size_t)snprintf(line, 32, "[%lu]", msg->Timestamp);
+	length += hexdump_hex(line + length, msg->Data, msg->DataSize, true);
+	line[length++] = '\n';
+	fwrite(line, 1, length, stdout);
 }
 
 void hexdump_msg(PASSTHRU_MSG* msg) {
     hexdump(msg->Data, msg->DataSize);
 }
 
-// credit: https://stackoverflow.com/questions/29242/off-the-shelf-c-hex-dump-code
 void hexdump(void *ptr, size_t buflen) {
-    unsigned char* buf = (unsigned char*)ptr;
-    size_t i, j;
-    for (i = 0; i < buflen; i += 16) {
-        printf("%06lx: ", i);
-        for (j = 0; j < 16; j++)
-            if (i + j < buflen)
-                printf("%02x ", buf[i + j]);
-            else
-                printf("   ");
-        printf(" ");
-        for (j = 0; j < 16; j++)
-            if (i + j < buflen)
-                printf("%c", isprint(buf[i + j]) ? buf[i + j] : '.');
-        printf("\n");
-    }
+    hexdump_write(stdout, (const uint8_t*)ptr, buflen, NULL);
 }
 
 // credit: https://stackoverflow.com/questions/1157209/is-there-an-alternative-sleep-function-in-c-to-milliseconds
@@ -84,4 +85,292 @@ void sleep_ms(int milliseconds)
         sleep(milliseconds / 1000);
     usleep((milliseconds % 1000) * 1000);
 #endif
-}
\ No newline at end of file
+}
+
+// monotonic clock in microseconds, only useful for measuring intervals
+uint64_t monotonic_us()
+{
+#ifdef WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER now;
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / frequency.QuadPart) * 1000000 +
+           (uint64_t)(now.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
+
+// whole file into memory, NULL with errno set on failure
+uint8_t* load_file(const char* path, size_t* length)
+{
+	FILE* file = fopen(path, "rb");
+	uint8_t* data = NULL;
+	long size = -1;
+	int error = 0;
+
+	if (!file) return NULL;
+	if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+		data = (uint8_t*)malloc(size ? (size_t)size : 1);
+		if (!data) {
+			error = ENOMEM;
+		} else if (fread(data, 1, (size_t)size, file) != (size_t)size) {
+			free(data);
+			data = NULL;
+			error = EIO;
+		}
+		*length = (size_t)size;
+	} else {
+		error = EIO;
+	}
+	fclose(file);
+	if (!data) errno = error;
+	return data;
+}
+
+// case insensitive "ends with", for file extensions
+static bool has_suffix(const char* name, const char* suffix)
+{
+	size_t n = strlen(name), m = strlen(suffix);
+	if (m > n) return false;
+	for (size_t i = 0; i < m; i++)
+		if (tolower((unsigned char)name[n - m + i]) != tolower((unsigned char)suffix[i]))
+			return false;
+	return true;
+}
+
+static int compare_names(const void* a, const void* b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// append the files of `directory` ending in `suffix` to `list`, and those of its subdirectories if `recursive`
+static bool list_directory(const char* directory, const char* suffix, bool recursive, char*** list, size_t* count, size_t* capacity)
+{
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+	WIN32_FIND_DATAA entry;
+	char pattern[MAX_PATH];
+	snprintf(pattern, sizeof(pattern), "%s\\*", directory);
+	HANDLE find = FindFirstFileA(pattern, &entry);
+	if (find == INVALID_HANDLE_VALUE) {
+		errno = ENOENT;
+		return false;
+	}
+	do {
+		const char* name = entry.cFileName;
+		bool isDirectory = (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) continue;
+#else
+	DIR* dir = opendir(directory);
+	struct dirent* entry;
+	if (!dir) return false;
+	while ((entry = readdir(dir))) {
+		const char* name = entry->d_name;
+		if (name[0] == '.') continue;
+		bool isDirectory = entry->d_type == DT_DIR;
+#endif
+		size_t length = strlen(directory) + strlen(name) + 2;
+		char* path = (char*)malloc(length);
+		if (!path) break;
+		snprintf(path, length, "%s/%s", directory, name);
+#if !defined(_WIN32) && !defined(WIN32) && !defined (_WIN64) && !defined (WIN64)
+		// not every file system fills in d_type
+		struct stat st;
+		if (entry->d_type == DT_UNKNOWN && !stat(path, &st)) isDirectory = S_ISDIR(st.st_mode);
+#endif
+		if (!isDirectory && !has_suffix(name, suffix)) {
+			free(path);
+			continue;
+		}
+		if (isDirectory) {
+			// subdirectories that can't be read are skipped
+			if (recursive) list_directory(path, suffix, true, list, count, capacity);
+			free(path);
+			continue;
+		}
+		if (*count == *capacity) {
+			char** grown = (char**)realloc(*list, *capacity * 2 * sizeof(char*));
+			if (!grown) {
+				free(path);
+				break;
+			}
+			*list = grown;
+			*capacity *= 2;
+		}
+		(*list)[(*count)++] = path;
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+	} while (FindNextFileA(find, &entry));
+	FindClose(find);
+#else
+	}
+	closedir(dir);
+#endif
+	return true;
+}
+
+static char** list_paths(const char* directory, const char* suffix, bool recursive, size_t* count)
+{
+	char** files = (char**)malloc(sizeof(char*));
+	size_t capacity = 1;
+	*count = 0;
+	if (!files) return NULL;
+	if (!list_directory(directory, suffix, recursive, &files, count, &capacity)) {
+		int error = errno;
+		free(files);
+		errno = error;
+		return NULL;
+	}
+	qsort(files, *count, sizeof(char*), compare_names);
+	return files;
+}
+
+// regular files in `directory` ending in `suffix`, as sorted full paths. NULL with errno set on failure
+char** list_files(const char* directory, const char* suffix, size_t* count)
+{
+	return list_paths(directory, suffix, false, count);
+}
+
+// same, including the files in every subdirectory
+char** list_files_recursive(const char* directory, const char* suffix, size_t* count)
+{
+	return list_paths(directory, suffix, true, count);
+}
+
+bool is_directory(const char* path)
+{
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+	DWORD attributes = GetFileAttributesA(path);
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	struct stat st;
+	return !stat(path, &st) && S_ISDIR(st.st_mode);
+#endif
+}
+
+void free_list(char** list, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		free(list[i]);
+	free(list);
+}
+
+static volatile sig_atomic_t interrupted;
+
+static void interrupt_handler(int sig)
+{
+	(void)sig;
+	interrupted = 1;
+}
+
+void interrupt_catch()
+{
+	interrupted = 0;
+	signal(SIGINT, interrupt_handler);
+}
+
+bool interrupt_requested()
+{
+	return interrupted != 0;
+}
+
+void interrupt_release()
+{
+	signal(SIGINT, SIG_DFL);
+}
+
+/**
+ * @brief open a passthru device and set up an ISO15765 channel with flow control filters for 0x7E0-0x7E7
+ *
+ * @param deviceName  passed to PassThruOpen, NULL for the first available device
+ * @return size_t     0 if successful, 1 otherwise
+ */
+size_t j2534Connect(J2534* j2534, const char* deviceName, unsigned long* devID, unsigned long* chanID)
+{
+	if (j2534->PassThruOpen(deviceName, devID)) {
+		LOGE(TAG, "failed to PassThruOpen()");
+		return 1;
+	}
+
+	if (j2534->PassThruConnect(*devID, ISO15765, CAN_ID_BOTH, CAN_BAUD, chanID)) {
+		reportJ2534Error(*j2534);
+		return 1;
+	}
+	j2534->PassThruIoctl(*chanID, CLEAR_MSG_FILTERS, NULL, NULL);
+
+	unsigned long filterID = 0;
+
+	PASSTHRU_MSG maskMSG = {0};
+	PASSTHRU_MSG maskPattern = {0};
+	PASSTHRU_MSG flowControlMsg = {0};
+	// every physical address a functional request can be answered from, 0x7E8-0x7EF
+	for (uint8_t i = 0; i < 8; i++) {
+		maskMSG.ProtocolID = ISO15765;
+		maskMSG.TxFlags = ISO15765_FRAME_PAD;
+		maskMSG.Data[0] = 0x00;
+		maskMSG.Data[1] = 0x00;
+		maskMSG.Data[2] = 0x07;
+		maskMSG.Data[3] = 0xff;
+		maskMSG.DataSize = 4;
+
+		maskPattern.ProtocolID = ISO15765;
+		maskPattern.TxFlags = ISO15765_FRAME_PAD;
+		maskPattern.Data[0] = 0x00;
+		maskPattern.Data[1] = 0x00;
+		maskPattern.Data[2] = 0x07;
+		maskPattern.Data[3] = (0xE8 + i);
+		maskPattern.DataSize = 4;
+
+		flowControlMsg.ProtocolID = ISO15765;
+		flowControlMsg.TxFlags = ISO15765_FRAME_PAD;
+		flowControlMsg.Data[0] = 0x00;
+		flowControlMsg.Data[1] = 0x00;
+		flowControlMsg.Data[2] = 0x07;
+		flowControlMsg.Data[3] = (0xE0 + i);
+		flowControlMsg.DataSize = 4;
+
+		if (j2534->PassThruStartMsgFilter(*chanID, FLOW_CONTROL_FILTER, &maskMSG, &maskPattern, &flowControlMsg, &filterID))
+		{
+			reportJ2534Error(*j2534);
+			return 1;
+
+		}
+	}
+	maskMSG.ProtocolID = ISO15765;
+	maskMSG.TxFlags = ISO15765_FRAME_PAD;
+	maskMSG.Data[0] = 0x00;
+	maskMSG.Data[1] = 0x00;
+	maskMSG.Data[2] = 0x07;
+	maskMSG.Data[3] = 0xf8;
+	maskMSG.DataSize = 4;
+
+	maskPattern.ProtocolID = ISO15765;
+	maskPattern.TxFlags = ISO15765_FRAME_PAD;
+	maskPattern.Data[0] = 0x00;
+	maskPattern.Data[1] = 0x00;
+	maskPattern.Data[2] = 0x07;
+	maskPattern.Data[3] = 0xE8;
+	maskPattern.DataSize = 4;
+
+	if (j2534->PassThruStartMsgFilter(*chanID, PASS_FILTER, &maskMSG, &maskPattern, NULL, &filterID)) {
+		LOGE(TAG, "Failed to set message filter");
+		reportJ2534Error(*j2534);
+		return 1;
+	}
+
+	if (j2534->PassThruIoctl(*chanID, CLEAR_TX_BUFFER, NULL, NULL)) {
+		LOGE(TAG, "Failed to clear j2534 TX buffer");
+		reportJ2534Error(*j2534);
+		return 1;
+	}
+
+	if (j2534->PassThruIoctl(*chanID, CLEAR_RX_BUFFER, NULL, NULL)) {
+		LOGE(TAG, "Failed to clear j2534 RX buffer");
+		reportJ2534Error(*j2534);
+		return 1;
+	}
+	return 0;
+}
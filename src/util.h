@@ -17,36 +17,28 @@ limitations under the License.
 #pragma once
 
 #include <stdio.h>
+#include <stdint.h>
 #include "J2534.h"
+#include "log.h"
 
-void reportJ2534Error(J2534 j2534);
+static const unsigned int CAN_BAUD = 500000;
+
+void reportJ2534Error(J2534& j2534);
+size_t j2534Connect(J2534* j2534, const char* deviceName, unsigned long* devID, unsigned long* chanID);
 void dump_msg(PASSTHRU_MSG* msg);
 void hexdump_msg(PASSTHRU_MSG* msg);
 void hexdump(void *ptr, size_t buflen);
 void sleep_ms(int milliseconds);
-
-#ifdef WIN32
-// Windows console doesn't support colors
-#define ANSI_COLOR_RED     ""
-#define ANSI_COLOR_GREEN   ""
-#define ANSI_COLOR_YELLOW  ""
-#define ANSI_COLOR_BLUE    ""
-#define ANSI_COLOR_MAGENTA ""
-#define ANSI_COLOR_CYAN    ""
-#define ANSI_COLOR_RESET   ""
-#else
-#define ANSI_COLOR_RED     "\x1b[31m"
-#define ANSI_COLOR_GREEN   "\x1b[32m"
-#define ANSI_COLOR_YELLOW  "\x1b[33m"
-#define ANSI_COLOR_BLUE    "\x1b[34m"
-#define ANSI_COLOR_MAGENTA "\x1b[35m"
-#define ANSI_COLOR_CYAN    "\x1b[36m"
-#define ANSI_COLOR_RESET   "\x1b[0m"
-#endif
-
-#define log_location stderr
-#define LOGE(TAG, ...) do { fprintf(log_location, "[" ANSI_COLOR_RED); fprintf(log_location, TAG); fprintf(log_location, ANSI_COLOR_RESET "] "); fprintf(log_location, __VA_ARGS__); fprintf(log_location, "\r\n"); fflush(log_location); } while(0)
-#define LOGI(TAG, ...) do { fprintf(log_location, "[" ANSI_COLOR_CYAN); fprintf(log_location, TAG); fprintf(log_location, ANSI_COLOR_RESET"] "); fprintf(log_location, __VA_ARGS__); fprintf(log_location, "\r\n"); fflush(log_location); } while(0)
+uint64_t monotonic_us();
+uint8_t* load_file(const char* path, size_t* length);
+char** list_files(const char* directory, const char* suffix, size_t* count);
+char** list_files_recursive(const char* directory, const char* suffix, size_t* count);
+void free_list(char** list, size_t count);
+bool is_directory(const char* path);
+// Ctrl+C sets a flag instead of killing the process until interrupt_release(), for loops that stop cleanly
+void interrupt_catch();
+bool interrupt_requested();
+void interrupt_release();
 
 #define DEBUG
 #ifdef DEBUG
@@ -0,0 +1,137 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "verify.h"
+#include "crc32c.h"
+#include "util.h"
+
+static const char* TAG = "Verify";
+
+// blocks that differ from `previous`, every block without it. Returns how many and their bytes
+static uint32_t verify_select(const dumpfile_region_t* region, uint32_t numBlocks, const uint8_t* written,
+                              const uint8_t* previous, uint8_t* selection, uint64_t* bytes)
+{
+  uint32_t selected = 0;
+  *bytes = 0;
+  for (uint32_t b = 0; b < numBlocks; b++) {
+    uint32_t offset = b * DUMPFILE_BLOCK;
+    uint32_t length = region->length - offset < DUMPFILE_BLOCK ? region->length - offset : DUMPFILE_BLOCK;
+    uint32_t address = region->address + offset;
+    selection[b] = !previous || memcmp(written + offset, previous + address, length) != 0;
+    selected += selection[b];
+    *bytes += selection[b] ? length : 0;
+  }
+  return selected;
+}
+
+size_t verify_flash(RX8* ecu, const dumpfile_t* flashed, const uint8_t* written, const char* compareFileName,
+                    progress_t* progress)
+{
+  const dumpfile_region_t* region = &flashed->regions[0];
+  uint8_t* previous = NULL;
+  size_t previousLength = 0;
+  uint32_t numBlocks = flashed->header.numBlocks, mismatched = 0;
+  uint64_t bytes = 0, start = monotonic_us();
+  size_t ret = 0;
+
+  if (compareFileName) {
+    previous = load_file(compareFileName, &previousLength);
+    if (!previous || previousLength != MAZDA_ROM_LENGTH) {
+      LOGE(TAG, "%s is not a ROM to compare with", compareFileName);
+      free(previous);
+      return VERIFY_ERROR_COMPARE;
+    }
+  }
+  uint8_t* selection = (uint8_t*)calloc(numBlocks, 1);
+  uint8_t* buffer = (uint8_t*)malloc(region->length);
+  if (!selection || !buffer) {
+    free(previous);
+    free(selection);
+    free(buffer);
+    return ENOMEM;
+  }
+  uint32_t selected = verify_select(region, numBlocks, written, previous, selection, &bytes);
+  free(previous);
+  if (!selected) {
+    LOGI(TAG, "No blocks changed, nothing to verify");
+    free(selection);
+    free(buffer);
+    return 0;
+  }
+
+  // the reset after flashing dropped the session
+  rx8_seed_t seed;
+  rx8_key_t key;
+  unsigned int failed;
+  if (!ecu->securityAccess(RX8_ACCESS_ALL, seed, key, &failed).ok()) {
+    LOGE(TAG, "Failed to unlock the ECU to verify the flash");
+    free(selection);
+    free(buffer);
+    return VERIFY_ERROR_UNLOCK;
+  }
+
+  // runs of selected blocks, each read with the largest request the ECU takes
+  uint16_t chunkSize = RX8_MAX_TRANSFER_LENGTH;
+  ecu->beginTransfer();
+  progress_start(progress, "verify", bytes);
+  for (uint32_t b = 0; b < numBlocks && !ret; b++) {
+    if (!selection[b]) continue;
+    uint32_t end = b;
+    while (end < numBlocks && selection[end]) end++;
+    uint32_t offset = b * DUMPFILE_BLOCK;
+    uint32_t runEnd = end * DUMPFILE_BLOCK < region->length ? end * DUMPFILE_BLOCK : region->length;
+    while (offset < runEnd) {
+      uint16_t size = runEnd - offset < chunkSize ? (uint16_t)(runEnd - offset) : chunkSize;
+      uint64_t chunkStart = monotonic_us();
+      if (!ecu->readMemory(region->address + offset, rx8_span_t{ buffer + offset, size }).ok()) {
+        // the first refusal settles how much the ECU takes per request
+        if (chunkSize > 0x100) {
+          chunkSize = chunkSize / 2 > 0x100 ? chunkSize / 2 : 0x100;
+          LOGI(TAG, "Retrying with 0x%x byte reads", chunkSize);
+          continue;
+        }
+        LOGE(TAG, "Failed to read back 0x%08x", region->address + offset);
+        ret = VERIFY_ERROR_READ;
+        break;
+      }
+      offset += size;
+      progress_chunk(progress, size, monotonic_us() - chunkStart);
+    }
+    for (; b < end && !ret; b++) {
+      uint32_t blockOffset = b * DUMPFILE_BLOCK;
+      uint32_t length = region->length - blockOffset < DUMPFILE_BLOCK ? region->length - blockOffset : DUMPFILE_BLOCK;
+      if (crc32c(0, buffer + blockOffset, length) != flashed->tree[b]) {
+        LOGE(TAG, "Block 0x%08x-0x%08x doesn't match what was flashed", region->address + blockOffset,
+          region->address + blockOffset + length - 1);
+        mismatched++;
+      }
+    }
+  }
+  progress_finish(progress);
+  ecu->endTransfer();
+  free(selection);
+  free(buffer);
+  if (ret)
+    return ret;
+
+  LOGI(TAG, "Verified %u of %u blocks (%.0f KB) in %.1fs with 0x%x byte reads, %u mismatched", selected, numBlocks,
+    (double)bytes / 1024.0, (double)(monotonic_us() - start) / 1e6, chunkSize, mismatched);
+  return mismatched ? VERIFY_ERROR_MISMATCH : 0;
+}
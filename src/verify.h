@@ -0,0 +1,53 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "librx8.h"
+#include "dumpfile.h"
+#include "progressbar.h"
+
+/* Flash verification.
+ *
+ * After --upload the ECU is reset and unlocked again, and the blocks that were written
+ * are read back and checked against the CRCs dumpfile took while streaming them. With
+ * a ROM of what the ECU held before only the blocks that changed are read back. Runs
+ * of selected blocks are read with the largest request the ECU takes, halving it down
+ * to 0x100 bytes on the first refusal.
+ */
+
+static const size_t VERIFY_ERROR_START = 0x300;
+enum verify_error {
+  /* the ECU couldn't be unlocked again after the reset */
+  VERIFY_ERROR_UNLOCK   = VERIFY_ERROR_START + 1,
+  /* a block couldn't be read back */
+  VERIFY_ERROR_READ     = VERIFY_ERROR_START + 2,
+  /* a block doesn't match its CRC */
+  VERIFY_ERROR_MISMATCH = VERIFY_ERROR_START + 3,
+  /* the ROM to compare with can't be read or isn't a whole ROM */
+  VERIFY_ERROR_COMPARE  = VERIFY_ERROR_START + 4,
+};
+
+/**
+ * Read back the blocks of `flashed`'s first region. `written` is the image that was
+ * sent, `compareFileName` the ROM the ECU held before, NULL to verify every block.
+ * Returns 0, a verify_error or errno
+ */
+size_t verify_flash(RX8* ecu, const dumpfile_t* flashed, const uint8_t* written, const char* compareFileName,
+                    progress_t* progress);
@@ -0,0 +1,464 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "zipfile.h"
+#include "util.h"
+
+static const char* TAG = "Zipfile";
+
+static const uint32_t ZIPFILE_END_SIGNATURE     = 0x06054b50;
+static const uint32_t ZIPFILE_CENTRAL_SIGNATURE = 0x02014b50;
+static const uint32_t ZIPFILE_LOCAL_SIGNATURE   = 0x04034b50;
+static const size_t   ZIPFILE_END_LENGTH        = 22;
+static const size_t   ZIPFILE_CENTRAL_LENGTH    = 46;
+static const size_t   ZIPFILE_LOCAL_LENGTH      = 30;
+static const uint16_t ZIPFILE_ENCRYPTED         = 1;
+static const uint32_t ZIPFILE_CRC32_POLYNOMIAL  = 0xEDB88320;  // reflected
+
+static uint16_t zipfile_u16(const uint8_t* p)
+{
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t zipfile_u32(const uint8_t* p)
+{
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+size_t zipfile_open(zipfile_t* zip, const char* path)
+{
+  memset(zip, 0, sizeof(zipfile_t));
+  size_t ret = mapfile_open(&zip->map, path);
+  if (ret) return ret;
+
+  const uint8_t* data = zip->map.data;
+  size_t length = zip->map.length;
+  const uint8_t* end = NULL;
+  // the end record is last, followed by a comment of up to 64KB
+  if (length >= ZIPFILE_END_LENGTH) {
+    size_t lowest = length > ZIPFILE_END_LENGTH + 0xffff ? length - ZIPFILE_END_LENGTH - 0xffff : 0;
+    for (size_t at = length - ZIPFILE_END_LENGTH + 1; at-- > lowest;) {
+      if (zipfile_u32(data + at) == ZIPFILE_END_SIGNATURE && at + ZIPFILE_END_LENGTH + zipfile_u16(data + at + 20) <= length) {
+        end = data + at;
+        break;
+      }
+    }
+  }
+  if (!end) {
+    LOGE(TAG, "%s is no zip archive", path);
+    zipfile_close(zip);
+    return EINVAL;
+  }
+
+  uint16_t entries = zipfile_u16(end + 10);
+  uint32_t size = zipfile_u32(end + 12), offset = zipfile_u32(end + 16);
+  if (zipfile_u16(end + 4) || zipfile_u16(end + 6) || entries != zipfile_u16(end + 8) ||
+      (size_t)offset + size > (size_t)(end - data)) {
+    LOGE(TAG, "%s: multi-disk or zip64 archives aren't supported", path);
+    zipfile_close(zip);
+    return EINVAL;
+  }
+  zip->entries = (zipfile_entry_t*)calloc(entries ? entries : 1, sizeof(zipfile_entry_t));
+  if (!zip->entries) {
+    zipfile_close(zip);
+    return ENOMEM;
+  }
+
+  const uint8_t* p = data + offset;
+  const uint8_t* last = p + size;
+  for (uint16_t i = 0; i < entries; i++) {
+    if (p + ZIPFILE_CENTRAL_LENGTH > last || zipfile_u32(p) != ZIPFILE_CENTRAL_SIGNATURE) {
+      LOGE(TAG, "%s: damaged central directory", path);
+      zipfile_close(zip);
+      return EINVAL;
+    }
+    uint16_t nameLength = zipfile_u16(p + 28);
+    const uint8_t* next = p + ZIPFILE_CENTRAL_LENGTH + nameLength + zipfile_u16(p + 30) + zipfile_u16(p + 32);
+    if (next > last) {
+      LOGE(TAG, "%s: damaged central directory", path);
+      zipfile_close(zip);
+      return EINVAL;
+    }
+    // directories and encrypted members hold nothing we can use
+    if (nameLength && p[ZIPFILE_CENTRAL_LENGTH + nameLength - 1] != '/' && !(zipfile_u16(p + 8) & ZIPFILE_ENCRYPTED)) {
+      zipfile_entry_t* entry = &zip->entries[zip->numEntries++];
+      size_t n = nameLength < ZIPFILE_MAX_NAME ? nameLength : ZIPFILE_MAX_NAME - 1;
+      memcpy(entry->name, p + ZIPFILE_CENTRAL_LENGTH, n);
+      entry->method           = zipfile_u16(p + 10);
+      entry->crc32            = zipfile_u32(p + 16);
+      entry->compressedLength = zipfile_u32(p + 20);
+      entry->length           = zipfile_u32(p + 24);
+      entry->localOffset      = zipfile_u32(p + 42);
+    }
+    p = next;
+  }
+  return 0;
+}
+
+void zipfile_close(zipfile_t* zip)
+{
+  mapfile_close(&zip->map);
+  free(zip->entries);
+  zip->entries = NULL;
+  zip->numEntries = 0;
+}
+
+size_t zipfile_extract(const zipfile_t* zip, const zipfile_entry_t* entry, uint8_t* out)
+{
+  const uint8_t* data = zip->map.data;
+  size_t length = zip->map.length;
+  size_t at = entry->localOffset;
+  if (at + ZIPFILE_LOCAL_LENGTH > length || zipfile_u32(data + at) != ZIPFILE_LOCAL_SIGNATURE)
+    return EINVAL;
+  at += ZIPFILE_LOCAL_LENGTH + zipfile_u16(data + at + 26) + zipfile_u16(data + at + 28);
+  if (at + entry->compressedLength > length)
+    return EINVAL;
+
+  if (entry->method == ZIPFILE_STORED) {
+    if (entry->compressedLength != entry->length) return EINVAL;
+    memcpy(out, data + at, entry->length);
+  } else if (entry->method == ZIPFILE_DEFLATED) {
+    if (zipfile_inflate(data + at, entry->compressedLength, out, entry->length) != (long)entry->length)
+      return EINVAL;
+  } else {
+    return ENOTSUP;
+  }
+  return zipfile_crc32(0, out, entry->length) == entry->crc32 ? 0 : EINVAL;
+}
+
+// DEFLATE
+
+static const unsigned ZIPFILE_MAX_BITS     = 15;
+static const size_t   ZIPFILE_LITERALS     = 288;
+static const size_t   ZIPFILE_DISTANCES    = 30;
+static const uint16_t ZIPFILE_END_OF_BLOCK = 256;
+
+static const uint16_t zipfile_length_base[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t zipfile_length_extra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t zipfile_distance_base[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t zipfile_distance_extra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+typedef struct Zipfile_Huffman {
+  uint16_t fast[1 << ZIPFILE_FAST_BITS];  // symbol << 4 | code length, 0 if the code is longer
+  uint16_t count[ZIPFILE_MAX_BITS + 1];   // codes per length
+  uint16_t symbol[ZIPFILE_LITERALS];      // by code
+} zipfile_huffman_t;
+
+typedef struct Zipfile_Bits {
+  const uint8_t* in;
+  size_t   length;
+  size_t   position;
+  uint64_t buffer;    // next bit lowest
+  unsigned count;
+  size_t   padding;   // zero bytes added past the end of the input
+} zipfile_bits_t;
+
+// at least 57 bits in the buffer, enough for a length and distance with their extra bits
+static inline void zipfile_refill(zipfile_bits_t* bits)
+{
+  if (bits->position + 8 <= bits->length) {
+    uint64_t word;
+    memcpy(&word, bits->in + bits->position, 8);
+    bits->buffer |= word << bits->count;
+    bits->position += (63 - bits->count) >> 3;
+    bits->count |= 56;
+    return;
+  }
+  while (bits->count <= 56) {
+    if (bits->position < bits->length) bits->buffer |= (uint64_t)bits->in[bits->position++] << bits->count;
+    else bits->padding++;
+    bits->count += 8;
+  }
+}
+
+static inline uint32_t zipfile_bits(zipfile_bits_t* bits, unsigned n)
+{
+  uint32_t value = (uint32_t)(bits->buffer & ((1ull << n) - 1));
+  bits->buffer >>= n;
+  bits->count -= n;
+  return value;
+}
+
+// read past the end of the input
+static bool zipfile_overrun(const zipfile_bits_t* bits)
+{
+  return bits->padding * 8 > bits->count;
+}
+
+// canonical codes from code lengths, false if they are over-subscribed
+static bool zipfile_build(zipfile_huffman_t* huffman, const uint8_t* lengths, size_t n)
+{
+  uint16_t offsets[ZIPFILE_MAX_BITS + 1];
+  uint16_t next[ZIPFILE_MAX_BITS + 1];
+  memset(huffman->fast, 0, sizeof(huffman->fast));
+  memset(huffman->count, 0, sizeof(huffman->count));
+  for (size_t s = 0; s < n; s++)
+    huffman->count[lengths[s]]++;
+  huffman->count[0] = 0;
+
+  int left = 1;
+  for (unsigned len = 1; len <= ZIPFILE_MAX_BITS; len++) {
+    left = (left << 1) - huffman->count[len];
+    if (left < 0) return false;
+  }
+  offsets[1] = 0;
+  next[1] = 0;
+  for (unsigned len = 1; len < ZIPFILE_MAX_BITS; len++) {
+    offsets[len + 1] = offsets[len] + huffman->count[len];
+    next[len + 1] = (uint16_t)((next[len] + huffman->count[len]) << 1);
+  }
+
+  for (size_t s = 0; s < n; s++) {
+    unsigned len = lengths[s];
+    if (!len) continue;
+    huffman->symbol[offsets[len]++] = (uint16_t)s;
+    unsigned code = next[len]++;
+    if (len > ZIPFILE_FAST_BITS) continue;
+    // codes are sent highest bit first, the bit buffer is lowest bit first
+    unsigned reversed = 0;
+    for (unsigned b = 0; b < len; b++)
+      reversed |= ((code >> b) & 1) << (len - 1 - b);
+    for (unsigned i = reversed; i < (1u << ZIPFILE_FAST_BITS); i += 1u << len)
+      huffman->fast[i] = (uint16_t)(s << 4 | len);
+  }
+  return true;
+}
+
+// next symbol, -1 for a code that isn't there. Needs ZIPFILE_MAX_BITS in the buffer
+static inline int zipfile_decode(zipfile_bits_t* bits, const zipfile_huffman_t* huffman)
+{
+  uint16_t entry = huffman->fast[bits->buffer & ((1u << ZIPFILE_FAST_BITS) - 1)];
+  if (entry) {
+    zipfile_bits(bits, entry & 15);
+    return entry >> 4;
+  }
+  int code = 0, first = 0, index = 0;
+  for (unsigned len = 1; len <= ZIPFILE_MAX_BITS; len++) {
+    code |= (int)zipfile_bits(bits, 1);
+    int count = huffman->count[len];
+    if (code - count < first)
+      return huffman->symbol[index + (code - first)];
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+typedef struct Zipfile_Fixed {
+  zipfile_huffman_t literals;
+  zipfile_huffman_t distances;
+} zipfile_fixed_t;
+
+static zipfile_fixed_t zipfile_fixed_init()
+{
+  zipfile_fixed_t fixed;
+  uint8_t lengths[ZIPFILE_LITERALS];
+  for (size_t s = 0; s < ZIPFILE_LITERALS; s++)
+    lengths[s] = s < 144 ? 8 : s < 256 ? 9 : s < 280 ? 7 : 8;
+  zipfile_build(&fixed.literals, lengths, ZIPFILE_LITERALS);
+  memset(lengths, 5, ZIPFILE_DISTANCES);
+  zipfile_build(&fixed.distances, lengths, ZIPFILE_DISTANCES);
+  return fixed;
+}
+
+static bool zipfile_dynamic(zipfile_bits_t* bits, zipfile_huffman_t* literals, zipfile_huffman_t* distances)
+{
+  static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+  uint8_t lengths[ZIPFILE_LITERALS + ZIPFILE_DISTANCES];
+  zipfile_huffman_t* codes = distances;  // scratch until the distance code is built
+
+  zipfile_refill(bits);
+  unsigned numLiterals  = zipfile_bits(bits, 5) + 257;
+  unsigned numDistances = zipfile_bits(bits, 5) + 1;
+  unsigned numCodes     = zipfile_bits(bits, 4) + 4;
+  if (numLiterals > 286 || numDistances > ZIPFILE_DISTANCES) return false;
+
+  memset(lengths, 0, 19);
+  zipfile_refill(bits);
+  for (unsigned i = 0; i < numCodes; i++) {
+    if (i == 12) zipfile_refill(bits);
+    lengths[order[i]] = (uint8_t)zipfile_bits(bits, 3);
+  }
+  if (!zipfile_build(codes, lengths, 19)) return false;
+
+  unsigned n = 0;
+  while (n < numLiterals + numDistances) {
+    zipfile_refill(bits);
+    int symbol = zipfile_decode(bits, codes);
+    if (symbol < 0) return false;
+    if (symbol < 16) {
+      lengths[n++] = (uint8_t)symbol;
+      continue;
+    }
+    uint8_t length = 0;
+    unsigned repeat;
+    if (symbol == 16) {
+      if (!n) return false;
+      length = lengths[n - 1];
+      repeat = 3 + zipfile_bits(bits, 2);
+    } else if (symbol == 17) {
+      repeat = 3 + zipfile_bits(bits, 3);
+    } else {
+      repeat = 11 + zipfile_bits(bits, 7);
+    }
+    if (n + repeat > numLiterals + numDistances) return false;
+    memset(lengths + n, length, repeat);
+    n += repeat;
+  }
+  if (!lengths[ZIPFILE_END_OF_BLOCK]) return false;
+  return zipfile_build(literals, lengths, numLiterals) &&
+         zipfile_build(distances, lengths + numLiterals, numDistances);
+}
+
+static bool zipfile_codes(zipfile_bits_t* bits, const zipfile_huffman_t* literals, const zipfile_huffman_t* distances,
+                          uint8_t* out, size_t capacity, size_t* produced)
+{
+  size_t o = *produced;
+  for (;;) {
+    zipfile_refill(bits);
+    int symbol = zipfile_decode(bits, literals);
+    if (symbol < 0) return false;
+    if (symbol < 256) {
+      if (o == capacity) return false;
+      out[o++] = (uint8_t)symbol;
+      continue;
+    }
+    if (symbol == ZIPFILE_END_OF_BLOCK) break;
+
+    symbol -= 257;
+    if (symbol >= 29) return false;
+    size_t length = zipfile_length_base[symbol] + zipfile_bits(bits, zipfile_length_extra[symbol]);
+    symbol = zipfile_decode(bits, distances);
+    if (symbol < 0 || symbol >= (int)ZIPFILE_DISTANCES) return false;
+    size_t distance = zipfile_distance_base[symbol] + zipfile_bits(bits, zipfile_distance_extra[symbol]);
+    if (distance > o || length > capacity - o) return false;
+
+    const uint8_t* from = out + o - distance;
+    if (distance >= length) {
+      memcpy(out + o, from, length);
+    } else {
+      for (size_t i = 0; i < length; i++)
+        out[o + i] = from[i];
+    }
+    o += length;
+  }
+  *produced = o;
+  return !zipfile_overrun(bits);
+}
+
+long zipfile_inflate(const uint8_t* in, size_t length, uint8_t* out, size_t capacity)
+{
+  static const zipfile_fixed_t fixed = zipfile_fixed_init();
+  zipfile_huffman_t literals, distances;
+  zipfile_bits_t bits;
+  size_t produced = 0;
+  bool last = false;
+
+  memset(&bits, 0, sizeof(bits));
+  bits.in     = in;
+  bits.length = length;
+  while (!last) {
+    zipfile_refill(&bits);
+    if (zipfile_overrun(&bits)) return -1;
+    last = zipfile_bits(&bits, 1);
+    uint32_t type = zipfile_bits(&bits, 2);
+
+    if (type == 0) {
+      // stored, from the next byte boundary
+      zipfile_bits(&bits, bits.count & 7);
+      uint32_t n = zipfile_bits(&bits, 16);
+      if ((zipfile_bits(&bits, 16) ^ 0xffff) != n) return -1;
+      if (zipfile_overrun(&bits) || n > capacity - produced) return -1;
+      // what is left in the buffer first, then straight from the input
+      size_t buffered = bits.count / 8 - bits.padding;
+      size_t fromBuffer = n < buffered ? n : buffered;
+      for (size_t i = 0; i < fromBuffer; i++)
+        out[produced++] = (uint8_t)zipfile_bits(&bits, 8);
+      size_t rest = n - fromBuffer;
+      if (rest) {
+        if (rest > bits.length - bits.position) return -1;
+        memcpy(out + produced, bits.in + bits.position, rest);
+        produced += rest;
+        bits.position += rest;
+        bits.buffer = 0;
+        bits.count = 0;
+        bits.padding = 0;
+      }
+    } else if (type == 1) {
+      if (!zipfile_codes(&bits, &fixed.literals, &fixed.distances, out, capacity, &produced)) return -1;
+    } else if (type == 2) {
+      if (!zipfile_dynamic(&bits, &literals, &distances)) return -1;
+      if (!zipfile_codes(&bits, &literals, &distances, out, capacity, &produced)) return -1;
+    } else {
+      return -1;
+    }
+  }
+  return (long)produced;
+}
+
+// CRC-32, slicing-by-8 like crc32c.cpp
+
+typedef struct Zipfile_Crc32 {
+  uint32_t table[8][256];
+} zipfile_crc32_t;
+
+static zipfile_crc32_t zipfile_crc32_init()
+{
+  zipfile_crc32_t tables;
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (ZIPFILE_CRC32_POLYNOMIAL & (0u - (crc & 1)));
+    tables.table[0][i] = crc;
+  }
+  for (uint32_t i = 0; i < 256; i++) {
+    for (int t = 1; t < 8; t++)
+      tables.table[t][i] = (tables.table[t - 1][i] >> 8) ^ tables.table[0][tables.table[t - 1][i] & 0xff];
+  }
+  return tables;
+}
+
+uint32_t zipfile_crc32(uint32_t crc, const void* data, size_t length)
+{
+  static const zipfile_crc32_t tables = zipfile_crc32_init();
+  const uint32_t (*table)[256] = tables.table;
+  const uint8_t* p = (const uint8_t*)data;
+  crc = ~crc;
+  while (length >= 8) {
+    uint32_t low  = crc ^ zipfile_u32(p);
+    uint32_t high = zipfile_u32(p + 4);
+    crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^ table[5][(low >> 16) & 0xff] ^ table[4][low >> 24] ^
+          table[3][high & 0xff] ^ table[2][(high >> 8) & 0xff] ^ table[1][(high >> 16) & 0xff] ^ table[0][high >> 24];
+    p += 8;
+    length -= 8;
+  }
+  while (length--)
+    crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];
+  return ~crc;
+}
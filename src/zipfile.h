@@ -0,0 +1,73 @@
+/*
+Copyright 2022 connorr@hey.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mapfile.h"
+
+/* Zip archives.
+ *
+ * Just enough of the zip format to read the calibration packages Ford's service site
+ * hands out (see fms-calibration-scraper.sh): the central directory of a mapped
+ * archive, and members that are stored or deflated. No zip64, no encryption, no
+ * multi-disk archives; archives using them fail to open or their members to extract.
+ *
+ * zipfile_inflate() is a plain DEFLATE (RFC 1951) decoder. Huffman codes up to
+ * ZIPFILE_FAST_BITS long decode with one table lookup, longer ones fall back to
+ * walking the code lengths a bit at a time. Members are extracted into a buffer of
+ * the size the central directory gives, so there is no window to manage: back
+ * references point into the output itself.
+ */
+
+static const unsigned ZIPFILE_FAST_BITS  = 10;
+static const size_t   ZIPFILE_MAX_NAME   = 256;
+static const uint16_t ZIPFILE_STORED     = 0;
+static const uint16_t ZIPFILE_DEFLATED   = 8;
+
+typedef struct Zipfile_Entry {
+  char     name[ZIPFILE_MAX_NAME];
+  uint16_t method;
+  uint32_t crc32;        // zip's CRC-32, not CRC32C
+  uint32_t compressedLength;
+  uint32_t length;
+  uint32_t localOffset;  // local file header
+} zipfile_entry_t;
+
+typedef struct Zipfile {
+  mapfile_t map;
+  size_t numEntries;
+  zipfile_entry_t* entries;
+} zipfile_t;
+
+/** Map an archive and read its central directory. Returns 0, errno, or EINVAL if it is no zip we can read */
+size_t zipfile_open(zipfile_t* zip, const char* path);
+
+void zipfile_close(zipfile_t* zip);
+
+/**
+ * Extract a member into `out`, which holds at least `entry->length` bytes, and check its CRC.
+ * Returns 0, EINVAL if it is damaged or ENOTSUP for a method other than stored or deflated
+ */
+size_t zipfile_extract(const zipfile_t* zip, const zipfile_entry_t* entry, uint8_t* out);
+
+/** Decompress a raw DEFLATE stream into at most `capacity` bytes. Returns the decompressed length, -1 if the stream is damaged */
+long zipfile_inflate(const uint8_t* in, size_t length, uint8_t* out, size_t capacity);
+
+/** zip's CRC-32 (the one of zlib and PNG) of `length` more bytes, starting from `crc`, 0 for the first call */
+uint32_t zipfile_crc32(uint32_t crc, const void* data, size_t length);